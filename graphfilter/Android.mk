@@ -52,6 +52,21 @@ LOCAL_SRC_FILES         := src/graphfilter.cpp            \
                            src/graphfilterjnilib.cpp      \
                            src/sqlitedatacache.cpp        \
                            src/datafilter.cpp             \
+                           src/pointbatch.cpp             \
+                           src/timestring.cpp             \
+                           src/aggregationkernels.cpp     \
+                           src/threadpool.cpp             \
+                           src/streamingdownsampler.cpp   \
+                           src/schema.cpp                 \
+                           src/statementcache.cpp         \
+                           src/connectionpool.cpp         \
+                           src/sqlitefunctions.cpp        \
+                           src/jsonpointreader.cpp        \
+                           src/chunkcodec.cpp             \
+                           src/ingestqueue.cpp            \
+                           src/requestqueue.cpp           \
+                           src/intervalset.cpp            \
+                           src/nativedatacache.cpp        \
                            src/sqlitedatabaseaccess.cpp
 
 LOCAL_C_INCLUDES        := $(LOCAL_PATH)/include
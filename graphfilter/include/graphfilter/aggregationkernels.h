@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_AGGREGATIONKERNELS_H
+#define GRAPHFILTER_AGGREGATIONKERNELS_H
+
+#include <stddef.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class AggregationKernels
+     * @brief Vectorized reductions over a contiguous column of values
+     *
+     * The bucket reductions at the core of every DataFilter filter type.  On x86 the AVX2 or
+     * SSE4.2 implementation is chosen at runtime from the features of the CPU; every other
+     * platform uses the portable scalar implementation.
+     *
+     * NaN values are skipped by every kernel.  Sums are accumulated in eight interleaved
+     * lanes that are combined in a fixed order, so every implementation returns bit-identical
+     * results and the cache contents do not depend on the device that built them.
+     */
+    class AggregationKernels {
+        public:
+            /**
+            * Enum representing the available kernel implementations
+            */
+            enum class Isa { SCALAR, SSE42, AVX2 };
+
+            /**
+            * Sum of the non-NaN values of values[0, count)
+            */
+            static double sum(const double* values, size_t count);
+
+            /**
+            * Number of non-NaN values in values[0, count)
+            */
+            static size_t count(const double* values, size_t count);
+
+            /**
+            * Minimum and maximum of the non-NaN values of values[0, count).  If there are no
+            * such values, min returns +infinity and max returns -infinity.
+            */
+            static double min(const double* values, size_t count);
+            static double max(const double* values, size_t count);
+
+            /**
+            * Index of the first minimum or maximum non-NaN value of values[0, count).  Returns
+            * 0 if there are no such values.
+            */
+            static size_t argMin(const double* values, size_t count);
+            static size_t argMax(const double* values, size_t count);
+
+            /**
+            * Reduce each variable-size bucket of values as sum(), count(), min() or max() would.
+            * Bucket i covers values[bounds[i], bounds[i + 1]), so bounds holds num_buckets + 1
+            * offsets.
+            *
+            * @param[out] results num_buckets results
+            */
+            static void sumBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results);
+            static void countBuckets(const double* values, const size_t* bounds, size_t num_buckets, size_t* results);
+            static void minBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results);
+            static void maxBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results);
+
+            /**
+            * Reduce each fixed-size bucket of values as sum(), count(), min() or max() would.
+            * The last bucket holds the remaining count % bucket_size values, if any.
+            *
+            * @param[out] results (count + bucket_size - 1) / bucket_size results
+            */
+            static void sumBuckets(const double* values, size_t count, size_t bucket_size, double* results);
+            static void countBuckets(const double* values, size_t count, size_t bucket_size, size_t* results);
+            static void minBuckets(const double* values, size_t count, size_t bucket_size, double* results);
+            static void maxBuckets(const double* values, size_t count, size_t bucket_size, double* results);
+
+            /**
+            * The implementation currently in use.
+            */
+            static Isa isa();
+
+            /**
+            * Select the implementation to use, e.g. to compare implementations in tests.
+            *
+            * @retval true The implementation is supported by this CPU and is now in use
+            * @retval false The implementation is not supported, nothing changed
+            */
+            static bool setIsa(Isa isa);
+    };
+
+}}
+
+#endif //GRAPHFILTER_AGGREGATIONKERNELS_H
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_CHUNKCODEC_H
+#define GRAPHFILTER_CHUNKCODEC_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <graphfilter/pointbatch.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class ChunkCodec
+     * @brief Compressed encoding of a run of points, stored as a BLOB per chunk
+     *
+     * The points of a chunk are encoded column by column:
+     * - times as Gorilla-style delta-of-delta bit codes, so regularly sampled points take a
+     *   single bit each
+     * - REAL columns as the XOR of each value with the previous one, keeping only the
+     *   meaningful bits between the leading and trailing zeros
+     * - INT columns as zig-zag varints of the difference with the previous value
+     * - TEXT columns as length-prefixed strings
+     *
+     * The summary of a chunk holds the min, max and sum of every column, so that coarse
+     * aggregates can be answered without decoding the points.
+     */
+    class ChunkCodec {
+        public:
+            /**
+            * Per column aggregates of a chunk, indexed like the columns of its batch.  TEXT
+            * columns have all three at 0.
+            */
+            struct Summary {
+                std::vector<double> min;
+                std::vector<double> max;
+                std::vector<double> sum;
+            };
+
+            /**
+            * Encode all points of a batch.
+            *
+            * @param[in] points The points, in any order
+            * @param[out] blob The encoded points
+            */
+            static void encode(const PointBatch& points, std::string& blob);
+
+            /**
+            * Append the points of an encoded chunk to a batch with the layout it was
+            * encoded from.
+            *
+            * @retval true The points were appended
+            * @retval false The blob is corrupt or does not match the layout of points.  Some
+            *               points may have been appended.
+            */
+            static bool decode(const void* blob, size_t size, PointBatch& points);
+
+            /**
+            * Encode the summary of all points of a batch.
+            */
+            static void summarize(const PointBatch& points, std::string& blob);
+
+            /**
+            * @retval true summary holds the aggregates of the num_columns columns of the blob
+            * @retval false The blob is corrupt or holds another number of columns
+            */
+            static bool decodeSummary(const void* blob, size_t size, size_t num_columns, Summary& summary);
+    };
+
+}}
+
+#endif //GRAPHFILTER_CHUNKCODEC_H
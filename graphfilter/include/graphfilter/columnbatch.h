@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef INTEL_POC_COLUMNBATCH_H
+#define INTEL_POC_COLUMNBATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace intel {
+  namespace poc {
+
+    /**
+     * @struct ColumnBatch
+     * @brief Data points to add, held as one caller-owned array per column
+     *
+     * The batch only points at the caller's arrays, which are read in place: adding a
+     * ColumnBatch neither parses nor copies the values.  Point i is made of times[i] and
+     * the i-th value of every column.
+     */
+    struct ColumnBatch {
+      /// Type of the values array of a column
+      enum class Type {
+        INT64,   ///< const int64_t values[num_points]
+        DOUBLE,  ///< const double values[num_points]
+        TEXT     ///< const char* const values[num_points], NULL entries are null
+      };
+
+      /**
+       * One metric column.  name must be a column of the data_schema passed to init, other
+       * than the date key column; schema columns missing from the batch are null.
+       * Values are stored by their column's declared type, as SQLite converts them.
+       */
+      struct Column {
+        const char* name;
+        Type type;
+        const void* values;
+        /// Null bitmap, may be NULL: point i is null if bit (i % 8) of nulls[i / 8] is set
+        const uint8_t* nulls;
+
+        bool isNull(size_t index) const {
+          return nulls != NULL && (nulls[index >> 3] & (1u << (index & 7))) != 0;
+        }
+      };
+
+      /// UTC epoch seconds of every point, the date key column
+      const int64_t* times;
+      size_t num_points;
+      const Column* columns;
+      size_t num_columns;
+    };
+  }
+}
+
+#endif // INTEL_POC_COLUMNBATCH_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_CONNECTIONPOOL_H
+#define GRAPHFILTER_CONNECTIONPOOL_H
+
+#include <sqlite3.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <graphfilter/statementcache.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class ConnectionPool
+     * @brief Pool of reader connections to one SQLite database
+     *
+     * Each connection is leased by one thread at a time, together with its own prepared
+     * statements, so queries on different threads neither share a connection mutex nor
+     * wait for each other.  Connections are opened when first needed, up to the maximum
+     * given to open(); further callers wait until a connection is handed back.
+     */
+    class ConnectionPool {
+        public:
+            /**
+            * A connection and the statements prepared on it
+            */
+            struct Connection {
+                sqlite3* database;
+                StatementCache statements;
+                unsigned int generation;
+            };
+
+            /**
+            * A connection leased from the pool for the lifetime of this object.
+            */
+            class Lease {
+                public:
+                    explicit Lease(ConnectionPool& pool):pool_(pool), connection_(pool.acquire()) {}
+                    ~Lease() { pool_.release(connection_); }
+
+                    /// @return The connection, or NULL if the pool is closed or opening failed
+                    Connection* get() const { return connection_; }
+
+                private:
+                    Lease(const Lease&);
+                    Lease& operator=(const Lease&);
+
+                    ConnectionPool& pool_;
+                    Connection* connection_;
+            };
+
+            /**
+            * Set up a new connection, e.g. by registering SQL functions on it.
+            *
+            * @return false if the connection cannot be used
+            */
+            typedef bool (*Setup)(sqlite3* database);
+
+            /// constructor
+            ConnectionPool();
+
+            /// destructor, closes all idle connections
+            ~ConnectionPool();
+
+            /**
+            * Close any previous connections and serve connections to a new database.
+            *
+            * @param[in] path Database path, as given to sqlite3_open_v2
+            * @param[in] flags Flags for sqlite3_open_v2
+            * @param[in] setup_sql SQL run on every new connection, may be empty
+            * @param[in] max_connections Maximum number of connections open at once
+            * @param[in] setup Called on every new connection after setup_sql, may be NULL
+            */
+            void open(const std::string& path, int flags, const std::string& setup_sql, size_t max_connections,
+                      Setup setup = NULL);
+
+            /**
+            * Close all idle connections, and stop serving new ones.  Leased connections are
+            * closed when handed back.
+            */
+            void close();
+
+            /**
+            * Take a connection out of the pool, opening a new one or waiting if necessary.
+            * Prefer Lease, which always hands the connection back.
+            *
+            * @return The connection, or NULL if the pool is closed or opening failed
+            */
+            Connection* acquire();
+
+            /**
+            * Hand back a connection from acquire().
+            */
+            void release(Connection* connection);
+
+            /**
+            * Finalize the statements that use a table on every connection, e.g. once it has
+            * been dropped.  Leased connections are purged when handed back.
+            */
+            void purge(const std::string& table);
+
+            /// Milliseconds a connection waits on a locked database before giving up
+            static const int BUSY_TIMEOUT_MS = 5000;
+
+        private:
+            ConnectionPool(const ConnectionPool&);
+            ConnectionPool& operator=(const ConnectionPool&);
+
+            Connection* openConnection();
+            static void closeConnection(Connection* connection);
+
+            std::string path_;
+            int flags_;
+            std::string setup_sql_;
+            Setup setup_;
+            size_t max_connections_;
+            size_t num_connections_;
+            unsigned int generation_;
+            std::vector<Connection*> idle_;
+            /// Tables purged while some connections were leased
+            std::vector<std::string> purged_;
+            std::mutex mutex_;
+            std::condition_variable available_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_CONNECTIONPOOL_H
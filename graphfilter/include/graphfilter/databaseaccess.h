@@ -11,6 +11,10 @@
 #define GRAPHFILTER_DATABASEACCESS_H
 
 #include "json.h"
+#include <graphfilter/columnbatch.h>
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/schema.h>
+#include <graphfilter/streamingdownsampler.h>
 
 namespace intel {
   namespace poc {
@@ -49,6 +53,22 @@ namespace intel {
        *                  treated as the primary key. It MUST be present in
        *                  the column list and MUST be of type "TEXT".  Dates in database
        *                  should be of the format: "YYYY-MM-DD HH:MMZ".
+       * An optional "date_key_storage": "INTEGER" field stores the date key of the database
+       *                  table as epoch seconds, in a WITHOUT ROWID table clustered by
+       *                  time.  Dates are still given and returned as text.  The default,
+       *                  "TEXT", stores them as given.
+       * An optional "partition_span" field splits the database table by time: "MONTH" keeps
+       *                  each calendar month in a table of its own, a number of seconds
+       *                  keeps each span of that length in its own table.  Inserts go to the
+       *                  table of each point, queries read only the tables of their time
+       *                  frame.  The default, "NONE", keeps all points in one table.
+       * An optional "chunk_points" field, e.g. 1024, seals points into compressed chunks of
+       *                  that many points once they are inserted, each stored as a BLOB
+       *                  with the min, max and sum of every column.  Queries decode only
+       *                  the chunks of their time frame, and aggregations take whole
+       *                  chunks from their sums.  Null values are stored as 0 or "", as
+       *                  getData returns them.  Cannot be combined with partition_span.
+       *                  The default, 0, keeps every point as a row.
        *
        * @param[in] clean Indicate if backend should initialize with clean database, if
        *                  it is set to true, all existing data will be deleted.
@@ -58,6 +78,12 @@ namespace intel {
        */
       virtual bool init(const std::string& database_path, const Json::Value& data_schema, bool clean) = 0;
 
+      /**
+       * Initialize DatabaseAccess with a data schema that has already been compiled, so that
+       *                  it can be shared with the other layers.  Otherwise the same as above.
+       */
+      virtual bool init(const std::string& database_path, const Schema& schema, bool clean) = 0;
+
 
       /**
        * Adds new data points to the database
@@ -95,6 +121,33 @@ namespace intel {
        */
       virtual bool putData(const Json::Value& data_values) = 0;
 
+      /**
+       * Adds new data points to the database straight from the JSON text of data_values,
+       *                  of the same form as above, without parsing it into a
+       *                  Json::Value first.  Either all points are added or none.
+       *
+       * @retval true Succesfully added data to library
+       * @retval false Failed to add data to library
+       */
+      virtual bool putJsonData(const std::string& data_values) = 0;
+
+      /**
+       * Adds several JSON payloads, as putJsonData above, in a single transaction.  Each
+       *                  payload is added entirely or not at all.
+       *
+       * @return The number of payloads added
+       */
+      virtual size_t putJsonData(const std::vector<std::string>& data_values) = 0;
+
+      /**
+       * Adds new data points held in arrays, see ColumnBatch.  Either all points are added
+       *                or none.
+       *
+       * @retval true Succesfully added data to library
+       * @retval false Failed to add data to library
+       */
+      virtual bool putColumns(const ColumnBatch& data_values) = 0;
+
       /**
        * Retrieve data points requested from the specified time time range and granularity
        *
@@ -151,6 +204,62 @@ namespace intel {
        */
       virtual Json::Value getData(const Json::Value& params) = 0;
 
+      /**
+       * Retrieve data points requested from the specified time range into a columnar batch.
+       *        Takes the same query parameters as the Json::Value version above, but fills the
+       *        batch straight from the database without building a Json::Value per point.
+       *
+       * @param[in] params A Json::Value object that specifies the search query parameters
+       * @param[out] data The batch to fill. It is reset to contain the date key column plus
+       *        one column per requested metric, and its start and end dates are set to
+       *        the requested range.
+       *
+       * @retval true The query succeeded (the batch may still contain zero points)
+       * @retval false In the event of an error
+       */
+      virtual bool getData(const Json::Value& params, PointBatch& data) = 0;
+
+      /**
+       * Stream the data points of the specified time range into a downsampler.  Takes the same
+       *        query parameters as above.  Rows are pushed to the downsampler in small chunks
+       *        while the query runs, so the raw range is never held in memory.  The downsampler
+       *        is started for the requested time frame and finished before this returns.
+       *
+       * @param[in] params A Json::Value object that specifies the search query parameters
+       * @param[in] downsampler The downsampler that receives the points
+       *
+       * @retval true The query succeeded
+       * @retval false In the event of an error
+       */
+      virtual bool getData(const Json::Value& params, StreamingDownsampler& downsampler) = 0;
+
+      /**
+       * Retrieve the data points of the specified time range already downsampled by the
+       *        database.  Takes the same query parameters as above, plus "numOfPoints".  The
+       *        time frame is divided into numOfPoints equal-width buckets and each non-empty
+       *        bucket becomes one point, averaged inside the query the same way as
+       *        StreamingDownsampler::Mode::TIME_WEIGHTED, so only the downsampled rows ever
+       *        leave the database.  NULL values count as 0, as in the rows getData returns.
+       *
+       * @param[in] params A Json::Value object that specifies the search query parameters
+       * @param[out] data The batch to fill, as for getData above
+       *
+       * @retval true The query succeeded
+       * @retval false In the event of an error, or if numOfPoints is not positive
+       */
+      virtual bool getAggregatedData(const Json::Value& params, PointBatch& data) = 0;
+
+      /**
+       * Remove every data point dated before before_date.  With a partitioned data_schema
+       *        the partitions wholly before before_date are dropped as a whole.
+       *
+       * @param[in] before_date A date of the format "YYYY-MM-DD HH:MMZ"
+       *
+       * @retval true The points were removed
+       * @retval false In the event of an error, nothing was removed
+       */
+      virtual bool removeData(const std::string& before_date) = 0;
+
      protected:
       /// constructor
       DatabaseAccess() {}
@@ -12,7 +12,12 @@
 
 #include <map>
 #include "graphfilter.h"
+#include <graphfilter/datacache.h>
 #include <graphfilter/datafilter.h>
+#include <graphfilter/ingestqueue.h>
+#include <graphfilter/requestqueue.h>
+#include <graphfilter/schema.h>
+#include <graphfilter/streamingdownsampler.h>
 
 namespace intel {
   namespace poc {
@@ -36,15 +41,44 @@ namespace intel {
 
       bool addData(const std::string& data_values);
 
+      bool addData(const ColumnBatch& data_values);
+
       std::string getData(const std::string& params);
 
+      uint64_t getDataAsync(const std::string& params, const std::string& group, const Callback& callback);
+
+      bool cancel(uint64_t request_id);
+
+      bool flush();
+
+      size_t pendingWrites() const;
+
+      size_t cacheBytes() const;
+
      private:
       /// private API
 
-      std::map<std::string, std::string> data_schema_;
+      /// Default "ingestBatchBytes" and "ingestDelayMs"
+      static const size_t INGEST_BATCH_BYTES_ = 1 << 20;
+      static const int INGEST_DELAY_MS_ = 1000;
+
+      /// Threads running getDataAsync requests, and requests queued at most
+      static const size_t ASYNC_THREADS_ = 2;
+      static const size_t ASYNC_CAPACITY_ = 8;
+
+      Schema schema_;
       bool use_cache_;
+      /// The cache selected by "cacheEngine"
+      DataCache* cache_;
       bool cache_raw_data_;
       DataFilter::FilterType downsampling_filter_;
+      bool use_streaming_;
+      bool use_database_downsampling_;
+      StreamingDownsampler::Mode streaming_mode_;
+      bool async_ingest_;
+      IngestQueue ingest_;
+      /// Last member, so requests are done before anything else is destroyed
+      RequestQueue requests_;
     };
   }
 }
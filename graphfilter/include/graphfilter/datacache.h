@@ -12,6 +12,8 @@
 
 
 #include "json.h"
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/schema.h>
 
 namespace intel {
   namespace poc {
@@ -64,7 +66,18 @@ namespace intel {
        *                  period spanning one day, the two previous days and one following day (for
        *                  a total of 4 days, including the original request) would be fetched,
        *                  downsampled, and stored in the cache.
+       * Note: "maxCacheBytes" bounds the estimated size of the cached points.  Once a fill
+       *                  takes the cache over it, the ranges least recently filled or read
+       *                  are removed from the raw data and every level.  If not present or 0,
+       *                  the cache is not bounded.
        * Note: If not present, "downsamplingFilter" will default to DataFilter::TIME_WEIGHTED_POINTS.
+       * Note: Valid "downsamplingFilter" values are "POINTS", "TIME_WEIGHTED_POINTS",
+       *                  "TIME_WEIGHTED_TIME", "LTTB" and "M4".  The first three average the
+       *                  points in each bucket; "LTTB" keeps a representative real point
+       *                  instead, so peaks and dips are not flattened.  "M4" treats the number
+       *                  of points as a pixel width and keeps the first, last, minimum and
+       *                  maximum points of each pixel column, so it may return up to four
+       *                  times as many points for a single metric.
        *
        * @param[in] data_schema Json::Value object that represents the mapping of column names to their
        *                  data types. Used for creating the databases or data structures used
@@ -91,6 +104,12 @@ namespace intel {
        */
       virtual bool init(const Json::Value& cache_setup, const Json::Value& data_schema, bool clean) = 0;
 
+      /**
+       * Initialize DataCache with a data schema that has already been compiled, so that it
+       *                  can be shared with the other layers.  Otherwise the same as above.
+       */
+      virtual bool init(const Json::Value& cache_setup, const Schema& schema, bool clean) = 0;
+
 
       /**
        * Adds new data points to the cache. Because processing is done done asynchronously on
@@ -164,6 +183,28 @@ namespace intel {
        */
       virtual Json::Value getData(const Json::Value& params) = 0;
 
+      /**
+       * Retrieve data points requested from the specified time range into a columnar batch.
+       *        Takes the same query parameters as the Json::Value version above, but fills the
+       *        batch straight from the cache without building a Json::Value per point.
+       *
+       * @param[in] params A Json::Value object that specifies the search query parameters
+       * @param[out] data The batch to fill. It is reset to contain the date key column plus
+       *        one column per requested metric, and its start and end dates are set to
+       *        the requested range.
+       *
+       * @retval true The query succeeded (the batch may still contain zero points)
+       * @retval false In the event of an error, OR in the event the cache does not
+       *        contain the data requested
+       */
+      virtual bool getData(const Json::Value& params, PointBatch& data) = 0;
+
+      /**
+       * @return The estimated size of the points cached, in bytes, which "maxCacheBytes"
+       *        bounds
+       */
+      virtual size_t cacheBytes() = 0;
+
      protected:
       /// constructor
       DataCache() {}
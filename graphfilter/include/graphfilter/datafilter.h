@@ -11,7 +11,11 @@
 #define GRAPHFILTER_DATAFILTER_H
 #include <string>
 #include <map>
+#include <vector>
 #include "json.h"
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/schema.h>
+#include <graphfilter/threadpool.h>
 
 namespace intel { namespace poc {
 
@@ -20,7 +24,7 @@ namespace intel { namespace poc {
             /**
             * Enum representing the valid filter types
             */
-            enum class FilterType { POINTS, TIME_WEIGHTED_POINTS, TIME_WEIGHTED_TIME };
+            enum class FilterType { POINTS, TIME_WEIGHTED_POINTS, TIME_WEIGHTED_TIME, LTTB, M4 };
 
             /**
             * Initialize DataFilter. Must be called exactly once before using the library.
@@ -82,6 +86,33 @@ namespace intel { namespace poc {
                                      const std::map<std::string, std::string>& data_schema,
                                      int num_of_points,
                                      FilterType filter);
+
+            /**
+            * Same as above, with the data schema already compiled.  The date key column of
+            * schema is used to read the date of each point.
+            */
+            static Json::Value applyFilter(const Json::Value& data,
+                                     const Schema& schema,
+                                     int num_of_points,
+                                     FilterType filter);
+
+            /**
+            * Downsample the given columnar batch using the given filter to the given number
+            * of points.  This produces the same points as the Json::Value version above, but
+            * works directly on the contiguous columns of the batch.
+            *
+            * @param[in] data The points to downsample, sorted by time.  Column types are
+            *                  taken from the batch itself.
+            * @param[out] out The downsampled points.  Any previous content is replaced.
+            * @param[in] num_of_points The maximum number of points you wish the data downsampled
+            *                  to.  Note that you are not guaranteed to receive this number of points.
+            * @param[in] filter The filter to apply
+            */
+            static void applyFilter(const PointBatch& data,
+                                     PointBatch& out,
+                                     int num_of_points,
+                                     FilterType filter);
+
             /**
             * Helper function to get an enum type given its equivalent string.
             *
@@ -104,7 +135,7 @@ namespace intel { namespace poc {
                                      Json::Value& out_points,
                                      int start_i,
                                      int end_i,
-                                     const std::map<std::string, std::string>& data_schema,
+                                     const Schema& schema,
                                      int num_of_points);
             /**
             * Performs a time-based averaging.  The timeframe given in "data" is divided into
@@ -131,18 +162,141 @@ namespace intel { namespace poc {
             * distributed more representatively of the original data.  This algorithm runs in
             * average case O(2n) time.  It runs in worst-case O(n*log(n)), where the log base is
             * num_of_points / AVG_POINTS_PER_BUCKET_.
+            *
+            * times holds the date of every point of data as epoch seconds, so that each date
+            * string is only parsed once per call to applyFilter.
             */
             static void applyFilterTimeWeighted(const Json::Value& data,
+                                     const std::vector<int64_t>& times,
                                      Json::Value& out_points,
                                      int start_i,
                                      int end_i,
-                                     const std::map<std::string, std::string>& data_schema,
+                                     const Schema& schema,
                                      int num_of_points,
                                      FilterType filter_type);
 
+            /**
+            * PointBatch versions of the filters above.  Points [start_i, end_i) of data are
+            * downsampled and appended to out.
+            */
+            static void applyFilterPoints(const PointBatch& data,
+                                     PointBatch& out,
+                                     size_t start_i,
+                                     size_t end_i,
+                                     int num_of_points);
+
+            /**
+            * The PointBatch version of the time-weighted filter does not recurse.  Each bucket
+            * is split into child buckets by splitTimeBucket and the children are processed
+            * depth-first from an explicit stack by applyFilterTimeBucket, so skewed data cannot
+            * overflow the call stack.  A bucket whose points all share one timestamp is
+            * averaged instead of being split forever.
+            *
+            * For large inputs the top level buckets are downsampled in parallel on threadPool()
+            * and their points concatenated in order, giving the same result as the serial run.
+            */
+            static void applyFilterTimeWeighted(const PointBatch& data,
+                                     PointBatch& out,
+                                     size_t start_i,
+                                     size_t end_i,
+                                     int num_of_points,
+                                     FilterType filter_type);
+
+            /**
+            * Points [start_i, end_i) to downsample to num_of_points points.  A filter_type of
+            * FilterType::POINTS marks a bucket that is averaged directly by applyFilterPoints.
+            */
+            struct TimeBucket {
+                size_t start_i;
+                size_t end_i;
+                int num_of_points;
+                FilterType filter_type;
+            };
+
+            /**
+            * Append the time-weighted buckets of bucket to children, in time order.
+            */
+            static void splitTimeBucket(const PointBatch& data,
+                                     const TimeBucket& bucket,
+                                     std::vector<TimeBucket>& children);
+
+            /**
+            * Downsample bucket and all its children, appending the points to out.
+            */
+            static void applyFilterTimeBucket(const PointBatch& data,
+                                     PointBatch& out,
+                                     const TimeBucket& bucket);
+
+            /**
+            * Worker threads shared by all filters, one per CPU core.
+            */
+            static ThreadPool& threadPool();
+
+            /**
+            * Largest-Triangle-Three-Buckets downsampling.  Unlike the averaging filters above,
+            * LTTB keeps real points: the first and last points are always kept, the points in
+            * between are split into num_of_points - 2 equal-count buckets, and from each bucket
+            * the point forming the largest triangle with the previously selected point and the
+            * average of the next bucket is kept.  Peaks and dips therefore survive downsampling.
+            *
+            * Every numeric column contributes its triangle area divided by the column's value
+            * range, so that one point per bucket is selected for all metrics together and no
+            * single metric dominates because of its units.  With a single numeric column this
+            * is exactly the classic algorithm.
+            *
+            * This algorithm runs in O(n) time, scanning each column's contiguous values once
+            * per bucket.
+            */
+            static void applyFilterLTTB(const PointBatch& data,
+                                     PointBatch& out,
+                                     int num_of_points);
+
+            /**
+            * M4 downsampling for line charts.  num_of_points is taken as the pixel width of the
+            * chart: the time frame of data is divided into num_of_points equal-width buckets,
+            * and from each bucket the first and last points, and the points holding the
+            * minimum and maximum value of every numeric column, are kept.  Drawing the result
+            * as a line gives the same pixels as drawing every raw point.
+            *
+            * With a single numeric column at most 4 * num_of_points points are returned, and
+            * at most (2 + 2 * number of numeric columns) * num_of_points in general, so unlike
+            * the other filters the result may hold more than num_of_points points.
+            *
+            * This algorithm runs in O(n) time: one scan of the time column to find the
+            * buckets, and one scan of each column's contiguous values.
+            */
+            static void applyFilterM4(const PointBatch& data,
+                                     PointBatch& out,
+                                     int num_of_points);
+
+            /**
+            * Convert the Json::Value data format into a PointBatch, using schema for the
+            * columns and their types.  Used to run the filters that only have a PointBatch version on
+            * Json::Value data.
+            */
+            static void toBatch(const Json::Value& data,
+                                     const Schema& schema,
+                                     PointBatch& batch);
+
+            /**
+            * Append the average of each bucket of data to out, where bucket b holds points
+            * [bounds[b], bounds[b + 1]).  Each column is reduced for all buckets at once with
+            * AggregationKernels.  INT columns are truncated, TEXT columns and the date take the
+            * value of the last point of the bucket.
+            *
+            * @param[in] bucket_size If not 0, every bucket but the last holds exactly this many
+            *            points, so the fixed-size kernels are used
+            */
+            static void appendAverages(const PointBatch& data,
+                                     PointBatch& out,
+                                     const std::vector<size_t>& bounds,
+                                     size_t bucket_size = 0);
+
             static std::string date_key_;
             static bool initialized_;
             static const int AVG_POINTS_PER_BUCKET_ = 10;
+            /// Inputs smaller than this are downsampled on the calling thread
+            static const size_t PARALLEL_MIN_POINTS_ = 20000;
     };
 
 }}
@@ -10,7 +10,10 @@
 #ifndef INTEL_POC_GRAPHFILTER_H
 #define INTEL_POC_GRAPHFILTER_H
 
+#include <functional>
+#include <stdint.h>
 #include <string>
+#include <graphfilter/columnbatch.h>
 
 namespace intel {
   namespace poc {
@@ -82,6 +85,38 @@ namespace intel {
        *                  a total of 4 days, including the original request) would be fetched,
        *                  downsampled, and stored in the cache.
        * Note: If not present, "downsamplingFilter" will default to DataFilter::TIME_WEIGHTED_POINTS.
+       * Note: Valid "downsamplingFilter" values are "POINTS", "TIME_WEIGHTED_POINTS",
+       *                  "TIME_WEIGHTED_TIME", "LTTB" and "M4".  The first three average the
+       *                  points in each bucket; "LTTB" keeps a representative real point
+       *                  instead, so peaks and dips are not flattened.  "M4" treats the number
+       *                  of points as a pixel width and keeps the first, last, minimum and
+       *                  maximum points of each pixel column, so it may return up to four
+       *                  times as many points for a single metric.
+       * Note: If "streamingDownsampling" is present, requests that are not answered by the
+       *                  cache are downsampled while the rows are read from the database,
+       *                  without holding the raw range in memory.  "AVERAGE" averages
+       *                  numOfPoints equal-width time buckets; "TIME_WEIGHTED" weights each
+       *                  value of a bucket by the time until the next point; "M4" keeps the
+       *                  first, last, minimum and maximum points of each bucket.  If not
+       *                  present, the raw range is read first and downsampled with
+       *                  "downsamplingFilter".
+       * Note: If "databaseDownsampling" is true, requests that are not answered by the cache
+       *                  are averaged into numOfPoints equal-width time buckets by the
+       *                  database query itself, weighted by time, so only the downsampled
+       *                  points are read.  It takes precedence over "streamingDownsampling".
+       *                  It approximates the "TIME_WEIGHTED_POINTS" and "TIME_WEIGHTED_TIME"
+       *                  filters, whose buckets adapt to the points, so its points differ
+       *                  from theirs; with any other "downsamplingFilter" it is ignored.
+       * Note: "maxCacheBytes" bounds the size of the cache, evicting the ranges least
+       *                  recently used first, see cacheBytes.
+       * Note: "cacheEngine" selects how the cache is stored: "sqlite" (default) keeps it in
+       *                  an in-memory SQLite database, "native" in sorted columnar arrays,
+       *                  which serve cache hits without any SQL.
+       * Note: If "asyncIngest" is true, addData queues its payload and returns at once, and a
+       *                  writer thread adds the queued payloads together, in one transaction.
+       *                  A transaction starts once "ingestBatchBytes" of payloads are queued
+       *                  (default 1048576), or "ingestDelayMs" after the first one (default
+       *                  1000).  Points are only returned by getData once written, see flush.
        *
        * @param[in] data_schema JSON string that represents the mapping of column names to their
        *                  data types. Used for creating the databases or data structures used
@@ -99,6 +134,14 @@ namespace intel {
        *                  treated as the primary key. It MUST be present in
        *                  the column list and MUST be of type "TEXT".  Dates in database
        *                  should be of the format: "YYYY-MM-DD HH:MMZ".
+       * An optional "date_key_storage": "INTEGER" field stores the date key of the database
+       *                  table as epoch seconds, in a WITHOUT ROWID table clustered by
+       *                  time.  Dates are still given and returned as text.  The default,
+       *                  "TEXT", stores them as given.
+       * An optional "partition_span" field, "MONTH" or a number of seconds, splits the
+       *                  database table into one table per month or per span of time.
+       * An optional "chunk_points" field, e.g. 1024, seals points into compressed chunks of
+       *                  that many points, see DatabaseAccess::init.
        *
        * @param[in] database_path Database backend path, e.g. @c "/path/to/database.db"
        * @param[in] clean Indicate if backend should initialize with clean database, if
@@ -145,6 +188,18 @@ namespace intel {
        */
       virtual bool addData(const std::string& data_values) = 0;
 
+      /**
+       * Adds new data points held in arrays, without going through JSON.  The arrays are
+       *                read in place, with no parsing and no per-value allocation.
+       *
+       * @param[in] data_values The points, see ColumnBatch.  Columns must match the
+       *                columns defined in the data_schema parameter passed to init.
+       *
+       * @retval true Succesfully added data to library
+       * @retval false Failed to add data to library, no point was added
+       */
+      virtual bool addData(const ColumnBatch& data_values) = 0;
+
       /**
        * Retrieve data points requested from the specified time time range and granularity
        *
@@ -202,6 +257,61 @@ namespace intel {
        */
       virtual std::string getData(const std::string& params) = 0;
 
+      /**
+       * Completion callback of getDataAsync, called exactly once per request
+       *
+       * @param[in] request_id The id returned by getDataAsync
+       * @param[in] completed false if the request was cancelled, result is then empty
+       * @param[in] result The response of getData
+       */
+      typedef std::function<void(uint64_t request_id, bool completed, const std::string& result)> Callback;
+
+      /**
+       * Retrieve data points as getData does, on an internal pool of threads, without
+       *                blocking the caller.  The callback runs on a pool thread, or on the
+       *                calling thread when the call cancels a request that had not started.
+       *
+       * @param[in] params As for getData
+       * @param[in] group Requests that supersede each other, e.g. those of one graph, or
+       *                empty for none.  A new request of a group cancels the earlier ones
+       *                still queued, and those running report being cancelled instead of
+       *                returning a stale result.  When too many requests are queued, the
+       *                oldest is cancelled, so the newest is never delayed behind stale ones.
+       * @param[in] callback Receives the result
+       *
+       * @return The id of the request, never 0
+       */
+      virtual uint64_t getDataAsync(const std::string& params, const std::string& group, const Callback& callback) = 0;
+
+      /**
+       * Cancel a request of getDataAsync.  Its callback reports it as cancelled.
+       *
+       * @retval true The request had not completed yet
+       * @retval false The request is unknown or already completed
+       */
+      virtual bool cancel(uint64_t request_id) = 0;
+
+      /**
+       * Wait until every point added before the call has been written to the database.
+       *                With "asyncIngest" false, addData writes before returning, so there
+       *                is nothing to wait for.
+       *
+       * @retval true All payloads written since the last flush were added
+       * @retval false Some payload written since the last flush could not be added
+       */
+      virtual bool flush() = 0;
+
+      /**
+       * @return The number of addData payloads queued by "asyncIngest" and not yet written
+       */
+      virtual size_t pendingWrites() const = 0;
+
+      /**
+       * @return The estimated size of the points held by the cache, in bytes, or 0 without
+       *                "useCache".  Use it to tune "maxCacheBytes".
+       */
+      virtual size_t cacheBytes() const = 0;
+
      protected:
       /// constructor
       GraphFilter() {}
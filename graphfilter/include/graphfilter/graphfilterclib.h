@@ -10,11 +10,30 @@
 #ifndef INTEL_POC_GRAPHFILTERCLIB_H
 #define INTEL_POC_GRAPHFILTERCLIB_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /// C wrapper 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    /// Types of the values array of an intel_poc_Column
+    enum {
+        INTEL_POC_COLUMN_INT64 = 0,   ///< const int64_t values[num_points]
+        INTEL_POC_COLUMN_DOUBLE = 1,  ///< const double values[num_points]
+        INTEL_POC_COLUMN_TEXT = 2     ///< const char* const values[num_points], NULL entries are null
+    };
+
+    /// One metric column of intel_poc_GraphFilter_addColumns, see intel::poc::ColumnBatch
+    typedef struct intel_poc_Column {
+        const char* name;
+        int type;
+        const void* values;
+        /// Null bitmap, may be NULL: point i is null if bit (i % 8) of nulls[i / 8] is set
+        const uint8_t* nulls;
+    } intel_poc_Column;
+
     /// str allocated using strdup(), must be freed by caller by calling free();
     const char* intel_poc_GraphFilter_id();
 
@@ -26,9 +45,39 @@ extern "C" {
 
     int intel_poc_GraphFilter_addData(const char* data_values);
 
+    /// Add num_points points, times in UTC epoch seconds, read in place from the arrays
+    int intel_poc_GraphFilter_addColumns(const int64_t* times,
+                                         size_t num_points,
+                                         const intel_poc_Column* columns,
+                                         size_t num_columns);
+
     /// str allocated using strdup(), must be freed by caller by calling free();
     const char* intel_poc_GraphFilter_getData(const char* params);
 
+    /**
+     * Completion callback of intel_poc_GraphFilter_getDataAsync.  completed is 0 if the
+     * request was cancelled, result is then "".  result is only valid during the call.
+     */
+    typedef void (*intel_poc_GetDataCallback)(uint64_t request_id, int completed, const char* result, void* user_data);
+
+    /// Run getData without blocking, see GraphFilter::getDataAsync; group may be NULL
+    uint64_t intel_poc_GraphFilter_getDataAsync(const char* params,
+                                                const char* group,
+                                                intel_poc_GetDataCallback callback,
+                                                void* user_data);
+
+    /// Cancel a request of intel_poc_GraphFilter_getDataAsync
+    int intel_poc_GraphFilter_cancel(uint64_t request_id);
+
+    /// Wait until every point added has been written, see GraphFilter::flush
+    int intel_poc_GraphFilter_flush();
+
+    /// Number of addData payloads queued and not yet written
+    size_t intel_poc_GraphFilter_pendingWrites();
+
+    /// Estimated size of the cache in bytes, see GraphFilter::cacheBytes
+    size_t intel_poc_GraphFilter_cacheBytes();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_INGESTQUEUE_H
+#define GRAPHFILTER_INGESTQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class IngestQueue
+     * @brief Queue of addData payloads written in batches by a writer thread
+     *
+     * Any number of threads push payloads onto a lock-free multi-producer, single-consumer
+     * list, and return without waiting for the database.  The writer thread takes every
+     * queued payload at once and hands them to the writer function, which adds them in one
+     * transaction, so the cost of a commit is shared by all of them.  A batch is written once
+     * batch_bytes of payloads are queued, or delay_ms after the writer found the first one.
+     * Producers only take the mutex to wake the writer up when it is idle or the size
+     * trigger is crossed.
+     */
+    class IngestQueue {
+        public:
+            /**
+            * Adds a batch of payloads to the database.
+            *
+            * @param[in,out] payloads The payloads, in the order they were pushed
+            * @return The number of payloads added
+            */
+            typedef std::function<size_t(std::vector<std::string>& payloads)> Writer;
+
+            /// constructor
+            IngestQueue();
+
+            /// destructor, writes every queued payload
+            ~IngestQueue();
+
+            /**
+            * Start the writer thread, after stopping the current one.
+            *
+            * @param[in] batch_bytes Payload bytes queued that start a write at once
+            * @param[in] delay_ms Longest time a payload waits for more to share its write
+            * @param[in] writer Adds the payloads, called on the writer thread
+            */
+            void start(size_t batch_bytes, int delay_ms, const Writer& writer);
+
+            /**
+            * Write every queued payload, then stop the writer thread.
+            */
+            void stop();
+
+            /**
+            * Queue a payload for the writer thread.  Must not be called once stop() was called.
+            */
+            void push(std::string payload);
+
+            /**
+            * Wait until every payload pushed before the call has been written.
+            *
+            * @retval true Every payload written since the last flush was added
+            * @retval false Some payload written since the last flush could not be added
+            */
+            bool flush();
+
+            /// @return The number of payloads pushed and not yet written
+            size_t depth() const;
+
+        private:
+            IngestQueue(const IngestQueue&);
+            IngestQueue& operator=(const IngestQueue&);
+
+            /// A payload of the list.  The consumer keeps the last node taken as a stub.
+            struct Node {
+                std::atomic<Node*> next;
+                std::string payload;
+            };
+
+            void run();
+
+            /// Take the oldest payload of the list, if it has been linked yet
+            bool pop(std::string& payload);
+
+            /// Producers exchange head_, the consumer follows next from tail_
+            std::atomic<Node*> head_;
+            Node* tail_;
+
+            std::atomic<uint64_t> pushed_;
+            std::atomic<uint64_t> written_;
+            std::atomic<size_t> queued_bytes_;
+            /// Set while the writer waits for a first payload
+            std::atomic<bool> idle_;
+
+            std::mutex mutex_;
+            std::condition_variable wake_;
+            std::condition_variable written_changed_;
+            uint64_t flush_target_;
+            size_t failed_;
+            bool running_;
+            bool stopping_;
+
+            size_t batch_bytes_;
+            int delay_ms_;
+            Writer writer_;
+            std::thread writer_thread_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_INGESTQUEUE_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_INTERVALSET_H
+#define GRAPHFILTER_INTERVALSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class IntervalSet
+     * @brief Set of closed epoch ranges, such as the ranges held by a cache
+     *
+     * Ranges are kept disjoint in a map ordered by start, merging those that overlap or
+     * touch, so every query only looks at the ranges around its own bounds instead of
+     * scanning the whole set.
+     */
+    class IntervalSet {
+        public:
+            typedef std::pair<int64_t, int64_t> Interval;
+
+            /**
+            * Add the range [start, end], merging it with the ranges it overlaps or touches.
+            */
+            void insert(int64_t start, int64_t end);
+
+            /**
+            * Remove the range [start, end].  Ranges partly inside it are cut one second
+            * before start and after end.
+            */
+            void erase(int64_t start, int64_t end);
+
+            /**
+            * @retval true A single range of the set covers [start, end]
+            * @retval false Some of [start, end] is missing
+            */
+            bool contains(int64_t start, int64_t end) const;
+
+            /**
+            * Find the parts of [start, end] missing from the set.  Each missing part starts
+            *              and ends where the ranges around it do, so filling them all makes
+            *              [start, end] one range of the set.
+            *
+            * @param[out] missing The missing parts, in order; empty if the set contains [start, end]
+            */
+            void difference(int64_t start, int64_t end, std::vector<Interval>& missing) const;
+
+            void clear() { intervals_.clear(); }
+
+            bool empty() const { return intervals_.empty(); }
+
+            /// @return The number of disjoint ranges
+            size_t size() const { return intervals_.size(); }
+
+        private:
+            /// End of every range, by start
+            std::map<int64_t, int64_t> intervals_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_INTERVALSET_H
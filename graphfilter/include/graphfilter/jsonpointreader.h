@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_JSONPOINTREADER_H
+#define GRAPHFILTER_JSONPOINTREADER_H
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <graphfilter/schema.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class JsonPointReader
+     * @brief Streaming parser for addData payloads
+     *
+     * Reads the documented addData shape, { "startDate": ..., "endDate": ..., "points": [...] },
+     * straight from the JSON text without building a Json::Value DOM.  The values of each
+     * point are typed by their schema column as they are read, and the points are handed to
+     * a sink in batches, so memory is bounded by the batch size rather than by the payload.
+     * Members that are not schema columns, and unknown members of the payload, are skipped.
+     */
+    class JsonPointReader {
+        public:
+            /**
+            * One value of a row, typed the way it is bound to an INSERT, as
+            * SQLiteDatabaseAccess does for a Json::Value point:
+            * - missing, null, object and array values are NONE
+            * - strings are TEXT, whatever the column type
+            * - numbers and booleans of TEXT columns are TEXT, as written in the payload
+            * - booleans are INTEGER 0 or 1
+            * - integral numbers of INT columns are INTEGER, other numbers REAL
+            */
+            struct Field {
+                enum class Type { NONE, INTEGER, REAL, TEXT };
+
+                Field():type(Type::NONE), integer(0), real(0) {}
+
+                Type type;
+                int64_t integer;
+                double real;
+                std::string text;
+            };
+
+            /**
+            * A batch of rows, with one Field per schema column in id order.  The fields
+            * keep their allocations when the batch is reset, so a reused batch stops
+            * allocating once it has been filled.
+            */
+            class Rows {
+                public:
+                    Rows():num_columns_(0), size_(0) {}
+
+                    /// Remove all rows, and set the number of fields per row
+                    void reset(size_t num_columns) { num_columns_ = num_columns; size_ = 0; }
+
+                    size_t size() const { return size_; }
+                    bool empty() const { return size_ == 0; }
+
+                    /// @return The fields of a new row, all NONE
+                    Field* addRow();
+
+                    /// Remove the row added last
+                    void removeRow() { --size_; }
+
+                    const Field* row(size_t index) const { return &fields_[index * num_columns_]; }
+
+                    void swap(Rows& other);
+
+                private:
+                    size_t num_columns_;
+                    size_t size_;
+                    std::vector<Field> fields_;
+            };
+
+            /**
+            * Called with every batch of rows.  The sink may swap the rows out instead of
+            * copying them; the reader resets whatever it is left with.
+            *
+            * @param[in,out] rows The batch, never empty
+            * @param[in] last true if the payload holds no more points
+            * @return false to stop reading
+            */
+            typedef std::function<bool(Rows& rows, bool last)> Sink;
+
+            /// constructor, the schema must outlive the reader
+            explicit JsonPointReader(const Schema& schema);
+
+            /**
+            * Parse an addData payload, handing its points to sink.  Points without the date
+            * key column are skipped.  As points are handed over while the payload is still
+            * being parsed, the caller must discard them if reading fails.
+            *
+            * @param[in] json The payload
+            * @param[in] length Length of the payload in bytes
+            * @param[in] batch_points Maximum number of rows handed to sink at once
+            * @param[in] sink Receives the rows
+            *
+            * @retval true The payload was read
+            * @retval false The payload is malformed, startDate, endDate or points is
+            *               missing, or sink returned false
+            */
+            bool read(const char* json, size_t length, size_t batch_points, const Sink& sink);
+
+            /// @return The startDate of the last payload read, if it was a string
+            const std::string& startDate() const { return start_date_; }
+
+            /// @return The endDate of the last payload read, if it was a string
+            const std::string& endDate() const { return end_date_; }
+
+        private:
+            JsonPointReader(const JsonPointReader&);
+            JsonPointReader& operator=(const JsonPointReader&);
+
+            void skipSpace();
+            bool accept(char c);
+            bool readString(std::string& out);
+            bool readNumber(const char*& begin, bool& integral);
+            bool readLiteral(const char* literal);
+            bool skipValue(int depth);
+            bool readField(Field& field, const Schema::Column& column);
+            bool readPoint(Rows& rows);
+            bool readPoints(Rows& rows, size_t batch_points, const Sink& sink);
+            bool fail(const char* what);
+
+            static const int MAX_DEPTH_ = 1000;
+
+            const Schema& schema_;
+            const char* pos_;
+            const char* begin_;
+            const char* end_;
+            std::string start_date_;
+            std::string end_date_;
+            /// Scratch space reused for member names and numbers
+            std::string key_;
+            std::string token_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_JSONPOINTREADER_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_NATIVEDATACACHE_H
+#define GRAPHFILTER_NATIVEDATACACHE_H
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <graphfilter/sqlitedatacache.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class NativeDataCache
+     * @brief Data cache holding its tables in memory as sorted columnar chunks
+     *
+     * Fills are scheduled and their bounds tracked as by SQLiteDataCache; only the storage
+     * differs.  The raw data and every downsampling level are a tier of PointBatch chunks,
+     * ordered by time and never overlapping, so a query finds its first chunk with a binary
+     * search and copies contiguous slices of the requested columns, without any SQL or date
+     * parsing.  Selected by "cacheEngine": "native" in the cache setup.
+     *
+     * Slices are copied rather than returned as views into the chunks: the PointBatch that
+     * getData fills owns its columns, and a fill or an eviction may replace or drop a chunk as
+     * soon as tiers_mutex_ is released.
+     */
+    class NativeDataCache : public SQLiteDataCache {
+        public:
+
+            static DataCache& instance();
+
+            ~NativeDataCache();
+
+            bool getData(const Json::Value& params, PointBatch& data);
+
+        protected:
+            /// constructor
+            NativeDataCache() {}
+
+            bool putDataTable(const std::string& table_name, const PointBatch& points);
+
+            bool clearDatabaseRange(const std::string& table_name, const std::string& start_date, const std::string& end_date);
+
+            bool openDatabase();
+
+            void createDatabase();
+
+        private:
+            NativeDataCache(const NativeDataCache&);
+            NativeDataCache& operator=(const NativeDataCache&);
+
+            /// Chunks of a table by the time of their first point
+            typedef std::map<int64_t, PointBatch> Tier;
+
+            /// Largest number of points in a chunk
+            static const size_t CHUNK_POINTS_ = 4096;
+
+            /// Split sorted points into chunks of the tier
+            static void addChunks(Tier& tier, const PointBatch& points);
+
+            /// Tiers by table name, like the tables of SQLiteDataCache
+            std::map<std::string, Tier> tiers_;
+            /// Column layout of every chunk, that of the schema without its date key
+            PointBatch layout_;
+            std::mutex tiers_mutex_;
+    };
+}}
+
+#endif //GRAPHFILTER_NATIVEDATACACHE_H
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_POINTBATCH_H
+#define GRAPHFILTER_POINTBATCH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "json.h"
+
+namespace intel { namespace poc {
+
+    /**
+     * @class PointBatch
+     * @brief Columnar (struct-of-arrays) batch of data points
+     *
+     * PointBatch holds the same information as the "points" array of the JSON API, but
+     * laid out one column at a time: the date key column is stored as int64 UTC epoch
+     * seconds (see TimeString), and every other schema column is stored in its own
+     * contiguous array.  Numeric columns (INT and REAL) are both stored as doubles, which is
+     * exact for every value the JSON API can carry for an INT column.  TEXT columns other
+     * than the date key are stored as strings.
+     *
+     * Filters, the database and the cache exchange PointBatch objects internally so that
+     * downsampling never has to walk a Json::Value DOM.  toJson() converts a batch back into
+     * the JSON response format documented in graphfilter.h.
+     */
+    class PointBatch {
+        public:
+            /**
+            * Enum representing the valid column data types
+            */
+            enum class ColumnType { INT, REAL, TEXT };
+
+            /**
+            * A single non-date column of the batch.  Only one of values and text is used,
+            * depending on type.
+            */
+            struct Column {
+                std::string name;
+                ColumnType type;
+                std::vector<double> values;
+                std::vector<std::string> text;
+            };
+
+            /// constructor
+            PointBatch() {}
+
+            /**
+            * Remove all points and columns, and set the date key column name.
+            *
+            * @param[in] date_key Name of the date key column, used when converting to JSON.
+            */
+            void reset(const std::string& date_key);
+
+            /**
+            * Add an empty column to the batch. Must be called before any points are added.
+            *
+            * @param[in] name Column name
+            * @param[in] type Column data type
+            *
+            * @return The index of the new column
+            */
+            int addColumn(const std::string& name, ColumnType type);
+
+            /**
+            * Create an empty batch with the same date key, dates and columns as another batch.
+            *
+            * @param[in] other The batch whose layout should be copied
+            */
+            void copyLayout(const PointBatch& other);
+
+            /**
+            * Append a copy of one point of another batch with the same layout.
+            *
+            * @param[in] other The source batch
+            * @param[in] index The index of the point in the source batch
+            */
+            void appendPoint(const PointBatch& other, size_t index);
+
+            /**
+            * Overwrite point index with a copy of one point of another batch with the same
+            * layout.
+            */
+            void setPoint(size_t index, const PointBatch& other, size_t other_index);
+
+            /**
+            * Remove all points, keeping the date key, dates and columns.
+            */
+            void clearPoints();
+
+            /**
+            * Append copies of all points of another batch with the same layout.
+            *
+            * @param[in] other The source batch
+            */
+            void append(const PointBatch& other);
+
+            /**
+            * Reserve space for the given number of points in every column.
+            */
+            void reserve(size_t num_of_points);
+
+            /**
+            * Find a column by name.
+            *
+            * @return The column index, or -1 if there is no such column
+            */
+            int columnIndex(const std::string& name) const;
+
+            size_t size() const { return times_.size(); }
+            bool empty() const { return times_.empty(); }
+
+            std::vector<int64_t>& times() { return times_; }
+            const std::vector<int64_t>& times() const { return times_; }
+
+            size_t numColumns() const { return columns_.size(); }
+            Column& column(size_t index) { return columns_[index]; }
+            const Column& column(size_t index) const { return columns_[index]; }
+
+            const std::string& dateKey() const { return date_key_; }
+
+            const std::string& startDate() const { return start_date_; }
+            const std::string& endDate() const { return end_date_; }
+            void setDates(const std::string& start_date, const std::string& end_date) {
+                start_date_ = start_date;
+                end_date_ = end_date;
+            }
+
+            /**
+            * Convert the batch into the JSON response format:
+            * { "startDate" : "2015-03-03 00:00Z",
+            *   "endDate" : "2015-03-03 23:59Z",
+            *   "points" : [
+            *    { "date":"2015-03-03 00:00Z",
+            *        "calories":2.0,
+            *        ...
+            *    },
+            *    ...
+            *   ]
+            * }
+            */
+            Json::Value toJson() const;
+
+        private:
+            std::string date_key_;
+            std::string start_date_;
+            std::string end_date_;
+            std::vector<int64_t> times_;
+            std::vector<Column> columns_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_POINTBATCH_H
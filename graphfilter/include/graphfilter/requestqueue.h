@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_REQUESTQUEUE_H
+#define GRAPHFILTER_REQUESTQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class RequestQueue
+     * @brief Bounded executor of getData requests that drops stale requests
+     *
+     * Requests are run in submission order by a fixed number of worker threads, and every
+     * request gets exactly one completion callback.  A request submitted with a group
+     * supersedes the earlier requests of its group: queued ones are cancelled without
+     * running, running ones run to the end but report being cancelled.  When the queue is
+     * full, the oldest queued request is cancelled to make room, so a burst of requests, e.g.
+     * while panning and zooming a graph, never delays the newest one behind stale ones.
+     */
+    class RequestQueue {
+        public:
+            /// Runs a request, returning its result
+            typedef std::function<std::string()> Task;
+
+            /**
+            * Called once per request.  Runs on a worker thread, or on the thread whose call
+            * cancelled the request while it was queued.
+            *
+            * @param[in] request_id Id returned by submit
+            * @param[in] completed false if the request was cancelled or its task threw,
+            *                      result is then empty
+            * @param[in] result The result of the task
+            */
+            typedef std::function<void(uint64_t request_id, bool completed, const std::string& result)> Callback;
+
+            /**
+            * Start the worker threads.
+            *
+            * @param[in] num_threads Number of worker threads, at least one is always started
+            * @param[in] capacity Most requests queued and not running, at least one
+            */
+            RequestQueue(size_t num_threads, size_t capacity);
+
+            /**
+            * Cancel the queued requests, wait for the running ones, then stop and join the
+            * worker threads.
+            */
+            ~RequestQueue();
+
+            /**
+            * Queue a request.
+            *
+            * @param[in] group Requests superseding each other, or empty for none
+            * @param[in] task Runs the request on a worker thread
+            * @param[in] callback Receives the result
+            *
+            * @return The id of the request, never 0
+            */
+            uint64_t submit(const std::string& group, const Task& task, const Callback& callback);
+
+            /**
+            * Cancel a request.  A queued request is removed, a running one reports being
+            * cancelled once it ends.
+            *
+            * @retval true The request was queued or running
+            * @retval false The request was unknown or had already completed
+            */
+            bool cancel(uint64_t request_id);
+
+        private:
+            RequestQueue(const RequestQueue&);
+            RequestQueue& operator=(const RequestQueue&);
+
+            struct Request {
+                uint64_t id;
+                std::string group;
+                Task task;
+                Callback callback;
+            };
+
+            void run();
+
+            /// Tell the callbacks of the requests that they were cancelled
+            static void cancelled(std::vector<Request>& requests);
+
+            std::vector<std::thread> workers_;
+            std::deque<Request> queued_;
+            /// Group of each running request, and whether it was cancelled
+            std::map<uint64_t, std::pair<std::string, bool>> running_;
+            uint64_t next_id_;
+            size_t capacity_;
+            std::mutex mutex_;
+            std::condition_variable condition_;
+            bool stopping_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_REQUESTQUEUE_H
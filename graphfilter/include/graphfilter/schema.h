@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_SCHEMA_H
+#define GRAPHFILTER_SCHEMA_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "json.h"
+#include <graphfilter/pointbatch.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class Schema
+     * @brief Compiled form of the data_schema JSON
+     *
+     * The data_schema is parsed once, and every layer (database, cache, filters) then works
+     * with dense column ids and enum types instead of looking column names up in a map and
+     * comparing type strings for every value.  Columns are ordered by name, which is the
+     * order the tables have always been created and queried in, and the column list and
+     * column definitions used to build SQL statements are prebuilt.
+     */
+    class Schema {
+        public:
+            /**
+            * A single column of the schema.  sql_type is the type exactly as given in the
+            * data_schema, type is how its values are held in a PointBatch: "INT" and "REAL"
+            * map to their own type, anything else is TEXT.
+            */
+            struct Column {
+                std::string name;
+                std::string sql_type;
+                PointBatch::ColumnType type;
+            };
+
+            /**
+            * How the database table is split by time.  With MONTH or SPAN the points of each
+            * calendar month or each partitionSpan() seconds are kept in a table of their own.
+            */
+            enum class Partitioning { NONE, MONTH, SPAN };
+
+            /// constructor
+            Schema():date_key_id_(0), integer_date_key_(false), partitioning_(Partitioning::NONE), partition_span_(0),
+                chunk_points_(0) {}
+
+            /**
+            * Compile a data_schema of the form documented in DatabaseAccess::init.
+            *
+            * @retval true The schema was compiled
+            * @retval false The data_schema is malformed, the date key column is not one
+            *               of its columns, its date_key_storage or partition_span is
+            *               unknown, or chunk_points is invalid or combined with
+            *               partition_span.  The schema is left empty.
+            */
+            bool parse(const Json::Value& data_schema);
+
+            /**
+            * Compile a schema from its parts.
+            *
+            * @param[in] table Name of the table
+            * @param[in] date_key_column Name of the date key column
+            * @param[in] columns Mapping of column names to their data types
+            * @param[in] integer_date_key Store the date key as INTEGER epoch seconds
+            */
+            bool parse(const std::string& table,
+                       const std::string& date_key_column,
+                       const std::map<std::string, std::string>& columns,
+                       bool integer_date_key = false);
+
+            bool empty() const { return columns_.empty(); }
+            const std::string& table() const { return table_; }
+            const std::string& dateKeyColumn() const { return date_key_column_; }
+            size_t dateKeyId() const { return date_key_id_; }
+
+            /**
+            * @return true if the database table stores the date key as INTEGER epoch seconds,
+            *         rather than as the "YYYY-MM-DD HH:MMZ" text it is given and returned as
+            */
+            bool integerDateKey() const { return integer_date_key_; }
+
+            Partitioning partitioning() const { return partitioning_; }
+
+            /// @return Seconds covered by each partition, for Partitioning::SPAN
+            int64_t partitionSpan() const { return partition_span_; }
+
+            /**
+            * @return The key of the partition holding epoch seconds time.  Keys increase with
+            *         time, so partitions ordered by key are ordered by time.
+            */
+            int64_t partitionKey(int64_t time) const;
+
+            /// @return The first epoch second of a partition
+            int64_t partitionStart(int64_t key) const;
+
+            /// @return The last epoch second of a partition
+            int64_t partitionEnd(int64_t key) const { return partitionStart(key + 1) - 1; }
+
+            /// @return The name of the table of a partition
+            std::string partitionTable(int64_t key) const;
+
+            /// @return The name of the table listing the partitions of the database table
+            std::string partitionsTable() const { return table_ + "_partitions"; }
+
+            /**
+            * @return Points per compressed chunk, or 0 if all points are kept as rows.  With
+            *         chunks, the database table only holds the points not yet sealed into
+            *         a chunk of chunksTable().
+            */
+            size_t chunkPoints() const { return chunk_points_; }
+
+            /// @return The name of the table holding the compressed chunks
+            std::string chunksTable() const { return table_ + "_chunks"; }
+
+            size_t numColumns() const { return columns_.size(); }
+            const Column& column(size_t id) const { return columns_[id]; }
+
+            /**
+            * @return The id of the named column, or -1 if the schema has no such column
+            */
+            int find(const std::string& name) const;
+
+            /**
+            * @return "col_a, col_b, ..." listing every column in id order
+            */
+            const std::string& columnList() const { return column_list_; }
+
+            /**
+            * @return "col_a TYPE, col_b TYPE PRIMARY KEY, ..." for a CREATE TABLE statement,
+            *         with the date key column as the primary key
+            */
+            const std::string& columnDefinitions() const { return column_definitions_; }
+
+            /**
+            * @return The CREATE TABLE statement of the database table, or of one of its
+            *         partitions.  With integerDateKey() the date key is an INTEGER primary key
+            *         of a WITHOUT ROWID table, so rows are clustered by time.
+            */
+            std::string createTable(const std::string& table) const;
+
+            /**
+            * Reset batch to hold every column of the schema except the date key, in id order.
+            */
+            void layout(PointBatch& batch) const;
+
+            /**
+            * Check whether a table's columns, as a mapping of column names to their declared
+            * types, are exactly the columns of the schema.  With integerDateKey() the date key
+            * must be declared INTEGER.
+            */
+            bool matches(const std::map<std::string, std::string>& table_columns) const;
+
+        private:
+            void clear();
+
+            /// Largest chunk_points accepted
+            static const int64_t MAX_CHUNK_POINTS_ = 1 << 20;
+
+            std::string table_;
+            std::string date_key_column_;
+            size_t date_key_id_;
+            bool integer_date_key_;
+            Partitioning partitioning_;
+            int64_t partition_span_;
+            size_t chunk_points_;
+            std::vector<Column> columns_;
+            std::map<std::string, size_t> ids_;
+            std::string column_list_;
+            std::string column_definitions_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_SCHEMA_H
@@ -16,7 +16,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include "databaseaccess.h"
+#include <graphfilter/connectionpool.h>
+#include <graphfilter/jsonpointreader.h>
+#include <graphfilter/statementcache.h>
+#include <graphfilter/threadpool.h>
 
 namespace intel { namespace poc {
 
@@ -29,18 +35,98 @@ namespace intel { namespace poc {
 
             bool init(const std::string& database_path, const Json::Value& data_schema, bool clean);
 
+            bool init(const std::string& database_path, const Schema& schema, bool clean);
+
             bool putData(const Json::Value& data_values);
 
+            bool putJsonData(const std::string& data_values);
+
+            size_t putJsonData(const std::vector<std::string>& data_values);
+
+            bool putColumns(const ColumnBatch& data_values);
+
             Json::Value getData(const Json::Value& params);
 
+            bool getData(const Json::Value& params, PointBatch& data);
+
+            bool getData(const Json::Value& params, StreamingDownsampler& downsampler);
+
+            bool getAggregatedData(const Json::Value& params, PointBatch& data);
+
+            bool removeData(const std::string& before_date);
+
         protected:
             /// constructor
-            SQLiteDatabaseAccess():database_(NULL) {}
+            SQLiteDatabaseAccess():database_(NULL), ingest_writer_(1) {}
 
+            /// The writer connection; queries run on readers_
             sqlite3 *database_;
-            std::string table_name_;
-            std::map<std::string,std::string> data_schema_;
-            std::string date_key_column_;
+            ConnectionPool readers_;
+            Schema schema_;
+            StatementCache statements_;
+            std::string insert_sql_;
+            /// Serializes insert transactions on the connection
+            std::mutex write_mutex_;
+            /// Inserts the batches of a payload while the next is parsed; one insert at a
+            /// time holds write_mutex_, so one worker is enough
+            ThreadPool ingest_writer_;
+
+            /**
+            * A partition of the database table, see Schema::Partitioning
+            */
+            struct Partition {
+                int64_t start;
+                int64_t end;
+                std::string table;
+            };
+
+            /// The committed partitions by key, which queries may read
+            std::map<int64_t, Partition> partitions_;
+            std::mutex partitions_mutex_;
+
+            /**
+            * Hands out the cached INSERT for the partition of each row, creating partitions
+            * as rows for them arrive.  Used by one thread at a time, inside an insert
+            * transaction.
+            */
+            class Inserter {
+                public:
+                    explicit Inserter(SQLiteDatabaseAccess& access);
+
+                    /**
+                    * @param[in] time Epoch seconds of the row, only used when partitioned
+                    * @return The INSERT for the row
+                    * @throw std::runtime_error if the statement or the partition cannot be created
+                    */
+                    sqlite3_stmt* statement(int64_t time);
+
+                    /**
+                    * Let queries read the partitions created by this insert transaction, once
+                    * it has been committed.
+                    */
+                    void commit();
+
+                    /// Remember the partitions created so far, see rollback()
+                    void savepoint();
+
+                    /**
+                    * Forget the partitions created since savepoint(), after the insert
+                    * transaction was rolled back to it.
+                    */
+                    void rollback();
+
+                private:
+                    Inserter(const Inserter&);
+                    Inserter& operator=(const Inserter&);
+
+                    SQLiteDatabaseAccess& access_;
+                    std::unique_ptr<StatementCache::Lease> insert_;
+                    /// Time range of the partition insert_ inserts into
+                    int64_t start_;
+                    int64_t end_;
+                    std::map<int64_t, Partition> created_;
+                    std::map<int64_t, Partition> saved_;
+            };
 
 
             bool initialized_;
@@ -55,6 +141,176 @@ namespace intel { namespace poc {
 
             void executeQuery(const std::string& sql_query);
 
+            /// @return The INSERT of every column into table
+            std::string insertSql(const std::string& table) const;
+
+            /**
+            * Read the partitions listed in the partitions table.
+            *
+            * @return false if there is no partitions table
+            */
+            bool readPartitions(std::map<int64_t, Partition>& partitions);
+
+            /**
+            * Load the partitions listed in the partitions table, for queries to read.
+            *
+            * @return false if the table is not partitioned the way the schema is
+            */
+            bool loadPartitions();
+
+            /**
+            * @return The tables to read for [start_time, end_time], in time order
+            */
+            std::vector<std::string> queryTables(int64_t start_time, int64_t end_time);
+
+            /// @return true if the rows need their epoch seconds to be inserted
+            bool insertNeedsTime() const {
+                return schema_.integerDateKey() || schema_.partitioning() != Schema::Partitioning::NONE;
+            }
+
+            /**
+            * Bind a JSON value to an INSERT parameter, by the type of its column.  Missing and
+            * null values are bound as NULL.
+            */
+            static void bindValue(sqlite3_stmt* stmt, int index, const Json::Value& value, PointBatch::ColumnType type);
+
+            /**
+            * Insert the points of an addData payload, inside an insert transaction.  The
+            * caller must roll back the points inserted if it fails.
+            *
+            * @return false if the payload is malformed or a point cannot be inserted
+            */
+            bool insertJson(Inserter& inserter, const std::string& data_values);
+
+            /**
+            * Insert a batch of rows from JsonPointReader.
+            *
+            * @throw std::runtime_error if a row cannot be inserted
+            */
+            void insertRows(Inserter& inserter, const JsonPointReader::Rows& rows);
+
+            /**
+            * End the insert transaction: commit it if committed is true, roll it back
+            * otherwise.
+            *
+            * @return committed, or false if committing failed
+            */
+            bool endTransaction(bool committed);
+
+            /**
+            * Append the current row of a query to data.  Query column i goes into batch
+            * column batch_columns[i], unless it is negative, and the date is read from query
+            * column date_field.
+            *
+            * @return false if the row has an invalid date, and was skipped
+            */
+            bool appendRow(sqlite3_stmt* stmt, int date_field, const std::vector<int>& batch_columns, PointBatch& data) const;
+
+            /**
+            * Step an aggregate query of queryData once for each of num_of_buckets equal-width
+            * time buckets of [start_time, end_time], with the bounds of the bucket bound to
+            * ?1 and ?2, and append its rows to data.  Empty buckets add no point.
+            *
+            * @return false if a step failed
+            */
+            bool readBuckets(sqlite3* database, sqlite3_stmt* stmt, int64_t start_time, int64_t end_time,
+                             int num_of_buckets, int date_field, const std::vector<int>& batch_columns,
+                             PointBatch& data) const;
+
+            /**
+            * Bind epoch seconds to a parameter compared with the date key: as an integer, or
+            * as its date text.  A time of -1 is bound as the empty text.
+            */
+            void bindTime(sqlite3_stmt* stmt, int index, int64_t time) const;
+
+            /// @return true if the database holds the named table
+            bool tableExists(const std::string& table);
+
+            /**
+            * Read rows of every column of the database table into a batch laid out by
+            * Schema::layout, in time order, on the writer connection.
+            *
+            * @param[in] condition Comparison of the date key with the time, e.g. " <= ?1"
+            * @param[in] time Epoch seconds compared with, or -1 to compare with no time
+            * @param[in] limit Maximum number of rows, or 0 for all rows
+            * @throw std::runtime_error if the rows cannot be read
+            */
+            void readTableRows(const std::string& condition, int64_t time, size_t limit, PointBatch& rows);
+
+            /**
+            * Delete the rows of the database table up to a time, on the writer connection.
+            *
+            * @throw std::runtime_error if the rows cannot be deleted
+            */
+            void deleteTableRows(int64_t through);
+
+            /// @return The last time of the chunks, or -1 if there are none
+            int64_t chunksEnd();
+
+            /**
+            * Store points as a new chunk.
+            *
+            * @throw std::runtime_error if the chunk cannot be stored
+            */
+            void writeChunk(const PointBatch& points);
+
+            /**
+            * Read the points of the chunk starting at start into points, laid out by
+            * Schema::layout.
+            *
+            * @throw std::runtime_error if the chunk cannot be read
+            */
+            void readChunk(int64_t start, PointBatch& points);
+
+            /**
+            * Seal the rows of the database table into chunks, inside an insert transaction.
+            * Rows up to the last chunk arrived late, and are merged into the chunks their
+            * time falls in.  The remaining rows are sealed, chunkPoints() at a time, in time
+            * order.  The table is thus left with fewer than chunkPoints() rows, all later
+            * than every chunk, and chunks never overlap.
+            *
+            * @throw std::runtime_error if the rows cannot be sealed
+            */
+            void sealChunks();
+
+            /**
+            * Merge late rows into the chunks: each row goes into the last chunk starting at or
+            * before it, or into the first chunk.  Points already in a chunk are kept, as
+            * INSERT OR IGNORE does.
+            */
+            void mergeLateRows(const PointBatch& rows);
+
+            /**
+            * Remove the points of the chunks before a time, inside a transaction.
+            */
+            void removeChunks(int64_t before);
+
+            /**
+            * Read the chunks overlapping [start_time, end_time] into data, on a reader
+            * connection.  If downsampler is not NULL the points are pushed to it as queryData
+            * does, and chunks it can average from their summaries are not decoded.
+            *
+            * @throw std::runtime_error if the chunks cannot be read
+            */
+            void readChunks(sqlite3* database, StatementCache& statements, int64_t start_time, int64_t end_time,
+                            PointBatch& data, StreamingDownsampler* downsampler);
+
+            /**
+            * Run a getData query into data.  If downsampler is not NULL, the rows are pushed
+            * to it every STREAM_CHUNK_POINTS_ rows instead of being kept in data.  If
+            * num_of_buckets is positive, the rows are averaged into that many time buckets
+            * by the query itself, weighted by time with tsdv_twavg, see readBuckets.
+            */
+            bool queryData(const Json::Value& params, PointBatch& data, StreamingDownsampler* downsampler, int num_of_buckets);
+
+            static const size_t STREAM_CHUNK_POINTS_ = 1024;
+
+            /// Points putJsonData parses ahead of the points being inserted
+            static const size_t INGEST_BATCH_POINTS_ = 512;
+
+            /// Maximum number of queries running at once
+            static const size_t READER_CONNECTIONS_ = 4;
+
     };
 }}
 
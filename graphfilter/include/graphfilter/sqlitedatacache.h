@@ -13,11 +13,18 @@
 
 #include <graphfilter/datafilter.h>
 #include <sqlite3.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
+#include <list>
 #include <map>
 #include <mutex>
+#include <condition_variable>
 #include "datacache.h"
+#include <graphfilter/connectionpool.h>
+#include <graphfilter/statementcache.h>
+#include <graphfilter/threadpool.h>
+#include <graphfilter/intervalset.h>
 
 namespace intel { namespace poc {
 
@@ -30,49 +37,141 @@ namespace intel { namespace poc {
 
             bool init(const Json::Value& cache_setup, const Json::Value& data_schema, bool clean);
 
+            bool init(const Json::Value& cache_setup, const Schema& schema, bool clean);
+
             void cacheData(const std::string& start_date, const std::string& end_date);
 
             Json::Value getData(const Json::Value& params);
 
+            bool getData(const Json::Value& params, PointBatch& data);
+
+            size_t cacheBytes();
+
         protected:
             /// constructor
-            SQLiteDataCache():database_(NULL) {}
+            SQLiteDataCache():database_(NULL), max_cache_bytes_(0), cached_bytes_(0), fill_generation_(0),
+                             fill_slice_seconds_(FILL_SLICE_SECONDS_), fill_pool_(FILL_THREADS_) {}
 
+            /// The writer connection; queries run on readers_
             sqlite3 *database_;
+            ConnectionPool readers_;
             static const std::string database_path_;
             std::string table_name_;
-            std::map<std::string,std::string> data_schema_;
+            Schema schema_;
             bool cache_raw_data_;
             int fetch_ahead_;
             int fetch_behind_;
             DataFilter::FilterType downsampling_filter_;
             std::vector<std::map<std::string,long>> cache_levels_;
 
-            std::string date_key_column_;
-            std::map<std::string,std::string> cache_data_bounds_;
-            std::mutex put_data_mutex_;
+            /// Epoch ranges the cache holds
+            IntervalSet cache_data_bounds_;
+
+            /// A range added by a fill, the unit of eviction, keyed by its start
+            struct CachedRange {
+                CachedRange():end(0), bytes(0), readers(0) {}
+                int64_t end;
+                /// Estimated size of its points in every table
+                size_t bytes;
+                /// Its place in lru_ranges_
+                std::list<int64_t>::iterator lru;
+                /// Queries still reading it; a range is not evicted while any are
+                int readers;
+            };
+
+            /// Ranges a query pinned in cacheContains, released when the query is done reading
+            class RangeLease {
+                public:
+                    explicit RangeLease(SQLiteDataCache& cache):cache_(cache) {}
+                    ~RangeLease();
+
+                    /// Starts of the pinned ranges
+                    std::vector<int64_t> starts;
+
+                private:
+                    RangeLease(const RangeLease&);
+                    RangeLease& operator=(const RangeLease&);
+
+                    SQLiteDataCache& cache_;
+            };
+            std::map<int64_t,CachedRange> cache_ranges_;
+            /// Starts of cache_ranges_, the most recently added or read first
+            std::list<int64_t> lru_ranges_;
+            /// "maxCacheBytes", 0 for no limit
+            size_t max_cache_bytes_;
+            size_t cached_bytes_;
+            /// Ranges evicted from the bounds whose points are still being deleted
+            std::vector<IntervalSet::Interval> evicting_;
+            std::condition_variable evicted_;
+            /// Guards the bounds, the cached ranges and their accounting
             std::mutex cache_data_bounds_mutex_;
+            StatementCache statements_;
+            /// Serializes insert transactions on the connection
+            std::mutex write_mutex_;
+
+            /// Maximum number of queries running at once
+            static const size_t READER_CONNECTIONS_ = 4;
 
             bool initialized_;
 
+            /// A fill of the cache, keyed by its start date
+            struct Fill {
+                std::string end_date;
+                /// The cacheData call that last requested the range
+                uint64_t generation;
+                /// Set once a newer call no longer needs the range; checked between slices and levels
+                bool cancelled;
+            };
+
+            /// Fills waiting for a worker, those of the requested ranges before those fetched
+            /// ahead and behind.  Fills of one map are merged so that none overlap.
+            std::map<std::string,Fill> pending_fills_;
+            std::map<std::string,Fill> pending_prefetches_;
+            std::map<std::string,Fill> running_fills_;
+            uint64_t fill_generation_;
+            std::mutex fills_mutex_;
+            std::condition_variable fills_done_;
+
+            /// Maximum number of fills running at once
+            static const size_t FILL_THREADS_ = 2;
+
+            /// Fills fetch and insert their ranges in slices of fill_slice_seconds_, at least
+            /// FILL_SLICE_SECONDS_ long and holding FILL_SLICE_LEVEL_POINTS_ points of every level
+            static const int64_t FILL_SLICE_SECONDS_ = 86400;
+            static const long FILL_SLICE_LEVEL_POINTS_ = 32;
+            int64_t fill_slice_seconds_;
+
+            /// Last member, so no fill outlives the rest of the cache
+            ThreadPool fill_pool_;
+
             /// private API
-            void cacheDataAsync(const std::string& start_date, const std::string& end_date);
-            bool getAndPutData(const std::string& start_date, const std::string& end_date);
-            bool downsampleAndPutData(int level, const Json::Value& data_values);
-            bool putDataTable(const std::string& table_name, const Json::Value& points);
-            long timeStringToEpochSeconds(const std::string& time_string);
-            std::string updateTimeString(const std::string& time_string, long offset);
+            void queueFill(std::map<std::string,Fill>& fills, std::string start_date, std::string end_date);
+            void dropStaleFills(std::map<std::string,Fill>& fills, const std::string& start_date, const std::string& end_date);
+            std::map<std::string,Fill>::iterator nextFill(std::map<std::string,Fill>& fills);
+            void scheduleFills();
+            void runFill(const std::string& start_date, const std::string& end_date);
+            bool fillCancelled(const std::string& start_date);
+            void waitForFills(std::unique_lock<std::mutex>& fills_lock);
+            void fillCache(const std::string& start_date, const std::string& end_date);
+            bool getAndPutData(const std::string& fill_start, const std::string& start_date, const std::string& end_date, size_t& bytes);
+            /// Storage of the cache tables, replaced by NativeDataCache
+            virtual bool putDataTable(const std::string& table_name, const PointBatch& points);
+            std::string updateTimeString(const std::string& time_string, int64_t offset);
             long getDurationNumPoints(const std::string& start_date, const std::string& end_date, int level);
-            bool clearDatabaseRange(const std::string& table_name, const std::string& start_date, const std::string& end_date);
+            virtual bool clearDatabaseRange(const std::string& table_name, const std::string& start_date, const std::string& end_date);
+            void touchRange(std::map<int64_t,CachedRange>::iterator range);
+            void evictColdRanges(int64_t added, std::vector<IntervalSet::Interval>& victims);
+            void clearEvictedRanges(const std::vector<IntervalSet::Interval>& victims);
+            void waitForEvictions(std::unique_lock<std::mutex>& lock_bounds, int64_t start, int64_t end);
+            static size_t batchBytes(const PointBatch& points);
 
 
-            std::string cacheContains(const std::string& startDate, const std::string& endDate, int num_of_points);
-            std::map<std::string,std::string> getCacheDifference(std::string start_date, std::string end_date);
+            std::string cacheContains(const std::string& startDate, const std::string& endDate, int num_of_points, RangeLease& pinned);
 
 
-            bool openDatabase();
+            virtual bool openDatabase();
 
-            void createDatabase();
+            virtual void createDatabase();
 
             void executeQuery(const std::string& sql_query);
 
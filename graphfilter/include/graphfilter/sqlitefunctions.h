@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_SQLITEFUNCTIONS_H
+#define GRAPHFILTER_SQLITEFUNCTIONS_H
+
+#include <sqlite3.h>
+#include <stdint.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class SQLiteFunctions
+     * @brief TSDV downsampling functions registered on SQLite connections
+     *
+     * Dates may be given either as "YYYY-MM-DD HH:MMZ" strings or as integer epoch seconds.
+     *
+     * tsdv_bucket(date, start, width)
+     *     Index of the width-second bucket, counted from start, that date falls into.
+     *     NULL if either date is invalid or width is not positive.
+     *
+     * tsdv_twavg(date, value)
+     *     Aggregate: time-weighted average, where each value holds until the date of the
+     *     next point of the group.  A group spanning no time gives the plain average.
+     *     Unlike DataFilter's TIME_WEIGHTED_* filters, which keep a downsampled set of points,
+     *     this reduces the whole group to one value, e.g. one per tsdv_bucket.  The sum is
+     *     taken with AggregationKernels like every DataFilter bucket.
+     *
+     * tsdv_lttb(date, value, num_of_points)
+     * tsdv_m4(date, value, num_of_points)
+     *     Aggregates: the points of the group downsampled with DataFilter's LTTB or M4
+     *     filter, as a JSON array of {"date": ..., "value": ...} objects in time order.
+     *     DataFilter must have been initialized.
+     *
+     * Window function versions are not provided, as the bundled SQLite predates them.
+     *
+     * The library itself only uses tsdv_twavg, to average the buckets of
+     * SQLiteDatabaseAccess::getAggregatedData.  The other functions are for SQL run by
+     * applications on the database.
+     */
+    class SQLiteFunctions {
+        public:
+            /**
+            * Register all functions on a connection.
+            *
+            * @retval true All functions were registered
+            * @retval false Registering a function failed
+            */
+            static bool registerAll(sqlite3* database);
+
+        private:
+            /// @return false if value is neither epoch seconds nor a valid date string
+            static bool toEpochSeconds(sqlite3_value* value, int64_t& time);
+
+            static void bucket(sqlite3_context* context, int argc, sqlite3_value** argv);
+            /// Step of every aggregate: collects the (date, value) points of the group
+            static void pointsStep(sqlite3_context* context, int argc, sqlite3_value** argv);
+            static void timeWeightedAverageFinal(sqlite3_context* context);
+            static void lttbFinal(sqlite3_context* context);
+            static void m4Final(sqlite3_context* context);
+            static void filterFinal(sqlite3_context* context, bool lttb);
+    };
+
+}}
+
+#endif //GRAPHFILTER_SQLITEFUNCTIONS_H
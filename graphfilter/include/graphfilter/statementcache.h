@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_STATEMENTCACHE_H
+#define GRAPHFILTER_STATEMENTCACHE_H
+
+#include <sqlite3.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class StatementCache
+     * @brief Prepared statements of one SQLite connection, keyed by their SQL text
+     *
+     * Each statement is prepared the first time it is needed and reused afterwards, so
+     * SQLite only parses it once.  A statement is leased by one caller at a time: callers
+     * running the same SQL concurrently each get their own statement, and the cache keeps
+     * the statements handed back for the next caller.  Queries are keyed by their full SQL,
+     * which varies with their columns and tables, so at most MAX_STATEMENTS_ idle statements
+     * are kept and the least recently used are finalized.  All idle statements are finalized
+     * when the connection is changed, which must happen before the connection is closed.
+     */
+    class StatementCache {
+        public:
+            /**
+            * A statement leased from the cache for the lifetime of this object.  The
+            * statement is reset, its bindings cleared and it is handed back when the lease
+            * goes out of scope, so text and blobs that outlive the step they are bound for
+            * can be bound with SQLITE_STATIC rather than copied.
+            */
+            class Lease {
+                public:
+                    Lease(StatementCache& cache, const std::string& sql)
+                        :cache_(cache), sql_(sql), stmt_(cache.acquire(sql)) {}
+                    ~Lease() { cache_.release(sql_, stmt_); }
+
+                    /// @return The statement, or NULL if it could not be prepared
+                    sqlite3_stmt* get() const { return stmt_; }
+
+                private:
+                    Lease(const Lease&);
+                    Lease& operator=(const Lease&);
+
+                    StatementCache& cache_;
+                    std::string sql_;
+                    sqlite3_stmt* stmt_;
+            };
+
+            /// constructor
+            StatementCache():database_(NULL) {}
+
+            /// destructor, finalizes all idle statements
+            ~StatementCache();
+
+            /**
+            * Finalize all idle statements and prepare new ones on the given connection.
+            * Statements leased from the previous connection are finalized when handed back.
+            *
+            * @param[in] database The connection, or NULL before closing the current one
+            */
+            void setDatabase(sqlite3* database);
+
+            /**
+            * Take a statement for sql out of the cache, preparing a new one if none is idle.
+            * Prefer Lease, which always hands the statement back.
+            *
+            * @return The statement, or NULL if sql could not be prepared
+            */
+            sqlite3_stmt* acquire(const std::string& sql);
+
+            /**
+            * Reset a statement from acquire() and keep it for the next caller.
+            */
+            void release(const std::string& sql, sqlite3_stmt* stmt);
+
+            /**
+            * Finalize the idle statements that use a table, e.g. once it has been dropped.
+            * Statements leased at the time are kept when handed back.
+            */
+            void purge(const std::string& table);
+
+            /// Most idle statements kept at once
+            static const size_t MAX_STATEMENTS_ = 64;
+
+        private:
+            StatementCache(const StatementCache&);
+            StatementCache& operator=(const StatementCache&);
+
+            typedef std::list<std::pair<std::string, sqlite3_stmt*>> Statements;
+
+            void clear();
+            void erase(Statements::iterator statement);
+
+            sqlite3* database_;
+            /// Idle statements, most recently released first
+            Statements statements_;
+            /// Idle statements by their SQL
+            std::multimap<std::string, Statements::iterator> index_;
+            std::mutex mutex_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_STATEMENTCACHE_H
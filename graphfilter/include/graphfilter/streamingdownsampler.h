@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_STREAMINGDOWNSAMPLER_H
+#define GRAPHFILTER_STREAMINGDOWNSAMPLER_H
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <graphfilter/pointbatch.h>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class StreamingDownsampler
+     * @brief Push-style downsampler that never holds the raw points
+     *
+     * Unlike DataFilter, which needs every raw point of the range before it can start, a
+     * StreamingDownsampler is fed the points in time order, one PointBatch chunk at a time,
+     * and only keeps the accumulators of the bucket currently being filled.  Finished output
+     * points are handed to the sink in chunks as soon as enough buckets are closed, so a
+     * query can be downsampled while it is still being read, in memory independent of the
+     * length of the range.
+     *
+     * The time frame [start_time, end_time] given to begin() is divided into num_of_points
+     * equal-width buckets.  In Mode::AVERAGE each bucket becomes one point: numeric columns
+     * are averaged (INT columns truncated), TEXT columns and the date take the value of the
+     * last point.  Mode::TIME_WEIGHTED does the same, but weights each value by the time
+     * until the next point of the bucket, as the tsdv_twavg SQL function does; a bucket whose
+     * points all share one time is averaged plainly.  In Mode::M4 each bucket keeps its first
+     * and last points and the points holding the minimum and maximum of every numeric column,
+     * as DataFilter's M4 filter does.
+     */
+    class StreamingDownsampler {
+        public:
+            /**
+            * Enum representing the valid downsampling modes
+            */
+            enum class Mode { AVERAGE, M4, TIME_WEIGHTED };
+
+            /**
+            * Receives finished output points.  The batch is only valid during the call.
+            */
+            typedef std::function<void(const PointBatch& points)> Sink;
+
+            /**
+            * @param[in] mode How each bucket is reduced
+            * @param[in] num_of_points Number of buckets the time frame is divided into
+            * @param[in] sink Called with each chunk of finished output points
+            */
+            StreamingDownsampler(Mode mode, int num_of_points, const Sink& sink);
+
+            /**
+            * Start a new stream, discarding any unfinished state.
+            *
+            * @param[in] layout Batch whose date key, dates and columns all pushed chunks share
+            * @param[in] start_time Start of the time frame, in epoch seconds
+            * @param[in] end_time End of the time frame, in epoch seconds, inclusive
+            *
+            * @retval true The stream was started
+            * @retval false The number of points or the time frame is invalid
+            */
+            bool begin(const PointBatch& layout, int64_t start_time, int64_t end_time);
+
+            /**
+            * Add the points of a chunk.  Points must arrive in time order across all chunks.
+            */
+            void push(const PointBatch& points);
+
+            /**
+            * Add a run of points by their sums alone, in AVERAGE mode, e.g. from the summary
+            * of a stored chunk.  Like pushed points, the run must be in time order with the
+            * points added before and after it.
+            *
+            * @param[in] start_time Time of the first point of the run
+            * @param[in] end_time Time of the last point of the run
+            * @param[in] num_of_points Number of points of the run
+            * @param[in] sums Sum of every layout column over the run, ignored for TEXT columns
+            *
+            * @retval true The run was added
+            * @retval false Nothing was added: the mode is not AVERAGE, the layout has TEXT columns,
+            *               whose last values are not known, or the run spans buckets
+            */
+            bool pushSummary(int64_t start_time, int64_t end_time, size_t num_of_points, const std::vector<double>& sums);
+
+            Mode mode() const { return mode_; }
+
+            /**
+            * Close the last bucket and hand all remaining output points to the sink.
+            */
+            void finish();
+
+            /**
+            * Helper function to get a mode given its equivalent string, "AVERAGE", "M4" or
+            * "TIME_WEIGHTED".
+            */
+            static Mode getMode(const std::string& mode_string);
+
+        private:
+            /// Number of finished output points collected before they are handed to the sink
+            static const size_t SINK_POINTS_ = 512;
+
+            int64_t bucketOf(int64_t time) const;
+            void accumulateAverage(const PointBatch& points, size_t first_i, size_t end_i);
+            void accumulateTimeWeighted(const PointBatch& points, size_t first_i, size_t end_i, bool continued);
+            void accumulateM4(const PointBatch& points, size_t first_i, size_t end_i);
+            void setSlot(size_t slot, const PointBatch& points, size_t index, double value);
+            void closeBucket();
+
+            Mode mode_;
+            int num_of_points_;
+            Sink sink_;
+
+            int64_t start_time_;
+            int64_t span_;
+            int64_t bucket_;
+            bool has_bucket_;
+            int64_t sequence_;
+            std::vector<size_t> numeric_columns_;
+            PointBatch out_;
+
+            /// AVERAGE accumulators of the current bucket: one point holding the last values
+            PointBatch last_point_;
+            std::vector<double> sums_;
+            std::vector<size_t> counts_;
+
+            /// TIME_WEIGHTED accumulators, besides those of AVERAGE: the time of the first point
+            /// and the sums of every value times the time until the next point
+            int64_t first_time_;
+            std::vector<double> weighted_sums_;
+            std::vector<double> terms_;
+
+            /// M4 candidates of the current bucket: first, last, then min and max per column
+            PointBatch slots_;
+            std::vector<int64_t> slot_sequences_;
+            std::vector<double> slot_values_;
+            std::vector<bool> slot_set_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_STREAMINGDOWNSAMPLER_H
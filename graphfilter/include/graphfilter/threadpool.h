@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_THREADPOOL_H
+#define GRAPHFILTER_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class ThreadPool
+     * @brief Fixed number of worker threads running tasks in submission order
+     *
+     * Tasks must not wait on other tasks of the same pool, as every worker might be waiting.
+     */
+    class ThreadPool {
+        public:
+            /**
+            * Start the worker threads.
+            *
+            * @param[in] num_threads Number of worker threads, at least one is always started
+            */
+            explicit ThreadPool(size_t num_threads);
+
+            /**
+            * Run all tasks still queued, then stop and join the worker threads.
+            */
+            ~ThreadPool();
+
+            /**
+            * Queue a task to run on one of the worker threads.
+            *
+            * @return A future for the result of the task.  Exceptions thrown by the task are
+            *         rethrown by future::get().
+            */
+            template<typename Task>
+            std::future<typename std::result_of<Task()>::type> submit(Task task){
+                typedef typename std::result_of<Task()>::type Result;
+                std::shared_ptr<std::packaged_task<Result()>> packaged(new std::packaged_task<Result()>(task));
+                std::future<Result> result = packaged->get_future();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    tasks_.push_back([packaged]() { (*packaged)(); });
+                }
+                condition_.notify_one();
+                return result;
+            }
+
+            size_t size() const { return workers_.size(); }
+
+        private:
+            ThreadPool(const ThreadPool&);
+            ThreadPool& operator=(const ThreadPool&);
+
+            void run();
+
+            std::vector<std::thread> workers_;
+            std::deque<std::function<void()>> tasks_;
+            std::mutex mutex_;
+            std::condition_variable condition_;
+            bool stopping_;
+    };
+
+}}
+
+#endif //GRAPHFILTER_THREADPOOL_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifndef GRAPHFILTER_TIMESTRING_H
+#define GRAPHFILTER_TIMESTRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace intel { namespace poc {
+
+    /**
+     * @class TimeString
+     * @brief Conversion between date strings and UTC epoch seconds
+     *
+     * All dates handled by the library use the fixed format "YYYY-MM-DD HH:MMZ".  TimeString
+     * parses and formats that format by hand: no allocation, no strptime, and no mktime
+     * time zone lookup.  Dates are always interpreted as UTC, as the trailing "Z" says.
+     */
+    class TimeString {
+        public:
+            /// Length of a date string, e.g. "2015-03-03 00:00Z"
+            static const size_t LENGTH = 17;
+
+            /**
+            * Convert a date string of the format "YYYY-MM-DD HH:MMZ" into UTC epoch seconds.
+            *
+            * @param[in] str The date string, which does not need to be null terminated
+            * @param[in] len The length of str
+            *
+            * @return The epoch seconds, or -1 if the string is not a valid date.  Since every
+            *         valid date is a whole minute, -1 is never a valid result.
+            */
+            static int64_t toEpochSeconds(const char* str, size_t len);
+
+            static int64_t toEpochSeconds(const std::string& str) {
+                return toEpochSeconds(str.data(), str.size());
+            }
+
+            /**
+            * Write UTC epoch seconds as "YYYY-MM-DD HH:MMZ" into buffer. Seconds are truncated.
+            *
+            * @param[in] epoch_seconds The time to format
+            * @param[out] buffer At least LENGTH + 1 characters; the result is null terminated
+            */
+            static void format(int64_t epoch_seconds, char* buffer);
+
+            static std::string fromEpochSeconds(int64_t epoch_seconds) {
+                char buffer[LENGTH + 1];
+                format(epoch_seconds, buffer);
+                return std::string(buffer, LENGTH);
+            }
+
+            /**
+            * @return The number of whole months between January 1970 and the month of
+            *         epoch_seconds, e.g. 542 for any time in March 2015
+            */
+            static int64_t monthIndex(int64_t epoch_seconds);
+
+            /**
+            * @return The epoch seconds of the first minute of a month given by monthIndex()
+            */
+            static int64_t monthStart(int64_t month_index);
+    };
+
+}}
+
+#endif //GRAPHFILTER_TIMESTRING_H
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "AggregationKernels"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/aggregationkernels.h>
+#include <stdio.h>
+#include <atomic>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GRAPHFILTER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+namespace intel { namespace poc {
+
+    namespace {
+
+        struct KernelTable {
+            AggregationKernels::Isa isa;
+            double (*sum)(const double* values, size_t count);
+            size_t (*count)(const double* values, size_t count);
+            double (*min)(const double* values, size_t count);
+            double (*max)(const double* values, size_t count);
+        };
+
+        const double INF = std::numeric_limits<double>::infinity();
+
+        inline bool isNumber(double value){
+            return value == value;
+        }
+
+        // Sums are accumulated in 8 lanes, lane k holding values[k], values[k + 8], ..., and
+        // combined as ((l0 + l4) + (l1 + l5)) + ((l2 + l6) + (l3 + l7)).  The remaining
+        // count % 8 values are then added in order.  Every implementation follows exactly
+        // this order so that they all produce the same result.
+        inline double combineLanes(const double* lanes){
+            return ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+        }
+
+        double sumScalar(const double* values, size_t count){
+            double lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+            size_t i = 0;
+            for(; i + 8 <= count; i += 8){
+                for(int k = 0; k < 8; ++k){
+                    lanes[k] += isNumber(values[i + k]) ? values[i + k] : 0.0;
+                }
+            }
+            double total = combineLanes(lanes);
+            for(; i < count; ++i){
+                total += isNumber(values[i]) ? values[i] : 0.0;
+            }
+            return total;
+        }
+
+        size_t countScalar(const double* values, size_t count){
+            size_t valid = 0;
+            for(size_t i = 0; i < count; ++i){
+                valid += isNumber(values[i]);
+            }
+            return valid;
+        }
+
+        double minScalar(const double* values, size_t count){
+            double result = INF;
+            for(size_t i = 0; i < count; ++i){
+                result = values[i] < result ? values[i] : result;
+            }
+            return result;
+        }
+
+        double maxScalar(const double* values, size_t count){
+            double result = -INF;
+            for(size_t i = 0; i < count; ++i){
+                result = values[i] > result ? values[i] : result;
+            }
+            return result;
+        }
+
+        const KernelTable SCALAR_KERNELS = { AggregationKernels::Isa::SCALAR, sumScalar, countScalar, minScalar, maxScalar };
+
+#ifdef GRAPHFILTER_X86_KERNELS
+
+        /// SSE4.2 kernels, two lanes per register
+
+        __attribute__((target("sse4.2")))
+        double sumSse42(const double* values, size_t count){
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            __m128d acc2 = _mm_setzero_pd();
+            __m128d acc3 = _mm_setzero_pd();
+            size_t i = 0;
+            for(; i + 8 <= count; i += 8){
+                __m128d x0 = _mm_loadu_pd(values + i);
+                __m128d x1 = _mm_loadu_pd(values + i + 2);
+                __m128d x2 = _mm_loadu_pd(values + i + 4);
+                __m128d x3 = _mm_loadu_pd(values + i + 6);
+                acc0 = _mm_add_pd(acc0, _mm_and_pd(x0, _mm_cmpord_pd(x0, x0)));
+                acc1 = _mm_add_pd(acc1, _mm_and_pd(x1, _mm_cmpord_pd(x1, x1)));
+                acc2 = _mm_add_pd(acc2, _mm_and_pd(x2, _mm_cmpord_pd(x2, x2)));
+                acc3 = _mm_add_pd(acc3, _mm_and_pd(x3, _mm_cmpord_pd(x3, x3)));
+            }
+            double lanes[8];
+            _mm_storeu_pd(lanes, acc0);
+            _mm_storeu_pd(lanes + 2, acc1);
+            _mm_storeu_pd(lanes + 4, acc2);
+            _mm_storeu_pd(lanes + 6, acc3);
+            double total = combineLanes(lanes);
+            for(; i < count; ++i){
+                total += isNumber(values[i]) ? values[i] : 0.0;
+            }
+            return total;
+        }
+
+        __attribute__((target("sse4.2,popcnt")))
+        size_t countSse42(const double* values, size_t count){
+            size_t valid = 0;
+            size_t i = 0;
+            for(; i + 2 <= count; i += 2){
+                __m128d x = _mm_loadu_pd(values + i);
+                valid += __builtin_popcount(_mm_movemask_pd(_mm_cmpord_pd(x, x)));
+            }
+            return valid + countScalar(values + i, count - i);
+        }
+
+        __attribute__((target("sse4.2")))
+        double minSse42(const double* values, size_t count){
+            const __m128d inf = _mm_set1_pd(INF);
+            __m128d acc0 = inf;
+            __m128d acc1 = inf;
+            size_t i = 0;
+            for(; i + 4 <= count; i += 4){
+                __m128d x0 = _mm_loadu_pd(values + i);
+                __m128d x1 = _mm_loadu_pd(values + i + 2);
+                acc0 = _mm_min_pd(acc0, _mm_blendv_pd(inf, x0, _mm_cmpord_pd(x0, x0)));
+                acc1 = _mm_min_pd(acc1, _mm_blendv_pd(inf, x1, _mm_cmpord_pd(x1, x1)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_min_pd(acc0, acc1));
+            double result = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+            double tail = minScalar(values + i, count - i);
+            return tail < result ? tail : result;
+        }
+
+        __attribute__((target("sse4.2")))
+        double maxSse42(const double* values, size_t count){
+            const __m128d inf = _mm_set1_pd(-INF);
+            __m128d acc0 = inf;
+            __m128d acc1 = inf;
+            size_t i = 0;
+            for(; i + 4 <= count; i += 4){
+                __m128d x0 = _mm_loadu_pd(values + i);
+                __m128d x1 = _mm_loadu_pd(values + i + 2);
+                acc0 = _mm_max_pd(acc0, _mm_blendv_pd(inf, x0, _mm_cmpord_pd(x0, x0)));
+                acc1 = _mm_max_pd(acc1, _mm_blendv_pd(inf, x1, _mm_cmpord_pd(x1, x1)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_max_pd(acc0, acc1));
+            double result = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+            double tail = maxScalar(values + i, count - i);
+            return tail > result ? tail : result;
+        }
+
+        const KernelTable SSE42_KERNELS = { AggregationKernels::Isa::SSE42, sumSse42, countSse42, minSse42, maxSse42 };
+
+        /// AVX2 kernels, four lanes per register
+
+        __attribute__((target("avx2")))
+        double sumAvx2(const double* values, size_t count){
+            __m256d acc0 = _mm256_setzero_pd();
+            __m256d acc1 = _mm256_setzero_pd();
+            size_t i = 0;
+            for(; i + 8 <= count; i += 8){
+                __m256d x0 = _mm256_loadu_pd(values + i);
+                __m256d x1 = _mm256_loadu_pd(values + i + 4);
+                acc0 = _mm256_add_pd(acc0, _mm256_and_pd(x0, _mm256_cmp_pd(x0, x0, _CMP_ORD_Q)));
+                acc1 = _mm256_add_pd(acc1, _mm256_and_pd(x1, _mm256_cmp_pd(x1, x1, _CMP_ORD_Q)));
+            }
+            double lanes[8];
+            _mm256_storeu_pd(lanes, acc0);
+            _mm256_storeu_pd(lanes + 4, acc1);
+            double total = combineLanes(lanes);
+            for(; i < count; ++i){
+                total += isNumber(values[i]) ? values[i] : 0.0;
+            }
+            return total;
+        }
+
+        __attribute__((target("avx2,popcnt")))
+        size_t countAvx2(const double* values, size_t count){
+            size_t valid = 0;
+            size_t i = 0;
+            for(; i + 4 <= count; i += 4){
+                __m256d x = _mm256_loadu_pd(values + i);
+                valid += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(x, x, _CMP_ORD_Q)));
+            }
+            return valid + countScalar(values + i, count - i);
+        }
+
+        __attribute__((target("avx2")))
+        double minAvx2(const double* values, size_t count){
+            const __m256d inf = _mm256_set1_pd(INF);
+            __m256d acc0 = inf;
+            __m256d acc1 = inf;
+            size_t i = 0;
+            for(; i + 8 <= count; i += 8){
+                __m256d x0 = _mm256_loadu_pd(values + i);
+                __m256d x1 = _mm256_loadu_pd(values + i + 4);
+                acc0 = _mm256_min_pd(acc0, _mm256_blendv_pd(inf, x0, _mm256_cmp_pd(x0, x0, _CMP_ORD_Q)));
+                acc1 = _mm256_min_pd(acc1, _mm256_blendv_pd(inf, x1, _mm256_cmp_pd(x1, x1, _CMP_ORD_Q)));
+            }
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_min_pd(acc0, acc1));
+            double result = minScalar(lanes, 4);
+            double tail = minScalar(values + i, count - i);
+            return tail < result ? tail : result;
+        }
+
+        __attribute__((target("avx2")))
+        double maxAvx2(const double* values, size_t count){
+            const __m256d inf = _mm256_set1_pd(-INF);
+            __m256d acc0 = inf;
+            __m256d acc1 = inf;
+            size_t i = 0;
+            for(; i + 8 <= count; i += 8){
+                __m256d x0 = _mm256_loadu_pd(values + i);
+                __m256d x1 = _mm256_loadu_pd(values + i + 4);
+                acc0 = _mm256_max_pd(acc0, _mm256_blendv_pd(inf, x0, _mm256_cmp_pd(x0, x0, _CMP_ORD_Q)));
+                acc1 = _mm256_max_pd(acc1, _mm256_blendv_pd(inf, x1, _mm256_cmp_pd(x1, x1, _CMP_ORD_Q)));
+            }
+            double lanes[4];
+            _mm256_storeu_pd(lanes, _mm256_max_pd(acc0, acc1));
+            double result = maxScalar(lanes, 4);
+            double tail = maxScalar(values + i, count - i);
+            return tail > result ? tail : result;
+        }
+
+        const KernelTable AVX2_KERNELS = { AggregationKernels::Isa::AVX2, sumAvx2, countAvx2, minAvx2, maxAvx2 };
+
+#endif
+
+        const KernelTable* kernelsFor(AggregationKernels::Isa isa){
+            switch(isa){
+                case AggregationKernels::Isa::SCALAR:
+                    return &SCALAR_KERNELS;
+#ifdef GRAPHFILTER_X86_KERNELS
+                case AggregationKernels::Isa::SSE42:
+                    __builtin_cpu_init();
+                    return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt") ? &SSE42_KERNELS : NULL;
+                case AggregationKernels::Isa::AVX2:
+                    __builtin_cpu_init();
+                    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ? &AVX2_KERNELS : NULL;
+#endif
+                default:
+                    return NULL;
+            }
+        }
+
+        const KernelTable* detectKernels(){
+            const KernelTable* kernels = kernelsFor(AggregationKernels::Isa::AVX2);
+            if(kernels == NULL){
+                kernels = kernelsFor(AggregationKernels::Isa::SSE42);
+            }
+            if(kernels == NULL){
+                kernels = &SCALAR_KERNELS;
+            }
+            return kernels;
+        }
+
+        std::atomic<const KernelTable*>& kernels(){
+            static std::atomic<const KernelTable*> kernels(detectKernels());
+            return kernels;
+        }
+
+        inline const KernelTable& current(){
+            return *kernels().load(std::memory_order_relaxed);
+        }
+
+        template<typename Result>
+        void reduceBuckets(Result (*kernel)(const double*, size_t), const double* values, const size_t* bounds,
+                           size_t num_buckets, Result* results){
+            for(size_t b = 0; b < num_buckets; ++b){
+                results[b] = kernel(values + bounds[b], bounds[b + 1] - bounds[b]);
+            }
+        }
+
+        template<typename Result>
+        void reduceBuckets(Result (*kernel)(const double*, size_t), const double* values, size_t count,
+                           size_t bucket_size, Result* results){
+            for(size_t first = 0; first < count; first += bucket_size){
+                *results++ = kernel(values + first, bucket_size < count - first ? bucket_size : count - first);
+            }
+        }
+    }
+
+    double AggregationKernels::sum(const double* values, size_t count){
+        return current().sum(values, count);
+    }
+
+    size_t AggregationKernels::count(const double* values, size_t count){
+        return current().count(values, count);
+    }
+
+    double AggregationKernels::min(const double* values, size_t count){
+        return current().min(values, count);
+    }
+
+    double AggregationKernels::max(const double* values, size_t count){
+        return current().max(values, count);
+    }
+
+    // One pass, keeping the first extreme; NaN never compares less or greater, so it is skipped
+    size_t AggregationKernels::argMin(const double* values, size_t count){
+        double min_value = INF;
+        size_t min_i = 0;
+        for(size_t i = 0; i < count; ++i){
+            if(values[i] < min_value){
+                min_value = values[i];
+                min_i = i;
+            }
+        }
+        return min_i;
+    }
+
+    size_t AggregationKernels::argMax(const double* values, size_t count){
+        double max_value = -INF;
+        size_t max_i = 0;
+        for(size_t i = 0; i < count; ++i){
+            if(values[i] > max_value){
+                max_value = values[i];
+                max_i = i;
+            }
+        }
+        return max_i;
+    }
+
+    void AggregationKernels::sumBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results){
+        reduceBuckets(current().sum, values, bounds, num_buckets, results);
+    }
+
+    void AggregationKernels::countBuckets(const double* values, const size_t* bounds, size_t num_buckets, size_t* results){
+        reduceBuckets(current().count, values, bounds, num_buckets, results);
+    }
+
+    void AggregationKernels::minBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results){
+        reduceBuckets(current().min, values, bounds, num_buckets, results);
+    }
+
+    void AggregationKernels::maxBuckets(const double* values, const size_t* bounds, size_t num_buckets, double* results){
+        reduceBuckets(current().max, values, bounds, num_buckets, results);
+    }
+
+    void AggregationKernels::sumBuckets(const double* values, size_t count, size_t bucket_size, double* results){
+        reduceBuckets(current().sum, values, count, bucket_size, results);
+    }
+
+    void AggregationKernels::countBuckets(const double* values, size_t count, size_t bucket_size, size_t* results){
+        reduceBuckets(current().count, values, count, bucket_size, results);
+    }
+
+    void AggregationKernels::minBuckets(const double* values, size_t count, size_t bucket_size, double* results){
+        reduceBuckets(current().min, values, count, bucket_size, results);
+    }
+
+    void AggregationKernels::maxBuckets(const double* values, size_t count, size_t bucket_size, double* results){
+        reduceBuckets(current().max, values, count, bucket_size, results);
+    }
+
+    AggregationKernels::Isa AggregationKernels::isa(){
+        return current().isa;
+    }
+
+    bool AggregationKernels::setIsa(Isa isa){
+        const KernelTable* table = kernelsFor(isa);
+        if(table == NULL){
+            LOGE("Aggregation kernels not supported on this CPU: %d\n", static_cast<int>(isa));
+            return false;
+        }
+        kernels().store(table, std::memory_order_relaxed);
+        return true;
+    }
+
+}}
@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "ChunkCodec"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/chunkcodec.h>
+#include <graphfilter/aggregationkernels.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+namespace intel { namespace poc {
+
+    namespace {
+
+        /// Column type codes of the blob header
+        enum : uint8_t { TYPE_INT = 0, TYPE_REAL = 1, TYPE_TEXT = 2 };
+
+        /// Bytes of each double of a summary: min, max and sum per column
+        const size_t SUMMARY_BYTES = 3 * sizeof(uint64_t);
+
+        uint8_t typeCode(PointBatch::ColumnType type){
+            switch(type){
+                case PointBatch::ColumnType::INT: return TYPE_INT;
+                case PointBatch::ColumnType::REAL: return TYPE_REAL;
+                default: return TYPE_TEXT;
+            }
+        }
+
+        uint64_t zigZag(int64_t value){
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        int64_t unZigZag(uint64_t value){
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        uint64_t doubleBits(double value){
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        double bitsDouble(uint64_t bits){
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        void writeVarint(std::string& out, uint64_t value){
+            while(value >= 0x80){
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        /// Little-endian, whatever the host order, so databases can be moved between devices
+        void writeFixed(std::string& out, uint64_t value){
+            for(int i = 0; i < 8; ++i){
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+            }
+        }
+
+        /**
+        * Bounded reader of the bytes of a blob
+        */
+        class ByteReader {
+            public:
+                ByteReader(const uint8_t* data, size_t size):data_(data), end_(data + size) {}
+
+                bool varint(uint64_t& value){
+                    value = 0;
+                    for(int shift = 0; shift < 64; shift += 7){
+                        if(data_ == end_){
+                            return false;
+                        }
+                        uint8_t byte = *data_++;
+                        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                        if((byte & 0x80) == 0){
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                bool fixed(uint64_t& value){
+                    if(remaining() < 8){
+                        return false;
+                    }
+                    value = 0;
+                    for(int i = 0; i < 8; ++i){
+                        value |= static_cast<uint64_t>(*data_++) << (8 * i);
+                    }
+                    return true;
+                }
+
+                /// Take the next size bytes, e.g. a section
+                bool bytes(size_t size, const uint8_t*& data){
+                    if(remaining() < size){
+                        return false;
+                    }
+                    data = data_;
+                    data_ += size;
+                    return true;
+                }
+
+                /// Take a section prefixed by its length
+                bool section(ByteReader& section){
+                    uint64_t size;
+                    const uint8_t* data;
+                    if(!varint(size) || size > remaining() || !bytes(static_cast<size_t>(size), data)){
+                        return false;
+                    }
+                    section = ByteReader(data, static_cast<size_t>(size));
+                    return true;
+                }
+
+                size_t remaining() const { return static_cast<size_t>(end_ - data_); }
+
+            private:
+                const uint8_t* data_;
+                const uint8_t* end_;
+        };
+
+        /**
+        * Writes codes of up to 64 bits, most significant bit first
+        */
+        class BitWriter {
+            public:
+                explicit BitWriter(std::string& out):out_(out), byte_(0), used_(0) {}
+
+                void write(uint64_t value, int bits){
+                    while(bits > 0){
+                        int n = bits < 8 - used_ ? bits : 8 - used_;
+                        uint8_t part = static_cast<uint8_t>((value >> (bits - n)) & ((1u << n) - 1));
+                        byte_ |= static_cast<uint8_t>(part << (8 - used_ - n));
+                        used_ += n;
+                        bits -= n;
+                        if(used_ == 8){
+                            out_.push_back(static_cast<char>(byte_));
+                            byte_ = 0;
+                            used_ = 0;
+                        }
+                    }
+                }
+
+                /// Write the last partial byte, padded with zeros
+                void flush(){
+                    if(used_ > 0){
+                        out_.push_back(static_cast<char>(byte_));
+                        byte_ = 0;
+                        used_ = 0;
+                    }
+                }
+
+            private:
+                std::string& out_;
+                uint8_t byte_;
+                int used_;
+        };
+
+        class BitReader {
+            public:
+                explicit BitReader(ByteReader& bytes):used_(0) {
+                    size_ = bytes.remaining();
+                    bytes.bytes(size_, data_);
+                    pos_ = 0;
+                }
+
+                bool read(int bits, uint64_t& value){
+                    value = 0;
+                    while(bits > 0){
+                        if(pos_ >= size_){
+                            return false;
+                        }
+                        int n = bits < 8 - used_ ? bits : 8 - used_;
+                        uint8_t part = static_cast<uint8_t>((data_[pos_] >> (8 - used_ - n)) & ((1u << n) - 1));
+                        value = (value << n) | part;
+                        used_ += n;
+                        bits -= n;
+                        if(used_ == 8){
+                            ++pos_;
+                            used_ = 0;
+                        }
+                    }
+                    return true;
+                }
+
+                bool bit(bool& value){
+                    uint64_t bit;
+                    if(!read(1, bit)){
+                        return false;
+                    }
+                    value = bit != 0;
+                    return true;
+                }
+
+            private:
+                const uint8_t* data_;
+                size_t size_;
+                size_t pos_;
+                int used_;
+        };
+
+        /**
+        * Delta-of-delta buckets: a value in [-bias, bias + 1] is written after the prefix,
+        * offset by bias, in the given number of bits
+        */
+        struct DeltaBucket {
+            int prefix_bits;
+            uint64_t prefix;
+            int bits;
+            int64_t bias;
+        };
+
+        const DeltaBucket DELTA_BUCKETS[] = {
+            { 2, 0x2, 7, 63 },
+            { 3, 0x6, 9, 255 },
+            { 4, 0xe, 12, 2047 },
+        };
+        const size_t NUM_DELTA_BUCKETS = sizeof(DELTA_BUCKETS) / sizeof(DELTA_BUCKETS[0]);
+
+        void encodeTimes(const std::vector<int64_t>& times, std::string& out){
+            BitWriter writer(out);
+            uint64_t previous = 0;
+            uint64_t delta = 0;
+            for(size_t i = 0; i < times.size(); ++i){
+                uint64_t time = static_cast<uint64_t>(times[i]);
+                if(i == 0){
+                    writer.write(time, 64);
+                    previous = time;
+                    continue;
+                }
+                // Unsigned arithmetic wraps instead of overflowing
+                uint64_t next_delta = time - previous;
+                int64_t dod = static_cast<int64_t>(next_delta - delta);
+                delta = next_delta;
+                previous = time;
+
+                if(dod == 0){
+                    writer.write(0, 1);
+                    continue;
+                }
+                size_t b = 0;
+                while(b < NUM_DELTA_BUCKETS && (dod < -DELTA_BUCKETS[b].bias || dod > DELTA_BUCKETS[b].bias + 1)){
+                    ++b;
+                }
+                if(b < NUM_DELTA_BUCKETS){
+                    writer.write(DELTA_BUCKETS[b].prefix, DELTA_BUCKETS[b].prefix_bits);
+                    writer.write(static_cast<uint64_t>(dod + DELTA_BUCKETS[b].bias), DELTA_BUCKETS[b].bits);
+                } else {
+                    writer.write(0xf, 4);
+                    writer.write(static_cast<uint64_t>(dod), 64);
+                }
+            }
+            writer.flush();
+        }
+
+        bool decodeTimes(ByteReader& section, size_t num_points, std::vector<int64_t>& times){
+            BitReader reader(section);
+            uint64_t previous = 0;
+            uint64_t delta = 0;
+            for(size_t i = 0; i < num_points; ++i){
+                if(i == 0){
+                    if(!reader.read(64, previous)){
+                        return false;
+                    }
+                    times.push_back(static_cast<int64_t>(previous));
+                    continue;
+                }
+
+                // Count the leading one bits of the prefix
+                size_t ones = 0;
+                bool bit = true;
+                while(ones < NUM_DELTA_BUCKETS + 1){
+                    if(!reader.bit(bit)){
+                        return false;
+                    }
+                    if(!bit){
+                        break;
+                    }
+                    ++ones;
+                }
+
+                int64_t dod = 0;
+                uint64_t value;
+                if(ones == 0){
+                    dod = 0;
+                } else if(ones <= NUM_DELTA_BUCKETS){
+                    const DeltaBucket& bucket = DELTA_BUCKETS[ones - 1];
+                    if(!reader.read(bucket.bits, value)){
+                        return false;
+                    }
+                    dod = static_cast<int64_t>(value) - bucket.bias;
+                } else {
+                    if(!reader.read(64, value)){
+                        return false;
+                    }
+                    dod = static_cast<int64_t>(value);
+                }
+                delta += static_cast<uint64_t>(dod);
+                previous += delta;
+                times.push_back(static_cast<int64_t>(previous));
+            }
+            return true;
+        }
+
+        void encodeReals(const std::vector<double>& values, std::string& out){
+            BitWriter writer(out);
+            uint64_t previous = 0;
+            int leading = -1;
+            int trailing = 0;
+            for(size_t i = 0; i < values.size(); ++i){
+                uint64_t bits = doubleBits(values[i]);
+                if(i == 0){
+                    writer.write(bits, 64);
+                    previous = bits;
+                    continue;
+                }
+                uint64_t x = bits ^ previous;
+                previous = bits;
+                if(x == 0){
+                    writer.write(0, 1);
+                    continue;
+                }
+
+                int next_leading = __builtin_clzll(x);
+                int next_trailing = __builtin_ctzll(x);
+                if(leading >= 0 && next_leading >= leading && next_trailing >= trailing){
+                    // The meaningful bits fit in the window of the previous value
+                    writer.write(0x2, 2);
+                    writer.write(x >> trailing, 64 - leading - trailing);
+                } else {
+                    leading = next_leading;
+                    trailing = next_trailing;
+                    int meaningful = 64 - leading - trailing;
+                    writer.write(0x3, 2);
+                    writer.write(static_cast<uint64_t>(leading), 6);
+                    writer.write(static_cast<uint64_t>(meaningful - 1), 6);
+                    writer.write(x >> trailing, meaningful);
+                }
+            }
+            writer.flush();
+        }
+
+        bool decodeReals(ByteReader& section, size_t num_points, std::vector<double>& values){
+            BitReader reader(section);
+            uint64_t previous = 0;
+            int leading = -1;
+            int trailing = 0;
+            for(size_t i = 0; i < num_points; ++i){
+                if(i == 0){
+                    if(!reader.read(64, previous)){
+                        return false;
+                    }
+                    values.push_back(bitsDouble(previous));
+                    continue;
+                }
+
+                bool bit;
+                if(!reader.bit(bit)){
+                    return false;
+                }
+                if(bit){
+                    if(!reader.bit(bit)){
+                        return false;
+                    }
+                    uint64_t value;
+                    if(bit){
+                        uint64_t meaningful;
+                        if(!reader.read(6, value) || !reader.read(6, meaningful)){
+                            return false;
+                        }
+                        leading = static_cast<int>(value);
+                        trailing = 64 - leading - static_cast<int>(meaningful + 1);
+                        if(trailing < 0){
+                            return false;
+                        }
+                    } else if(leading < 0){
+                        return false;
+                    }
+                    if(!reader.read(64 - leading - trailing, value)){
+                        return false;
+                    }
+                    previous ^= value << trailing;
+                }
+                values.push_back(bitsDouble(previous));
+            }
+            return true;
+        }
+
+        void encodeInts(const std::vector<double>& values, std::string& out){
+            int64_t previous = 0;
+            for(size_t i = 0; i < values.size(); ++i){
+                int64_t value = static_cast<int64_t>(values[i]);
+                writeVarint(out, zigZag(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous))));
+                previous = value;
+            }
+        }
+
+        bool decodeInts(ByteReader& section, size_t num_points, std::vector<double>& values){
+            uint64_t previous = 0;
+            for(size_t i = 0; i < num_points; ++i){
+                uint64_t delta;
+                if(!section.varint(delta)){
+                    return false;
+                }
+                previous += static_cast<uint64_t>(unZigZag(delta));
+                values.push_back(static_cast<double>(static_cast<int64_t>(previous)));
+            }
+            return true;
+        }
+
+        void encodeText(const std::vector<std::string>& text, std::string& out){
+            for(size_t i = 0; i < text.size(); ++i){
+                writeVarint(out, text[i].size());
+                out += text[i];
+            }
+        }
+
+        bool decodeText(ByteReader& section, size_t num_points, std::vector<std::string>& text){
+            for(size_t i = 0; i < num_points; ++i){
+                uint64_t size;
+                const uint8_t* data;
+                if(!section.varint(size) || size > section.remaining() || !section.bytes(static_cast<size_t>(size), data)){
+                    return false;
+                }
+                text.push_back(std::string(reinterpret_cast<const char*>(data), static_cast<size_t>(size)));
+            }
+            return true;
+        }
+
+        /// Append a section prefixed by its length
+        void appendSection(std::string& blob, const std::string& section){
+            writeVarint(blob, section.size());
+            blob += section;
+        }
+
+    }
+
+    void ChunkCodec::encode(const PointBatch& points, std::string& blob){
+        blob.clear();
+        writeVarint(blob, points.size());
+        writeVarint(blob, points.numColumns());
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            blob.push_back(static_cast<char>(typeCode(points.column(c).type)));
+        }
+
+        std::string section;
+        encodeTimes(points.times(), section);
+        appendSection(blob, section);
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            const PointBatch::Column& column = points.column(c);
+            section.clear();
+            switch(column.type){
+                case PointBatch::ColumnType::INT:
+                    encodeInts(column.values, section);
+                    break;
+                case PointBatch::ColumnType::REAL:
+                    encodeReals(column.values, section);
+                    break;
+                case PointBatch::ColumnType::TEXT:
+                    encodeText(column.text, section);
+                    break;
+            }
+            appendSection(blob, section);
+        }
+    }
+
+    bool ChunkCodec::decode(const void* blob, size_t size, PointBatch& points){
+        ByteReader reader(static_cast<const uint8_t*>(blob), size);
+        uint64_t num_points;
+        uint64_t num_columns;
+        const uint8_t* types;
+        if(blob == NULL || !reader.varint(num_points) || !reader.varint(num_columns) ||
+           num_columns != points.numColumns() || !reader.bytes(points.numColumns(), types)){
+            LOGE("Invalid chunk header\n");
+            return false;
+        }
+        // Every point takes at least one bit of the times section
+        if(num_points > static_cast<uint64_t>(size) * 8){
+            LOGE("Invalid chunk size\n");
+            return false;
+        }
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            if(types[c] != typeCode(points.column(c).type)){
+                LOGE("Chunk column %s has another type\n", points.column(c).name.c_str());
+                return false;
+            }
+        }
+
+        size_t count = static_cast<size_t>(num_points);
+        points.reserve(points.size() + count);
+        ByteReader section(NULL, 0);
+        if(!reader.section(section) || !decodeTimes(section, count, points.times())){
+            LOGE("Invalid chunk times\n");
+            return false;
+        }
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            PointBatch::Column& column = points.column(c);
+            bool decoded = reader.section(section);
+            switch(column.type){
+                case PointBatch::ColumnType::INT:
+                    decoded = decoded && decodeInts(section, count, column.values);
+                    break;
+                case PointBatch::ColumnType::REAL:
+                    decoded = decoded && decodeReals(section, count, column.values);
+                    break;
+                case PointBatch::ColumnType::TEXT:
+                    decoded = decoded && decodeText(section, count, column.text);
+                    break;
+            }
+            if(!decoded){
+                LOGE("Invalid chunk column %s\n", column.name.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ChunkCodec::summarize(const PointBatch& points, std::string& blob){
+        blob.clear();
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            const PointBatch::Column& column = points.column(c);
+            double min = 0;
+            double max = 0;
+            double sum = 0;
+            if(column.type != PointBatch::ColumnType::TEXT && !column.values.empty()){
+                min = AggregationKernels::min(&column.values[0], column.values.size());
+                max = AggregationKernels::max(&column.values[0], column.values.size());
+                sum = AggregationKernels::sum(&column.values[0], column.values.size());
+            }
+            writeFixed(blob, doubleBits(min));
+            writeFixed(blob, doubleBits(max));
+            writeFixed(blob, doubleBits(sum));
+        }
+    }
+
+    bool ChunkCodec::decodeSummary(const void* blob, size_t size, size_t num_columns, Summary& summary){
+        if(blob == NULL || size != num_columns * SUMMARY_BYTES){
+            return false;
+        }
+        summary.min.resize(num_columns);
+        summary.max.resize(num_columns);
+        summary.sum.resize(num_columns);
+        ByteReader reader(static_cast<const uint8_t*>(blob), size);
+        for(size_t c = 0; c < num_columns; ++c){
+            uint64_t min = 0, max = 0, sum = 0;
+            if(!reader.fixed(min) || !reader.fixed(max) || !reader.fixed(sum)){
+                return false;
+            }
+            summary.min[c] = bitsDouble(min);
+            summary.max[c] = bitsDouble(max);
+            summary.sum[c] = bitsDouble(sum);
+        }
+        return true;
+    }
+
+}}
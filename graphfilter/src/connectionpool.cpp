@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "ConnectionPool"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/connectionpool.h>
+
+
+namespace intel { namespace poc {
+
+    ConnectionPool::ConnectionPool()
+        :flags_(0), setup_(NULL), max_connections_(0), num_connections_(0), generation_(0) {}
+
+    ConnectionPool::~ConnectionPool(){
+        close();
+    }
+
+    void ConnectionPool::open(const std::string& path, int flags, const std::string& setup_sql, size_t max_connections,
+                              Setup setup){
+        close();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        flags_ = flags;
+        setup_sql_ = setup_sql;
+        setup_ = setup;
+        max_connections_ = max_connections;
+    }
+
+    void ConnectionPool::close(){
+        std::vector<Connection*> idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+            idle.swap(idle_);
+            purged_.clear();
+            num_connections_ = 0;
+            max_connections_ = 0;
+        }
+        available_.notify_all();
+
+        for(std::vector<Connection*>::iterator it = idle.begin(); it != idle.end(); ++it){
+            closeConnection(*it);
+        }
+    }
+
+    ConnectionPool::Connection* ConnectionPool::acquire(){
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(true){
+            if(max_connections_ == 0){
+                return NULL;
+            }
+            if(!idle_.empty()){
+                Connection* connection = idle_.back();
+                idle_.pop_back();
+                return connection;
+            }
+            if(num_connections_ < max_connections_){
+                break;
+            }
+            available_.wait(lock);
+        }
+
+        // Open a new connection without holding up the other callers
+        ++num_connections_;
+        unsigned int generation = generation_;
+        lock.unlock();
+        Connection* connection = openConnection();
+        if(connection == NULL){
+            lock.lock();
+            if(generation == generation_){
+                --num_connections_;
+            }
+            lock.unlock();
+            available_.notify_one();
+            return NULL;
+        }
+        connection->generation = generation;
+        return connection;
+    }
+
+    void ConnectionPool::release(Connection* connection){
+        if(connection == NULL){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(connection->generation == generation_){
+                for(std::vector<std::string>::iterator it = purged_.begin(); it != purged_.end(); ++it){
+                    connection->statements.purge(*it);
+                }
+                idle_.push_back(connection);
+                if(idle_.size() == num_connections_){
+                    purged_.clear();
+                }
+                connection = NULL;
+            }
+        }
+        if(connection != NULL){
+            // Leased before the pool was closed or reopened
+            closeConnection(connection);
+            return;
+        }
+        available_.notify_one();
+    }
+
+    void ConnectionPool::purge(const std::string& table){
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(std::vector<Connection*>::iterator it = idle_.begin(); it != idle_.end(); ++it){
+            (*it)->statements.purge(table);
+        }
+        if(idle_.size() < num_connections_){
+            purged_.push_back(table);
+        }
+    }
+
+    /// private API
+
+    ConnectionPool::Connection* ConnectionPool::openConnection(){
+        std::string path;
+        int flags;
+        std::string setup_sql;
+        Setup setup;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            path = path_;
+            flags = flags_;
+            setup_sql = setup_sql_;
+            setup = setup_;
+        }
+
+        sqlite3* database = NULL;
+        if(sqlite3_open_v2(path.c_str(), &database, flags, NULL) != SQLITE_OK){
+            LOGE("Cannot open pooled connection to %s: %s\n", path.c_str(), sqlite3_errmsg(database));
+            sqlite3_close(database);
+            return NULL;
+        }
+        sqlite3_busy_timeout(database, BUSY_TIMEOUT_MS);
+
+        if(!setup_sql.empty()){
+            char* err = 0;
+            if(sqlite3_exec(database, setup_sql.c_str(), NULL, NULL, &err) != SQLITE_OK){
+                LOGE("Cannot set up pooled connection to %s: %s\n", path.c_str(), err ? err : "");
+                sqlite3_free(err);
+                sqlite3_close(database);
+                return NULL;
+            }
+        }
+
+        if(setup != NULL && !setup(database)){
+            LOGE("Cannot set up pooled connection to %s\n", path.c_str());
+            sqlite3_close(database);
+            return NULL;
+        }
+
+        Connection* connection = new Connection();
+        connection->database = database;
+        connection->statements.setDatabase(database);
+        return connection;
+    }
+
+    void ConnectionPool::closeConnection(Connection* connection){
+        connection->statements.setDatabase(NULL);
+        sqlite3_close(connection->database);
+        delete connection;
+    }
+
+}}
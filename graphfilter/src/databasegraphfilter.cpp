@@ -9,6 +9,7 @@
 
 #include <graphfilter/databasegraphfilter.h>
 #include <graphfilter/sqlitedatacache.h>
+#include <graphfilter/nativedatacache.h>
 #include <graphfilter/sqlitedatabaseaccess.h>
 #include <algorithm>
 #include <stdexcept>
@@ -32,7 +33,7 @@ namespace intel {
     namespace poc {
 
         DatabaseGraphFilter::DatabaseGraphFilter()
-            : GraphFilter()
+            : GraphFilter(), cache_(&SQLiteDataCache::instance()), requests_(ASYNC_THREADS_, ASYNC_CAPACITY_)
         {
             initialized_ = false;
         }
@@ -52,10 +53,19 @@ namespace intel {
                                        bool clean)
         {
             initialized_ = false;
+            // Payloads queued for the previous database are written to it first
+            ingest_.stop();
+            async_ingest_ = false;
             use_cache_ = false;
+            cache_ = &SQLiteDataCache::instance();
             cache_raw_data_ = false;
             downsampling_filter_ = DataFilter::FilterType::TIME_WEIGHTED_POINTS;
+            use_streaming_ = false;
+            use_database_downsampling_ = false;
+            streaming_mode_ = StreamingDownsampler::Mode::AVERAGE;
 
+            size_t ingest_batch_bytes = INGEST_BATCH_BYTES_;
+            int ingest_delay_ms = INGEST_DELAY_MS_;
             Json::Reader reader;
 
             // Parse cache_setup
@@ -66,6 +76,28 @@ namespace intel {
                 use_cache_ = cache_setup_json.isMember("useCache") ? cache_setup_json["useCache"].asBool() : false;
                 cache_raw_data_ = cache_setup_json.isMember("cacheRawData") ? cache_setup_json["cacheRawData"].asBool() : false;
                 downsampling_filter_ = cache_setup_json.isMember("downsamplingFilter") ? DataFilter::getType(cache_setup_json["downsamplingFilter"].asString()) : DataFilter::FilterType::TIME_WEIGHTED_POINTS;
+                use_streaming_ = cache_setup_json.isMember("streamingDownsampling");
+                use_database_downsampling_ = cache_setup_json.isMember("databaseDownsampling") ? cache_setup_json["databaseDownsampling"].asBool() : false;
+                // The database only averages time buckets, which stands in for the time
+                // weighted filters alone: other filters read the rows and apply the filter
+                if(use_database_downsampling_ && downsampling_filter_ != DataFilter::FilterType::TIME_WEIGHTED_POINTS &&
+                   downsampling_filter_ != DataFilter::FilterType::TIME_WEIGHTED_TIME){
+                    LOGE("databaseDownsampling ignored: it only applies to the TIME_WEIGHTED filters\n");
+                    use_database_downsampling_ = false;
+                }
+                if(use_streaming_){
+                    streaming_mode_ = StreamingDownsampler::getMode(cache_setup_json["streamingDownsampling"].asString());
+                }
+                async_ingest_ = cache_setup_json.isMember("asyncIngest") ? cache_setup_json["asyncIngest"].asBool() : false;
+                ingest_batch_bytes = cache_setup_json.get("ingestBatchBytes", static_cast<Json::UInt64>(INGEST_BATCH_BYTES_)).asUInt64();
+                ingest_delay_ms = cache_setup_json.get("ingestDelayMs", INGEST_DELAY_MS_).asInt();
+                std::string cache_engine = cache_setup_json.get("cacheEngine", "sqlite").asString();
+                if(cache_engine == "native"){
+                    cache_ = &NativeDataCache::instance();
+                } else if(cache_engine != "sqlite"){
+                    LOGE("Unknown cacheEngine: %s\n", cache_engine.c_str());
+                    return false;
+                }
             } else {
                 LOGE("Cannot parse cache setup param: %s\n", cache_setup.c_str());
                 return false;
@@ -76,41 +108,37 @@ namespace intel {
             }
 
 
-            // Parse data_schema
+            // Parse data_schema once; every layer shares the compiled schema
             Json::Value data_schema_json;
-            if (reader.parse(data_schema, data_schema_json)) {
-                if(!data_schema_json.isMember("table") || !data_schema_json.isMember("date_key_column") || !data_schema_json.isMember("columns")){
-                    LOGE("Malformed data schema value: %s\n", data_schema.c_str());
-                    return false;
-                } else {
-                    std::vector<std::string> data_names = data_schema_json["columns"].getMemberNames();
-                    if(std::find(data_names.begin(),data_names.end(),data_schema_json["date_key_column"].asString()) == data_names.end()){
-                        LOGE("Date key column not found in column list\n");
-                        return false;
-                    }
-                    for(std::vector<std::string>::iterator it = data_names.begin(); it != data_names.end(); ++it){
-                        data_schema_[*it] = data_schema_json["columns"][*it].asString();
-                    }
-                }
-            } else {
+            if (!reader.parse(data_schema, data_schema_json)) {
                 LOGE("Cannot parse data schema param: %s\n", data_schema.c_str());
                 return false;
             }
+            if (!schema_.parse(data_schema_json)) {
+                return false;
+            }
 
             // Initialize the cache, database, and data filter
-            if(use_cache_ && !SQLiteDataCache::instance().init(cache_setup_json, data_schema_json, true)){
+            if(use_cache_ && !cache_->init(cache_setup_json, schema_, true)){
                 LOGE("Cannot initialize cache\n");
                 return false;
             }
-            if(!SQLiteDatabaseAccess::instance().init(database_path, data_schema_json, clean)){
+            if(!SQLiteDatabaseAccess::instance().init(database_path, schema_, clean)){
                 LOGD("Cannot initalize database\n");
                 return false;
             }
-            if(!DataFilter::init(data_schema_json["date_key_column"].asString())){
+            if(!DataFilter::init(schema_.dateKeyColumn())){
                 LOGD("Cannot initalize data filter\n");
                 return false;
             }
 
+            if(async_ingest_){
+                LOGD("Adding data asynchronously\n");
+                ingest_.start(ingest_batch_bytes, ingest_delay_ms, [](std::vector<std::string>& payloads) {
+                    return SQLiteDatabaseAccess::instance().putJsonData(payloads);
+                });
+            }
+
             initialized_ = true;
 
             return true;
@@ -123,14 +151,29 @@ namespace intel {
                 return false;
             }
 
-            Json::Reader reader;
-            Json::Value data_values_json;
-            if(!reader.parse(data_values, data_values_json)) {
-                LOGE("Unable to parse json data: %s\n", data_values.c_str());
+            // Queued payloads are parsed by the writer thread, so only their copy is made here
+            if(async_ingest_){
+                ingest_.push(data_values);
+                return true;
+            }
+
+            // Parsed as it is inserted, without building a Json::Value of the whole payload
+            return SQLiteDatabaseAccess::instance().putJsonData(data_values);
+        }
+
+        bool DatabaseGraphFilter::addData(const ColumnBatch& data_values)
+        {
+            if(!initialized_) {
+                LOGE("Error: Database not initialized\n");
                 return false;
             }
 
-            return SQLiteDatabaseAccess::instance().putData(data_values_json);
+            // The arrays belong to the caller, so they are added at once, after the points
+            // queued before them
+            if(async_ingest_){
+                ingest_.flush();
+            }
+            return SQLiteDatabaseAccess::instance().putColumns(data_values);
         }
 
         std::string DatabaseGraphFilter::getData(const std::string& params)
@@ -163,7 +206,7 @@ namespace intel {
 
             if(use_cache_){
                 try{
-                    SQLiteDataCache::instance().cacheData(start_date, end_date);
+                    cache_->cacheData(start_date, end_date);
                 } catch (std::exception& ex) {
                     LOGE("Failed caching data: %s\n", ex.what());
                 }
@@ -178,33 +221,82 @@ namespace intel {
             }
 
 
-            // Check the cache and parse its results
-            Json::Value json_response = use_cache_ ? SQLiteDataCache::instance().getData(params_json) : Json::Value(Json::objectValue);
-            std::string cache_start_date = json_response.get("startDate", "").asString();
-            std::string cache_end_date = json_response.get("endDate", "").asString();
+            // Check the cache and fill the batch from its results
+            PointBatch data;
+            bool cache_hit = use_cache_ && cache_->getData(params_json, data);
 
-            // If needed, pull data from database and parse its results
-            if(cache_start_date != start_date || cache_end_date != end_date) {
-                json_response = SQLiteDatabaseAccess::instance().getData(params_json);
-            } else if(!cache_raw_data_ && json_response.isMember("points") && json_response["points"].isArray()){
-                // If we're not caching raw data and the cache returns a valid response, we're done.    If
-                // we ARE caching raw data, we might still need to downsample.
-                return fastWriter.write(json_response);
+            // If downsampling in the database, only the averaged buckets are read
+            if(!cache_hit && use_database_downsampling_) {
+                if(!SQLiteDatabaseAccess::instance().getAggregatedData(params_json, data)){
+                    LOGD("Database query failed. Returning empty response.\n");
+                    return fastWriter.write(empty_response);
+                }
+                return fastWriter.write(data.toJson());
             }
 
-            if(!json_response.isMember("points") || !json_response["points"].isArray()){
-                LOGD("Database and/or cache response missing points array. Returning empty response.\n");
-                return fastWriter.write(empty_response);
+            // If streaming, downsample the database rows while they are read
+            if(!cache_hit && use_streaming_) {
+                PointBatch downsampled;
+                StreamingDownsampler downsampler(streaming_mode_, num_of_points, [&downsampled](const PointBatch& points) {
+                    if(downsampled.dateKey().empty()){
+                        downsampled.copyLayout(points);
+                    }
+                    downsampled.append(points);
+                });
+                if(!SQLiteDatabaseAccess::instance().getData(params_json, downsampler)){
+                    LOGD("Database query failed. Returning empty response.\n");
+                    return fastWriter.write(empty_response);
+                }
+                downsampled.setDates(start_date, end_date);
+                return fastWriter.write(downsampled.toJson());
+            }
+
+            // If needed, pull data from database
+            if(!cache_hit) {
+                if(!SQLiteDatabaseAccess::instance().getData(params_json, data)){
+                    LOGD("Database and/or cache query failed. Returning empty response.\n");
+                    return fastWriter.write(empty_response);
+                }
+            } else if(!cache_raw_data_){
+                // If we're not caching raw data and the cache returns a valid response, we're done.    If
+                // we ARE caching raw data, we might still need to downsample.
+                return fastWriter.write(data.toJson());
             }
 
             // Downsample data if needed.
-            if(json_response["points"].size() > num_of_points) {
+            if(static_cast<int>(data.size()) > num_of_points) {
                 LOGD("Downsample data to total %d points of data\n", num_of_points);
-                json_response = DataFilter::applyFilter(json_response, data_schema_, num_of_points, downsampling_filter_);
+                PointBatch downsampled;
+                DataFilter::applyFilter(data, downsampled, num_of_points, downsampling_filter_);
+                return fastWriter.write(downsampled.toJson());
             }
 
+            return fastWriter.write(data.toJson());
+        }
 
-            return fastWriter.write(json_response);
+        uint64_t DatabaseGraphFilter::getDataAsync(const std::string& params, const std::string& group, const Callback& callback)
+        {
+            return requests_.submit(group, [this, params]() { return getData(params); }, callback);
+        }
+
+        bool DatabaseGraphFilter::cancel(uint64_t request_id)
+        {
+            return requests_.cancel(request_id);
+        }
+
+        bool DatabaseGraphFilter::flush()
+        {
+            return async_ingest_ ? ingest_.flush() : true;
+        }
+
+        size_t DatabaseGraphFilter::pendingWrites() const
+        {
+            return ingest_.depth();
+        }
+
+        size_t DatabaseGraphFilter::cacheBytes() const
+        {
+            return use_cache_ ? cache_->cacheBytes() : 0;
         }
 
     }
@@ -22,9 +22,15 @@
 
 
 #include <graphfilter/datafilter.h>
+#include <graphfilter/timestring.h>
+#include <graphfilter/aggregationkernels.h>
+#include <graphfilter/threadpool.h>
 #include <vector>
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
+#include <stdlib.h>
+#include <functional>
 
 
 namespace intel { namespace poc {
@@ -39,6 +45,10 @@ namespace intel { namespace poc {
             return FilterType::TIME_WEIGHTED_POINTS;
         } else if(filter_string == "TIME_WEIGHTED_TIME"){
             return FilterType::TIME_WEIGHTED_TIME;
+        } else if(filter_string == "LTTB"){
+            return FilterType::LTTB;
+        } else if(filter_string == "M4"){
+            return FilterType::M4;
         } else {
             throw std::runtime_error(std::string("Invalid data downsampling filter: ") + filter_string);
         }
@@ -66,11 +76,22 @@ namespace intel { namespace poc {
             throw std::runtime_error("DataFilter not initialized.");
         }
 
+        Schema schema;
+        if(!schema.parse("", date_key_, data_schema)){
+            throw std::runtime_error("Data schema missing the date key column.");
+        }
+        return applyFilter(data, schema, num_of_points, filter);
+    }
+
+    Json::Value DataFilter::applyFilter(const Json::Value& data,
+                                    const Schema& schema,
+                                    int num_of_points,
+                                    FilterType filter){
 
-        /*LOGD("Schema:\n");
-        for(std::map<std::string,std::string>::const_iterator it = data_schema.begin(); it != data_schema.end(); ++it){
-            LOGD("%s : %s\n", it->first.c_str(),it->second.c_str());
-        }*/
+        if(!initialized_){
+            LOGE("DataFilter not initialized.\n");
+            throw std::runtime_error("DataFilter not initialized.");
+        }
 
         if(!data.isMember("points") || !data["points"].isArray()){
             throw std::runtime_error("Json data missing or malformed \"points\" element.");
@@ -93,19 +114,40 @@ namespace intel { namespace poc {
         downsampled_results["endDate"] = data.get("endDate", "").asString();
         downsampled_results["points"] = Json::Value(Json::arrayValue);
 
+        // Parse every date once up front; the time-weighted filters compare them repeatedly
+        std::vector<int64_t> times;
+        if(filter == FilterType::TIME_WEIGHTED_POINTS || filter == FilterType::TIME_WEIGHTED_TIME){
+            const Json::Value& points = data["points"];
+            times.resize(points.size());
+            for(Json::ArrayIndex i = 0; i < points.size(); ++i){
+                times[i] = TimeString::toEpochSeconds(points[i].get(schema.dateKeyColumn(),"").asString());
+            }
+        }
+
         switch(filter){
             case FilterType::POINTS:
                 LOGD("Using points-based downsampling filter\n");
-                applyFilterPoints(data, downsampled_results["points"], 0, data["points"].size(), data_schema, num_of_points);
+                applyFilterPoints(data, downsampled_results["points"], 0, data["points"].size(), schema, num_of_points);
                 break;
             case FilterType::TIME_WEIGHTED_POINTS:
                 LOGD("Using time-weighted-points-based downsampling filter\n");
-                applyFilterTimeWeighted(data, downsampled_results["points"],0, data["points"].size(), data_schema, num_of_points, FilterType::TIME_WEIGHTED_POINTS);
+                applyFilterTimeWeighted(data, times, downsampled_results["points"],0, data["points"].size(), schema, num_of_points, FilterType::TIME_WEIGHTED_POINTS);
                 break;
             case FilterType::TIME_WEIGHTED_TIME:
                 LOGD("Using time-weighted-time-based downsampling filter\n");
-                applyFilterTimeWeighted(data, downsampled_results["points"],0, data["points"].size(), data_schema, num_of_points, FilterType::TIME_WEIGHTED_TIME);
+                applyFilterTimeWeighted(data, times, downsampled_results["points"],0, data["points"].size(), schema, num_of_points, FilterType::TIME_WEIGHTED_TIME);
                 break;
+            case FilterType::LTTB:
+            case FilterType::M4:
+            {
+                LOGD("Using PointBatch downsampling filter\n");
+                PointBatch batch;
+                PointBatch downsampled;
+                toBatch(data, schema, batch);
+                applyFilter(batch, downsampled, num_of_points, filter);
+                downsampled_results["points"] = downsampled.toJson()["points"];
+                break;
+            }
             default:
                 LOGD("Invalid/uninitialized FilterType value passed: %d", filter);
                 throw std::runtime_error("Invalid/uninitialized FilterType value passed: " + static_cast<int>(filter));
@@ -120,7 +162,7 @@ namespace intel { namespace poc {
                                     Json::Value& out_points,
                                     int start_i,
                                     int end_i,
-                                    const std::map<std::string, std::string>& data_schema,
+                                    const Schema& schema,
                                     int num_of_points){
 
 
@@ -131,40 +173,28 @@ namespace intel { namespace poc {
 
         //LOGD("Averaging points %d through %d\n", start_i, end_i);
         //LOGD("out_points already has %d points\n", out_points.size());
-        int num_fields = points[start_i].size();
+        size_t num_fields = schema.numColumns();
         double avg_data_per_point = static_cast<double>(end_i - start_i) / static_cast<double>(num_of_points);
         //LOGD("avg_data_per_point = %f\n",avg_data_per_point);
-        double averages[num_fields];
+        std::vector<double> averages(num_fields, 0);
 
         int prev_point_index = start_i - 1;
 
-        for (int i = 0; i < num_fields; i++) {
-            averages[i] = 0;
-        }
-
         // loop through every element in the points array
         for (int point_index = start_i; point_index < end_i; point_index++) {
-            Json::Value element = points[point_index];
+            const Json::Value& element = points[point_index];
             //LOGD("Point %d: %s\n",point_index, element.toStyledString().c_str());
-            int mapping_index = 0;
-            std::vector<std::string> data_names = element.getMemberNames();
-            for(std::vector<std::string>::const_iterator i = data_names.begin(); i != data_names.end(); ++i) {
-                std::string element_name = *i;
-                //LOGD("element_name: %s\n", element_name.c_str());
-                std::string element_type = data_schema.find(*i)->second;
-                //LOGD("element_type: %s\n", element_type.c_str());
+            for(size_t id = 0; id < num_fields; ++id) {
+                const Schema::Column& column = schema.column(id);
 
                 // only average numeric number, not strings values like date time
-                if (element_type == "INT" || element_type == "REAL") {
+                if (column.type != PointBatch::ColumnType::TEXT && element.isMember(column.name)) {
                     try {
-                        //LOGD("%s average = %f + %f = ",element_name.c_str(), averages[mapping_index], element[element_name].asDouble());
-                        averages[mapping_index] += element[element_name].asDouble();
-                        //LOGD("%f\n",averages[mapping_index]);
+                        averages[id] += element[column.name].asDouble();
                     } catch (...) {
-                        averages[mapping_index] += 0;
+                        averages[id] += 0;
                     }
                 }
-                mapping_index++;
             }
 
             //if (downsampled_points.size() == num_of_points - 1 && point_index != end_i - 1) {
@@ -177,25 +207,21 @@ namespace intel { namespace poc {
 
 
                 // loop through all value pair and calculate averages
-                mapping_index = 0;
-                std::vector<std::string> data_names = element.getMemberNames();
-                for(std::vector<std::string>::const_iterator i = data_names.begin(); i != data_names.end(); ++i) {
-                    std::string element_name = *i;
-                    std::string element_type = data_schema.find(*i)->second;
-                    //LOGD("element_name: %s, element_type: %s, value = %f / %d", element_name.c_str(), element_type.c_str(), averages[mapping_index], range);
-                    averages[mapping_index] /= range;
-                    //LOGD(" = %f\n", averages[mapping_index]);
-
-                    if (element_type == "INT") {
-                        new_element[element_name] = static_cast<int>(averages[mapping_index]);
-                    } else if (element_type == "REAL") {
-                        new_element[element_name] = averages[mapping_index];
+                for(size_t id = 0; id < num_fields; ++id) {
+                    const Schema::Column& column = schema.column(id);
+                    averages[id] /= range;
+
+                    if (!element.isMember(column.name)) {
+                        // skip columns this point does not have
+                    } else if (column.type == PointBatch::ColumnType::INT) {
+                        new_element[column.name] = static_cast<int>(averages[id]);
+                    } else if (column.type == PointBatch::ColumnType::REAL) {
+                        new_element[column.name] = averages[id];
                     } else {
-                        new_element[element_name] = element.get(element_name, "").asString();
+                        new_element[column.name] = element.get(column.name, "").asString();
                     }
 
-                    averages[mapping_index] = 0;
-                    mapping_index++;
+                    averages[id] = 0;
                 }
                 prev_point_index = point_index;
                 out_points.append(new_element);
@@ -204,46 +230,30 @@ namespace intel { namespace poc {
 
     }
 
-    long timeStringToEpochSeconds(const std::string& time_string){
-        struct tm tm = {};
-        // 2015-03-03 00:00Z
-        // TODO: Expand this to check for and allow other common date formats
-        if (strptime(time_string.c_str(), "%Y-%m-%d %H:%MZ", &tm) == NULL){
-            LOGE("Error converting time_string to time struct: %s\n", time_string.c_str());
-            return -1;
-        }
-        return static_cast<long>(mktime(&tm));
-    }
-
-
     void DataFilter::applyFilterTimeWeighted(const Json::Value& data,
+                                        const std::vector<int64_t>& times,
                                         Json::Value& out_points,
                                         int start_i,
                                         int end_i,
-                                        const std::map<std::string, std::string>& data_schema,
+                                        const Schema& schema,
                                         int num_of_points,
                                         DataFilter::FilterType filter_type){
 
-        const Json::Value& points = data["points"];
-
         if(num_of_points == 0){
             return;
         } else if(num_of_points <= AVG_POINTS_PER_BUCKET_){
-            applyFilterPoints(data, out_points, start_i, end_i, data_schema, num_of_points);
+            applyFilterPoints(data, out_points, start_i, end_i, schema, num_of_points);
         } else {
 
-            long start_time = timeStringToEpochSeconds(points[start_i].get(date_key_,"").asString());
-            long end_time = timeStringToEpochSeconds(points[end_i - 1].get(date_key_,"").asString());
-            long bucket_duration = static_cast<double>(end_time - start_time) / (static_cast<double>(num_of_points) / AVG_POINTS_PER_BUCKET_);
+            int64_t start_time = times[start_i];
+            int64_t end_time = times[end_i - 1];
+            int64_t bucket_duration = static_cast<double>(end_time - start_time) / (static_cast<double>(num_of_points) / AVG_POINTS_PER_BUCKET_);
 
-            long bucket_start = start_time;
-            long bucket_end = start_time + bucket_duration;
+            int64_t bucket_start = start_time;
+            int64_t bucket_end = start_time + bucket_duration;
             int bucket_size = 0;
             for(int i = start_i; i < end_i; ++i){
-                //LOGD("bucket_start = %ld, bucket_end = %ld\n",bucket_start, bucket_end);
-                //LOGD("point.date = %ld\n",timeStringToEpochSeconds(points[i].get(date_key_,"").asString()));
-                if(timeStringToEpochSeconds(points[i].get(date_key_,"").asString()) >= bucket_start &&
-                    timeStringToEpochSeconds(points[i].get(date_key_,"").asString()) <= bucket_end){
+                if(times[i] >= bucket_start && times[i] <= bucket_end){
                     bucket_size++;
                 } else {
                     int scaled_num_of_points = static_cast<int>(static_cast<double>(bucket_size) / static_cast<double>(end_i - start_i) * num_of_points);
@@ -252,11 +262,14 @@ namespace intel { namespace poc {
                     if(scaled_num_of_points > 0){
                         switch(filter_type){
                             case FilterType::TIME_WEIGHTED_POINTS:
-                                applyFilterPoints(data, out_points, i - bucket_size, i, data_schema, scaled_num_of_points);
+                                applyFilterPoints(data, out_points, i - bucket_size, i, schema, scaled_num_of_points);
                                 break;
                             case FilterType::TIME_WEIGHTED_TIME:
-                                applyFilterTimeWeighted(data, out_points, i - bucket_size, i, data_schema, scaled_num_of_points, FilterType::TIME_WEIGHTED_TIME);
+                                applyFilterTimeWeighted(data, times, out_points, i - bucket_size, i, schema, scaled_num_of_points, FilterType::TIME_WEIGHTED_TIME);
                                 break;
+                            default:
+                                LOGE("FilterType %d is not time weighted.\n", static_cast<int>(filter_type));
+                                throw std::runtime_error("FilterType is not time weighted.");
                         }
                     }
                     //LOGD("Update current bucket\n");
@@ -270,13 +283,425 @@ namespace intel { namespace poc {
             //LOGD("Downsample %d points to %d scaled points.\n", bucket_size, scaled_num_of_points);
             switch(filter_type){
                 case FilterType::TIME_WEIGHTED_POINTS:
-                    applyFilterPoints(data, out_points, end_i - bucket_size, end_i, data_schema, scaled_num_of_points);
+                    applyFilterPoints(data, out_points, end_i - bucket_size, end_i, schema, scaled_num_of_points);
                     break;
                 case FilterType::TIME_WEIGHTED_TIME:
-                    applyFilterTimeWeighted(data, out_points, end_i - bucket_size, end_i, data_schema, scaled_num_of_points, FilterType::TIME_WEIGHTED_TIME);
+                    applyFilterTimeWeighted(data, times, out_points, end_i - bucket_size, end_i, schema, scaled_num_of_points, FilterType::TIME_WEIGHTED_TIME);
                     break;
+                default:
+                    LOGE("FilterType %d is not time weighted.\n", static_cast<int>(filter_type));
+                    throw std::runtime_error("FilterType is not time weighted.");
             }
         }
      }
 
+    void DataFilter::applyFilter(const PointBatch& data,
+                                 PointBatch& out,
+                                 int num_of_points,
+                                 FilterType filter){
+
+        if(!initialized_){
+            LOGE("DataFilter not initialized.\n");
+            throw std::runtime_error("DataFilter not initialized.");
+        }
+
+        int point_size = static_cast<int>(data.size());
+        LOGD("Requesting %d points downsampled to %d points\n", point_size, num_of_points);
+
+        if (point_size == 0 || point_size <= num_of_points) {
+            LOGD("No downsampling required.\n");
+            out = data;
+            return;
+        }
+
+        out.copyLayout(data);
+        if(num_of_points <= 0){
+            return;
+        }
+        out.reserve(num_of_points);
+
+        switch(filter){
+            case FilterType::POINTS:
+                LOGD("Using points-based downsampling filter\n");
+                applyFilterPoints(data, out, 0, data.size(), num_of_points);
+                break;
+            case FilterType::TIME_WEIGHTED_POINTS:
+                LOGD("Using time-weighted-points-based downsampling filter\n");
+                applyFilterTimeWeighted(data, out, 0, data.size(), num_of_points, FilterType::TIME_WEIGHTED_POINTS);
+                break;
+            case FilterType::TIME_WEIGHTED_TIME:
+                LOGD("Using time-weighted-time-based downsampling filter\n");
+                applyFilterTimeWeighted(data, out, 0, data.size(), num_of_points, FilterType::TIME_WEIGHTED_TIME);
+                break;
+            case FilterType::LTTB:
+                LOGD("Using LTTB downsampling filter\n");
+                applyFilterLTTB(data, out, num_of_points);
+                break;
+            case FilterType::M4:
+                LOGD("Using M4 downsampling filter\n");
+                applyFilterM4(data, out, num_of_points);
+                break;
+            default:
+                LOGD("Invalid/uninitialized FilterType value passed: %d", static_cast<int>(filter));
+                throw std::runtime_error("Invalid/uninitialized FilterType value passed.");
+                break;
+        }
+
+        LOGD("Final downsampled points count: %d\n", static_cast<int>(out.size()));
+    }
+
+    void DataFilter::appendAverages(const PointBatch& data,
+                                    PointBatch& out,
+                                    const std::vector<size_t>& bounds,
+                                    size_t bucket_size){
+        size_t num_buckets = bounds.size() - 1;
+
+        for(size_t b = 0; b < num_buckets; ++b){
+            out.times().push_back(data.times()[bounds[b + 1] - 1]);
+        }
+
+        std::vector<double> sums(num_buckets);
+        std::vector<size_t> counts(num_buckets);
+        for(size_t c = 0; c < data.numColumns(); ++c){
+            const PointBatch::Column& column = data.column(c);
+            PointBatch::Column& out_column = out.column(c);
+
+            // only average numeric columns, TEXT columns keep the value of the last point
+            if(column.type == PointBatch::ColumnType::TEXT){
+                for(size_t b = 0; b < num_buckets; ++b){
+                    out_column.text.push_back(column.text[bounds[b + 1] - 1]);
+                }
+                continue;
+            }
+
+            // Reduce all buckets of this column in one sweep over its contiguous values
+            const double* values = &column.values[0];
+            if(bucket_size > 0){
+                size_t count = bounds[num_buckets] - bounds[0];
+                AggregationKernels::sumBuckets(values + bounds[0], count, bucket_size, &sums[0]);
+                AggregationKernels::countBuckets(values + bounds[0], count, bucket_size, &counts[0]);
+            } else {
+                AggregationKernels::sumBuckets(values, &bounds[0], num_buckets, &sums[0]);
+                AggregationKernels::countBuckets(values, &bounds[0], num_buckets, &counts[0]);
+            }
+            for(size_t b = 0; b < num_buckets; ++b){
+                double average = counts[b] > 0 ? sums[b] / static_cast<double>(counts[b]) : 0;
+                if(column.type == PointBatch::ColumnType::INT){
+                    average = static_cast<int>(average);
+                }
+                out_column.values.push_back(average);
+            }
+        }
+    }
+
+    void DataFilter::applyFilterPoints(const PointBatch& data,
+                                       PointBatch& out,
+                                       size_t start_i,
+                                       size_t end_i,
+                                       int num_of_points){
+
+        if(num_of_points <= 0 || start_i >= end_i){
+            return;
+        }
+
+        double avg_data_per_point = static_cast<double>(end_i - start_i) / static_cast<double>(num_of_points);
+        size_t points_per_bucket = static_cast<size_t>(ceil(avg_data_per_point));
+
+        // Buckets close every points_per_bucket points, and the last bucket closes at end_i - 1.
+        // Like the Json::Value version, a bucket never closes at index 0, which is the only
+        // case where the buckets are not all points_per_bucket points but the last.
+        std::vector<size_t> bounds;
+        bounds.reserve(num_of_points + 2);
+        bounds.push_back(start_i);
+        bool fixed_size = true;
+        for(size_t last_i = start_i + points_per_bucket - 1; last_i < end_i - 1; last_i += points_per_bucket){
+            if(last_i == 0){
+                fixed_size = false;
+                continue;
+            }
+            bounds.push_back(last_i + 1);
+        }
+        bounds.push_back(end_i);
+        appendAverages(data, out, bounds, fixed_size ? points_per_bucket : 0);
+    }
+
+    void DataFilter::applyFilterTimeWeighted(const PointBatch& data,
+                                             PointBatch& out,
+                                             size_t start_i,
+                                             size_t end_i,
+                                             int num_of_points,
+                                             DataFilter::FilterType filter_type){
+
+        TimeBucket root = { start_i, end_i, num_of_points, filter_type };
+        std::vector<TimeBucket> buckets;
+        splitTimeBucket(data, root, buckets);
+
+        if(buckets.size() < 2 || end_i - start_i < PARALLEL_MIN_POINTS_){
+            for(std::vector<TimeBucket>::const_iterator it = buckets.begin(); it != buckets.end(); ++it){
+                applyFilterTimeBucket(data, out, *it);
+            }
+            return;
+        }
+
+        // The top level buckets are independent: downsample each on the thread pool into its
+        // own batch, then concatenate the results in order
+        std::vector<PointBatch> results(buckets.size());
+        std::vector<std::future<void>> futures;
+        futures.reserve(buckets.size());
+        for(size_t b = 0; b < buckets.size(); ++b){
+            results[b].copyLayout(out);
+            futures.push_back(threadPool().submit(std::bind(&DataFilter::applyFilterTimeBucket, std::cref(data), std::ref(results[b]), buckets[b])));
+        }
+        for(size_t b = 0; b < futures.size(); ++b){
+            futures[b].get();
+        }
+        for(size_t b = 0; b < results.size(); ++b){
+            out.append(results[b]);
+        }
+    }
+
+    void DataFilter::applyFilterTimeBucket(const PointBatch& data,
+                                           PointBatch& out,
+                                           const TimeBucket& bucket){
+
+        // Depth-first over an explicit stack.  Children are pushed in reverse so that they
+        // are popped, and their points appended, in time order.
+        std::vector<TimeBucket> stack(1, bucket);
+        std::vector<TimeBucket> children;
+        while(!stack.empty()){
+            TimeBucket current = stack.back();
+            stack.pop_back();
+            if(current.filter_type == FilterType::POINTS){
+                applyFilterPoints(data, out, current.start_i, current.end_i, current.num_of_points);
+                continue;
+            }
+            children.clear();
+            splitTimeBucket(data, current, children);
+            stack.insert(stack.end(), children.rbegin(), children.rend());
+        }
+    }
+
+    void DataFilter::splitTimeBucket(const PointBatch& data,
+                                     const TimeBucket& bucket,
+                                     std::vector<TimeBucket>& children){
+
+        size_t start_i = bucket.start_i;
+        size_t end_i = bucket.end_i;
+        int num_of_points = bucket.num_of_points;
+        if(num_of_points == 0){
+            return;
+        } else if(num_of_points <= AVG_POINTS_PER_BUCKET_){
+            TimeBucket child = { start_i, end_i, num_of_points, FilterType::POINTS };
+            children.push_back(child);
+            return;
+        }
+
+        // Buckets of a TIME_WEIGHTED_TIME bucket are split again, buckets of a
+        // TIME_WEIGHTED_POINTS bucket are averaged directly
+        FilterType child_type = bucket.filter_type == FilterType::TIME_WEIGHTED_TIME ? FilterType::TIME_WEIGHTED_TIME : FilterType::POINTS;
+
+        const std::vector<int64_t>& times = data.times();
+        int64_t start_time = times[start_i];
+        int64_t end_time = times[end_i - 1];
+        int64_t bucket_duration = static_cast<double>(end_time - start_time) / (static_cast<double>(num_of_points) / AVG_POINTS_PER_BUCKET_);
+
+        int64_t bucket_start = start_time;
+        int64_t bucket_end = start_time + bucket_duration;
+        size_t bucket_size = 0;
+        for(size_t i = start_i; i < end_i; ++i){
+            if(times[i] >= bucket_start && times[i] <= bucket_end){
+                bucket_size++;
+            } else {
+                int scaled_num_of_points = static_cast<int>(static_cast<double>(bucket_size) / static_cast<double>(end_i - start_i) * num_of_points);
+                if(scaled_num_of_points > 0){
+                    TimeBucket child = { i - bucket_size, i, scaled_num_of_points, child_type };
+                    children.push_back(child);
+                }
+                bucket_size = 1;
+                bucket_start += bucket_duration;
+                bucket_end += bucket_duration;
+            }
+        }
+        int scaled_num_of_points = static_cast<int>(static_cast<double>(bucket_size) / static_cast<double>(end_i - start_i) * num_of_points);
+        if(scaled_num_of_points > 0){
+            // If every point landed in one bucket (e.g. all points share one timestamp), the
+            // child is the bucket itself and splitting it again would never finish
+            if(bucket_size == end_i - start_i){
+                child_type = FilterType::POINTS;
+            }
+            TimeBucket child = { end_i - bucket_size, end_i, scaled_num_of_points, child_type };
+            children.push_back(child);
+        }
+    }
+
+    ThreadPool& DataFilter::threadPool(){
+        static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    void DataFilter::applyFilterLTTB(const PointBatch& data,
+                                     PointBatch& out,
+                                     int num_of_points){
+
+        size_t size = data.size();
+        if(num_of_points <= 0 || size == 0){
+            return;
+        } else if(num_of_points == 1){
+            out.appendPoint(data, size - 1);
+            return;
+        } else if(num_of_points == 2){
+            out.appendPoint(data, 0);
+            out.appendPoint(data, size - 1);
+            return;
+        }
+
+        // Only numeric columns with a non-zero range take part in the triangle areas, and
+        // each is scaled by its range so the metrics are comparable
+        std::vector<const double*> values;
+        std::vector<double> scales;
+        for(size_t c = 0; c < data.numColumns(); ++c){
+            const PointBatch::Column& column = data.column(c);
+            if(column.type == PointBatch::ColumnType::TEXT){
+                continue;
+            }
+            double min = AggregationKernels::min(&column.values[0], size);
+            double max = AggregationKernels::max(&column.values[0], size);
+            if(max > min){
+                values.push_back(&column.values[0]);
+                scales.push_back(1.0 / (max - min));
+            }
+        }
+
+        // Times relative to the first point keep the areas well within double precision
+        const std::vector<int64_t>& times = data.times();
+        int64_t base_time = times[0];
+
+        double every = static_cast<double>(size - 2) / static_cast<double>(num_of_points - 2);
+        std::vector<double> areas(static_cast<size_t>(ceil(every)) + 1);
+
+        size_t a = 0;
+        out.appendPoint(data, 0);
+        for(int bucket = 0; bucket < num_of_points - 2; ++bucket){
+            size_t first_i = static_cast<size_t>(bucket * every) + 1;
+            size_t end_i = std::min(static_cast<size_t>((bucket + 1) * every) + 1, size - 1);
+            size_t next_first_i = end_i;
+            size_t next_end_i = std::min(static_cast<size_t>((bucket + 2) * every) + 1, size);
+            if(next_first_i >= next_end_i){
+                next_first_i = size - 1;
+                next_end_i = size;
+            }
+            if(first_i >= end_i){
+                continue;
+            }
+
+            double next_count = static_cast<double>(next_end_i - next_first_i);
+            double next_x = 0;
+            for(size_t i = next_first_i; i < next_end_i; ++i){
+                next_x += static_cast<double>(times[i] - base_time);
+            }
+            next_x = next_x / next_count;
+            double a_x = static_cast<double>(times[a] - base_time);
+
+            size_t bucket_size = end_i - first_i;
+            std::fill(areas.begin(), areas.begin() + bucket_size, 0.0);
+            for(size_t v = 0; v < values.size(); ++v){
+                const double* y = values[v];
+                double next_y = 0;
+                for(size_t i = next_first_i; i < next_end_i; ++i){
+                    next_y += y[i];
+                }
+                next_y = next_y / next_count;
+
+                // Twice the triangle area between point a, point i and the next bucket average
+                double a_y = y[a];
+                for(size_t i = first_i; i < end_i; ++i){
+                    double x = static_cast<double>(times[i] - base_time);
+                    areas[i - first_i] += fabs((a_x - next_x) * (y[i] - a_y) - (a_x - x) * (next_y - a_y)) * scales[v];
+                }
+            }
+
+            size_t max_i = first_i + AggregationKernels::argMax(&areas[0], bucket_size);
+            out.appendPoint(data, max_i);
+            a = max_i;
+        }
+        out.appendPoint(data, size - 1);
+    }
+
+    void DataFilter::applyFilterM4(const PointBatch& data,
+                                   PointBatch& out,
+                                   int num_of_points){
+
+        size_t size = data.size();
+        if(num_of_points <= 0 || size == 0){
+            return;
+        }
+
+        const std::vector<int64_t>& times = data.times();
+        int64_t start_time = times[0];
+        int64_t span = times[size - 1] - start_time + 1;
+
+        std::vector<const double*> values;
+        for(size_t c = 0; c < data.numColumns(); ++c){
+            if(data.column(c).type != PointBatch::ColumnType::TEXT){
+                values.push_back(&data.column(c).values[0]);
+            }
+        }
+
+        std::vector<size_t> selected;
+        selected.reserve(2 + 2 * values.size());
+        size_t first_i = 0;
+        while(first_i < size){
+            // Points are sorted by time, so each bucket is a contiguous range [first_i, end_i)
+            int64_t bucket = (times[first_i] - start_time) * num_of_points / span;
+            size_t end_i = first_i + 1;
+            while(end_i < size && (times[end_i] - start_time) * num_of_points / span == bucket){
+                ++end_i;
+            }
+
+            selected.clear();
+            selected.push_back(first_i);
+            selected.push_back(end_i - 1);
+            for(size_t v = 0; v < values.size(); ++v){
+                selected.push_back(first_i + AggregationKernels::argMin(values[v] + first_i, end_i - first_i));
+                selected.push_back(first_i + AggregationKernels::argMax(values[v] + first_i, end_i - first_i));
+            }
+
+            std::sort(selected.begin(), selected.end());
+            std::vector<size_t>::iterator last = std::unique(selected.begin(), selected.end());
+            for(std::vector<size_t>::iterator it = selected.begin(); it != last; ++it){
+                out.appendPoint(data, *it);
+            }
+            first_i = end_i;
+        }
+    }
+
+    void DataFilter::toBatch(const Json::Value& data,
+                             const Schema& schema,
+                             PointBatch& batch){
+
+        schema.layout(batch);
+        batch.setDates(data.get("startDate", "").asString(), data.get("endDate", "").asString());
+
+        const Json::Value& points = data["points"];
+        batch.reserve(points.size());
+        for(Json::ArrayIndex i = 0; i < points.size(); ++i){
+            const Json::Value& point = points[i];
+            batch.times().push_back(TimeString::toEpochSeconds(point.get(schema.dateKeyColumn(), "").asString()));
+            for(size_t c = 0; c < batch.numColumns(); ++c){
+                PointBatch::Column& column = batch.column(c);
+                const Json::Value& value = point[column.name];
+                if(column.type == PointBatch::ColumnType::TEXT){
+                    column.text.push_back(value.isNull() ? "" : value.asString());
+                } else if(value.isString()){
+                    // Numbers can arrive as strings, e.g. "gsr":"4.27263e-05"
+                    column.values.push_back(strtod(value.asCString(), NULL));
+                } else if(value.isNumeric() || value.isBool()){
+                    column.values.push_back(value.asDouble());
+                } else {
+                    column.values.push_back(0);
+                }
+            }
+        }
+    }
+
 }}
\ No newline at end of file
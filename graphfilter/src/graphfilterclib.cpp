@@ -7,6 +7,8 @@
  *
  */
 
+#include <string.h>
+#include <vector>
 #include <graphfilter/graphfilter.h>
 #include <graphfilter/graphfilterclib.h>
 
@@ -34,6 +36,44 @@ int intel_poc_GraphFilter_addData(const char* data_values)
     return intel::poc::GraphFilter::instance().addData(data_values_str);
 }
 
+int intel_poc_GraphFilter_addColumns(const int64_t* times,
+                                     size_t num_points,
+                                     const intel_poc_Column* columns,
+                                     size_t num_columns)
+{
+    if(num_columns > 0 && columns == NULL){
+        return 0;
+    }
+
+    std::vector<intel::poc::ColumnBatch::Column> batch_columns(num_columns);
+    for(size_t i = 0; i < num_columns; ++i){
+        switch(columns[i].type){
+            case INTEL_POC_COLUMN_INT64:
+                batch_columns[i].type = intel::poc::ColumnBatch::Type::INT64;
+                break;
+            case INTEL_POC_COLUMN_DOUBLE:
+                batch_columns[i].type = intel::poc::ColumnBatch::Type::DOUBLE;
+                break;
+            case INTEL_POC_COLUMN_TEXT:
+                batch_columns[i].type = intel::poc::ColumnBatch::Type::TEXT;
+                break;
+            default:
+                return 0;
+        }
+        batch_columns[i].name = columns[i].name;
+        batch_columns[i].values = columns[i].values;
+        batch_columns[i].nulls = columns[i].nulls;
+    }
+
+    intel::poc::ColumnBatch batch;
+    batch.times = times;
+    batch.num_points = num_points;
+    batch.columns = batch_columns.empty() ? NULL : &batch_columns[0];
+    batch.num_columns = num_columns;
+
+    return intel::poc::GraphFilter::instance().addData(batch);
+}
+
 const char* intel_poc_GraphFilter_getData(const char* params)
 {
     std::string params_str(params);
@@ -41,3 +81,39 @@ const char* intel_poc_GraphFilter_getData(const char* params)
     std::string data = intel::poc::GraphFilter::instance().getData(params_str);
     return strdup(data.c_str());
 }
+
+uint64_t intel_poc_GraphFilter_getDataAsync(const char* params,
+                                            const char* group,
+                                            intel_poc_GetDataCallback callback,
+                                            void* user_data)
+{
+    std::string params_str(params);
+    std::string group_str(group != NULL ? group : "");
+
+    return intel::poc::GraphFilter::instance().getDataAsync(params_str, group_str,
+        [callback, user_data](uint64_t request_id, bool completed, const std::string& result) {
+            if(callback != NULL){
+                callback(request_id, completed, result.c_str(), user_data);
+            }
+        });
+}
+
+int intel_poc_GraphFilter_cancel(uint64_t request_id)
+{
+    return intel::poc::GraphFilter::instance().cancel(request_id);
+}
+
+int intel_poc_GraphFilter_flush()
+{
+    return intel::poc::GraphFilter::instance().flush();
+}
+
+size_t intel_poc_GraphFilter_pendingWrites()
+{
+    return intel::poc::GraphFilter::instance().pendingWrites();
+}
+
+size_t intel_poc_GraphFilter_cacheBytes()
+{
+    return intel::poc::GraphFilter::instance().cacheBytes();
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "IngestQueue"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/ingestqueue.h>
+#include <stdio.h>
+#include <chrono>
+
+
+namespace intel { namespace poc {
+
+    IngestQueue::IngestQueue()
+        :head_(NULL), tail_(NULL), pushed_(0), written_(0), queued_bytes_(0), idle_(false),
+         flush_target_(0), failed_(0), running_(false), stopping_(false), batch_bytes_(0), delay_ms_(0)
+    {
+        Node* stub = new Node();
+        stub->next.store(NULL);
+        head_.store(stub);
+        tail_ = stub;
+    }
+
+    IngestQueue::~IngestQueue()
+    {
+        stop();
+        while(tail_ != NULL){
+            Node* next = tail_->next.load();
+            delete tail_;
+            tail_ = next;
+        }
+    }
+
+    void IngestQueue::start(size_t batch_bytes, int delay_ms, const Writer& writer){
+        stop();
+        batch_bytes_ = batch_bytes;
+        delay_ms_ = delay_ms > 0 ? delay_ms : 0;
+        writer_ = writer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = true;
+            stopping_ = false;
+        }
+        writer_thread_ = std::thread(&IngestQueue::run, this);
+    }
+
+    void IngestQueue::stop(){
+        if(!writer_thread_.joinable()){
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        writer_thread_.join();
+    }
+
+    void IngestQueue::push(std::string payload){
+        size_t bytes = payload.size();
+        Node* node = new Node();
+        node->next.store(NULL, std::memory_order_relaxed);
+        node->payload.swap(payload);
+
+        // Counted first, so the writer never takes more payloads than were counted
+        size_t queued = queued_bytes_.fetch_add(bytes) + bytes;
+        pushed_.fetch_add(1);
+
+        // The node is reachable from the consumer once the previous head links to it
+        Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+
+        // Taking the mutex before notifying means the writer cannot miss the wake up
+        // between checking for work and starting to wait
+        if(idle_.load() || (queued >= batch_bytes_ && queued - bytes < batch_bytes_)){
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+            }
+            wake_.notify_one();
+        }
+    }
+
+    bool IngestQueue::flush(){
+        uint64_t target = pushed_.load();
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(target > flush_target_){
+            flush_target_ = target;
+        }
+        wake_.notify_one();
+        written_changed_.wait(lock, [&]() { return written_.load() >= target || !running_; });
+
+        bool added = failed_ == 0 && written_.load() >= target;
+        failed_ = 0;
+        return added;
+    }
+
+    size_t IngestQueue::depth() const{
+        return static_cast<size_t>(pushed_.load() - written_.load());
+    }
+
+    /// private API
+
+    void IngestQueue::run(){
+        std::vector<std::string> batch;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(true){
+            idle_.store(true);
+            wake_.wait(lock, [this]() { return stopping_ || pushed_.load() > written_.load(); });
+            idle_.store(false);
+            if(pushed_.load() == written_.load()){
+                break;
+            }
+
+            // Give more payloads the chance to share the transaction
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms_);
+            wake_.wait_until(lock, deadline, [this]() {
+                return stopping_ || flush_target_ > written_.load() || queued_bytes_.load() >= batch_bytes_;
+            });
+            lock.unlock();
+
+            batch.clear();
+            size_t bytes = 0;
+            std::string payload;
+            while(pop(payload)){
+                bytes += payload.size();
+                batch.push_back(std::string());
+                batch.back().swap(payload);
+            }
+            size_t added = batch.empty() ? 0 : writer_(batch);
+            queued_bytes_.fetch_sub(bytes);
+            if(added < batch.size()){
+                LOGE("%zu of %zu queued payloads could not be added\n", batch.size() - added, batch.size());
+            }
+
+            lock.lock();
+            failed_ += batch.size() - (added < batch.size() ? added : batch.size());
+            written_.fetch_add(batch.size());
+            written_changed_.notify_all();
+        }
+        running_ = false;
+        written_changed_.notify_all();
+    }
+
+    bool IngestQueue::pop(std::string& payload){
+        Node* next = tail_->next.load(std::memory_order_acquire);
+        if(next == NULL){
+            return false;
+        }
+        // next becomes the stub, its payload is handed out
+        payload.swap(next->payload);
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+}}
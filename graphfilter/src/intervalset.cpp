@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include <graphfilter/intervalset.h>
+#include <algorithm>
+
+
+namespace intel { namespace poc {
+
+    void IntervalSet::insert(int64_t start, int64_t end){
+        std::map<int64_t, int64_t>::iterator it = intervals_.upper_bound(start);
+        if(it != intervals_.begin()){
+            std::map<int64_t, int64_t>::iterator before = it;
+            --before;
+            if(before->second >= start){
+                // Extend the range starting before this one
+                start = before->first;
+                it = before;
+            }
+        }
+
+        // Absorb every range starting before this one ends
+        while(it != intervals_.end() && it->first <= end){
+            end = std::max(end, it->second);
+            it = intervals_.erase(it);
+        }
+        intervals_[start] = end;
+    }
+
+    void IntervalSet::erase(int64_t start, int64_t end){
+        std::map<int64_t, int64_t>::iterator it = intervals_.upper_bound(start);
+        if(it != intervals_.begin()){
+            std::map<int64_t, int64_t>::iterator before = it;
+            --before;
+            if(before->second >= start){
+                // Cut the range starting before this one, keeping what is left on each side
+                int64_t before_end = before->second;
+                if(before->first < start){
+                    before->second = start - 1;
+                } else {
+                    intervals_.erase(before);
+                }
+                if(before_end > end){
+                    intervals_[end + 1] = before_end;
+                    return;
+                }
+            }
+        }
+
+        // Remove every range starting inside this one, keeping what is left after it
+        while(it != intervals_.end() && it->first <= end){
+            if(it->second > end){
+                intervals_[end + 1] = it->second;
+            }
+            it = intervals_.erase(it);
+        }
+    }
+
+    bool IntervalSet::contains(int64_t start, int64_t end) const{
+        std::map<int64_t, int64_t>::const_iterator it = intervals_.upper_bound(start);
+        if(it == intervals_.begin()){
+            return false;
+        }
+        --it;
+        return it->second >= end;
+    }
+
+    void IntervalSet::difference(int64_t start, int64_t end, std::vector<Interval>& missing) const{
+        missing.clear();
+        if(contains(start, end)){
+            return;
+        }
+
+        int64_t from = start;
+        std::map<int64_t, int64_t>::const_iterator it = intervals_.upper_bound(start);
+        if(it != intervals_.begin()){
+            std::map<int64_t, int64_t>::const_iterator before = it;
+            --before;
+            from = std::max(from, before->second);
+        }
+
+        for(; it != intervals_.end() && it->first < end; ++it){
+            if(it->first > from){
+                missing.push_back(Interval(from, it->first));
+            }
+            from = it->second;
+            if(from >= end){
+                return;
+            }
+        }
+        if(from < end || start == end){
+            missing.push_back(Interval(from, end));
+        }
+    }
+
+}}
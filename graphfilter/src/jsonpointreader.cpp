@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "JsonPointReader"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/jsonpointreader.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace intel { namespace poc {
+
+    namespace {
+        int hexDigit(char c){
+            if(c >= '0' && c <= '9'){
+                return c - '0';
+            } else if(c >= 'a' && c <= 'f'){
+                return c - 'a' + 10;
+            } else if(c >= 'A' && c <= 'F'){
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        void appendUtf8(std::string& out, unsigned int code_point){
+            if(code_point < 0x80){
+                out += static_cast<char>(code_point);
+            } else if(code_point < 0x800){
+                out += static_cast<char>(0xC0 | (code_point >> 6));
+                out += static_cast<char>(0x80 | (code_point & 0x3F));
+            } else if(code_point < 0x10000){
+                out += static_cast<char>(0xE0 | (code_point >> 12));
+                out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code_point & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (code_point >> 18));
+                out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code_point & 0x3F));
+            }
+        }
+    }
+
+    JsonPointReader::Field* JsonPointReader::Rows::addRow(){
+        size_t needed = (size_ + 1) * num_columns_;
+        if(fields_.size() < needed){
+            fields_.resize(needed);
+        }
+        Field* row = &fields_[size_ * num_columns_];
+        for(size_t i = 0; i < num_columns_; ++i){
+            row[i].type = Field::Type::NONE;
+        }
+        ++size_;
+        return row;
+    }
+
+    void JsonPointReader::Rows::swap(Rows& other){
+        std::swap(num_columns_, other.num_columns_);
+        std::swap(size_, other.size_);
+        fields_.swap(other.fields_);
+    }
+
+    JsonPointReader::JsonPointReader(const Schema& schema)
+        :schema_(schema), pos_(NULL), begin_(NULL), end_(NULL) {}
+
+    bool JsonPointReader::read(const char* json, size_t length, size_t batch_points, const Sink& sink){
+        begin_ = pos_ = json;
+        end_ = json + length;
+        start_date_.clear();
+        end_date_.clear();
+        if(batch_points == 0){
+            batch_points = 1;
+        }
+
+        Rows rows;
+        rows.reset(schema_.numColumns());
+
+        if(!accept('{')){
+            return fail("data_values not object json type");
+        }
+        bool has_start = false;
+        bool has_end = false;
+        bool has_points = false;
+        if(!accept('}')){
+            while(true){
+                if(!readString(key_) || !accept(':')){
+                    return fail("Expected member");
+                }
+                bool read;
+                if(key_ == "startDate"){
+                    has_start = true;
+                    skipSpace();
+                    read = pos_ < end_ && *pos_ == '"' ? readString(start_date_) || fail("Malformed string") : skipValue(0);
+                } else if(key_ == "endDate"){
+                    has_end = true;
+                    skipSpace();
+                    read = pos_ < end_ && *pos_ == '"' ? readString(end_date_) || fail("Malformed string") : skipValue(0);
+                } else if(key_ == "points"){
+                    has_points = true;
+                    skipSpace();
+                    read = pos_ < end_ && *pos_ == '[' ? readPoints(rows, batch_points, sink) : skipValue(0);
+                } else {
+                    read = skipValue(0);
+                }
+                if(!read){
+                    return false;
+                }
+                if(accept(',')){
+                    continue;
+                }
+                if(accept('}')){
+                    break;
+                }
+                return fail("Expected ',' or '}'");
+            }
+        }
+        skipSpace();
+        if(pos_ != end_){
+            return fail("Unexpected data after payload");
+        }
+
+        if(!has_start || !has_end || !has_points){
+            LOGE("Invalid data: startDate, endDate, or points missing.\n");
+            return false;
+        }
+        if(!rows.empty() && !sink(rows, true)){
+            return false;
+        }
+        return true;
+    }
+
+    /// private API
+
+    void JsonPointReader::skipSpace(){
+        while(pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')){
+            ++pos_;
+        }
+    }
+
+    bool JsonPointReader::accept(char c){
+        skipSpace();
+        if(pos_ < end_ && *pos_ == c){
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool JsonPointReader::readString(std::string& out){
+        out.clear();
+        if(!accept('"')){
+            return false;
+        }
+        while(pos_ < end_){
+            // Copy runs of plain characters at once
+            const char* run = pos_;
+            while(pos_ < end_ && *pos_ != '"' && *pos_ != '\\'){
+                ++pos_;
+            }
+            out.append(run, pos_ - run);
+            if(pos_ == end_){
+                break;
+            }
+            if(*pos_++ == '"'){
+                return true;
+            }
+
+            if(pos_ == end_){
+                break;
+            }
+            char escape = *pos_++;
+            switch(escape){
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned int code_point = 0;
+                    for(int units = 0; units < 2; ++units){
+                        if(end_ - pos_ < 4){
+                            return false;
+                        }
+                        unsigned int unit = 0;
+                        for(int i = 0; i < 4; ++i){
+                            int digit = hexDigit(*pos_++);
+                            if(digit < 0){
+                                return false;
+                            }
+                            unit = unit * 16 + static_cast<unsigned int>(digit);
+                        }
+                        if(units == 0){
+                            code_point = unit;
+                            // A high surrogate is followed by the escaped low surrogate
+                            if(unit < 0xD800 || unit > 0xDBFF){
+                                break;
+                            }
+                            if(end_ - pos_ < 6 || pos_[0] != '\\' || pos_[1] != 'u'){
+                                return false;
+                            }
+                            pos_ += 2;
+                        } else {
+                            if(unit < 0xDC00 || unit > 0xDFFF){
+                                return false;
+                            }
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (unit - 0xDC00);
+                        }
+                    }
+                    appendUtf8(out, code_point);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool JsonPointReader::readNumber(const char*& begin, bool& integral){
+        skipSpace();
+        begin = pos_;
+        integral = true;
+        if(pos_ < end_ && *pos_ == '-'){
+            ++pos_;
+        }
+        const char* digits = pos_;
+        while(pos_ < end_ && *pos_ >= '0' && *pos_ <= '9'){
+            ++pos_;
+        }
+        if(pos_ == digits){
+            return false;
+        }
+        if(pos_ < end_ && *pos_ == '.'){
+            integral = false;
+            digits = ++pos_;
+            while(pos_ < end_ && *pos_ >= '0' && *pos_ <= '9'){
+                ++pos_;
+            }
+            if(pos_ == digits){
+                return false;
+            }
+        }
+        if(pos_ < end_ && (*pos_ == 'e' || *pos_ == 'E')){
+            integral = false;
+            ++pos_;
+            if(pos_ < end_ && (*pos_ == '+' || *pos_ == '-')){
+                ++pos_;
+            }
+            digits = pos_;
+            while(pos_ < end_ && *pos_ >= '0' && *pos_ <= '9'){
+                ++pos_;
+            }
+            if(pos_ == digits){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool JsonPointReader::readLiteral(const char* literal){
+        size_t length = strlen(literal);
+        if(static_cast<size_t>(end_ - pos_) < length || strncmp(pos_, literal, length) != 0){
+            return false;
+        }
+        pos_ += length;
+        return true;
+    }
+
+    bool JsonPointReader::skipValue(int depth){
+        if(depth > MAX_DEPTH_){
+            return fail("Payload nested too deeply");
+        }
+        skipSpace();
+        if(pos_ == end_){
+            return fail("Unexpected end of payload");
+        }
+        switch(*pos_){
+            case '"':
+                return readString(key_) || fail("Malformed string");
+            case '{':
+                ++pos_;
+                if(accept('}')){
+                    return true;
+                }
+                do {
+                    if(!readString(key_) || !accept(':')){
+                        return fail("Expected member");
+                    }
+                    if(!skipValue(depth + 1)){
+                        return false;
+                    }
+                } while(accept(','));
+                return accept('}') || fail("Expected ',' or '}'");
+            case '[':
+                ++pos_;
+                if(accept(']')){
+                    return true;
+                }
+                do {
+                    if(!skipValue(depth + 1)){
+                        return false;
+                    }
+                } while(accept(','));
+                return accept(']') || fail("Expected ',' or ']'");
+            case 't':
+                return readLiteral("true") || fail("Malformed value");
+            case 'f':
+                return readLiteral("false") || fail("Malformed value");
+            case 'n':
+                return readLiteral("null") || fail("Malformed value");
+            default: {
+                const char* begin;
+                bool integral;
+                return readNumber(begin, integral) || fail("Malformed value");
+            }
+        }
+    }
+
+    bool JsonPointReader::readField(Field& field, const Schema::Column& column){
+        skipSpace();
+        if(pos_ == end_){
+            return fail("Unexpected end of payload");
+        }
+
+        field.type = Field::Type::NONE;
+        switch(*pos_){
+            case '"':
+                field.type = Field::Type::TEXT;
+                return readString(field.text) || fail("Malformed string");
+            case '{':
+            case '[':
+                return skipValue(1);
+            case 'n':
+                return readLiteral("null") || fail("Malformed value");
+            case 't':
+            case 'f': {
+                bool value = *pos_ == 't';
+                if(!readLiteral(value ? "true" : "false")){
+                    return fail("Malformed value");
+                }
+                if(column.type == PointBatch::ColumnType::TEXT){
+                    field.type = Field::Type::TEXT;
+                    field.text = value ? "true" : "false";
+                } else {
+                    field.type = Field::Type::INTEGER;
+                    field.integer = value ? 1 : 0;
+                }
+                return true;
+            }
+            default:
+                break;
+        }
+
+        const char* begin;
+        bool integral;
+        if(!readNumber(begin, integral)){
+            return fail("Malformed value");
+        }
+        if(column.type == PointBatch::ColumnType::TEXT){
+            field.type = Field::Type::TEXT;
+            field.text.assign(begin, pos_ - begin);
+            return true;
+        }
+
+        // strtoll and strtod need a terminated string
+        token_.assign(begin, pos_ - begin);
+        if(column.type == PointBatch::ColumnType::INT && integral){
+            errno = 0;
+            long long value = strtoll(token_.c_str(), NULL, 10);
+            if(errno == 0){
+                field.type = Field::Type::INTEGER;
+                field.integer = static_cast<int64_t>(value);
+                return true;
+            }
+        }
+        double value = strtod(token_.c_str(), NULL);
+        if(column.type == PointBatch::ColumnType::INT && value == floor(value) &&
+           value >= -9223372036854775808.0 && value < 9223372036854775808.0){
+            field.type = Field::Type::INTEGER;
+            field.integer = static_cast<int64_t>(value);
+        } else {
+            field.type = Field::Type::REAL;
+            field.real = value;
+        }
+        return true;
+    }
+
+    bool JsonPointReader::readPoint(Rows& rows){
+        Field* row = rows.addRow();
+        bool has_date = false;
+        ++pos_;
+        if(!accept('}')){
+            do {
+                if(!readString(key_) || !accept(':')){
+                    return fail("Expected member");
+                }
+                int id = schema_.find(key_);
+                if(id < 0){
+                    if(!skipValue(1)){
+                        return false;
+                    }
+                    continue;
+                }
+                if(!readField(row[id], schema_.column(id))){
+                    return false;
+                }
+                if(static_cast<size_t>(id) == schema_.dateKeyId()){
+                    has_date = true;
+                }
+            } while(accept(','));
+            if(!accept('}')){
+                return fail("Expected ',' or '}'");
+            }
+        }
+
+        if(!has_date){
+            LOGE("Invalid data point encountered. Skipping.");
+            rows.removeRow();
+        }
+        return true;
+    }
+
+    bool JsonPointReader::readPoints(Rows& rows, size_t batch_points, const Sink& sink){
+        ++pos_;
+        if(accept(']')){
+            return true;
+        }
+        do {
+            skipSpace();
+            bool read;
+            if(pos_ < end_ && *pos_ == '{'){
+                read = readPoint(rows);
+            } else {
+                LOGE("Invalid data point encountered. Skipping.");
+                read = skipValue(1);
+            }
+            if(!read){
+                return false;
+            }
+
+            if(rows.size() >= batch_points){
+                if(!sink(rows, false)){
+                    return false;
+                }
+                rows.reset(schema_.numColumns());
+            }
+        } while(accept(','));
+        return accept(']') || fail("Expected ',' or ']'");
+    }
+
+    bool JsonPointReader::fail(const char* what){
+        LOGE("Unable to parse json data at offset %ld: %s\n", static_cast<long>(pos_ - begin_), what);
+        return false;
+    }
+
+}}
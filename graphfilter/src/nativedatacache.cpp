@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#include <android/log.h>
+#define  LOG_TAG    "NativeDataCache"
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/nativedatacache.h>
+#include <graphfilter/timestring.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace intel { namespace poc {
+
+    DataCache& NativeDataCache::instance()
+    {
+        static DataCache *instance = new NativeDataCache();
+
+        return *instance;
+    }
+
+    NativeDataCache::~NativeDataCache()
+    {
+        // Fills write to the tiers, so they must be done before those are destroyed
+        std::unique_lock<std::mutex> fills_lock(fills_mutex_);
+        waitForFills(fills_lock);
+    }
+
+    bool NativeDataCache::getData(const Json::Value& params, PointBatch& data){
+        const std::string& date_key_column = schema_.dateKeyColumn();
+        data.reset(date_key_column);
+
+        if (!initialized_) {
+            LOGE("Error: Database not initialized\n");
+            return false;
+        }
+
+        // Parse the query params
+        if(!params.isObject()){
+            LOGE("params not object json type: %s", params.toStyledString().c_str());
+            return false;
+        }
+        if(!params.isMember("startDate") || !params.isMember("endDate")){
+            LOGE("Invalid query params: %s\n", params.toStyledString().c_str());
+            return false;
+        }
+        std::string query_start_time = params["startDate"].asString();
+        std::string query_end_time = params["endDate"].asString();
+        int num_of_points = params.get("numOfPoints", 0).asInt();
+        const Json::Value metrics = params["metrics"];
+
+        if(num_of_points <= 0){
+            LOGD("Requesting <= 0 points.");
+            data.setDates(query_start_time, query_end_time);
+            return true;
+        }
+
+        // Pin the ranges read, so a concurrent fill does not evict them before the query is done
+        RangeLease pinned(*this);
+        std::string table_name = cacheContains(query_start_time, query_end_time, num_of_points, pinned);
+        if(table_name == ""){
+            return false;
+        }
+
+        // Every column, or the requested metrics, mapped to the chunk column they are read from
+        std::vector<size_t> sources;
+        if(metrics.empty() || (metrics.size() == 1 && metrics[0].asString() == "*")){
+            for(size_t c = 0; c < layout_.numColumns(); ++c){
+                data.addColumn(layout_.column(c).name, layout_.column(c).type);
+                sources.push_back(c);
+            }
+        } else {
+            for (Json::ArrayIndex i = 0; i < metrics.size(); i++ ) {
+                // Check if metric is valid
+                int id = schema_.find(metrics[i].asString());
+                if(id < 0){
+                    LOGD("Invalid metric found: %s\n",metrics[i].asString().c_str());
+                    data.reset(date_key_column);
+                    return false;
+                }
+                // The date key goes into the time column; repeated metrics are only read once
+                const Schema::Column& column = schema_.column(id);
+                if(static_cast<size_t>(id) == schema_.dateKeyId() || data.columnIndex(column.name) >= 0){
+                    continue;
+                }
+                data.addColumn(column.name, column.type);
+                sources.push_back(static_cast<size_t>(layout_.columnIndex(column.name)));
+            }
+        }
+        data.setDates(query_start_time, query_end_time);
+
+        int64_t start_time = TimeString::toEpochSeconds(query_start_time);
+        int64_t end_time = TimeString::toEpochSeconds(query_end_time);
+
+        std::lock_guard<std::mutex> lock(tiers_mutex_);
+        std::map<std::string, Tier>::const_iterator tier = tiers_.find(table_name);
+        if(tier == tiers_.end()){
+            LOGE("No cache table %s\n", table_name.c_str());
+            data.reset(date_key_column);
+            return false;
+        }
+
+        // The first chunk may start before the range
+        const Tier& chunks = tier->second;
+        Tier::const_iterator it = chunks.upper_bound(start_time);
+        if(it != chunks.begin()){
+            --it;
+        }
+        for(; it != chunks.end() && it->first <= end_time; ++it){
+            const PointBatch& chunk = it->second;
+            const std::vector<int64_t>& times = chunk.times();
+            size_t first = std::lower_bound(times.begin(), times.end(), start_time) - times.begin();
+            size_t last = std::upper_bound(times.begin(), times.end(), end_time) - times.begin();
+            if(first >= last){
+                continue;
+            }
+
+            // Copy contiguous slices of the selected columns
+            data.times().insert(data.times().end(), times.begin() + first, times.begin() + last);
+            for(size_t c = 0; c < sources.size(); ++c){
+                const PointBatch::Column& source = chunk.column(sources[c]);
+                PointBatch::Column& column = data.column(c);
+                if(column.type == PointBatch::ColumnType::TEXT){
+                    column.text.insert(column.text.end(), source.text.begin() + first, source.text.begin() + last);
+                } else {
+                    column.values.insert(column.values.end(), source.values.begin() + first, source.values.begin() + last);
+                }
+            }
+        }
+        return true;
+    }
+
+    /// private API
+
+    bool NativeDataCache::putDataTable(const std::string& table_name, const PointBatch& points){
+        if(points.empty()){
+            LOGD("No points to put into cache table %s\n", table_name.c_str());
+            return true;
+        }
+
+        // Points are kept in time order
+        std::vector<size_t> order(points.size());
+        for(size_t i = 0; i < order.size(); ++i){
+            order[i] = i;
+        }
+        const std::vector<int64_t>& point_times = points.times();
+        if(!std::is_sorted(point_times.begin(), point_times.end())){
+            std::stable_sort(order.begin(), order.end(), [&point_times](size_t a, size_t b) { return point_times[a] < point_times[b]; });
+        }
+
+        // Convert the points to the chunk layout.  INT columns hold what SQLite would read back.
+        std::vector<int> sources;
+        for(size_t c = 0; c < layout_.numColumns(); ++c){
+            sources.push_back(points.columnIndex(layout_.column(c).name));
+        }
+        PointBatch added;
+        added.copyLayout(layout_);
+        added.reserve(points.size());
+        for(std::vector<size_t>::iterator i = order.begin(); i != order.end(); ++i){
+            added.times().push_back(point_times[*i]);
+            for(size_t c = 0; c < layout_.numColumns(); ++c){
+                PointBatch::Column& column = added.column(c);
+                const PointBatch::Column* source = sources[c] >= 0 ? &points.column(sources[c]) : NULL;
+                if(column.type == PointBatch::ColumnType::TEXT){
+                    column.text.push_back(source != NULL && source->type == PointBatch::ColumnType::TEXT ? source->text[*i] : std::string());
+                } else {
+                    double value = source != NULL && source->type != PointBatch::ColumnType::TEXT ? source->values[*i] : 0.0;
+                    column.values.push_back(column.type == PointBatch::ColumnType::INT ? std::trunc(value) : value);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(tiers_mutex_);
+        std::map<std::string, Tier>::iterator tier = tiers_.find(table_name);
+        if(tier == tiers_.end()){
+            LOGE("No cache table %s\n", table_name.c_str());
+            return false;
+        }
+        LOGD("Adding %d data points to cache table %s\n", static_cast<int>(points.size()), table_name.c_str());
+
+        // Chunks overlapping the new points are merged with them and split again
+        Tier& chunks = tier->second;
+        int64_t first_time = added.times().front();
+        int64_t last_time = added.times().back();
+        Tier::iterator begin = chunks.upper_bound(first_time);
+        if(begin != chunks.begin()){
+            Tier::iterator before = begin;
+            --before;
+            if(before->second.times().back() >= first_time){
+                begin = before;
+            }
+        }
+        Tier::iterator end = chunks.upper_bound(last_time);
+
+        PointBatch cached;
+        cached.copyLayout(layout_);
+        for(Tier::iterator it = begin; it != end; ++it){
+            cached.append(it->second);
+        }
+
+        // Cached points are kept, like INSERT OR IGNORE, so new points on the time of a cached
+        // or an earlier new point are dropped
+        PointBatch merged;
+        merged.copyLayout(layout_);
+        merged.reserve(cached.size() + added.size());
+        size_t i = 0;
+        size_t j = 0;
+        while(i < cached.size() || j < added.size()){
+            if(j == added.size() || (i < cached.size() && cached.times()[i] <= added.times()[j])){
+                merged.appendPoint(cached, i++);
+            } else if(merged.empty() || merged.times().back() < added.times()[j]){
+                merged.appendPoint(added, j++);
+            } else {
+                ++j;
+            }
+        }
+        chunks.erase(begin, end);
+        addChunks(chunks, merged);
+        return true;
+    }
+
+    bool NativeDataCache::clearDatabaseRange(const std::string& table_name, const std::string& start_date, const std::string& end_date){
+        int64_t start_time = TimeString::toEpochSeconds(start_date);
+        int64_t end_time = TimeString::toEpochSeconds(end_date);
+
+        std::lock_guard<std::mutex> lock(tiers_mutex_);
+        std::map<std::string, Tier>::iterator tier = tiers_.find(table_name);
+        if(tier == tiers_.end()){
+            LOGE("No cache table %s\n", table_name.c_str());
+            return false;
+        }
+        LOGD("Deleting data points from cache table %s from %s to %s\n", table_name.c_str(), start_date.c_str(), end_date.c_str());
+
+        // The points of the chunks overlapping the range that are outside it are split again
+        Tier& chunks = tier->second;
+        Tier::iterator begin = chunks.upper_bound(start_time);
+        if(begin != chunks.begin()){
+            Tier::iterator before = begin;
+            --before;
+            if(before->second.times().back() >= start_time){
+                begin = before;
+            }
+        }
+        Tier::iterator end = chunks.upper_bound(end_time);
+
+        PointBatch kept;
+        kept.copyLayout(layout_);
+        for(Tier::iterator it = begin; it != end; ++it){
+            const PointBatch& chunk = it->second;
+            for(size_t i = 0; i < chunk.size(); ++i){
+                if(chunk.times()[i] < start_time || chunk.times()[i] > end_time){
+                    kept.appendPoint(chunk, i);
+                }
+            }
+        }
+        chunks.erase(begin, end);
+        addChunks(chunks, kept);
+        return true;
+    }
+
+    bool NativeDataCache::openDatabase(){
+        // Nothing to open, the tiers are created by createDatabase
+        return true;
+    }
+
+    void NativeDataCache::createDatabase(){
+        LOGD("Creating native cache\n");
+
+        std::lock_guard<std::mutex> lock(tiers_mutex_);
+        tiers_.clear();
+        layout_.reset(schema_.dateKeyColumn());
+        for(size_t id = 0; id < schema_.numColumns(); ++id){
+            if(id != schema_.dateKeyId()){
+                layout_.addColumn(schema_.column(id).name, schema_.column(id).type);
+            }
+        }
+
+        if(cache_raw_data_){
+            tiers_[table_name_ + "_raw"] = Tier();
+        }
+        for(size_t level=1; level <= cache_levels_.size(); ++level){
+            std::stringstream buff;
+            buff << "_" << level;
+            tiers_[table_name_ + buff.str()] = Tier();
+        }
+    }
+
+    void NativeDataCache::addChunks(Tier& tier, const PointBatch& points){
+        for(size_t offset = 0; offset < points.size(); offset += CHUNK_POINTS_){
+            size_t count = std::min(CHUNK_POINTS_, points.size() - offset);
+            PointBatch& chunk = tier[points.times()[offset]];
+            chunk.copyLayout(points);
+            chunk.reserve(count);
+            for(size_t i = offset; i < offset + count; ++i){
+                chunk.appendPoint(points, i);
+            }
+        }
+    }
+
+}}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "PointBatch"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/timestring.h>
+
+
+namespace intel { namespace poc {
+
+    void PointBatch::reset(const std::string& date_key){
+        date_key_ = date_key;
+        start_date_.clear();
+        end_date_.clear();
+        times_.clear();
+        columns_.clear();
+    }
+
+    int PointBatch::addColumn(const std::string& name, ColumnType type){
+        Column column;
+        column.name = name;
+        column.type = type;
+        columns_.push_back(column);
+        return static_cast<int>(columns_.size()) - 1;
+    }
+
+    void PointBatch::copyLayout(const PointBatch& other){
+        reset(other.date_key_);
+        setDates(other.start_date_, other.end_date_);
+        for(std::vector<Column>::const_iterator it = other.columns_.begin(); it != other.columns_.end(); ++it){
+            addColumn(it->name, it->type);
+        }
+    }
+
+    void PointBatch::appendPoint(const PointBatch& other, size_t index){
+        times_.push_back(other.times_[index]);
+        for(size_t i = 0; i < columns_.size(); ++i){
+            if(columns_[i].type == ColumnType::TEXT){
+                columns_[i].text.push_back(other.columns_[i].text[index]);
+            } else {
+                columns_[i].values.push_back(other.columns_[i].values[index]);
+            }
+        }
+    }
+
+    void PointBatch::setPoint(size_t index, const PointBatch& other, size_t other_index){
+        times_[index] = other.times_[other_index];
+        for(size_t i = 0; i < columns_.size(); ++i){
+            if(columns_[i].type == ColumnType::TEXT){
+                columns_[i].text[index] = other.columns_[i].text[other_index];
+            } else {
+                columns_[i].values[index] = other.columns_[i].values[other_index];
+            }
+        }
+    }
+
+    void PointBatch::clearPoints(){
+        times_.clear();
+        for(std::vector<Column>::iterator it = columns_.begin(); it != columns_.end(); ++it){
+            it->values.clear();
+            it->text.clear();
+        }
+    }
+
+    void PointBatch::append(const PointBatch& other){
+        times_.insert(times_.end(), other.times_.begin(), other.times_.end());
+        for(size_t i = 0; i < columns_.size(); ++i){
+            if(columns_[i].type == ColumnType::TEXT){
+                columns_[i].text.insert(columns_[i].text.end(), other.columns_[i].text.begin(), other.columns_[i].text.end());
+            } else {
+                columns_[i].values.insert(columns_[i].values.end(), other.columns_[i].values.begin(), other.columns_[i].values.end());
+            }
+        }
+    }
+
+    void PointBatch::reserve(size_t num_of_points){
+        times_.reserve(num_of_points);
+        for(std::vector<Column>::iterator it = columns_.begin(); it != columns_.end(); ++it){
+            if(it->type == ColumnType::TEXT){
+                it->text.reserve(num_of_points);
+            } else {
+                it->values.reserve(num_of_points);
+            }
+        }
+    }
+
+    int PointBatch::columnIndex(const std::string& name) const{
+        for(size_t i = 0; i < columns_.size(); ++i){
+            if(columns_[i].name == name){
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    Json::Value PointBatch::toJson() const{
+        Json::Value response;
+        response["startDate"] = start_date_;
+        response["endDate"] = end_date_;
+        response["points"] = Json::Value(Json::arrayValue);
+
+        Json::Value& points = response["points"];
+        points.resize(static_cast<Json::ArrayIndex>(times_.size()));
+        char date[TimeString::LENGTH + 1];
+        for(size_t i = 0; i < times_.size(); ++i){
+            Json::Value& point = points[static_cast<Json::ArrayIndex>(i)];
+            point = Json::Value(Json::objectValue);
+            TimeString::format(times_[i], date);
+            point[date_key_] = date;
+            for(std::vector<Column>::const_iterator it = columns_.begin(); it != columns_.end(); ++it){
+                switch(it->type){
+                    case ColumnType::INT:
+                        point[it->name] = static_cast<int>(it->values[i]);
+                        break;
+                    case ColumnType::REAL:
+                        point[it->name] = it->values[i];
+                        break;
+                    case ColumnType::TEXT:
+                        point[it->name] = it->text[i];
+                        break;
+                }
+            }
+        }
+        return response;
+    }
+
+}}
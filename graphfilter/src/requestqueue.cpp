@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include <graphfilter/requestqueue.h>
+#include <exception>
+
+
+namespace intel { namespace poc {
+
+    RequestQueue::RequestQueue(size_t num_threads, size_t capacity)
+        :next_id_(1), capacity_(capacity > 0 ? capacity : 1), stopping_(false){
+        if(num_threads == 0){
+            num_threads = 1;
+        }
+        workers_.reserve(num_threads);
+        for(size_t i = 0; i < num_threads; ++i){
+            workers_.push_back(std::thread(&RequestQueue::run, this));
+        }
+    }
+
+    RequestQueue::~RequestQueue(){
+        std::vector<Request> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            dropped.assign(queued_.begin(), queued_.end());
+            queued_.clear();
+        }
+        condition_.notify_all();
+        cancelled(dropped);
+        for(std::vector<std::thread>::iterator it = workers_.begin(); it != workers_.end(); ++it){
+            it->join();
+        }
+    }
+
+    uint64_t RequestQueue::submit(const std::string& group, const Task& task, const Callback& callback){
+        Request request;
+        request.group = group;
+        request.task = task;
+        request.callback = callback;
+
+        std::vector<Request> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request.id = next_id_++;
+            if(!group.empty()){
+                std::deque<Request>::iterator it = queued_.begin();
+                while(it != queued_.end()){
+                    if(it->group == group){
+                        dropped.push_back(*it);
+                        it = queued_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                for(std::map<uint64_t, std::pair<std::string, bool>>::iterator running = running_.begin(); running != running_.end(); ++running){
+                    if(running->second.first == group){
+                        running->second.second = true;
+                    }
+                }
+            }
+            while(queued_.size() >= capacity_){
+                dropped.push_back(queued_.front());
+                queued_.pop_front();
+            }
+            queued_.push_back(request);
+        }
+        condition_.notify_one();
+        cancelled(dropped);
+        return request.id;
+    }
+
+    bool RequestQueue::cancel(uint64_t request_id){
+        std::vector<Request> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::map<uint64_t, std::pair<std::string, bool>>::iterator running = running_.find(request_id);
+            if(running != running_.end()){
+                running->second.second = true;
+                return true;
+            }
+            for(std::deque<Request>::iterator it = queued_.begin(); it != queued_.end(); ++it){
+                if(it->id == request_id){
+                    dropped.push_back(*it);
+                    queued_.erase(it);
+                    break;
+                }
+            }
+        }
+        cancelled(dropped);
+        return !dropped.empty();
+    }
+
+    /// private API
+
+    void RequestQueue::run(){
+        while(true){
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while(!stopping_ && queued_.empty()){
+                    condition_.wait(lock);
+                }
+                if(queued_.empty()){
+                    return;
+                }
+                request = queued_.front();
+                queued_.pop_front();
+                running_[request.id] = std::make_pair(request.group, false);
+            }
+
+            std::string result;
+            bool completed = true;
+            try {
+                result = request.task();
+            } catch (std::exception&) {
+                completed = false;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::map<uint64_t, std::pair<std::string, bool>>::iterator running = running_.find(request.id);
+                completed = completed && !running->second.second;
+                running_.erase(running);
+            }
+            request.callback(request.id, completed, completed ? result : std::string());
+        }
+    }
+
+    void RequestQueue::cancelled(std::vector<Request>& requests){
+        for(std::vector<Request>::iterator it = requests.begin(); it != requests.end(); ++it){
+            it->callback(it->id, false, std::string());
+        }
+    }
+
+}}
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "Schema"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/schema.h>
+#include <graphfilter/timestring.h>
+
+
+namespace intel { namespace poc {
+
+    bool Schema::parse(const Json::Value& data_schema){
+        clear();
+
+        if(!data_schema.isObject()){
+            LOGE("data_schema not JSON object type: %s", data_schema.toStyledString().c_str());
+            return false;
+        }
+        if(!data_schema.isMember("table") || !data_schema.isMember("date_key_column") || !data_schema.isMember("columns")){
+            LOGE("Malformed data schema value: %s\n", data_schema.toStyledString().c_str());
+            return false;
+        }
+
+        std::map<std::string, std::string> columns;
+        std::vector<std::string> data_names = data_schema["columns"].getMemberNames();
+        for(std::vector<std::string>::iterator it = data_names.begin(); it != data_names.end(); ++it){
+            columns[*it] = data_schema["columns"][*it].asString();
+        }
+
+        std::string storage = data_schema.get("date_key_storage", "TEXT").asString();
+        if(storage != "TEXT" && storage != "INTEGER"){
+            LOGE("Unknown date key storage: %s\n", storage.c_str());
+            return false;
+        }
+
+        // Either "NONE", "MONTH" or a number of seconds
+        Partitioning partitioning = Partitioning::NONE;
+        int64_t partition_span = 0;
+        const Json::Value& span = data_schema["partition_span"];
+        if(span.isString() && span.asString() == "MONTH"){
+            partitioning = Partitioning::MONTH;
+        } else if(span.isIntegral() && span.asInt64() > 0){
+            partitioning = Partitioning::SPAN;
+            partition_span = span.asInt64();
+        } else if(!span.isNull() && !(span.isString() && span.asString() == "NONE")){
+            LOGE("Unknown partition span: %s\n", span.toStyledString().c_str());
+            return false;
+        }
+
+        // Chunks span the whole table, so they are not combined with partitions
+        size_t chunk_points = 0;
+        const Json::Value& chunk = data_schema["chunk_points"];
+        if(chunk.isIntegral() && chunk.asInt64() >= 0 && chunk.asInt64() <= MAX_CHUNK_POINTS_){
+            chunk_points = static_cast<size_t>(chunk.asInt64());
+        } else if(!chunk.isNull()){
+            LOGE("Invalid chunk points: %s\n", chunk.toStyledString().c_str());
+            return false;
+        }
+        if(chunk_points > 0 && partitioning != Partitioning::NONE){
+            LOGE("chunk_points cannot be combined with partition_span\n");
+            return false;
+        }
+
+        if(!parse(data_schema["table"].asString(), data_schema["date_key_column"].asString(), columns,
+                  storage == "INTEGER")){
+            return false;
+        }
+        partitioning_ = partitioning;
+        partition_span_ = partition_span;
+        chunk_points_ = chunk_points;
+        return true;
+    }
+
+    bool Schema::parse(const std::string& table,
+                       const std::string& date_key_column,
+                       const std::map<std::string, std::string>& columns,
+                       bool integer_date_key){
+        clear();
+
+        if(columns.find(date_key_column) == columns.end()){
+            LOGE("Date key column not found in column list\n");
+            return false;
+        }
+
+        table_ = table;
+        date_key_column_ = date_key_column;
+        integer_date_key_ = integer_date_key;
+        columns_.reserve(columns.size());
+        for(std::map<std::string, std::string>::const_iterator it = columns.begin(); it != columns.end(); ++it){
+            Column column;
+            column.name = it->first;
+            column.sql_type = it->second;
+            if(it->second == "INT"){
+                column.type = PointBatch::ColumnType::INT;
+            } else if(it->second == "REAL"){
+                column.type = PointBatch::ColumnType::REAL;
+            } else {
+                column.type = PointBatch::ColumnType::TEXT;
+            }
+
+            if(!columns_.empty()){
+                column_list_ += ", ";
+                column_definitions_ += ", ";
+            }
+            column_list_ += column.name;
+            column_definitions_ += column.name + " " + column.sql_type;
+            if(column.name == date_key_column_){
+                column_definitions_ += " PRIMARY KEY";
+                date_key_id_ = columns_.size();
+            }
+
+            ids_[column.name] = columns_.size();
+            columns_.push_back(column);
+        }
+        return true;
+    }
+
+    int Schema::find(const std::string& name) const{
+        std::map<std::string, size_t>::const_iterator it = ids_.find(name);
+        return it == ids_.end() ? -1 : static_cast<int>(it->second);
+    }
+
+    int64_t Schema::partitionKey(int64_t time) const{
+        if(partitioning_ == Partitioning::MONTH){
+            return TimeString::monthIndex(time);
+        } else if(partitioning_ == Partitioning::SPAN){
+            return time >= 0 ? time / partition_span_ : -((partition_span_ - 1 - time) / partition_span_);
+        }
+        return 0;
+    }
+
+    int64_t Schema::partitionStart(int64_t key) const{
+        if(partitioning_ == Partitioning::MONTH){
+            return TimeString::monthStart(key);
+        } else if(partitioning_ == Partitioning::SPAN){
+            return key * partition_span_;
+        }
+        return 0;
+    }
+
+    std::string Schema::partitionTable(int64_t key) const{
+        return table_ + "_p" + (key < 0 ? "m" + std::to_string(-key) : std::to_string(key));
+    }
+
+    std::string Schema::createTable(const std::string& table) const{
+        if(!integer_date_key_){
+            return "CREATE TABLE " + table + "(" + column_definitions_ + ");";
+        }
+
+        std::string definitions;
+        for(size_t id = 0; id < columns_.size(); ++id){
+            if(id > 0){
+                definitions += ", ";
+            }
+            if(id == date_key_id_){
+                definitions += columns_[id].name + " INTEGER PRIMARY KEY";
+            } else {
+                definitions += columns_[id].name + " " + columns_[id].sql_type;
+            }
+        }
+        return "CREATE TABLE " + table + "(" + definitions + ") WITHOUT ROWID;";
+    }
+
+    void Schema::layout(PointBatch& batch) const{
+        batch.reset(date_key_column_);
+        for(size_t id = 0; id < columns_.size(); ++id){
+            if(id != date_key_id_){
+                batch.addColumn(columns_[id].name, columns_[id].type);
+            }
+        }
+    }
+
+    bool Schema::matches(const std::map<std::string, std::string>& table_columns) const{
+        if(table_columns.size() != columns_.size()){
+            return false;
+        }
+        // Both are ordered by name
+        std::map<std::string, std::string>::const_iterator it = table_columns.begin();
+        for(size_t id = 0; id < columns_.size(); ++id, ++it){
+            if(it->first != columns_[id].name){
+                return false;
+            }
+            const std::string& sql_type = integer_date_key_ && id == date_key_id_ ? "INTEGER" : columns_[id].sql_type;
+            if(it->second != sql_type){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// private API
+
+    void Schema::clear(){
+        table_.clear();
+        date_key_column_.clear();
+        date_key_id_ = 0;
+        integer_date_key_ = false;
+        partitioning_ = Partitioning::NONE;
+        partition_span_ = 0;
+        chunk_points_ = 0;
+        columns_.clear();
+        ids_.clear();
+        column_list_.clear();
+        column_definitions_.clear();
+    }
+
+}}
@@ -21,13 +21,46 @@
 
 
 #include <graphfilter/sqlitedatabaseaccess.h>
-#include <sstream>
+#include <graphfilter/chunkcodec.h>
+#include <graphfilter/sqlitefunctions.h>
+#include <graphfilter/timestring.h>
 #include <algorithm>
+#include <condition_variable>
+#include <future>
 #include <stdexcept>
 
 
 namespace intel { namespace poc {
 
+    namespace {
+
+        /**
+        * Holds a read transaction on a reader connection, so that consecutive queries all
+        * read the same commit
+        */
+        class ReadTransaction {
+            public:
+                explicit ReadTransaction(sqlite3* database):database_(database) {
+                    if(database_ != NULL && sqlite3_exec(database_, "BEGIN TRANSACTION;", NULL, NULL, NULL) != SQLITE_OK){
+                        database_ = NULL;
+                    }
+                }
+
+                ~ReadTransaction() {
+                    if(database_ != NULL){
+                        sqlite3_exec(database_, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+                    }
+                }
+
+            private:
+                ReadTransaction(const ReadTransaction&);
+                ReadTransaction& operator=(const ReadTransaction&);
+
+                sqlite3* database_;
+        };
+
+    }
+
     DatabaseAccess& SQLiteDatabaseAccess::instance()
     {
         static DatabaseAccess *instance = new SQLiteDatabaseAccess();
@@ -38,6 +71,8 @@ namespace intel { namespace poc {
     SQLiteDatabaseAccess::~SQLiteDatabaseAccess()
     {
         if (database_) {
+            readers_.close();
+            statements_.setDatabase(NULL);
             sqlite3_close(database_);
         }
     }
@@ -46,25 +81,24 @@ namespace intel { namespace poc {
         initialized_ = false;
 
         // Parse data_schema
-        if(!data_schema.isObject()){
-            LOGE("data_schema not JSON object type: %s", data_schema.toStyledString().c_str());
+        Schema schema;
+        if(!schema.parse(data_schema)){
             return false;
         }
-        if(!data_schema.isMember("table") || !data_schema.isMember("date_key_column") || !data_schema.isMember("columns")){
-            LOGE("Malformed data schema value: %s\n", data_schema.toStyledString().c_str());
+        return init(database_path, schema, clean);
+    }
+
+    bool SQLiteDatabaseAccess::init(const std::string& database_path, const Schema& schema, bool clean){
+        initialized_ = false;
+
+        if(schema.empty()){
+            LOGE("Cannot initialize database with empty data schema.\n");
             return false;
-        } else {
-            table_name_ = data_schema["table"].asString();
-            date_key_column_ = data_schema["date_key_column"].asString();
-            std::vector<std::string> data_names = data_schema["columns"].getMemberNames();
-            if(std::find(data_names.begin(),data_names.end(),date_key_column_) == data_names.end()){
-                LOGE("Date key column not found in column list\n");
-                return false;
-            }
-            for(std::vector<std::string>::iterator it = data_names.begin(); it != data_names.end(); ++it){
-                data_schema_[*it] = data_schema["columns"][*it].asString();
-            }
         }
+        schema_ = schema;
+
+        // One cached INSERT binds every column of a row
+        insert_sql_ = insertSql(schema_.table());
 
         if(!openDatabase(database_path)){
             LOGE("Failed to open database: %s\n", database_path.c_str());
@@ -108,62 +142,233 @@ namespace intel { namespace poc {
         std::string startDate = data_values.get("startDate", "").asString();
         std::string endDate = data_values.get("endDate", "").asString();
 
-        // Build the SQL insert string
-        std::string query = "BEGIN TRANSACTION; "
-            "INSERT OR IGNORE INTO " + table_name_ + " (";
+        // Insert the points with the cached INSERT, all in one transaction
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Inserter inserter(*this);
+
+        try {
+            LOGD("Adding data to database from %s to %s\n", startDate.c_str(), endDate.c_str());
+            executeQuery("BEGIN TRANSACTION;");
+
+            const Json::Value& points = data_values["points"];
+            for (int i = 0; i < points.size(); ++i ){
+                const Json::Value& data_point = points[i];
+
+                if(!data_point.isMember(schema_.dateKeyColumn())){
+                    LOGE("Invalid data point encountered. Skipping.");
+                    continue;
+                }
+
+                int64_t time = -1;
+                if(insertNeedsTime()){
+                    time = TimeString::toEpochSeconds(data_point[schema_.dateKeyColumn()].asString());
+                    if(time == -1){
+                        LOGE("Invalid date encountered. Skipping.\n");
+                        continue;
+                    }
+                }
 
-        for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-            if(it != data_schema_.begin()){
-                query += ", ";
+                sqlite3_stmt* stmt = inserter.statement(time);
+                for(size_t id = 0; id < schema_.numColumns(); ++id){
+                    const Schema::Column& column = schema_.column(id);
+                    if(id == schema_.dateKeyId() && schema_.integerDateKey()){
+                        // Stored as epoch seconds, converted from the text date
+                        sqlite3_bind_int64(stmt, static_cast<int>(id) + 1, static_cast<sqlite3_int64>(time));
+                        continue;
+                    }
+                    bindValue(stmt, static_cast<int>(id) + 1, data_point[column.name], column.type);
+                }
+                if(sqlite3_step(stmt) != SQLITE_DONE){
+                    std::string err_msg(sqlite3_errmsg(database_));
+                    sqlite3_reset(stmt);
+                    throw std::runtime_error(err_msg);
+                }
+                sqlite3_reset(stmt);
             }
-            query += it->first;
+
+            sealChunks();
+            executeQuery("COMMIT TRANSACTION;");
+            inserter.commit();
+            return true;
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught: %s\n", ex.what());
+            return endTransaction(false);
         }
+    }
 
-        query += ") VALUES ";
-        for (int i = 0; i < data_values["points"].size(); ++i ){
-            Json::Value data_point = data_values["points"][i];
+    bool SQLiteDatabaseAccess::putJsonData(const std::string& data_values){
+        if(!initialized_){
+            LOGE("Error: Database not initialized\n");
+            return false;
+        }
 
-            if(!data_point.isMember(date_key_column_)){
-                LOGE("Invalid data point encountered. Skipping.");
-                continue;
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Inserter inserter(*this);
+        try {
+            executeQuery("BEGIN TRANSACTION;");
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught: %s\n", ex.what());
+            return false;
+        }
+
+        bool inserted = insertJson(inserter, data_values);
+        if(inserted){
+            try {
+                sealChunks();
+            } catch (std::exception& ex) {
+                LOGE("Exceptions caught: %s\n", ex.what());
+                inserted = false;
+            }
+        }
+        if(!endTransaction(inserted)){
+            return false;
+        }
+        inserter.commit();
+        return true;
+    }
+
+    size_t SQLiteDatabaseAccess::putJsonData(const std::vector<std::string>& data_values){
+        if(!initialized_){
+            LOGE("Error: Database not initialized\n");
+            return 0;
+        }
+        if(data_values.empty()){
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Inserter inserter(*this);
+        try {
+            executeQuery("BEGIN TRANSACTION;");
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught: %s\n", ex.what());
+            return 0;
+        }
+
+        // One transaction for all payloads, with a savepoint each so that a payload that
+        // fails is rolled back alone
+        size_t added = 0;
+        try {
+            for(std::vector<std::string>::const_iterator it = data_values.begin(); it != data_values.end(); ++it){
+                executeQuery("SAVEPOINT payload;");
+                inserter.savepoint();
+                if(insertJson(inserter, *it)){
+                    ++added;
+                } else {
+                    executeQuery("ROLLBACK TO SAVEPOINT payload;");
+                    inserter.rollback();
+                }
+                executeQuery("RELEASE SAVEPOINT payload;");
+            }
+            sealChunks();
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught: %s\n", ex.what());
+            endTransaction(false);
+            return 0;
+        }
+        if(!endTransaction(true)){
+            return 0;
+        }
+        inserter.commit();
+        return added;
+    }
+
+    bool SQLiteDatabaseAccess::putColumns(const ColumnBatch& data_values){
+        if(!initialized_){
+            LOGE("Error: Database not initialized\n");
+            return false;
+        }
+        if(data_values.num_points == 0){
+            LOGD("No points to put into databasae.\n");
+            return true;
+        }
+        if(data_values.times == NULL || (data_values.num_columns > 0 && data_values.columns == NULL)){
+            LOGE("Invalid data: times or columns missing.\n");
+            return false;
+        }
+
+        // Map every schema column to its batch column, the rest are bound as NULL
+        std::vector<const ColumnBatch::Column*> columns(schema_.numColumns(), NULL);
+        for(size_t i = 0; i < data_values.num_columns; ++i){
+            const ColumnBatch::Column& column = data_values.columns[i];
+            int id = column.name != NULL ? schema_.find(column.name) : -1;
+            if(id < 0 || static_cast<size_t>(id) == schema_.dateKeyId() || columns[id] != NULL){
+                LOGE("Invalid column: %s\n", column.name != NULL ? column.name : "(null)");
+                return false;
+            }
+            if(column.values == NULL){
+                LOGE("Invalid column: %s has no values\n", column.name);
+                return false;
             }
+            columns[id] = &column;
+        }
 
-            query += "(";
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        Inserter inserter(*this);
 
-            for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                if(it != data_schema_.begin()){
-                    query += ", ";
+        try {
+            executeQuery("BEGIN TRANSACTION;");
+
+            int date_index = static_cast<int>(schema_.dateKeyId()) + 1;
+            char date[TimeString::LENGTH + 1];
+            for(size_t i = 0; i < data_values.num_points; ++i){
+                int64_t time = data_values.times[i];
+                if(time == -1){
+                    LOGE("Invalid date encountered. Skipping.\n");
+                    continue;
                 }
-                if(data_point.isMember(it->first)){
-                    query += "'" + data_point[it->first].asString() + "'";
+                sqlite3_stmt* stmt = inserter.statement(time);
+                if(schema_.integerDateKey()){
+                    sqlite3_bind_int64(stmt, date_index, static_cast<sqlite3_int64>(time));
                 } else {
-                    query += "NULL";
+                    TimeString::format(time, date);
+                    sqlite3_bind_text(stmt, date_index, date, static_cast<int>(TimeString::LENGTH), SQLITE_STATIC);
                 }
-            }
 
-            if(i > 0 && i % 499 == 0){
-                query += "); INSERT OR IGNORE INTO " + table_name_ + " (";
-                for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                    if(it != data_schema_.begin()){
-                        query += ", ";
+                for(size_t id = 0; id < columns.size(); ++id){
+                    if(id == schema_.dateKeyId()){
+                        continue;
                     }
-                    query += it->first;
+                    const ColumnBatch::Column* column = columns[id];
+                    int index = static_cast<int>(id) + 1;
+                    if(column == NULL || column->isNull(i)){
+                        sqlite3_bind_null(stmt, index);
+                        continue;
+                    }
+                    switch(column->type){
+                        case ColumnBatch::Type::INT64:
+                            sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(static_cast<const int64_t*>(column->values)[i]));
+                            break;
+                        case ColumnBatch::Type::DOUBLE:
+                            sqlite3_bind_double(stmt, index, static_cast<const double*>(column->values)[i]);
+                            break;
+                        case ColumnBatch::Type::TEXT: {
+                            const char* text = static_cast<const char* const*>(column->values)[i];
+                            if(text == NULL){
+                                sqlite3_bind_null(stmt, index);
+                            } else {
+                                sqlite3_bind_text(stmt, index, text, -1, SQLITE_STATIC);
+                            }
+                            break;
+                        }
+                    }
+                }
+
+                if(sqlite3_step(stmt) != SQLITE_DONE){
+                    std::string err_msg(sqlite3_errmsg(database_));
+                    sqlite3_reset(stmt);
+                    throw std::runtime_error(err_msg);
                 }
-                query += ") VALUES ";
-            } else if(i != data_values["points"].size() - 1){
-                query += "),";
-            }  else {
-                query += ");";
+                sqlite3_reset(stmt);
             }
-        }
-        query += "COMMIT TRANSACTION;";
-        try {
-            LOGD("Adding data to database from %s to %s\n", startDate.c_str(), endDate.c_str());
-            executeQuery(query);
+
+            sealChunks();
+            executeQuery("COMMIT TRANSACTION;");
+            inserter.commit();
             return true;
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
-            return false;
+            return endTransaction(false);
         }
     }
 
@@ -172,127 +377,587 @@ namespace intel { namespace poc {
         empty_response["startDate"] = "";
         empty_response["endDate"] = "";
         empty_response["points"] = Json::Value(Json::arrayValue);
-        //empty_response["points"] = Json::arrayValue;
 
+        PointBatch data;
+        if(!getData(params, data)){
+            return empty_response;
+        }
+        return data.toJson();
+    }
+
+    bool SQLiteDatabaseAccess::getData(const Json::Value& params, PointBatch& data){
+        return queryData(params, data, NULL, 0);
+    }
+
+    bool SQLiteDatabaseAccess::getData(const Json::Value& params, StreamingDownsampler& downsampler){
+        PointBatch chunk;
+        return queryData(params, chunk, &downsampler, 0);
+    }
+
+    bool SQLiteDatabaseAccess::getAggregatedData(const Json::Value& params, PointBatch& data){
+        int num_of_points = params.isObject() ? params.get("numOfPoints", 0).asInt() : 0;
+        if(num_of_points <= 0){
+            LOGE("Invalid number of points for aggregation: %d\n", num_of_points);
+            data.reset(schema_.dateKeyColumn());
+            return false;
+        }
+        if(schema_.chunkPoints() == 0){
+            return queryData(params, data, NULL, num_of_points);
+        }
+
+        // The query cannot see the points inside chunks, so they are streamed into a
+        // TIME_WEIGHTED downsampler, which averages them as the query would
+        data.reset(schema_.dateKeyColumn());
+        bool has_layout = false;
+        StreamingDownsampler averager(StreamingDownsampler::Mode::TIME_WEIGHTED, num_of_points,
+            [&](const PointBatch& points) {
+                if(!has_layout){
+                    data.copyLayout(points);
+                    has_layout = true;
+                }
+                data.append(points);
+            });
+        PointBatch rows;
+        if(!queryData(params, rows, &averager, 0)){
+            data.reset(schema_.dateKeyColumn());
+            return false;
+        }
+        if(!has_layout){
+            data.copyLayout(rows);
+        }
+        return true;
+    }
+
+    bool SQLiteDatabaseAccess::removeData(const std::string& before_date){
         if (!initialized_) {
             LOGE("Error: Database not initialized\n");
-            return empty_response;
+            return false;
+        }
+        int64_t before = TimeString::toEpochSeconds(before_date);
+        if(before == -1){
+            LOGE("Invalid date: %s\n", before_date.c_str());
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+
+        // Whole partitions before the date are dropped, the rest have their leading points
+        // deleted.  Queries stop reading the dropped partitions before they are dropped.
+        std::map<int64_t, Partition> dropped;
+        std::vector<std::string> tables;
+        if(schema_.partitioning() == Schema::Partitioning::NONE){
+            tables.push_back(schema_.table());
+        } else {
+            std::lock_guard<std::mutex> lock(partitions_mutex_);
+            std::map<int64_t, Partition>::iterator it = partitions_.begin();
+            while(it != partitions_.end() && it->second.start < before){
+                if(it->second.end < before){
+                    dropped.insert(*it);
+                    partitions_.erase(it++);
+                } else {
+                    tables.push_back(it->second.table);
+                    ++it;
+                }
+            }
+        }
+
+        try {
+            executeQuery("BEGIN TRANSACTION;");
+            if(schema_.chunkPoints() > 0){
+                removeChunks(before);
+            }
+            for(std::map<int64_t, Partition>::iterator it = dropped.begin(); it != dropped.end(); ++it){
+                executeQuery("DROP TABLE " + it->second.table + "; DELETE FROM " + schema_.partitionsTable() +
+                    " WHERE partition_key = " + std::to_string(it->first) + ";");
+            }
+            for(std::vector<std::string>::iterator it = tables.begin(); it != tables.end(); ++it){
+                StatementCache::Lease remove(statements_, "DELETE FROM " + *it + " WHERE " + schema_.dateKeyColumn() + " < ?1;");
+                sqlite3_stmt* stmt = remove.get();
+                if(stmt == NULL){
+                    throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+                }
+                if(schema_.integerDateKey()){
+                    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(before));
+                } else {
+                    sqlite3_bind_text(stmt, 1, before_date.c_str(), static_cast<int>(before_date.size()), SQLITE_TRANSIENT);
+                }
+                if(sqlite3_step(stmt) != SQLITE_DONE){
+                    throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+                }
+            }
+            executeQuery("COMMIT TRANSACTION;");
+
+            // Statements of the dropped partitions can no longer run
+            for(std::map<int64_t, Partition>::iterator it = dropped.begin(); it != dropped.end(); ++it){
+                statements_.purge(it->second.table);
+                readers_.purge(it->second.table);
+            }
+            return true;
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught: %s\n", ex.what());
+            endTransaction(false);
+            std::lock_guard<std::mutex> lock(partitions_mutex_);
+            partitions_.insert(dropped.begin(), dropped.end());
+            return false;
+        }
+    }
+
+    bool SQLiteDatabaseAccess::queryData(const Json::Value& params, PointBatch& data, StreamingDownsampler* downsampler, int num_of_buckets){
+        const std::string& date_key_column = schema_.dateKeyColumn();
+        data.reset(date_key_column);
+
+        if (!initialized_) {
+            LOGE("Error: Database not initialized\n");
+            return false;
         }
 
         // Parse the query params
         if(!params.isObject()){
             LOGE("params not object json type: %s", params.toStyledString().c_str());
-            return empty_response;
+            return false;
         }
         if(!params.isMember("startDate") || !params.isMember("endDate")){
             LOGE("Invalid query params: %s\n", params.toStyledString().c_str());
-            return empty_response;
+            return false;
         }
         std::string query_start_time = params["startDate"].asString();
         std::string query_end_time = params["endDate"].asString();
         const Json::Value metrics = params["metrics"];
 
-        std::vector<std::string> json_fields;
-
+        // Select every column, or the date key and the requested metrics
+        std::string columns;
+        std::vector<size_t> fields;
         if(metrics.empty() || (metrics.size() == 1 && metrics[0].asString() == "*")){
-            // Include all metrics
-            for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                json_fields.push_back(std::string(it->first));
+            columns = schema_.columnList();
+            for(size_t id = 0; id < schema_.numColumns(); ++id){
+                fields.push_back(id);
             }
-
         } else {
-            // Parse through metrics to build vectors
-            json_fields.push_back(date_key_column_);
-            std::map<std::string,std::string>::iterator it;
+            columns = date_key_column;
+            fields.push_back(schema_.dateKeyId());
             for (int i = 0; i < metrics.size(); i++ ) {
                 // Check if metric is valid
-                it = data_schema_.find(metrics[i].asString());
-                if(it == data_schema_.end()){
+                int id = schema_.find(metrics[i].asString());
+                if(id < 0){
                     LOGD("Invalid metric found: %s\n",metrics[i].asString().c_str());
-                    return empty_response;
+                    return false;
                 }
-                json_fields.push_back(metrics[i].asString());
+                columns += ", " + schema_.column(id).name;
+                fields.push_back(id);
             }
         }
 
-        // build the query columns string
-        std::string columns = "";
-        for(std::vector<std::string>::iterator it = json_fields.begin(); it != json_fields.end(); ++it){
-            if(it == json_fields.begin()){
-                columns = *it;
+        // Map every selected column to a batch column
+        std::vector<int> batch_columns;
+        int date_field = -1;
+        for(std::vector<size_t>::iterator it = fields.begin(); it != fields.end(); ++it){
+            const Schema::Column& column = schema_.column(*it);
+            if(*it == schema_.dateKeyId() || data.columnIndex(column.name) >= 0){
+                // The date key goes into the time column; repeated metrics are only read once
+                if(*it == schema_.dateKeyId() && date_field < 0){
+                    date_field = static_cast<int>(batch_columns.size());
+                }
+                batch_columns.push_back(-1);
             } else {
-                columns += ", " + *it;
+                batch_columns.push_back(data.addColumn(column.name, column.type));
             }
         }
 
-        // Build the SQL query
-        std::stringstream query;
-        query << "SELECT ";
-        query << columns;
-        query << " FROM " + table_name_;
-        query << " WHERE " << date_key_column_ << " BETWEEN \"" << query_start_time << "\" AND \"" << query_end_time << "\" ";
-        query << " ORDER BY " << date_key_column_ << " ASC;";
+        int num_of_fields = static_cast<int>(fields.size());
+        int64_t start_time = TimeString::toEpochSeconds(query_start_time);
+        int64_t end_time = TimeString::toEpochSeconds(query_end_time);
+        if((num_of_buckets > 0 || insertNeedsTime() || schema_.chunkPoints() > 0) && (start_time == -1 || end_time == -1)){
+            LOGE("Invalid time frame: %s to %s\n", query_start_time.c_str(), query_end_time.c_str());
+            data.reset(date_key_column);
+            return false;
+        }
+        if(num_of_buckets > 0 && end_time < start_time){
+            LOGE("Invalid time frame for aggregation: %s to %s\n", query_start_time.c_str(), query_end_time.c_str());
+            data.reset(date_key_column);
+            return false;
+        }
 
-        int num_of_fields = static_cast<int>(json_fields.size());
-        std::string sql_query = query.str();
+        // The dates are bound, so the statements are shared by every query of these columns.
+        // Partitions are read one after the other, in time order, unless they are aggregated.
+        std::vector<std::string> tables = queryTables(start_time, end_time);
+        std::string range = " WHERE " + date_key_column + " BETWEEN ?1 AND ?2";
+        std::vector<std::string> queries;
+        if(num_of_buckets <= 0){
+            for(std::vector<std::string>::iterator it = tables.begin(); it != tables.end(); ++it){
+                queries.push_back("SELECT " + columns + " FROM " + *it + range + " ORDER BY " + date_key_column + " ASC;");
+            }
+        } else if(!tables.empty()){
+            // Average one equal-width time bucket inside SQLite, weighted by time as
+            // StreamingDownsampler::Mode::TIME_WEIGHTED does, with NULL values read as 0 like
+            // every other query.  The statement is stepped once per bucket with the bounds of
+            // the bucket bound, so rows are only compared by date key, never converted.  The
+            // date and TEXT columns are bare columns, which SQLite takes from the row holding
+            // max(date): the last point.
+            std::string aggregates;
+            for(std::vector<size_t>::iterator it = fields.begin(); it != fields.end(); ++it){
+                const Schema::Column& column = schema_.column(*it);
+                if(!aggregates.empty()){
+                    aggregates += ", ";
+                }
+                if(*it == schema_.dateKeyId()){
+                    aggregates += "max(" + column.name + ")";
+                } else if(column.type == PointBatch::ColumnType::INT){
+                    aggregates += "CAST(tsdv_twavg(" + date_key_column + ", ifnull(" + column.name + ", 0)) AS INTEGER)";
+                } else if(column.type == PointBatch::ColumnType::REAL){
+                    aggregates += "tsdv_twavg(" + date_key_column + ", ifnull(" + column.name + ", 0))";
+                } else {
+                    aggregates += column.name;
+                }
+            }
+            // tsdv_twavg needs the points in time order, and buckets may span partitions
+            std::string source = "(";
+            for(std::vector<std::string>::iterator it = tables.begin(); it != tables.end(); ++it){
+                source += (it == tables.begin() ? "SELECT " : " UNION ALL SELECT ") + columns + " FROM " + *it + range;
+            }
+            source += " ORDER BY " + date_key_column + " ASC)";
+            queries.push_back("SELECT " + aggregates + " FROM " + source + ";");
+        }
 
-        Json::Value response = empty_response;
-        response["startDate"] = query_start_time;
-        response["endDate"] = query_end_time;
+        data.setDates(query_start_time, query_end_time);
+        if(downsampler != NULL && !downsampler->begin(data, start_time, end_time)){
+            LOGE("Unable to start streaming downsampling for query params: %s\n", params.toStyledString().c_str());
+            data.reset(date_key_column);
+            return false;
+        }
         try{
-            sqlite3_stmt *stmt;
-            int rc = sqlite3_prepare_v2(database_, sql_query.c_str(), -1, &stmt, NULL);
-
-            if (rc != SQLITE_OK) {
-                std::string err_msg(sqlite3_errmsg(database_));
-                LOGE("Error processing SQL query: %s\n", sql_query.c_str());
-                return empty_response;
-            } else if(sqlite3_column_count(stmt) != num_of_fields){
-                LOGE("Number of returned columns does not match number expected.");
-                return empty_response;
+            // Read on a pooled reader connection, so the query does not wait behind inserts
+            ConnectionPool::Lease reader(readers_);
+            sqlite3* database = reader.get() ? reader.get()->database : database_;
+            StatementCache& statements = reader.get() ? reader.get()->statements : statements_;
+
+            // Sealing moves rows into chunks, so with chunks both are read from one commit.
+            // The chunks all precede the rows of the table.
+            std::unique_ptr<ReadTransaction> transaction;
+            if(schema_.chunkPoints() > 0 && num_of_buckets <= 0){
+                transaction.reset(new ReadTransaction(reader.get() ? database : NULL));
+                readChunks(database, statements, start_time, end_time, data, downsampler);
             }
 
-            // Build response object from query response
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
+            for(std::vector<std::string>::iterator query = queries.begin(); query != queries.end(); ++query){
+                StatementCache::Lease select(statements, *query);
+                sqlite3_stmt *stmt = select.get();
+
+                if (stmt == NULL) {
+                    LOGE("Error processing SQL query: %s\n", query->c_str());
+                    data.reset(date_key_column);
+                    return false;
+                } else if(sqlite3_column_count(stmt) != num_of_fields){
+                    LOGE("Number of returned columns does not match number expected.");
+                    data.reset(date_key_column);
+                    return false;
+                }
+                if(num_of_buckets > 0){
+                    if(!readBuckets(database, stmt, start_time, end_time, num_of_buckets, date_field, batch_columns, data)){
+                        data.reset(date_key_column);
+                        return false;
+                    }
+                    continue;
+                }
+                if(schema_.integerDateKey()){
+                    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(start_time));
+                    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(end_time));
+                } else {
+                    sqlite3_bind_text(stmt, 1, query_start_time.c_str(), static_cast<int>(query_start_time.size()), SQLITE_TRANSIENT);
+                    sqlite3_bind_text(stmt, 2, query_end_time.c_str(), static_cast<int>(query_end_time.size()), SQLITE_TRANSIENT);
+                }
+
+                // Fill the batch columns straight from the query response
+                int rc;
+                while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                    if(!appendRow(stmt, date_field, batch_columns, data)){
+                        continue;
+                    }
 
-                // Begin constructing json object
-                Json::Value point(Json::objectValue); // {}
-
-                for(int i=0; i < num_of_fields; ++i){
-                    std::string type = data_schema_[json_fields[i]];
-                    if(type == "INT"){
-                        point[json_fields[i]] = Json::Value(Json::intValue);
-                        point[json_fields[i]] = sqlite3_column_int(stmt, i);
-                    } else if (type == "REAL"){
-                        point[json_fields[i]] = Json::Value(Json::realValue );
-                        point[json_fields[i]] = sqlite3_column_double(stmt, i);
-                    } else if (type == "TEXT"){
-                        point[json_fields[i]] = Json::Value(Json::stringValue  );
-                        point[json_fields[i]] = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, i)));
+                    if(downsampler != NULL && data.size() >= STREAM_CHUNK_POINTS_){
+                        downsampler->push(data);
+                        data.clearPoints();
                     }
                 }
-                response["points"].append(point);
+                if (rc != SQLITE_DONE) {
+                    LOGE("Error reading SQL query results: %s\n", sqlite3_errmsg(database));
+                    data.reset(date_key_column);
+                    return false;
+                }
+            }
+
+            if(downsampler != NULL){
+                downsampler->push(data);
+                data.clearPoints();
+                downsampler->finish();
             }
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
-            return empty_response;
+            data.reset(date_key_column);
+            return false;
         }
-        return response;
+        return true;
     }
 
     /// private API
 
+    bool SQLiteDatabaseAccess::readBuckets(sqlite3* database, sqlite3_stmt* stmt, int64_t start_time, int64_t end_time,
+                                           int num_of_buckets, int date_field, const std::vector<int>& batch_columns,
+                                           PointBatch& data) const{
+        // Bucket b holds the times t with (t - start_time) * num_of_buckets / span == b, as
+        // in StreamingDownsampler, so it starts at the first such t
+        int64_t span = end_time - start_time + 1;
+        int64_t first = start_time;
+        for(int64_t b = 0; b < num_of_buckets; ++b){
+            int64_t next = start_time + ((b + 1) * span + num_of_buckets - 1) / num_of_buckets;
+            int64_t last = b + 1 < num_of_buckets ? next - 1 : end_time;
+            int64_t low = first;
+            first = next;
+            if(!schema_.integerDateKey()){
+                // Text dates are whole minutes, and never -1: round the bounds inwards to them
+                low += 59;
+                low -= (low % 60 + 60) % 60;
+                last -= (last % 60 + 60) % 60;
+                if(low > last){
+                    continue;
+                }
+            }
+
+            sqlite3_reset(stmt);
+            bindTime(stmt, 1, low);
+            bindTime(stmt, 2, last);
+
+            // An empty bucket is a single row of NULLs
+            int rc;
+            while((rc = sqlite3_step(stmt)) == SQLITE_ROW){
+                if(sqlite3_column_type(stmt, date_field) != SQLITE_NULL){
+                    appendRow(stmt, date_field, batch_columns, data);
+                }
+            }
+            if(rc != SQLITE_DONE){
+                LOGE("Error reading SQL query results: %s\n", sqlite3_errmsg(database));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SQLiteDatabaseAccess::appendRow(sqlite3_stmt* stmt, int date_field, const std::vector<int>& batch_columns, PointBatch& data) const{
+        int64_t time;
+        if(schema_.integerDateKey()){
+            time = sqlite3_column_type(stmt, date_field) == SQLITE_INTEGER ? sqlite3_column_int64(stmt, date_field) : -1;
+        } else {
+            const char* date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, date_field));
+            time = TimeString::toEpochSeconds(date, sqlite3_column_bytes(stmt, date_field));
+        }
+        if(time == -1){
+            LOGE("Invalid date encountered. Skipping.\n");
+            return false;
+        }
+        data.times().push_back(time);
+
+        for(size_t i = 0; i < batch_columns.size(); ++i){
+            if(batch_columns[i] < 0){
+                continue;
+            }
+            int field = static_cast<int>(i);
+            PointBatch::Column& column = data.column(batch_columns[i]);
+            switch(column.type){
+                case PointBatch::ColumnType::INT:
+                    column.values.push_back(sqlite3_column_int(stmt, field));
+                    break;
+                case PointBatch::ColumnType::REAL:
+                    column.values.push_back(sqlite3_column_double(stmt, field));
+                    break;
+                case PointBatch::ColumnType::TEXT: {
+                    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, field));
+                    column.text.push_back(text ? std::string(text) : std::string());
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    void SQLiteDatabaseAccess::bindValue(sqlite3_stmt* stmt, int index, const Json::Value& value, PointBatch::ColumnType type){
+        if(value.isNull()){
+            sqlite3_bind_null(stmt, index);
+        } else if(value.isString()){
+            // Numbers can arrive as strings, e.g. "gsr":"4.27263e-05"; the column affinity
+            // converts them as it did when the values were quoted into the SQL text
+            sqlite3_bind_text(stmt, index, value.asCString(), -1, SQLITE_TRANSIENT);
+        } else if(type == PointBatch::ColumnType::TEXT){
+            std::string text = value.asString();
+            sqlite3_bind_text(stmt, index, text.c_str(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+        } else if(value.isBool()){
+            sqlite3_bind_int(stmt, index, value.asBool() ? 1 : 0);
+        } else if(type == PointBatch::ColumnType::INT && value.isInt64()){
+            sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value.asInt64()));
+        } else if(value.isNumeric()){
+            sqlite3_bind_double(stmt, index, value.asDouble());
+        } else {
+            sqlite3_bind_null(stmt, index);
+        }
+    }
+
+    bool SQLiteDatabaseAccess::insertJson(Inserter& inserter, const std::string& data_values){
+        // Once the payload holds more than one batch, the batches are inserted on the
+        // ingest_writer_ thread while the parser fills the next one.  Only the batch being
+        // filled, the one handed over and the one being inserted are held at once.
+        std::mutex mutex;
+        std::condition_variable changed;
+        JsonPointReader::Rows pending;
+        bool has_pending = false;
+        bool finished = false;
+        bool failed = false;
+        std::future<void> writer;
+
+        std::function<void()> write_rows = [&]() {
+            JsonPointReader::Rows rows;
+            while(true){
+                {
+                    std::unique_lock<std::mutex> guard(mutex);
+                    changed.wait(guard, [&]() { return has_pending || finished; });
+                    if(!has_pending){
+                        return;
+                    }
+                    rows.swap(pending);
+                    has_pending = false;
+                }
+                changed.notify_all();
+
+                try {
+                    insertRows(inserter, rows);
+                } catch (std::exception& ex) {
+                    LOGE("Exceptions caught: %s\n", ex.what());
+                    {
+                        std::lock_guard<std::mutex> guard(mutex);
+                        failed = true;
+                    }
+                    changed.notify_all();
+                    return;
+                }
+            }
+        };
+
+        JsonPointReader reader(schema_);
+        bool read = reader.read(data_values.data(), data_values.size(), INGEST_BATCH_POINTS_,
+            [&](JsonPointReader::Rows& rows, bool last) {
+                if(!writer.valid()){
+                    if(last){
+                        // The whole payload fit in one batch
+                        try {
+                            insertRows(inserter, rows);
+                            return true;
+                        } catch (std::exception& ex) {
+                            LOGE("Exceptions caught: %s\n", ex.what());
+                            return false;
+                        }
+                    }
+                    writer = ingest_writer_.submit(write_rows);
+                }
+
+                std::unique_lock<std::mutex> guard(mutex);
+                changed.wait(guard, [&]() { return !has_pending || failed; });
+                if(failed){
+                    return false;
+                }
+                pending.swap(rows);
+                has_pending = true;
+                guard.unlock();
+                changed.notify_all();
+                return true;
+            });
+
+        if(writer.valid()){
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                finished = true;
+            }
+            changed.notify_all();
+            writer.wait();
+        }
+
+        LOGD("Added data to database from %s to %s\n", reader.startDate().c_str(), reader.endDate().c_str());
+        return read && !failed;
+    }
+
+    void SQLiteDatabaseAccess::insertRows(Inserter& inserter, const JsonPointReader::Rows& rows){
+        for(size_t i = 0; i < rows.size(); ++i){
+            const JsonPointReader::Field* row = rows.row(i);
+            int64_t time = -1;
+            if(insertNeedsTime()){
+                const JsonPointReader::Field& date = row[schema_.dateKeyId()];
+                time = date.type == JsonPointReader::Field::Type::TEXT ? TimeString::toEpochSeconds(date.text) : -1;
+                if(time == -1){
+                    LOGE("Invalid date encountered. Skipping.\n");
+                    continue;
+                }
+            }
+
+            sqlite3_stmt* stmt = inserter.statement(time);
+            for(size_t id = 0; id < schema_.numColumns(); ++id){
+                const JsonPointReader::Field& field = row[id];
+                int index = static_cast<int>(id) + 1;
+                if(id == schema_.dateKeyId() && schema_.integerDateKey()){
+                    // Stored as epoch seconds, converted from the text date
+                    sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(time));
+                    continue;
+                }
+                switch(field.type){
+                    case JsonPointReader::Field::Type::NONE:
+                        sqlite3_bind_null(stmt, index);
+                        break;
+                    case JsonPointReader::Field::Type::INTEGER:
+                        sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(field.integer));
+                        break;
+                    case JsonPointReader::Field::Type::REAL:
+                        sqlite3_bind_double(stmt, index, field.real);
+                        break;
+                    case JsonPointReader::Field::Type::TEXT:
+                        sqlite3_bind_text(stmt, index, field.text.data(), static_cast<int>(field.text.size()), SQLITE_STATIC);
+                        break;
+                }
+            }
+            if(sqlite3_step(stmt) != SQLITE_DONE){
+                std::string err_msg(sqlite3_errmsg(database_));
+                sqlite3_reset(stmt);
+                throw std::runtime_error(err_msg);
+            }
+            sqlite3_reset(stmt);
+        }
+    }
+
+    bool SQLiteDatabaseAccess::endTransaction(bool committed){
+        if(committed){
+            try {
+                executeQuery("COMMIT TRANSACTION;");
+                return true;
+            } catch (std::exception& ex) {
+                LOGE("Exceptions caught: %s\n", ex.what());
+            }
+        }
+        // Roll back the transaction if it is left hanging
+        if(!sqlite3_get_autocommit(database_)){
+            try {
+                executeQuery("ROLLBACK TRANSACTION;");
+            } catch (std::exception& ex) {
+                LOGE("Exception caught trying to roll back transaction: %s\n", ex.what());
+            }
+        }
+        return false;
+    }
+
     bool SQLiteDatabaseAccess::checkDatabase() {
         LOGD("Checking tables\n");
-        if(data_schema_.empty()){
+        if(schema_.empty()){
             LOGE("Cannot check database against empty data schema.\n");
             return false;
         }
 
         try {
-            std::string sql_query = "PRAGMA table_info(" + table_name_ + ");";
+            std::string sql_query = "PRAGMA table_info(" + schema_.table() + ");";
 
-            sqlite3_stmt *stmt;
+            sqlite3_stmt *stmt = NULL;
 
             //LOGD("Executing SQL query %s: \n", sql_query.c_str());
             int rc = sqlite3_prepare_v2(database_, sql_query.c_str(), -1, &stmt, NULL);
@@ -300,9 +965,11 @@ namespace intel { namespace poc {
             if (rc != SQLITE_OK) {
                 std::string err_msg(sqlite3_errmsg(database_));
                 LOGE("Error processing SQL query: %s\n", sql_query.c_str());
+                sqlite3_finalize(stmt);
                 return false;
             } else if(sqlite3_column_count(stmt) != 6){
                 LOGE("Number of returned columns does not match number expected.");
+                sqlite3_finalize(stmt);
                 return false;
             }
 
@@ -312,13 +979,14 @@ namespace intel { namespace poc {
                 std::string column_type = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2)));
                 table_schema[column_name] = column_type;
             }
+            sqlite3_finalize(stmt);
 
 
             /*
             // Output data schema and table schema for visual comparison
             LOGD("Data Schema:\n");
-            for(std::map<std::string,std::string>::const_iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                LOGD("%s : %s\n", it->first.c_str(),it->second.c_str());
+            for(size_t id = 0; id < schema_.numColumns(); ++id){
+                LOGD("%s : %s\n", schema_.column(id).name.c_str(),schema_.column(id).sql_type.c_str());
             }
 
             LOGD("Table Schema:\n");
@@ -326,7 +994,14 @@ namespace intel { namespace poc {
                 LOGD("%s : %s\n", it->first.c_str(),it->second.c_str());
             }*/
 
-            return table_schema == data_schema_;
+            if(!schema_.matches(table_schema)){
+                return false;
+            }
+            if(tableExists(schema_.chunksTable()) != (schema_.chunkPoints() > 0)){
+                LOGE("Database chunks do not match schema\n");
+                return false;
+            }
+            return loadPartitions();
 
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
@@ -339,10 +1014,13 @@ namespace intel { namespace poc {
     bool SQLiteDatabaseAccess::openDatabase(const std::string& database_path){
         LOGD("Opening database %s\n", database_path.c_str());
 
+        readers_.close();
         if (database_){
+            statements_.setDatabase(NULL);
             sqlite3_close(database_);
         }
 
+        // database_ is the only connection that writes
         int rc = sqlite3_open_v2(database_path.c_str(), &database_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
 
         if (rc != SQLITE_OK) {
@@ -350,6 +1028,26 @@ namespace intel { namespace poc {
             LOGE("Cannot open database: %s\n",err_msg.c_str());
             return false;
         }
+        sqlite3_busy_timeout(database_, ConnectionPool::BUSY_TIMEOUT_MS);
+        statements_.setDatabase(database_);
+
+        // The tsdv_* downsampling functions are available on every connection
+        if (!SQLiteFunctions::registerAll(database_)) {
+            return false;
+        }
+
+        // In WAL mode readers see the last commit while a write transaction is in progress
+        try {
+            executeQuery("PRAGMA journal_mode=WAL;");
+        } catch (std::exception& ex) {
+            LOGE("Unable to enable WAL journal mode: %s\n", ex.what());
+        }
+
+        // A private in-memory database cannot be shared, so queries then use database_
+        if (!database_path.empty() && database_path != ":memory:") {
+            readers_.open(database_path, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, "", READER_CONNECTIONS_,
+                          &SQLiteFunctions::registerAll);
+        }
 
         LOGD("Database opened succesfully\n");
         return true;
@@ -359,24 +1057,32 @@ namespace intel { namespace poc {
     void SQLiteDatabaseAccess::createDatabase(){
         LOGD("Creating database\n");
 
-        if(data_schema_.empty()){
+        if(schema_.empty()){
             throw std::runtime_error(std::string("createDatabase called with empty data schema."));
         }
 
-        // recreating tables from scratch
-        std::map<std::string,std::string>::iterator it;
-        std::string query = "DROP TABLE IF EXISTS " + table_name_ + "; ";
-        query += "CREATE TABLE " + table_name_ + "(";
-        for(it = data_schema_.begin(); it != data_schema_.end(); it++){
-            if(it != data_schema_.begin()){
-                query += ", ";
-            }
-            query += it->first + " " + it->second;
-            if(it->first == date_key_column_){
-                query += " PRIMARY KEY";
+        // recreating tables from scratch, together with any partitions
+        std::map<int64_t, Partition> partitions;
+        std::string query;
+        if(readPartitions(partitions)){
+            for(std::map<int64_t, Partition>::iterator it = partitions.begin(); it != partitions.end(); ++it){
+                query += "DROP TABLE IF EXISTS " + it->second.table + "; ";
             }
+            query += "DROP TABLE " + schema_.partitionsTable() + "; ";
+        }
+        query += "DROP TABLE IF EXISTS " + schema_.table() + "; ";
+        query += "DROP TABLE IF EXISTS " + schema_.chunksTable() + "; ";
+        // A partitioned table is only kept as the template of its partitions
+        query += schema_.createTable(schema_.table()) + " ";
+        if(schema_.partitioning() != Schema::Partitioning::NONE){
+            query += "CREATE TABLE " + schema_.partitionsTable() +
+                "(partition_key INTEGER PRIMARY KEY, start_time INTEGER, end_time INTEGER, table_name TEXT); ";
+        }
+        if(schema_.chunkPoints() > 0){
+            // Chunks never overlap, so they are keyed and ordered by their first time
+            query += "CREATE TABLE " + schema_.chunksTable() +
+                "(start_time INTEGER PRIMARY KEY, end_time INTEGER, num_points INTEGER, summary BLOB, points BLOB); ";
         }
-        query += "); ";
 
         try {
             executeQuery(query);
@@ -384,6 +1090,456 @@ namespace intel { namespace poc {
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
         }
+        loadPartitions();
+    }
+
+    std::string SQLiteDatabaseAccess::insertSql(const std::string& table) const{
+        std::string sql = "INSERT OR IGNORE INTO " + table + " (" + schema_.columnList() + ") VALUES (";
+        for(size_t id = 0; id < schema_.numColumns(); ++id){
+            sql += id == 0 ? "?" : ", ?";
+        }
+        return sql + ");";
+    }
+
+    bool SQLiteDatabaseAccess::readPartitions(std::map<int64_t, Partition>& partitions){
+        partitions.clear();
+        std::string sql_query = "SELECT partition_key, start_time, end_time, table_name FROM " + schema_.partitionsTable() + ";";
+        sqlite3_stmt *stmt = NULL;
+        if(sqlite3_prepare_v2(database_, sql_query.c_str(), -1, &stmt, NULL) != SQLITE_OK){
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            Partition& partition = partitions[sqlite3_column_int64(stmt, 0)];
+            partition.start = sqlite3_column_int64(stmt, 1);
+            partition.end = sqlite3_column_int64(stmt, 2);
+            const char* table = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            partition.table = table ? table : "";
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    }
+
+    bool SQLiteDatabaseAccess::loadPartitions(){
+        std::map<int64_t, Partition> partitions;
+        bool matches = readPartitions(partitions) == (schema_.partitioning() != Schema::Partitioning::NONE);
+        for(std::map<int64_t, Partition>::iterator it = partitions.begin(); matches && it != partitions.end(); ++it){
+            matches = it->second.start == schema_.partitionStart(it->first) && it->second.end == schema_.partitionEnd(it->first);
+        }
+        if(!matches){
+            LOGE("Database partitioning does not match schema\n");
+            partitions.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(partitions_mutex_);
+        partitions_.swap(partitions);
+        return matches;
+    }
+
+    std::vector<std::string> SQLiteDatabaseAccess::queryTables(int64_t start_time, int64_t end_time){
+        std::vector<std::string> tables;
+        if(schema_.partitioning() == Schema::Partitioning::NONE){
+            tables.push_back(schema_.table());
+            return tables;
+        }
+
+        std::lock_guard<std::mutex> lock(partitions_mutex_);
+        std::map<int64_t, Partition>::const_iterator it = partitions_.lower_bound(schema_.partitionKey(start_time));
+        for(; it != partitions_.end() && it->second.start <= end_time; ++it){
+            tables.push_back(it->second.table);
+        }
+        return tables;
+    }
+
+    void SQLiteDatabaseAccess::bindTime(sqlite3_stmt* stmt, int index, int64_t time) const{
+        if(schema_.integerDateKey()){
+            sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(time));
+        } else if(time == -1){
+            sqlite3_bind_text(stmt, index, "", 0, SQLITE_STATIC);
+        } else {
+            char date[TimeString::LENGTH + 1];
+            TimeString::format(time, date);
+            sqlite3_bind_text(stmt, index, date, static_cast<int>(TimeString::LENGTH), SQLITE_TRANSIENT);
+        }
+    }
+
+    bool SQLiteDatabaseAccess::tableExists(const std::string& table){
+        StatementCache::Lease select(statements_, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?1;");
+        sqlite3_stmt* stmt = select.get();
+        if(stmt == NULL){
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, table.c_str(), static_cast<int>(table.size()), SQLITE_TRANSIENT);
+        return sqlite3_step(stmt) == SQLITE_ROW;
+    }
+
+    void SQLiteDatabaseAccess::readTableRows(const std::string& condition, int64_t time, size_t limit, PointBatch& rows){
+        schema_.layout(rows);
+        std::vector<int> batch_columns;
+        for(size_t id = 0; id < schema_.numColumns(); ++id){
+            batch_columns.push_back(id == schema_.dateKeyId() ? -1 : rows.columnIndex(schema_.column(id).name));
+        }
+
+        const std::string& date_key_column = schema_.dateKeyColumn();
+        StatementCache::Lease select(statements_, "SELECT " + schema_.columnList() + " FROM " + schema_.table() +
+            " WHERE " + date_key_column + condition + " ORDER BY " + date_key_column +
+            (limit > 0 ? " LIMIT " + std::to_string(limit) : std::string()) + ";");
+        sqlite3_stmt* stmt = select.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to read rows: " + std::string(sqlite3_errmsg(database_)));
+        }
+        bindTime(stmt, 1, time);
+
+        int rc;
+        while((rc = sqlite3_step(stmt)) == SQLITE_ROW){
+            appendRow(stmt, static_cast<int>(schema_.dateKeyId()), batch_columns, rows);
+        }
+        if(rc != SQLITE_DONE){
+            throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+        }
+    }
+
+    void SQLiteDatabaseAccess::deleteTableRows(int64_t through){
+        StatementCache::Lease remove(statements_, "DELETE FROM " + schema_.table() + " WHERE " + schema_.dateKeyColumn() + " <= ?1;");
+        sqlite3_stmt* stmt = remove.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to delete rows: " + std::string(sqlite3_errmsg(database_)));
+        }
+        bindTime(stmt, 1, through);
+        if(sqlite3_step(stmt) != SQLITE_DONE){
+            throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+        }
+    }
+
+    int64_t SQLiteDatabaseAccess::chunksEnd(){
+        StatementCache::Lease select(statements_, "SELECT end_time FROM " + schema_.chunksTable() + " ORDER BY start_time DESC LIMIT 1;");
+        sqlite3_stmt* stmt = select.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to read chunks: " + std::string(sqlite3_errmsg(database_)));
+        }
+        int rc = sqlite3_step(stmt);
+        if(rc == SQLITE_ROW){
+            return sqlite3_column_int64(stmt, 0);
+        } else if(rc != SQLITE_DONE){
+            throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+        }
+        return -1;
+    }
+
+    void SQLiteDatabaseAccess::writeChunk(const PointBatch& points){
+        std::string summary;
+        std::string blob;
+        ChunkCodec::summarize(points, summary);
+        ChunkCodec::encode(points, blob);
+
+        StatementCache::Lease insert(statements_, "INSERT INTO " + schema_.chunksTable() +
+            " (start_time, end_time, num_points, summary, points) VALUES (?1, ?2, ?3, ?4, ?5);");
+        sqlite3_stmt* stmt = insert.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to write chunk: " + std::string(sqlite3_errmsg(database_)));
+        }
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(points.times().front()));
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(points.times().back()));
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(points.size()));
+        sqlite3_bind_blob(stmt, 4, summary.data(), static_cast<int>(summary.size()), SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 5, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+        if(sqlite3_step(stmt) != SQLITE_DONE){
+            throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+        }
+    }
+
+    void SQLiteDatabaseAccess::readChunk(int64_t start, PointBatch& points){
+        schema_.layout(points);
+        StatementCache::Lease select(statements_, "SELECT points FROM " + schema_.chunksTable() + " WHERE start_time = ?1;");
+        sqlite3_stmt* stmt = select.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to read chunk: " + std::string(sqlite3_errmsg(database_)));
+        }
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(start));
+        if(sqlite3_step(stmt) != SQLITE_ROW){
+            throw std::runtime_error("Unable to read chunk at " + std::to_string(start));
+        }
+        const void* blob = sqlite3_column_blob(stmt, 0);
+        int size = sqlite3_column_bytes(stmt, 0);
+        if(!ChunkCodec::decode(blob, static_cast<size_t>(size), points)){
+            throw std::runtime_error("Corrupt chunk at " + std::to_string(start));
+        }
+    }
+
+    void SQLiteDatabaseAccess::sealChunks(){
+        size_t chunk_points = schema_.chunkPoints();
+        if(chunk_points == 0){
+            return;
+        }
+
+        int64_t end = chunksEnd();
+        PointBatch rows;
+        if(end >= 0){
+            readTableRows(" <= ?1", end, 0, rows);
+            if(!rows.empty()){
+                mergeLateRows(rows);
+                deleteTableRows(end);
+            }
+        }
+
+        int64_t num_rows = 0;
+        {
+            StatementCache::Lease count(statements_, "SELECT count(*) FROM " + schema_.table() + ";");
+            sqlite3_stmt* stmt = count.get();
+            if(stmt == NULL || sqlite3_step(stmt) != SQLITE_ROW){
+                throw std::runtime_error("Unable to count rows: " + std::string(sqlite3_errmsg(database_)));
+            }
+            num_rows = sqlite3_column_int64(stmt, 0);
+        }
+
+        for(; num_rows >= static_cast<int64_t>(chunk_points); num_rows -= static_cast<int64_t>(chunk_points)){
+            readTableRows(" > ?1", end, chunk_points, rows);
+            if(rows.size() < chunk_points){
+                // Rows with invalid dates are never sealed
+                break;
+            }
+            writeChunk(rows);
+            end = rows.times().back();
+            deleteTableRows(end);
+        }
+    }
+
+    void SQLiteDatabaseAccess::mergeLateRows(const PointBatch& rows){
+        const std::string table = schema_.chunksTable();
+        std::map<int64_t, std::vector<size_t>> targets;
+        {
+            StatementCache::Lease find(statements_, "SELECT coalesce((SELECT max(start_time) FROM " + table +
+                " WHERE start_time <= ?1), (SELECT min(start_time) FROM " + table + "));");
+            sqlite3_stmt* stmt = find.get();
+            if(stmt == NULL){
+                throw std::runtime_error("Unable to read chunks: " + std::string(sqlite3_errmsg(database_)));
+            }
+            for(size_t i = 0; i < rows.size(); ++i){
+                sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(rows.times()[i]));
+                if(sqlite3_step(stmt) != SQLITE_ROW){
+                    throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+                }
+                targets[sqlite3_column_int64(stmt, 0)].push_back(i);
+                sqlite3_reset(stmt);
+            }
+        }
+
+        PointBatch chunk;
+        PointBatch merged;
+        for(std::map<int64_t, std::vector<size_t>>::iterator it = targets.begin(); it != targets.end(); ++it){
+            readChunk(it->first, chunk);
+            merged.copyLayout(chunk);
+            const std::vector<size_t>& late = it->second;
+            size_t i = 0;
+            size_t j = 0;
+            while(i < chunk.size() || j < late.size()){
+                if(j == late.size() || (i < chunk.size() && chunk.times()[i] <= rows.times()[late[j]])){
+                    if(j < late.size() && chunk.times()[i] == rows.times()[late[j]]){
+                        ++j;
+                    }
+                    merged.appendPoint(chunk, i++);
+                } else {
+                    merged.appendPoint(rows, late[j++]);
+                }
+            }
+
+            StatementCache::Lease remove(statements_, "DELETE FROM " + table + " WHERE start_time = ?1;");
+            sqlite3_stmt* stmt = remove.get();
+            if(stmt == NULL){
+                throw std::runtime_error("Unable to delete chunk: " + std::string(sqlite3_errmsg(database_)));
+            }
+            sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(it->first));
+            if(sqlite3_step(stmt) != SQLITE_DONE){
+                throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+            }
+            writeChunk(merged);
+        }
+    }
+
+    void SQLiteDatabaseAccess::removeChunks(int64_t before){
+        const std::string table = schema_.chunksTable();
+        int64_t straddling = -1;
+        {
+            StatementCache::Lease remove(statements_, "DELETE FROM " + table + " WHERE end_time < ?1;");
+            StatementCache::Lease select(statements_, "SELECT start_time FROM " + table + " WHERE start_time < ?1;");
+            if(remove.get() == NULL || select.get() == NULL){
+                throw std::runtime_error("Unable to remove chunks: " + std::string(sqlite3_errmsg(database_)));
+            }
+            sqlite3_bind_int64(remove.get(), 1, static_cast<sqlite3_int64>(before));
+            if(sqlite3_step(remove.get()) != SQLITE_DONE){
+                throw std::runtime_error(std::string(sqlite3_errmsg(database_)));
+            }
+            // Chunks do not overlap, so at most one is left holding points before the time
+            sqlite3_bind_int64(select.get(), 1, static_cast<sqlite3_int64>(before));
+            if(sqlite3_step(select.get()) == SQLITE_ROW){
+                straddling = sqlite3_column_int64(select.get(), 0);
+            }
+        }
+        if(straddling < 0){
+            return;
+        }
+
+        PointBatch chunk;
+        readChunk(straddling, chunk);
+        PointBatch kept;
+        kept.copyLayout(chunk);
+        for(size_t i = 0; i < chunk.size(); ++i){
+            if(chunk.times()[i] >= before){
+                kept.appendPoint(chunk, i);
+            }
+        }
+        executeQuery("DELETE FROM " + table + " WHERE start_time = " + std::to_string(straddling) + ";");
+        if(!kept.empty()){
+            writeChunk(kept);
+        }
+    }
+
+    void SQLiteDatabaseAccess::readChunks(sqlite3* database, StatementCache& statements, int64_t start_time, int64_t end_time,
+                                          PointBatch& data, StreamingDownsampler* downsampler){
+        // Map every batch column to its chunk column
+        PointBatch chunk;
+        schema_.layout(chunk);
+        std::vector<int> chunk_columns;
+        bool summaries = downsampler != NULL && downsampler->mode() == StreamingDownsampler::Mode::AVERAGE;
+        for(size_t c = 0; c < data.numColumns(); ++c){
+            chunk_columns.push_back(chunk.columnIndex(data.column(c).name));
+            summaries = summaries && data.column(c).type != PointBatch::ColumnType::TEXT;
+        }
+
+        // The chunk holding start_time, if any, is the last one starting at or before it
+        const std::string table = schema_.chunksTable();
+        StatementCache::Lease select(statements, "SELECT start_time, end_time, num_points, summary, points FROM " + table +
+            " WHERE start_time >= coalesce((SELECT max(start_time) FROM " + table + " WHERE start_time <= ?1), ?1)" +
+            " AND start_time <= ?2 AND end_time >= ?1 ORDER BY start_time;");
+        sqlite3_stmt* stmt = select.get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to read chunks: " + std::string(sqlite3_errmsg(database)));
+        }
+        sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(start_time));
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(end_time));
+
+        ChunkCodec::Summary summary;
+        std::vector<double> sums(data.numColumns());
+        int rc;
+        while((rc = sqlite3_step(stmt)) == SQLITE_ROW){
+            int64_t chunk_start = sqlite3_column_int64(stmt, 0);
+            int64_t chunk_end = sqlite3_column_int64(stmt, 1);
+            if(summaries && chunk_start >= start_time && chunk_end <= end_time){
+                // A chunk inside one bucket is averaged from its summary, without decoding it
+                const void* blob = sqlite3_column_blob(stmt, 3);
+                int size = sqlite3_column_bytes(stmt, 3);
+                if(ChunkCodec::decodeSummary(blob, static_cast<size_t>(size), chunk.numColumns(), summary)){
+                    for(size_t c = 0; c < sums.size(); ++c){
+                        sums[c] = summary.sum[chunk_columns[c]];
+                    }
+                    downsampler->push(data);
+                    data.clearPoints();
+                    if(downsampler->pushSummary(chunk_start, chunk_end, static_cast<size_t>(sqlite3_column_int64(stmt, 2)), sums)){
+                        continue;
+                    }
+                }
+            }
+
+            const void* blob = sqlite3_column_blob(stmt, 4);
+            int size = sqlite3_column_bytes(stmt, 4);
+            chunk.clearPoints();
+            if(!ChunkCodec::decode(blob, static_cast<size_t>(size), chunk)){
+                throw std::runtime_error("Corrupt chunk at " + std::to_string(chunk_start));
+            }
+
+            // Copy the points of the time frame, column by column
+            const std::vector<int64_t>& times = chunk.times();
+            std::vector<int64_t>::const_iterator first = std::lower_bound(times.begin(), times.end(), start_time);
+            std::vector<int64_t>::const_iterator last = std::upper_bound(first, times.end(), end_time);
+            size_t first_i = static_cast<size_t>(first - times.begin());
+            size_t last_i = static_cast<size_t>(last - times.begin());
+            data.times().insert(data.times().end(), first, last);
+            for(size_t c = 0; c < chunk_columns.size(); ++c){
+                const PointBatch::Column& from = chunk.column(chunk_columns[c]);
+                PointBatch::Column& to = data.column(c);
+                if(to.type == PointBatch::ColumnType::TEXT){
+                    to.text.insert(to.text.end(), from.text.begin() + first_i, from.text.begin() + last_i);
+                } else {
+                    to.values.insert(to.values.end(), from.values.begin() + first_i, from.values.begin() + last_i);
+                }
+            }
+
+            if(downsampler != NULL && data.size() >= STREAM_CHUNK_POINTS_){
+                downsampler->push(data);
+                data.clearPoints();
+            }
+        }
+        if(rc != SQLITE_DONE){
+            throw std::runtime_error("Error reading chunks: " + std::string(sqlite3_errmsg(database)));
+        }
+    }
+
+    SQLiteDatabaseAccess::Inserter::Inserter(SQLiteDatabaseAccess& access)
+        :access_(access), start_(0), end_(-1) {}
+
+    sqlite3_stmt* SQLiteDatabaseAccess::Inserter::statement(int64_t time){
+        const Schema& schema = access_.schema_;
+        if(schema.partitioning() == Schema::Partitioning::NONE){
+            if(!insert_){
+                insert_.reset(new StatementCache::Lease(access_.statements_, access_.insert_sql_));
+            }
+        } else if(!insert_ || time < start_ || time > end_){
+            // Rows mostly arrive in time order, so the partition rarely changes
+            int64_t key = schema.partitionKey(time);
+            Partition partition;
+            bool found = false;
+            std::map<int64_t, Partition>::iterator created = created_.find(key);
+            if(created != created_.end()){
+                partition = created->second;
+                found = true;
+            } else {
+                std::lock_guard<std::mutex> lock(access_.partitions_mutex_);
+                std::map<int64_t, Partition>::iterator it = access_.partitions_.find(key);
+                if(it != access_.partitions_.end()){
+                    partition = it->second;
+                    found = true;
+                }
+            }
+
+            if(!found){
+                partition.start = schema.partitionStart(key);
+                partition.end = schema.partitionEnd(key);
+                partition.table = schema.partitionTable(key);
+                access_.executeQuery(schema.createTable(partition.table) + " INSERT INTO " + schema.partitionsTable() +
+                    " VALUES (" + std::to_string(key) + ", " + std::to_string(partition.start) + ", " +
+                    std::to_string(partition.end) + ", '" + partition.table + "');");
+                created_[key] = partition;
+            }
+
+            insert_.reset();
+            insert_.reset(new StatementCache::Lease(access_.statements_, access_.insertSql(partition.table)));
+            start_ = partition.start;
+            end_ = partition.end;
+        }
+
+        sqlite3_stmt* stmt = insert_->get();
+        if(stmt == NULL){
+            throw std::runtime_error("Unable to prepare insert: " + std::string(sqlite3_errmsg(access_.database_)));
+        }
+        return stmt;
+    }
+
+    void SQLiteDatabaseAccess::Inserter::savepoint(){
+        saved_ = created_;
+    }
+
+    void SQLiteDatabaseAccess::Inserter::rollback(){
+        created_.swap(saved_);
+        // The partition being inserted into may have been rolled back
+        insert_.reset();
+        start_ = 0;
+        end_ = -1;
+    }
+
+    void SQLiteDatabaseAccess::Inserter::commit(){
+        std::lock_guard<std::mutex> lock(access_.partitions_mutex_);
+        access_.partitions_.insert(created_.begin(), created_.end());
+        created_.clear();
     }
 
     void SQLiteDatabaseAccess::executeQuery(const std::string& sql_query){
@@ -22,12 +22,11 @@
 
 #include <graphfilter/sqlitedatacache.h>
 #include <graphfilter/sqlitedatabaseaccess.h>
+#include <graphfilter/timestring.h>
 #include <stdexcept>
 #include <stdlib.h>
 #include <algorithm>
-#include <thread>
-#include <future>
-#include <time.h>
+#include <functional>
 
 namespace intel { namespace poc {
 
@@ -40,19 +39,43 @@ namespace intel { namespace poc {
 
     SQLiteDataCache::~SQLiteDataCache()
     {
+        std::unique_lock<std::mutex> fills_lock(fills_mutex_);
+        waitForFills(fills_lock);
+        fills_lock.unlock();
+
         if (database_) {
+            readers_.close();
+            statements_.setDatabase(NULL);
             sqlite3_close(database_);
         }
     }
 
-    const std::string SQLiteDataCache::database_path_ = ":memory:";
+    // A named in-memory database, so the reader connections share it with the writer
+    const std::string SQLiteDataCache::database_path_ = "file:tsdv_cache?mode=memory&cache=shared";
 
     bool SQLiteDataCache::init(const Json::Value& cache_setup, const Json::Value& data_schema, bool clean){
-        // Wait until any putData calls are done in case someone re-calls init after putData.
-        std::lock_guard<std::mutex> guard(put_data_mutex_);
+        // Parse data_schema
+        Schema schema;
+        if(!schema.parse(data_schema)){
+            initialized_ = false;
+            return false;
+        }
+        return init(cache_setup, schema, clean);
+    }
+
+    bool SQLiteDataCache::init(const Json::Value& cache_setup, const Schema& schema, bool clean){
+        // Drop the fills not started yet and wait until the running ones are done, in case
+        // someone re-calls init after cacheData.  No fill starts until init is done.
+        std::unique_lock<std::mutex> fills_lock(fills_mutex_);
+        waitForFills(fills_lock);
 
         initialized_ = false;
+        std::unique_lock<std::mutex> lock_bounds(cache_data_bounds_mutex_);
         cache_data_bounds_.clear();
+        cache_ranges_.clear();
+        lru_ranges_.clear();
+        cached_bytes_ = 0;
+        lock_bounds.unlock();
         cache_levels_.clear();
 
         // Parse cache_setup
@@ -63,6 +86,7 @@ namespace intel { namespace poc {
         cache_raw_data_ = cache_setup.isMember("cacheRawData") ? cache_setup["cacheRawData"].asBool() : false;
         fetch_ahead_ = cache_setup.isMember("fetchAhead") ? cache_setup["fetchAhead"].asInt() : 0;
         fetch_behind_ = cache_setup.isMember("fetchBehind") ? cache_setup["fetchBehind"].asInt() : 0;
+        max_cache_bytes_ = static_cast<size_t>(cache_setup.get("maxCacheBytes", 0).asUInt64());
         downsampling_filter_ = cache_setup.isMember("downsamplingFilter") ? DataFilter::getType(cache_setup["downsamplingFilter"].asString()) : DataFilter::FilterType::TIME_WEIGHTED_POINTS;
         if(cache_setup.isMember("downsamplingLevels") && cache_setup["downsamplingLevels"].isArray()){
             //LOGD("Requested downsampling levels: %s\n",cache_setup["downsamplingLevels"].toStyledString().c_str());
@@ -79,27 +103,22 @@ namespace intel { namespace poc {
             }
         }
 
-        // Parse data_schema
-        if(!data_schema.isObject()){
-            LOGE("data_schema not object json type: %s", data_schema.toStyledString().c_str());
-            return false;
+        // Levels are downsampled slice by slice, so each loses at most one point per slice
+        // to rounding
+        fill_slice_seconds_ = FILL_SLICE_SECONDS_;
+        for(size_t level = 0; level < cache_levels_.size(); ++level){
+            if(cache_levels_[level]["num_of_points"] > 0){
+                int64_t seconds = static_cast<int64_t>(cache_levels_[level]["duration"]) * FILL_SLICE_LEVEL_POINTS_ / cache_levels_[level]["num_of_points"];
+                fill_slice_seconds_ = std::max(fill_slice_seconds_, (seconds + 59) / 60 * 60);
+            }
         }
-        if(!data_schema.isMember("table") || !data_schema.isMember("date_key_column") || !data_schema.isMember("columns")){
-            LOGE("Malformed data schema value: %s\n", data_schema.toStyledString().c_str());
-            return false;
-        } else {
-            table_name_ = data_schema.get("table", "table").asString() + "_cache";
 
-            date_key_column_ = data_schema["date_key_column"].asString();
-            std::vector<std::string> data_names = data_schema["columns"].getMemberNames();
-            if(std::find(data_names.begin(),data_names.end(),date_key_column_) == data_names.end()){
-                LOGE("Date key column not found in column list\n");
-                return false;
-            }
-            for(std::vector<std::string>::iterator it = data_names.begin(); it != data_names.end(); ++it){
-                data_schema_[*it] = data_schema["columns"][*it].asString();
-            }
+        if(schema.empty()){
+            LOGE("Cannot initialize cache with empty data schema.\n");
+            return false;
         }
+        schema_ = schema;
+        table_name_ = schema.table() + "_cache";
 
         if(!openDatabase()){
             LOGE("Failed to open database: %s\n", database_path_.c_str());
@@ -130,214 +149,338 @@ namespace intel { namespace poc {
             throw std::runtime_error(std::string("Database not yet initialized."));
         }
 
-        if(start_date.empty() || end_date.empty() || timeStringToEpochSeconds(start_date) <= 0 || timeStringToEpochSeconds(end_date) <= 0){
+        if(start_date.empty() || end_date.empty() || TimeString::toEpochSeconds(start_date) == -1 || TimeString::toEpochSeconds(end_date) == -1){
             throw std::runtime_error(std::string("Invalid start_date or end_date: ") + start_date + ", " + end_date);
         }
 
-        LOGD("Calling cacheData in separate thread.\n");
-        std::thread (&SQLiteDataCache::cacheDataAsync, this, start_date, end_date).detach();
+        std::string start_date_cache = start_date;
+        std::string end_date_cache = end_date;
+
+        int64_t duration = TimeString::toEpochSeconds(end_date_cache) - TimeString::toEpochSeconds(start_date_cache);
+        if(fetch_behind_ > 0) {
+            start_date_cache = updateTimeString(start_date_cache, -1 * fetch_behind_ * duration);
+        }
+        if(fetch_ahead_ > 0){
+            end_date_cache = updateTimeString(end_date_cache, fetch_ahead_ * duration);
+        }
+
+        std::lock_guard<std::mutex> lock(fills_mutex_);
+        ++fill_generation_;
+
+        // Fills of earlier calls that this one does not touch are for views scrolled past
+        dropStaleFills(pending_fills_, start_date_cache, end_date_cache);
+        dropStaleFills(pending_prefetches_, start_date_cache, end_date_cache);
+        for(std::map<std::string,Fill>::iterator it = running_fills_.begin(); it != running_fills_.end(); ++it){
+            if(it->second.end_date.compare(start_date_cache) < 0 || it->first.compare(end_date_cache) > 0){
+                it->second.cancelled = true;
+            }
+        }
+
+        // The requested range is filled first, so the cache serves the next frame
+        queueFill(pending_fills_, start_date, end_date);
+        if(start_date_cache.compare(start_date) < 0){
+            queueFill(pending_prefetches_, start_date_cache, start_date);
+        }
+        if(end_date_cache.compare(end_date) > 0){
+            queueFill(pending_prefetches_, end_date, end_date_cache);
+        }
+        scheduleFills();
     }
 
-    bool SQLiteDataCache::getAndPutData(const std::string& start_date, const std::string& end_date){
+    size_t SQLiteDataCache::cacheBytes(){
+        std::lock_guard<std::mutex> lock(cache_data_bounds_mutex_);
+        return cached_bytes_;
+    }
+
+    /**
+    * Fetches [start_date, end_date] and inserts it into every cache table.  All levels are
+    *              downsampled before any table is written, so a fill cancelled between levels
+    *              returns false without inserting anything.
+    */
+    bool SQLiteDataCache::getAndPutData(const std::string& fill_start, const std::string& start_date, const std::string& end_date, size_t& bytes){
+        bytes = 0;
         LOGD("Adding portion of data to cache from %s to %s\n", start_date.c_str(), end_date.c_str());
         Json::Value params_json;
         params_json["startDate"] = start_date;
         params_json["endDate"] = end_date;
-        Json::Value data_values = SQLiteDatabaseAccess::instance().getData(params_json);
-
-        if (!data_values.isMember("startDate") || !data_values.isMember("endDate") || !data_values.isMember("points")){
-            LOGE("Invalid data: startDate, endDate, or points missing.\n");
+        PointBatch data_values;
+        if(!SQLiteDatabaseAccess::instance().getData(params_json, data_values)){
+            LOGE("Unable to retrieve data from database.\n");
             return false;
         }
 
-        if(!data_values["points"].isArray() || data_values["points"].size() == 0){
+        if(data_values.empty()){
             LOGD("No points to put into databasae.\n");
             return true;
         }
 
-        // Add the data to the database
-        bool putDataSuccess = true;
+        std::vector<PointBatch> levels(cache_levels_.size());
+        for(size_t level = 1; level <= cache_levels_.size(); ++level){
+            if(fillCancelled(fill_start)){
+                return false;
+            }
+            DataFilter::applyFilter(data_values, levels[level - 1], getDurationNumPoints(start_date, end_date, static_cast<int>(level)), downsampling_filter_);
+        }
 
-        std::vector<std::future<bool>> results;
+        // Add the data to the database.  The fill already runs on a fill worker, and inserts
+        // are serialized on the connection, so the levels are filled one after the other.
+        bool putDataSuccess = true;
 
         if(cache_raw_data_){
-            results.push_back(std::async(std::launch::async, &SQLiteDataCache::putDataTable, this, table_name_ + "_raw", data_values["points"]));
+            putDataSuccess = putDataTable(table_name_ + "_raw", data_values) && putDataSuccess;
+            bytes += batchBytes(data_values);
         }
 
-        // Start all async puts
-        for(int level=1; level <= cache_levels_.size(); ++level){
-            results.push_back(std::async(std::launch::async, &SQLiteDataCache::downsampleAndPutData, this, level, data_values));
-        }
-        // Retrieve all success values
-        for(int i=0; i < results.size(); ++i){
-            putDataSuccess = putDataSuccess && results[i].get();
+        for(size_t level = 1; level <= levels.size(); ++level){
+            std::stringstream buff;
+            buff << "_" << level;
+            putDataSuccess = putDataTable(table_name_ + buff.str(), levels[level - 1]) && putDataSuccess;
+            bytes += batchBytes(levels[level - 1]);
         }
 
         return putDataSuccess;
     }
 
-    bool SQLiteDataCache::downsampleAndPutData(int level, const Json::Value& data_values){
-        bool putDataSuccess = true;
-        std::stringstream buff;
-        buff << "_" << level;
-        std::string start_date = data_values.get("startDate", "").asString();
-        std::string end_date = data_values.get("endDate", "").asString();
-        //putDataSuccess = putDataSuccess && clearDatabaseRange(table_name_ + buff.str(), start_date, end_date);
-        Json::Value json_response = DataFilter::applyFilter(data_values, data_schema_, getDurationNumPoints(start_date, end_date, level),downsampling_filter_);
-        putDataSuccess = putDataSuccess && putDataTable(table_name_ + buff.str(), json_response["points"]);
-        return putDataSuccess;
-    }
-
-    void SQLiteDataCache::cacheDataAsync(const std::string& start_date, const std::string& end_date){
-        std::lock_guard<std::mutex> guard(put_data_mutex_);
-
-        std::string start_date_cache = start_date;
-        std::string end_date_cache = end_date;
-
-        long duration = timeStringToEpochSeconds(end_date_cache) - timeStringToEpochSeconds(start_date_cache);
-        if(fetch_behind_ > 0) {
-            start_date_cache = updateTimeString(start_date_cache, -1 * fetch_behind_ * duration);
-        }
-        if(fetch_ahead_ > 0){
-            end_date_cache = updateTimeString(end_date_cache, fetch_ahead_ * duration);
+    void SQLiteDataCache::queueFill(std::map<std::string,Fill>& fills, std::string start_date, std::string end_date){
+        // Merge the fill with every pending one it overlaps or touches, so that fast scrolling
+        // queues one fill for the whole range rather than one per call
+        std::map<std::string,Fill>::iterator it = fills.begin();
+        while(it != fills.end()){
+            if(it->second.end_date.compare(start_date) < 0 || it->first.compare(end_date) > 0){
+                ++it;
+                continue;
+            }
+            if(it->first.compare(start_date) < 0){
+                start_date = it->first;
+            }
+            if(it->second.end_date.compare(end_date) > 0){
+                end_date = it->second.end_date;
+            }
+            fills.erase(it++);  // NOTE: post-increment is VERY IMPORTANT here
         }
 
-        std::string start_date_tmp = start_date_cache;
-        std::string end_date_tmp = end_date_cache;
-
-
-        LOGD("Adding data to cache from %s to %s\n", start_date_cache.c_str(), end_date_cache.c_str());
+        Fill fill;
+        fill.end_date = end_date;
+        fill.generation = fill_generation_;
+        fill.cancelled = false;
+        fills[start_date] = fill;
+        LOGD("Queued cache fill from %s to %s\n", start_date.c_str(), end_date.c_str());
+    }
 
-        // Create a copy of the current state so we aren't affecting the original yet
-        std::unique_lock<std::mutex> lock_read(cache_data_bounds_mutex_);
-        std::map<std::string,std::string> cache_data_bounds_tmp = cache_data_bounds_;
-        lock_read.unlock();
-        // Check the data cache bounds against this query
-        std::map<std::string,std::string>::iterator it = cache_data_bounds_tmp.begin();
-        while( it != cache_data_bounds_tmp.end()){
-            if(start_date_tmp.compare(it->first) >= 0 && end_date_tmp.compare(it->second) <= 0){
-                // Cache already contains all data for this range
-                LOGD("Cache already contains all data.\n");
-                return;
-            } else if(start_date_tmp.compare(it->second) > 0 || end_date_tmp.compare(it->first) < 0){
-                // No conflict with this set, keep looking
-                ++it;
-            } else if((start_date_tmp.compare(it->first) <= 0 && end_date_tmp.compare(it->second) <= 0) || end_date_tmp.compare(it->first) == 0){
-                // New data overlaps data to the left. Use new start date as start bound and old end date as end bound
-                LOGD("New data overlaps cache data to the left.\n");
-                end_date_tmp = it->second;
-                // Remove the old value, as new one will replace it
-                cache_data_bounds_tmp.erase(it++);  // NOTE: post-increment is VERY IMPORTANT here
-            } else if((start_date_tmp.compare(it->first) >= 0 && end_date_tmp.compare(it->second) >= 0) || start_date_tmp.compare(it->second) == 0){
-                 // New data overlaps data to the right. Use old start date as start bound and new end date as end bound
-                 LOGD("New data overlaps cache data to the right.\n");
-                 start_date_tmp = it->first;
-                 // Remove the old value, as new one will replace it
-                 cache_data_bounds_tmp.erase(it++);  // NOTE: post-increment is VERY IMPORTANT here
-             } else if(start_date_tmp.compare(it->first) <= 0 && end_date_tmp.compare(it->second) >= 0){
-                 // Old data is a subset of new data. Use new start and end date
-                 LOGD("Old data is a subset of new data.\n");
-                 // remove the old value, as new one will replace it
-                 cache_data_bounds_tmp.erase(it++);  // NOTE: post-increment is VERY IMPORTANT here
-             } else {
+    void SQLiteDataCache::dropStaleFills(std::map<std::string,Fill>& fills, const std::string& start_date, const std::string& end_date){
+        std::map<std::string,Fill>::iterator it = fills.begin();
+        while(it != fills.end()){
+            if(it->second.end_date.compare(start_date) < 0 || it->first.compare(end_date) > 0){
+                LOGD("Dropped stale cache fill from %s to %s\n", it->first.c_str(), it->second.end_date.c_str());
+                fills.erase(it++);  // NOTE: post-increment is VERY IMPORTANT here
+            } else {
                 ++it;
             }
         }
+    }
 
-        // Put the new value in the cache data bounds map
-        cache_data_bounds_tmp[start_date_tmp] = end_date_tmp;
+    /**
+    * Returns the pending fill of the newest generation that can start now, or fills.end().  A
+    *              fill overlapping a running one waits for it, so both do not fetch the same
+    *              points; fills that only share an end date may run together.
+    */
+    std::map<std::string,SQLiteDataCache::Fill>::iterator SQLiteDataCache::nextFill(std::map<std::string,Fill>& fills){
+        std::map<std::string,Fill>::iterator next = fills.end();
+        for(std::map<std::string,Fill>::iterator it = fills.begin(); it != fills.end(); ++it){
+            if(next != fills.end() && it->second.generation <= next->second.generation){
+                continue;
+            }
+            bool overlaps_running = false;
+            for(std::map<std::string,Fill>::iterator running = running_fills_.begin(); running != running_fills_.end(); ++running){
+                if(running->second.end_date.compare(it->first) > 0 && running->first.compare(it->second.end_date) < 0){
+                    overlaps_running = true;
+                    break;
+                }
+            }
+            if(!overlaps_running){
+                next = it;
+            }
+        }
+        return next;
+    }
 
+    void SQLiteDataCache::scheduleFills(){
+        while(running_fills_.size() < FILL_THREADS_){
+            std::map<std::string,Fill>* fills = &pending_fills_;
+            std::map<std::string,Fill>::iterator next = nextFill(pending_fills_);
+            if(next == pending_fills_.end()){
+                fills = &pending_prefetches_;
+                next = nextFill(pending_prefetches_);
+                if(next == pending_prefetches_.end()){
+                    return;
+                }
+            }
 
-        // Add the data to the database
-        bool putDataSuccess = true;
+            std::string start_date = next->first;
+            std::string end_date = next->second.end_date;
+            running_fills_[start_date] = next->second;
+            fills->erase(next);
+            fill_pool_.submit([this, start_date, end_date]() { runFill(start_date, end_date); });
+        }
+    }
 
-        std::vector<std::future<bool>> results;
+    void SQLiteDataCache::runFill(const std::string& start_date, const std::string& end_date){
+        try {
+            fillCache(start_date, end_date);
+        } catch (std::exception& ex) {
+            LOGE("Exceptions caught filling cache: %s\n", ex.what());
+        }
 
+        // The worker is free, start the next fill that can run
+        std::lock_guard<std::mutex> lock(fills_mutex_);
+        running_fills_.erase(start_date);
+        scheduleFills();
+        fills_done_.notify_all();
+    }
 
-        std::map<std::string,std::string> cacheDiff = getCacheDifference(start_date_cache, end_date_cache);
+    bool SQLiteDataCache::fillCancelled(const std::string& start_date){
+        std::lock_guard<std::mutex> lock(fills_mutex_);
+        std::map<std::string,Fill>::iterator it = running_fills_.find(start_date);
+        return it == running_fills_.end() || it->second.cancelled;
+    }
 
-        for(std::map<std::string,std::string>::iterator it = cacheDiff.begin(); it != cacheDiff.end(); ++it){
-            results.push_back(std::async(std::launch::async, &SQLiteDataCache::getAndPutData, this, it->first, it->second));
+    void SQLiteDataCache::waitForFills(std::unique_lock<std::mutex>& fills_lock){
+        pending_fills_.clear();
+        pending_prefetches_.clear();
+        for(std::map<std::string,Fill>::iterator it = running_fills_.begin(); it != running_fills_.end(); ++it){
+            it->second.cancelled = true;
         }
-
-        // Retrieve all success values
-        for(int i=0; i < results.size(); ++i){
-            putDataSuccess = putDataSuccess && results[i].get();
+        while(!running_fills_.empty()){
+            fills_done_.wait(fills_lock);
         }
+    }
 
-        if(putDataSuccess){
-            // We successfully added the data to the cache, so update the bounds
-            std::unique_lock<std::mutex> lock_write(cache_data_bounds_mutex_);
-            cache_data_bounds_ = cache_data_bounds_tmp;
-            lock_write.unlock();
+    void SQLiteDataCache::fillCache(const std::string& start_date, const std::string& end_date){
+        LOGD("Adding data to cache from %s to %s\n", start_date.c_str(), end_date.c_str());
+
+        // Only fetch what is not cached yet
+        std::vector<IntervalSet::Interval> missing;
+        std::unique_lock<std::mutex> lock_read(cache_data_bounds_mutex_);
+        cache_data_bounds_.difference(TimeString::toEpochSeconds(start_date), TimeString::toEpochSeconds(end_date), missing);
+        lock_read.unlock();
+
+        // Add the data to the database one slice of a missing range at a time, so a fill that
+        // is no longer needed stops at the next slice.  Slices share their bounds, as the
+        // missing ranges share theirs with the cached ones.
+        for(std::vector<IntervalSet::Interval>::iterator it = missing.begin(); it != missing.end(); ++it){
+            int64_t slice_end = it->first;
+            do {
+                int64_t slice_start = slice_end;
+                slice_end = std::min(slice_start + fill_slice_seconds_, it->second);
+                if(fillCancelled(start_date)){
+                    LOGD("Cancelled cache fill from %s to %s\n", start_date.c_str(), end_date.c_str());
+                    return;
+                }
+                // Points of an evicted range still being deleted would take the new ones along
+                std::unique_lock<std::mutex> lock_evictions(cache_data_bounds_mutex_);
+                waitForEvictions(lock_evictions, slice_start, slice_end);
+                lock_evictions.unlock();
+
+                size_t bytes = 0;
+                if(getAndPutData(start_date, TimeString::fromEpochSeconds(slice_start), TimeString::fromEpochSeconds(slice_end), bytes)){
+                    // We successfully added the slice to the cache, so update the bounds.  Fills
+                    // of other ranges may have updated them meanwhile, so merge into the current ones.
+                    std::vector<IntervalSet::Interval> victims;
+                    std::unique_lock<std::mutex> lock_write(cache_data_bounds_mutex_);
+                    cache_data_bounds_.insert(slice_start, slice_end);
+
+                    std::map<int64_t,CachedRange>::iterator range = cache_ranges_.find(slice_start);
+                    if(range == cache_ranges_.end()){
+                        range = cache_ranges_.insert(std::make_pair(slice_start, CachedRange())).first;
+                        range->second.lru = lru_ranges_.insert(lru_ranges_.begin(), slice_start);
+                    } else {
+                        touchRange(range);
+                    }
+                    range->second.end = std::max(range->second.end, slice_end);
+                    range->second.bytes += bytes;
+                    cached_bytes_ += bytes;
+                    evictColdRanges(slice_start, victims);
+                    lock_write.unlock();
+
+                    // The victims are out of the bounds, so only their points are left to delete
+                    clearEvictedRanges(victims);
+                }
+            } while(slice_end < it->second);
         }
     }
 
 
 
-    bool SQLiteDataCache::putDataTable(const std::string& table_name, const Json::Value& points){
-        // Build the SQL insert string
-        std::string query = "BEGIN TRANSACTION; "
-            "INSERT OR IGNORE INTO " + table_name + " (";
-
-        for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-            if(it != data_schema_.begin()){
-                query += ", ";
-            }
-            query += it->first;
+    bool SQLiteDataCache::putDataTable(const std::string& table_name, const PointBatch& points){
+        if(points.empty()){
+            LOGD("No points to put into cache table %s\n", table_name.c_str());
+            return true;
         }
 
-        query += ") VALUES ";
-        for (int i = 0; i < points.size(); ++i ){
-            Json::Value data_point = points[i];
-
-            if(!data_point.isMember(date_key_column_)){
-                LOGE("Invalid data point encountered. Skipping.");
-                continue;
-            }
+        // Each table is always filled with the same columns, so its INSERT is prepared once
+        std::string insert = "INSERT OR IGNORE INTO " + table_name + " (" + schema_.dateKeyColumn();
+        std::string values = "?";
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            insert += ", " + points.column(c).name;
+            values += ", ?";
+        }
+        insert += ") VALUES (" + values + ");";
 
-            query += "(";
+        // Transactions on the connection must not interleave, and the level tables are
+        // filled from several threads
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        StatementCache::Lease insert_statement(statements_, insert);
+        sqlite3_stmt* stmt = insert_statement.get();
+        if(stmt == NULL){
+            LOGE("Unable to prepare insert into cache table %s\n", table_name.c_str());
+            return false;
+        }
 
-            for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                if(it != data_schema_.begin()){
-                    query += ", ";
-                }
-                if(data_point.isMember(it->first)){
-                    query += "'" + data_point[it->first].asString() + "'";
-                } else {
-                    query += "NULL";
+        try {
+            LOGD("Adding %d data points to cache table %s\n", static_cast<int>(points.size()), table_name.c_str());
+            executeQuery("BEGIN TRANSACTION;");
+
+            char date[TimeString::LENGTH + 1];
+            for (size_t i = 0; i < points.size(); ++i ){
+                TimeString::format(points.times()[i], date);
+                sqlite3_bind_text(stmt, 1, date, TimeString::LENGTH, SQLITE_TRANSIENT);
+
+                for(size_t c = 0; c < points.numColumns(); ++c){
+                    const PointBatch::Column& column = points.column(c);
+                    int index = static_cast<int>(c) + 2;
+                    switch(column.type){
+                        case PointBatch::ColumnType::INT:
+                            sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(column.values[i]));
+                            break;
+                        case PointBatch::ColumnType::REAL:
+                            sqlite3_bind_double(stmt, index, column.values[i]);
+                            break;
+                        case PointBatch::ColumnType::TEXT:
+                            sqlite3_bind_text(stmt, index, column.text[i].c_str(), static_cast<int>(column.text[i].size()), SQLITE_TRANSIENT);
+                            break;
+                    }
                 }
-            }
 
-            if(i > 0 && i % 499 == 0){
-                query += "); INSERT OR IGNORE INTO " + table_name + " (";
-                for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                    if(it != data_schema_.begin()){
-                        query += ", ";
-                    }
-                    query += it->first;
+                if(sqlite3_step(stmt) != SQLITE_DONE){
+                    std::string err_msg(sqlite3_errmsg(database_));
+                    sqlite3_reset(stmt);
+                    throw std::runtime_error(err_msg);
                 }
-                query += ") VALUES ";
-            } else if(i != points.size() - 1){
-                query += "),";
-            }  else {
-                query += ");";
+                sqlite3_reset(stmt);
             }
-        }
-        query += "COMMIT TRANSACTION;";
 
-        try {
-            LOGD("Adding %d data points to cache table %s\n",points.size(), table_name.c_str());
-            executeQuery(query);
+            executeQuery("COMMIT TRANSACTION;");
             return true;
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
             // Try to roll back the transaction that is likely left hanging
-            try {
-                LOGE("Attempting to roll back transaction.\n");
-                executeQuery("ROLLBACK TRANSACTION;");
-            } catch (std::exception& ex) {
-                LOGE("Exception caught trying to roll back transaction: %s\n", ex.what());
+            if(!sqlite3_get_autocommit(database_)){
+                try {
+                    LOGE("Attempting to roll back transaction.\n");
+                    executeQuery("ROLLBACK TRANSACTION;");
+                } catch (std::exception& ex) {
+                    LOGE("Exception caught trying to roll back transaction: %s\n", ex.what());
+                }
             }
             return false;
         }
@@ -348,21 +491,31 @@ namespace intel { namespace poc {
         empty_response["startDate"] = "";
         empty_response["endDate"] = "";
         empty_response["points"] = Json::Value(Json::arrayValue);
-        //empty_response["points"] = Json::arrayValue;
+
+        PointBatch data;
+        if(!getData(params, data)){
+            return empty_response;
+        }
+        return data.toJson();
+    }
+
+    bool SQLiteDataCache::getData(const Json::Value& params, PointBatch& data){
+        const std::string& date_key_column = schema_.dateKeyColumn();
+        data.reset(date_key_column);
 
         if (!initialized_) {
             LOGE("Error: Database not initialized\n");
-            return empty_response;
+            return false;
         }
 
         // Parse the query params
         if(!params.isObject()){
             LOGE("params not object json type: %s", params.toStyledString().c_str());
-            return empty_response;
+            return false;
         }
         if(!params.isMember("startDate") || !params.isMember("endDate")){
             LOGE("Invalid query params: %s\n", params.toStyledString().c_str());
-            return empty_response;
+            return false;
         }
         std::string query_start_time = params["startDate"].asString();
         std::string query_end_time = params["endDate"].asString();
@@ -371,107 +524,125 @@ namespace intel { namespace poc {
 
         if(num_of_points <= 0){
             LOGD("Requesting <= 0 points.");
-            Json::Value response = empty_response;
-            response["startDate"] = query_start_time;
-            response["endDate"] = query_end_time;
-            return response;
+            data.setDates(query_start_time, query_end_time);
+            return true;
         }
 
-        std::string table_name = cacheContains(query_start_time, query_end_time, num_of_points);
+        // Pin the ranges read, so a concurrent fill does not evict them before the query is done
+        RangeLease pinned(*this);
+        std::string table_name = cacheContains(query_start_time, query_end_time, num_of_points, pinned);
         if(table_name == ""){
-            return empty_response;
+            return false;
         }
 
-        std::vector<std::string> json_fields;
-
+        // Select every column, or the date key and the requested metrics
+        std::string columns;
+        std::vector<size_t> fields;
         //LOGD("Metrics: %s\n",metrics.toStyledString().c_str());
         if(metrics.empty() || (metrics.size() == 1 && metrics[0].asString() == "*")){
-            // Include all metrics
-            //LOGD("Including all metrics\n");
-            for(std::map<std::string,std::string>::iterator it = data_schema_.begin(); it != data_schema_.end(); ++it){
-                json_fields.push_back(std::string(it->first));
+            columns = schema_.columnList();
+            for(size_t id = 0; id < schema_.numColumns(); ++id){
+                fields.push_back(id);
             }
-
         } else {
-            // Parse through metrics to build vectors
-            json_fields.push_back(date_key_column_);
-            std::map<std::string,std::string>::iterator it;
+            columns = date_key_column;
+            fields.push_back(schema_.dateKeyId());
             for (int i = 0; i < metrics.size(); i++ ) {
                 // Check if metric is valid
-                it = data_schema_.find(metrics[i].asString());
-                if(it == data_schema_.end()){
+                int id = schema_.find(metrics[i].asString());
+                if(id < 0){
                     LOGD("Invalid metric found: %s\n",metrics[i].asString().c_str());
-                    return empty_response;
+                    return false;
                 }
-                json_fields.push_back(metrics[i].asString());
+                columns += ", " + schema_.column(id).name;
+                fields.push_back(id);
             }
         }
 
-        // build the query columns string
-        std::string columns = "";
-        for(std::vector<std::string>::iterator it = json_fields.begin(); it != json_fields.end(); ++it){
-            if(it == json_fields.begin()){
-                columns = *it;
+        // Map every selected column to a batch column
+        std::vector<int> batch_columns;
+        int date_field = -1;
+        for(std::vector<size_t>::iterator it = fields.begin(); it != fields.end(); ++it){
+            const Schema::Column& column = schema_.column(*it);
+            if(*it == schema_.dateKeyId() || data.columnIndex(column.name) >= 0){
+                // The date key goes into the time column; repeated metrics are only read once
+                if(*it == schema_.dateKeyId() && date_field < 0){
+                    date_field = static_cast<int>(batch_columns.size());
+                }
+                batch_columns.push_back(-1);
             } else {
-                columns += ", " + *it;
+                batch_columns.push_back(data.addColumn(column.name, column.type));
             }
         }
 
-        // Build the SQL query
-        std::stringstream query;
-        query << "SELECT ";
-        query << columns;
-        query << " FROM " + table_name;
-        query << " WHERE " << date_key_column_ << " BETWEEN \"" << query_start_time << "\" AND \"" << query_end_time << "\" ";
-        query << " ORDER BY " << date_key_column_ << " ASC;";
-
-        int num_of_fields = static_cast<int>(json_fields.size());
-        std::string sql_query = query.str();
+        // The dates are bound, so the statement is shared by every query of this table and columns
+        std::string sql_query = "SELECT " + columns + " FROM " + table_name +
+            " WHERE " + date_key_column + " BETWEEN ?1 AND ?2 ORDER BY " + date_key_column + " ASC;";
+        int num_of_fields = static_cast<int>(fields.size());
 
-        Json::Value response = empty_response;
-        response["startDate"] = query_start_time;
-        response["endDate"] = query_end_time;
+        data.setDates(query_start_time, query_end_time);
         try{
-            sqlite3_stmt *stmt;
+            // Read on a pooled reader connection, so the query does not wait behind cache fills
+            ConnectionPool::Lease reader(readers_);
+            sqlite3* database = reader.get() ? reader.get()->database : database_;
+            StatementCache::Lease select(reader.get() ? reader.get()->statements : statements_, sql_query);
+            sqlite3_stmt *stmt = select.get();
 
-            //LOGD("Executing SQL query %s: \n", sql_query.c_str());
-            int rc = sqlite3_prepare_v2(database_, sql_query.c_str(), -1, &stmt, NULL);
-
-            if (rc != SQLITE_OK) {
-                std::string err_msg(sqlite3_errmsg(database_));
+            if (stmt == NULL) {
                 LOGE("Error processing SQL query: %s\n", sql_query.c_str());
-                return empty_response;
+                data.reset(date_key_column);
+                return false;
             } else if(sqlite3_column_count(stmt) != num_of_fields){
                 LOGE("Number of returned columns does not match number expected.");
-                return empty_response;
+                data.reset(date_key_column);
+                return false;
             }
-
-            // Build response object from query response
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-
-                // Begin constructing json object
-                Json::Value point(Json::objectValue); // {}
+            sqlite3_bind_text(stmt, 1, query_start_time.c_str(), static_cast<int>(query_start_time.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, query_end_time.c_str(), static_cast<int>(query_end_time.size()), SQLITE_TRANSIENT);
+
+            // Fill the batch columns straight from the query response
+            std::vector<int64_t>& times = data.times();
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                const char* date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, date_field));
+                int64_t time = TimeString::toEpochSeconds(date, sqlite3_column_bytes(stmt, date_field));
+                if(time == -1){
+                    LOGE("Invalid date encountered. Skipping.\n");
+                    continue;
+                }
+                times.push_back(time);
 
                 for(int i=0; i < num_of_fields; ++i){
-                    std::string type = data_schema_[json_fields[i]];
-                    if(type == "INT"){
-                        point[json_fields[i]] = Json::Value(Json::intValue);
-                        point[json_fields[i]] = sqlite3_column_int(stmt, i);
-                    } else if (type == "REAL"){
-                        point[json_fields[i]] = Json::Value(Json::realValue );
-                        point[json_fields[i]] = sqlite3_column_double(stmt, i);
-                    } else if (type == "TEXT"){
-                        point[json_fields[i]] = Json::Value(Json::stringValue  );
-                        point[json_fields[i]] = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, i)));
+                    if(batch_columns[i] < 0){
+                        continue;
+                    }
+                    PointBatch::Column& column = data.column(batch_columns[i]);
+                    switch(column.type){
+                        case PointBatch::ColumnType::INT:
+                            column.values.push_back(sqlite3_column_int(stmt, i));
+                            break;
+                        case PointBatch::ColumnType::REAL:
+                            column.values.push_back(sqlite3_column_double(stmt, i));
+                            break;
+                        case PointBatch::ColumnType::TEXT: {
+                            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+                            column.text.push_back(text ? std::string(text) : std::string());
+                            break;
+                        }
                     }
                 }
-                response["points"].append(point);
+            }
+            if (rc != SQLITE_DONE) {
+                LOGE("Error reading SQL query results: %s\n", sqlite3_errmsg(database));
+                data.reset(date_key_column);
+                return false;
             }
         } catch (std::exception& ex) {
             LOGE("Exceptions caught: %s\n", ex.what());
-            return empty_response;
+            data.reset(date_key_column);
+            return false;
         }
-        return response;
+        return true;
     }
 
     /// private API
@@ -482,121 +653,68 @@ namespace intel { namespace poc {
     * @param[in] start_date timestampof the format: "YYYY-MM-DD HH:MMZ"
     * @param[in] end_date timestampof the format: "YYYY-MM-DD HH:MMZ"
     * @param[in] num_of_points the number of points requested
+    * @param[out] pinned the ranges holding the dates, kept from eviction until it is destroyed
     *
     * @retval "<table_name>" The name of the table that will satisfy the request
     * @retval "" Failed to find a cache level that will satisfy the request
     */
-    std::string SQLiteDataCache::cacheContains(const std::string& start_date, const std::string& end_date, int num_of_points){
+    std::string SQLiteDataCache::cacheContains(const std::string& start_date, const std::string& end_date, int num_of_points, RangeLease& pinned){
         LOGD("Checking cache: start_date = %s, end_date = %s\n",start_date.c_str(),end_date.c_str());
+        int64_t start_time = TimeString::toEpochSeconds(start_date);
+        int64_t end_time = TimeString::toEpochSeconds(end_date);
         std::unique_lock<std::mutex> lock_read(cache_data_bounds_mutex_);
-        for(std::map<std::string,std::string>::iterator it = cache_data_bounds_.begin(); it != cache_data_bounds_.end(); ++it){
-            LOGD("Comparing against cache: cacheStart = %s, cacheEnd = %s\n",it->first.c_str(),it->second.c_str());
-            if(start_date.compare(it->first) >= 0 && end_date.compare(it->second) <= 0){
-                LOGD("Data is in cache. Checking requested points.\n");
-
-
-
-                for(int level=1; level <= cache_levels_.size(); ++level){
-                    long put_duration = timeStringToEpochSeconds(end_date.c_str()) - timeStringToEpochSeconds(start_date.c_str());
-                    long level_duration = cache_levels_[level-1]["duration"];
-                    long level_points = cache_levels_[level-1]["num_of_points"];
-
-                    /*
-                    LOGD("chache level %d has %ld points for every %ld sec\n",level,level_points,level_duration);
-                    LOGD("put_duration %ld / level_duration %ld = %f durations",put_duration,level_duration,static_cast<double>(put_duration)/static_cast<double>(level_duration));
-                    LOGD(" = %f points for put duration = %d rounded points\n", static_cast<double>(put_duration)/static_cast<double>(level_duration)*level_points, static_cast<int>(static_cast<double>(put_duration)/static_cast<double>(level_duration)*level_points));
-                    LOGD("Request wants %d points.\n",num_of_points);
-                    */
-
-                    if(static_cast<int>(static_cast<double>(put_duration)/static_cast<double>(level_duration)*level_points) == num_of_points){
-                        std::stringstream buff;
-                        buff << "_" << level;
-                        std::string table_name = table_name_ + buff.str();
-                        LOGD("Cache table %s will satisfy request.\n", table_name.c_str());
-                        return table_name;
-                    }
-                }
-
-                if(cache_raw_data_){
-                    LOGD("Falling back to cached raw data.\n");
-                    return table_name_ + "_raw";
-                } else {
-                    LOGD("No cache level found to satisfy request.\n");
-                    return "";
+        bool contains = cache_data_bounds_.contains(start_time, end_time);
+        if(contains){
+            // The ranges read are the last to be evicted, and are pinned until the read is done
+            std::map<int64_t,CachedRange>::iterator it = cache_ranges_.upper_bound(start_time);
+            if(it != cache_ranges_.begin()){
+                --it;
+            }
+            for(; it != cache_ranges_.end() && it->first <= end_time; ++it){
+                if(it->second.end >= start_time){
+                    touchRange(it);
+                    it->second.readers++;
+                    pinned.starts.push_back(it->first);
                 }
             }
         }
         lock_read.unlock();
-        LOGD("Data not found in cache.\n");
-        return "";
-    }
+        if(!contains){
+            LOGD("Data not found in cache.\n");
+            return "";
+        }
+        LOGD("Data is in cache. Checking requested points.\n");
 
-    /**
-    * Returns the difference between your search interval and the cache. That is, returns a map
-    *              of <start_date,end_date> pairs representing the intervals in your search range
-    *              not already present in the cache.
-    *
-    * Note that this function relies on the guaranteed sorted ordering of keys in std::map.
-    *
-    * @param[in] start_date timestampof the format: "YYYY-MM-DD HH:MMZ"
-    * @param[in] end_date timestampof the format: "YYYY-MM-DD HH:MMZ"
-    *
-    * @return The map containing the difference between your search interval and the cache. If
-    *  an empty map is returned, the cache already contains your entire search interval.
-    */
-    std::map<std::string,std::string> SQLiteDataCache::getCacheDifference(std::string start_date, std::string end_date){
-        std::map<std::string,std::string> result;
-        for(std::map<std::string,std::string>::iterator it = cache_data_bounds_.begin(); it != cache_data_bounds_.end(); ++it){
-            if(it->second.compare(start_date) <= 0 ){
-                // Skip if this cache interval ends before our start_date
-                continue;
-            } else if(it->first.compare(end_date) >= 0){
-                // If this cache interval starts after our end_date, stop iterating
-                break;
-            } else if(it->first.compare(start_date) <= 0 && it->second.compare(end_date) >= 0) {
-                // If this cache interval completely overlaps the search, return empty set
-                return result;
-            } else if(it->first.compare(start_date) <= 0 && it->second.compare(end_date) < 0) {
-                // If this cache interval overlaps to the left, remove overlapping portion from the search
-                start_date = it->second;
-            } else if(it->first.compare(start_date) > 0 && it->second.compare(end_date) < 0) {
-                // If the search completely overlaps this cache interval, add the left hand overlap
-                // and update the search.
-                result[start_date] = it->first;
-                start_date = it->second;
-            } else if(it->first.compare(start_date) > 0 && it->second.compare(end_date) >= 0) {
-                // If this cache interval overlaps to the right, add the left hand overlap
-                // and return
-                result[start_date] = it->first;
-                return result;
+        long put_duration = static_cast<long>(end_time - start_time);
+        for(int level=1; level <= cache_levels_.size(); ++level){
+            long level_duration = cache_levels_[level-1]["duration"];
+            long level_points = cache_levels_[level-1]["num_of_points"];
+
+            if(static_cast<int>(static_cast<double>(put_duration)/static_cast<double>(level_duration)*level_points) == num_of_points){
+                std::stringstream buff;
+                buff << "_" << level;
+                std::string table_name = table_name_ + buff.str();
+                LOGD("Cache table %s will satisfy request.\n", table_name.c_str());
+                return table_name;
             }
         }
-        // If we didn't return mid-loop, add the current search and return
-        result[start_date] = end_date;
-        return result;
-    }
 
-    long SQLiteDataCache::timeStringToEpochSeconds(const std::string& time_string){
-        struct tm tm = {};
-        // 2015-03-03 00:00Z
-        // TODO: Expand this to check for and allow other common date formats
-        if (strptime(time_string.c_str(), "%Y-%m-%d %H:%MZ", &tm) == NULL){
-            LOGE("Error converting time_string to time struct: %s\n", time_string.c_str());
-            return -1;
+        if(cache_raw_data_){
+            LOGD("Falling back to cached raw data.\n");
+            return table_name_ + "_raw";
+        } else {
+            LOGD("No cache level found to satisfy request.\n");
+            return "";
         }
-        return static_cast<long>(mktime(&tm));
     }
 
-    std::string SQLiteDataCache::updateTimeString(const std::string& time_string, long offset){
-        std::time_t time = static_cast<time_t>(timeStringToEpochSeconds(time_string) + offset);
-        char buffer [30];
-        strftime (buffer,30,"%Y-%m-%d %H:%MZ",localtime(&time));
-        //LOGD("Original time %s + %ld sec = %s\n", time_string.c_str(), offset, buffer);
-        return std::string(buffer);
+    std::string SQLiteDataCache::updateTimeString(const std::string& time_string, int64_t offset){
+        //LOGD("Original time %s + %lld sec\n", time_string.c_str(), static_cast<long long>(offset));
+        return TimeString::fromEpochSeconds(TimeString::toEpochSeconds(time_string) + offset);
     }
 
     long SQLiteDataCache::getDurationNumPoints(const std::string& start_date, const std::string& end_date, int level){
-        long put_duration = timeStringToEpochSeconds(end_date) - timeStringToEpochSeconds(start_date);
+        long put_duration = TimeString::toEpochSeconds(end_date) - TimeString::toEpochSeconds(start_date);
         long level_duration = cache_levels_[level-1]["duration"];
         long level_points = static_cast<long>(cache_levels_[level-1]["num_of_points"]);
 
@@ -608,36 +726,155 @@ namespace intel { namespace poc {
         return static_cast<long>(level_points * (static_cast<double>(put_duration)/static_cast<double>(level_duration)));
     }
 
-    // Note: This function is not currently being used, but has been tested to work and would be useful
-    // if someone wanted to implement an update-cache function that makes the cache clear and re-pull
-    // a certain period of time
+    /// Move a range to the front of lru_ranges_.  cache_data_bounds_mutex_ must be held.
+    void SQLiteDataCache::touchRange(std::map<int64_t,CachedRange>::iterator range){
+        lru_ranges_.splice(lru_ranges_.begin(), lru_ranges_, range->second.lru);
+    }
+
+    /**
+    * Picks the least recently used ranges, other than the one just added, until the cache
+    *              fits in max_cache_bytes_, and removes them from the bounds so that no query or
+    *              fill relies on them.  Their points are deleted by clearEvictedRanges once
+    *              cache_data_bounds_mutex_, which must be held here, is released.  Queries read
+    *              the tables after releasing that lock, so ranges they pinned in cacheContains are
+    *              skipped; the cache may stay over budget until the next fill.
+    *
+    * @param[in] added Start of the range just added
+    * @param[out] victims The ranges to clear
+    */
+    void SQLiteDataCache::evictColdRanges(int64_t added, std::vector<IntervalSet::Interval>& victims){
+        std::list<int64_t>::iterator lru = lru_ranges_.end();
+        while(max_cache_bytes_ > 0 && cached_bytes_ > max_cache_bytes_ && lru != lru_ranges_.begin()){
+            --lru;
+            std::map<int64_t,CachedRange>::iterator coldest = cache_ranges_.find(*lru);
+            if(coldest->first == added || coldest->second.readers > 0){
+                continue;
+            }
+
+            IntervalSet::Interval victim(coldest->first, coldest->second.end);
+            cache_data_bounds_.erase(victim.first, victim.second);
+            evicting_.push_back(victim);
+            victims.push_back(victim);
+            cached_bytes_ -= std::min(cached_bytes_, coldest->second.bytes);
+            cache_ranges_.erase(coldest);
+            lru = lru_ranges_.erase(lru);
+        }
+    }
+
+    /**
+    * Deletes the points of ranges picked by evictColdRanges.  cache_data_bounds_mutex_ must not
+    *              be held, as the deletes wait for the insert transactions of running fills.
+    */
+    void SQLiteDataCache::clearEvictedRanges(const std::vector<IntervalSet::Interval>& victims){
+        if(victims.empty()){
+            return;
+        }
+        for(std::vector<IntervalSet::Interval>::const_iterator it = victims.begin(); it != victims.end(); ++it){
+            std::string start_date = TimeString::fromEpochSeconds(it->first);
+            std::string end_date = TimeString::fromEpochSeconds(it->second);
+            LOGD("Evicting cache range from %s to %s\n", start_date.c_str(), end_date.c_str());
+            if(cache_raw_data_){
+                clearDatabaseRange(table_name_ + "_raw", start_date, end_date);
+            }
+            for(size_t level=1; level <= cache_levels_.size(); ++level){
+                std::stringstream buff;
+                buff << "_" << level;
+                clearDatabaseRange(table_name_ + buff.str(), start_date, end_date);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(cache_data_bounds_mutex_);
+        for(std::vector<IntervalSet::Interval>::const_iterator it = victims.begin(); it != victims.end(); ++it){
+            evicting_.erase(std::find(evicting_.begin(), evicting_.end(), *it));
+        }
+        evicted_.notify_all();
+    }
+
+    /// Wait until no range overlapping [start, end] is being evicted
+    void SQLiteDataCache::waitForEvictions(std::unique_lock<std::mutex>& lock_bounds, int64_t start, int64_t end){
+        while(true){
+            bool overlaps = false;
+            for(std::vector<IntervalSet::Interval>::iterator it = evicting_.begin(); it != evicting_.end(); ++it){
+                if(it->first <= end && it->second >= start){
+                    overlaps = true;
+                    break;
+                }
+            }
+            if(!overlaps){
+                return;
+            }
+            evicted_.wait(lock_bounds);
+        }
+    }
+
+    SQLiteDataCache::RangeLease::~RangeLease(){
+        std::lock_guard<std::mutex> lock(cache_.cache_data_bounds_mutex_);
+        for(std::vector<int64_t>::iterator it = starts.begin(); it != starts.end(); ++it){
+            // init may have cleared the ranges meanwhile
+            std::map<int64_t,CachedRange>::iterator range = cache_.cache_ranges_.find(*it);
+            if(range != cache_.cache_ranges_.end() && range->second.readers > 0){
+                range->second.readers--;
+            }
+        }
+    }
+
+    size_t SQLiteDataCache::batchBytes(const PointBatch& points){
+        size_t bytes = points.size() * sizeof(int64_t);
+        for(size_t c = 0; c < points.numColumns(); ++c){
+            const PointBatch::Column& column = points.column(c);
+            bytes += column.values.size() * sizeof(double);
+            for(std::vector<std::string>::const_iterator text = column.text.begin(); text != column.text.end(); ++text){
+                bytes += text->size();
+            }
+        }
+        return bytes;
+    }
+
     bool SQLiteDataCache::clearDatabaseRange(const std::string& table_name, const std::string& start_date, const std::string& end_date){
-        std::string query = "DELETE FROM " + table_name + " WHERE " + date_key_column_ + " BETWEEN \"" + start_date + "\" AND \"" + end_date + "\";";
-        try {
-            LOGD("Deleting data points from cache table %s from %s to %s\n", table_name.c_str(), start_date.c_str(), end_date.c_str());
-            executeQuery(query);
-            return true;
-        } catch (std::exception& ex) {
-            LOGE("Exceptions caught deleting data: %s\n", ex.what());
+        // Deletes must not interleave with the transactions of fills
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        LOGD("Deleting data points from cache table %s from %s to %s\n", table_name.c_str(), start_date.c_str(), end_date.c_str());
+        StatementCache::Lease remove(statements_, "DELETE FROM " + table_name + " WHERE " + schema_.dateKeyColumn() + " BETWEEN ?1 AND ?2;");
+        sqlite3_stmt* stmt = remove.get();
+        if(stmt == NULL){
+            LOGE("Error deleting data: %s\n", sqlite3_errmsg(database_));
             return false;
         }
+        sqlite3_bind_text(stmt, 1, start_date.c_str(), static_cast<int>(start_date.size()), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, end_date.c_str(), static_cast<int>(end_date.size()), SQLITE_STATIC);
+        if(sqlite3_step(stmt) != SQLITE_DONE){
+            LOGE("Error deleting data: %s\n", sqlite3_errmsg(database_));
+            return false;
+        }
+        return true;
     }
 
 
     bool SQLiteDataCache::openDatabase(){
         LOGD("Open database %s\n", database_path_.c_str());
 
+        // Closing every connection drops the in-memory database
+        readers_.close();
         if (database_){
+            statements_.setDatabase(NULL);
             sqlite3_close(database_);
         }
 
-        int rc = sqlite3_open_v2(database_path_.c_str(), &database_, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI | SQLITE_OPEN_SHAREDCACHE;
+        int rc = sqlite3_open_v2(database_path_.c_str(), &database_, flags | SQLITE_OPEN_FULLMUTEX, NULL);
 
         if (rc != SQLITE_OK) {
             std::string err_msg(sqlite3_errmsg(database_));
             LOGE("Cannot open database: %s\n",err_msg.c_str());
             return false;
         }
+        sqlite3_busy_timeout(database_, ConnectionPool::BUSY_TIMEOUT_MS);
+        statements_.setDatabase(database_);
+
+        // Shared-cache connections lock whole tables, so readers read uncommitted rows rather
+        // than wait for a fill to commit.  Rows are only queried once their range is in
+        // cache_data_bounds_, which is updated after the fill commits.
+        readers_.open(database_path_, flags | SQLITE_OPEN_NOMUTEX, "PRAGMA read_uncommitted = 1; PRAGMA query_only = 1;", READER_CONNECTIONS_);
 
         LOGD("Database opened succesfully\n");
         return true;
@@ -647,43 +884,21 @@ namespace intel { namespace poc {
     void SQLiteDataCache::createDatabase(){
         LOGD("Creating cache database\n");
 
-        if(data_schema_.empty()){
+        if(schema_.empty()){
             throw std::runtime_error(std::string("createDatabase called with empty data schema."));
         }
         std::string query;
 
         if(cache_raw_data_){
             query += "DROP TABLE IF EXISTS " + table_name_ + "_raw" + "; ";
-            query += "CREATE TABLE " + table_name_ + "_raw" + "(";
-            std::map<std::string,std::string>::iterator it;
-            for(it = data_schema_.begin(); it != data_schema_.end(); it++){
-                if(it != data_schema_.begin()){
-                    query += ", ";
-                }
-                query += it->first + " " + it->second;
-                if(it->first == date_key_column_){
-                    query += " PRIMARY KEY";
-                }
-            }
-            query += "); ";
+            query += "CREATE TABLE " + table_name_ + "_raw" + "(" + schema_.columnDefinitions() + "); ";
         }
 
         for(int level=1; level <= cache_levels_.size(); ++level){
             std::stringstream buff;
             buff << "_" << level;
             query += "DROP TABLE IF EXISTS " + table_name_ + buff.str() + "; ";
-            query += "CREATE TABLE " + table_name_ + buff.str() + "(";
-            std::map<std::string,std::string>::iterator it;
-            for(it = data_schema_.begin(); it != data_schema_.end(); it++){
-                if(it != data_schema_.begin()){
-                    query += ", ";
-                }
-                query += it->first + " " + it->second;
-                if(it->first == date_key_column_){
-                    query += " PRIMARY KEY";
-                }
-            }
-            query += "); ";
+            query += "CREATE TABLE " + table_name_ + buff.str() + "(" + schema_.columnDefinitions() + "); ";
         }
 
 
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "SQLiteFunctions"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/sqlitefunctions.h>
+#include <graphfilter/aggregationkernels.h>
+#include <graphfilter/datafilter.h>
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/timestring.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "json.h"
+
+
+namespace intel { namespace poc {
+
+    namespace {
+        /// Aggregate state, kept behind a pointer in the SQLite aggregate context
+        struct Points {
+            std::vector<std::pair<int64_t, double>> points;
+            int num_of_points;
+        };
+
+        bool earlier(const std::pair<int64_t, double>& a, const std::pair<int64_t, double>& b){
+            return a.first < b.first;
+        }
+
+        /// Take the state out of the aggregate context, in time order.  NULL for an empty group.
+        Points* takePoints(sqlite3_context* context){
+            Points** state = static_cast<Points**>(sqlite3_aggregate_context(context, 0));
+            if(state == NULL || *state == NULL){
+                return NULL;
+            }
+            Points* points = *state;
+            *state = NULL;
+            std::stable_sort(points->points.begin(), points->points.end(), earlier);
+            return points;
+        }
+    }
+
+    bool SQLiteFunctions::registerAll(sqlite3* database){
+        int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+        int rc = sqlite3_create_function_v2(database, "tsdv_bucket", 3, flags, NULL, &SQLiteFunctions::bucket, NULL, NULL, NULL);
+        if(rc == SQLITE_OK){
+            rc = sqlite3_create_function_v2(database, "tsdv_twavg", 2, flags, NULL, NULL, &SQLiteFunctions::pointsStep, &SQLiteFunctions::timeWeightedAverageFinal, NULL);
+        }
+        if(rc == SQLITE_OK){
+            rc = sqlite3_create_function_v2(database, "tsdv_lttb", 3, flags, NULL, NULL, &SQLiteFunctions::pointsStep, &SQLiteFunctions::lttbFinal, NULL);
+        }
+        if(rc == SQLITE_OK){
+            rc = sqlite3_create_function_v2(database, "tsdv_m4", 3, flags, NULL, NULL, &SQLiteFunctions::pointsStep, &SQLiteFunctions::m4Final, NULL);
+        }
+        if(rc != SQLITE_OK){
+            LOGE("Unable to register SQLite functions: %s\n", sqlite3_errmsg(database));
+            return false;
+        }
+        return true;
+    }
+
+    /// private API
+
+    bool SQLiteFunctions::toEpochSeconds(sqlite3_value* value, int64_t& time){
+        switch(sqlite3_value_type(value)){
+            case SQLITE_INTEGER:
+                time = sqlite3_value_int64(value);
+                return true;
+            case SQLITE_TEXT:
+                time = TimeString::toEpochSeconds(reinterpret_cast<const char*>(sqlite3_value_text(value)),
+                                                  static_cast<size_t>(sqlite3_value_bytes(value)));
+                return time != -1;
+            default:
+                return false;
+        }
+    }
+
+    void SQLiteFunctions::bucket(sqlite3_context* context, int, sqlite3_value** argv){
+        int64_t time;
+        int64_t start;
+        int64_t width = sqlite3_value_int64(argv[2]);
+        if(!toEpochSeconds(argv[0], time) || !toEpochSeconds(argv[1], start) || width <= 0){
+            sqlite3_result_null(context);
+            return;
+        }
+        // Round towards negative infinity, so dates before start get negative buckets
+        int64_t offset = time - start;
+        int64_t index = offset >= 0 ? offset / width : -((-offset + width - 1) / width);
+        sqlite3_result_int64(context, index);
+    }
+
+    void SQLiteFunctions::pointsStep(sqlite3_context* context, int argc, sqlite3_value** argv){
+        Points** state = static_cast<Points**>(sqlite3_aggregate_context(context, sizeof(Points*)));
+        if(state == NULL){
+            sqlite3_result_error_nomem(context);
+            return;
+        }
+        if(*state == NULL){
+            *state = new Points();
+            (*state)->num_of_points = 0;
+        }
+        if(argc > 2){
+            (*state)->num_of_points = sqlite3_value_int(argv[2]);
+        }
+
+        // Points without a valid date or value are skipped
+        int64_t time;
+        if(!toEpochSeconds(argv[0], time) || sqlite3_value_type(argv[1]) == SQLITE_NULL){
+            return;
+        }
+        (*state)->points.push_back(std::make_pair(time, sqlite3_value_double(argv[1])));
+    }
+
+    void SQLiteFunctions::timeWeightedAverageFinal(sqlite3_context* context){
+        Points* state = takePoints(context);
+        if(state == NULL || state->points.empty()){
+            delete state;
+            sqlite3_result_null(context);
+            return;
+        }
+
+        // Reduce with the DataFilter kernels, so the result matches their summation order
+        const std::vector<std::pair<int64_t, double>>& points = state->points;
+        int64_t duration = points.back().first - points.front().first;
+        std::vector<double> terms;
+        if(duration <= 0){
+            terms.reserve(points.size());
+            for(size_t i = 0; i < points.size(); ++i){
+                terms.push_back(points[i].second);
+            }
+            sqlite3_result_double(context, AggregationKernels::sum(&terms[0], terms.size()) / static_cast<double>(terms.size()));
+        } else {
+            terms.reserve(points.size() - 1);
+            for(size_t i = 0; i + 1 < points.size(); ++i){
+                terms.push_back(points[i].second * static_cast<double>(points[i + 1].first - points[i].first));
+            }
+            sqlite3_result_double(context, AggregationKernels::sum(&terms[0], terms.size()) / static_cast<double>(duration));
+        }
+        delete state;
+    }
+
+    void SQLiteFunctions::lttbFinal(sqlite3_context* context){
+        filterFinal(context, true);
+    }
+
+    void SQLiteFunctions::m4Final(sqlite3_context* context){
+        filterFinal(context, false);
+    }
+
+    void SQLiteFunctions::filterFinal(sqlite3_context* context, bool lttb){
+        Points* state = takePoints(context);
+
+        PointBatch data;
+        data.reset("date");
+        int value = data.addColumn("value", PointBatch::ColumnType::REAL);
+        int num_of_points = 0;
+        if(state != NULL){
+            data.reserve(state->points.size());
+            for(size_t i = 0; i < state->points.size(); ++i){
+                data.times().push_back(state->points[i].first);
+                data.column(value).values.push_back(state->points[i].second);
+            }
+            num_of_points = state->num_of_points;
+            delete state;
+        }
+
+        try {
+            PointBatch downsampled;
+            DataFilter::applyFilter(data, downsampled, num_of_points, lttb ? DataFilter::FilterType::LTTB : DataFilter::FilterType::M4);
+            Json::FastWriter writer;
+            std::string result = writer.write(downsampled.toJson()["points"]);
+            // FastWriter ends its output with a newline
+            if(!result.empty() && result[result.size() - 1] == '\n'){
+                result.erase(result.size() - 1);
+            }
+            sqlite3_result_text(context, result.c_str(), static_cast<int>(result.size()), SQLITE_TRANSIENT);
+        } catch (std::exception& ex) {
+            sqlite3_result_error(context, ex.what(), -1);
+        }
+    }
+
+}}
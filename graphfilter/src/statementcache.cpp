@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "StatementCache"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/statementcache.h>
+#include <ctype.h>
+
+
+namespace intel { namespace poc {
+
+    namespace {
+        bool isNameChar(char c){
+            return isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        /// Whether sql names table as a whole word, so e.g. data_1 does not match data_10
+        bool usesTable(const std::string& sql, const std::string& table){
+            for(size_t pos = sql.find(table); pos != std::string::npos; pos = sql.find(table, pos + 1)){
+                size_t end = pos + table.size();
+                if((pos == 0 || !isNameChar(sql[pos - 1])) && (end == sql.size() || !isNameChar(sql[end]))){
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    StatementCache::~StatementCache(){
+        clear();
+    }
+
+    void StatementCache::setDatabase(sqlite3* database){
+        std::lock_guard<std::mutex> lock(mutex_);
+        clear();
+        database_ = database;
+    }
+
+    sqlite3_stmt* StatementCache::acquire(const std::string& sql){
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!database_){
+            LOGE("No database to prepare statement on: %s\n", sql.c_str());
+            return NULL;
+        }
+
+        std::multimap<std::string, Statements::iterator>::iterator it = index_.find(sql);
+        if(it != index_.end()){
+            sqlite3_stmt* stmt = it->second->second;
+            statements_.erase(it->second);
+            index_.erase(it);
+            return stmt;
+        }
+
+        sqlite3_stmt* stmt = NULL;
+        if(sqlite3_prepare_v2(database_, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK){
+            LOGE("Error preparing SQL statement %s: %s\n", sql.c_str(), sqlite3_errmsg(database_));
+            sqlite3_finalize(stmt);
+            return NULL;
+        }
+        return stmt;
+    }
+
+    void StatementCache::release(const std::string& sql, sqlite3_stmt* stmt){
+        if(stmt == NULL){
+            return;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(sqlite3_db_handle(stmt) != database_){
+            // Leased before the connection was changed
+            sqlite3_finalize(stmt);
+            return;
+        }
+        statements_.push_front(std::make_pair(sql, stmt));
+        index_.insert(std::make_pair(sql, statements_.begin()));
+        while(statements_.size() > MAX_STATEMENTS_){
+            erase(--statements_.end());
+        }
+    }
+
+    void StatementCache::purge(const std::string& table){
+        std::lock_guard<std::mutex> lock(mutex_);
+        Statements::iterator it = statements_.begin();
+        while(it != statements_.end()){
+            if(usesTable(it->first, table)){
+                erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /// private API
+
+    void StatementCache::clear(){
+        for(Statements::iterator it = statements_.begin(); it != statements_.end(); ++it){
+            sqlite3_finalize(it->second);
+        }
+        statements_.clear();
+        index_.clear();
+    }
+
+    /// Finalize an idle statement and drop it from the cache
+    void StatementCache::erase(Statements::iterator statement){
+        std::pair<std::multimap<std::string, Statements::iterator>::iterator,
+                  std::multimap<std::string, Statements::iterator>::iterator> range = index_.equal_range(statement->first);
+        for(std::multimap<std::string, Statements::iterator>::iterator it = range.first; it != range.second; ++it){
+            if(it->second == statement){
+                index_.erase(it);
+                break;
+            }
+        }
+        sqlite3_finalize(statement->second);
+        statements_.erase(statement);
+    }
+
+}}
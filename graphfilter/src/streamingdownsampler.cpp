@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#ifdef ANDROID
+#define  LOG_TAG    "StreamingDownsampler"
+#include <android/log.h>
+#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGI(...)  printf(__VA_ARGS__)
+#define  LOGD(...)  printf(__VA_ARGS__)
+#define  LOGE(...)  printf(__VA_ARGS__)
+#endif
+
+
+#include <graphfilter/streamingdownsampler.h>
+#include <graphfilter/aggregationkernels.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+namespace intel { namespace poc {
+
+    StreamingDownsampler::StreamingDownsampler(Mode mode, int num_of_points, const Sink& sink)
+        :mode_(mode), num_of_points_(num_of_points), sink_(sink), start_time_(0), span_(1),
+         bucket_(0), has_bucket_(false), sequence_(0), first_time_(0) {}
+
+    StreamingDownsampler::Mode StreamingDownsampler::getMode(const std::string& mode_string){
+        if(mode_string == "AVERAGE"){
+            return Mode::AVERAGE;
+        } else if(mode_string == "M4"){
+            return Mode::M4;
+        } else if(mode_string == "TIME_WEIGHTED"){
+            return Mode::TIME_WEIGHTED;
+        } else {
+            throw std::runtime_error(std::string("Invalid streaming downsampling mode: ") + mode_string);
+        }
+    }
+
+    bool StreamingDownsampler::begin(const PointBatch& layout, int64_t start_time, int64_t end_time){
+        if(num_of_points_ <= 0){
+            LOGE("Invalid number of points for streaming downsampling: %d\n", num_of_points_);
+            return false;
+        }
+        if(start_time == -1 || end_time < start_time){
+            LOGE("Invalid time frame for streaming downsampling.\n");
+            return false;
+        }
+
+        start_time_ = start_time;
+        span_ = end_time - start_time + 1;
+        has_bucket_ = false;
+        sequence_ = 0;
+        out_.copyLayout(layout);
+
+        numeric_columns_.clear();
+        for(size_t c = 0; c < layout.numColumns(); ++c){
+            if(layout.column(c).type != PointBatch::ColumnType::TEXT){
+                numeric_columns_.push_back(c);
+            }
+        }
+
+        // Both accumulators are batches of fixed size, overwritten in place
+        size_t num_rows = mode_ != Mode::M4 ? 1 : 2 + 2 * numeric_columns_.size();
+        PointBatch& rows = mode_ != Mode::M4 ? last_point_ : slots_;
+        rows.copyLayout(layout);
+        rows.times().resize(num_rows);
+        for(size_t c = 0; c < rows.numColumns(); ++c){
+            if(rows.column(c).type == PointBatch::ColumnType::TEXT){
+                rows.column(c).text.resize(num_rows);
+            } else {
+                rows.column(c).values.resize(num_rows);
+            }
+        }
+        sums_.assign(numeric_columns_.size(), 0);
+        counts_.assign(numeric_columns_.size(), 0);
+        weighted_sums_.assign(numeric_columns_.size(), 0);
+        slot_sequences_.assign(num_rows, 0);
+        slot_values_.assign(num_rows, 0);
+        slot_set_.assign(num_rows, false);
+        return true;
+    }
+
+    void StreamingDownsampler::push(const PointBatch& points){
+        const std::vector<int64_t>& times = points.times();
+        size_t size = points.size();
+        size_t first_i = 0;
+        while(first_i < size){
+            // Points are in time order, so each bucket is a contiguous run of the chunk
+            int64_t bucket = bucketOf(times[first_i]);
+            size_t end_i = first_i + 1;
+            while(end_i < size && bucketOf(times[end_i]) == bucket){
+                ++end_i;
+            }
+
+            bool continued = has_bucket_ && bucket == bucket_;
+            if(has_bucket_ && bucket != bucket_){
+                closeBucket();
+            }
+            bucket_ = bucket;
+            has_bucket_ = true;
+
+            if(mode_ == Mode::AVERAGE){
+                accumulateAverage(points, first_i, end_i);
+            } else if(mode_ == Mode::TIME_WEIGHTED){
+                accumulateTimeWeighted(points, first_i, end_i, continued);
+            } else {
+                accumulateM4(points, first_i, end_i);
+            }
+            first_i = end_i;
+        }
+        sequence_ += size;
+    }
+
+    bool StreamingDownsampler::pushSummary(int64_t start_time, int64_t end_time, size_t num_of_points, const std::vector<double>& sums){
+        if(mode_ != Mode::AVERAGE || numeric_columns_.size() != out_.numColumns() || num_of_points == 0 ||
+           sums.size() != out_.numColumns() || bucketOf(start_time) != bucketOf(end_time)){
+            return false;
+        }
+
+        int64_t bucket = bucketOf(end_time);
+        if(has_bucket_ && bucket != bucket_){
+            closeBucket();
+        }
+        bucket_ = bucket;
+        has_bucket_ = true;
+
+        for(size_t k = 0; k < numeric_columns_.size(); ++k){
+            sums_[k] += sums[numeric_columns_[k]];
+            counts_[k] += num_of_points;
+        }
+        // Only the date of the last point is kept, all other columns are averaged
+        last_point_.times()[0] = end_time;
+        sequence_ += static_cast<int64_t>(num_of_points);
+        return true;
+    }
+
+    void StreamingDownsampler::finish(){
+        if(has_bucket_){
+            closeBucket();
+        }
+        if(!out_.empty()){
+            sink_(out_);
+            out_.clearPoints();
+        }
+    }
+
+    /// private API
+
+    int64_t StreamingDownsampler::bucketOf(int64_t time) const{
+        if(time < start_time_){
+            return 0;
+        }
+        int64_t bucket = (time - start_time_) * num_of_points_ / span_;
+        return bucket < num_of_points_ ? bucket : num_of_points_ - 1;
+    }
+
+    void StreamingDownsampler::accumulateAverage(const PointBatch& points, size_t first_i, size_t end_i){
+        for(size_t k = 0; k < numeric_columns_.size(); ++k){
+            const double* values = &points.column(numeric_columns_[k]).values[first_i];
+            sums_[k] += AggregationKernels::sum(values, end_i - first_i);
+            counts_[k] += AggregationKernels::count(values, end_i - first_i);
+        }
+        last_point_.setPoint(0, points, end_i - 1);
+    }
+
+    void StreamingDownsampler::accumulateTimeWeighted(const PointBatch& points, size_t first_i, size_t end_i, bool continued){
+        const std::vector<int64_t>& times = points.times();
+        if(!continued){
+            first_time_ = times[first_i];
+        }
+        for(size_t k = 0; k < numeric_columns_.size(); ++k){
+            const std::vector<double>& values = points.column(numeric_columns_[k]).values;
+            // The last point of an earlier run is weighted by the time until this run
+            terms_.clear();
+            if(continued){
+                double last_value = last_point_.column(numeric_columns_[k]).values[0];
+                terms_.push_back(last_value * static_cast<double>(times[first_i] - last_point_.times()[0]));
+            }
+            for(size_t i = first_i; i + 1 < end_i; ++i){
+                terms_.push_back(values[i] * static_cast<double>(times[i + 1] - times[i]));
+            }
+            if(!terms_.empty()){
+                weighted_sums_[k] += AggregationKernels::sum(&terms_[0], terms_.size());
+            }
+            sums_[k] += AggregationKernels::sum(&values[first_i], end_i - first_i);
+            counts_[k] += AggregationKernels::count(&values[first_i], end_i - first_i);
+        }
+        last_point_.setPoint(0, points, end_i - 1);
+    }
+
+    void StreamingDownsampler::accumulateM4(const PointBatch& points, size_t first_i, size_t end_i){
+        if(!slot_set_[0]){
+            setSlot(0, points, first_i, 0);
+        }
+        setSlot(1, points, end_i - 1, 0);
+
+        // A later run only replaces a candidate with a strictly smaller or larger value, so
+        // the first minimum and maximum of the bucket are kept
+        for(size_t k = 0; k < numeric_columns_.size(); ++k){
+            const double* values = &points.column(numeric_columns_[k]).values[0];
+            size_t min_i = first_i + AggregationKernels::argMin(values + first_i, end_i - first_i);
+            size_t max_i = first_i + AggregationKernels::argMax(values + first_i, end_i - first_i);
+            size_t min_slot = 2 + 2 * k;
+            size_t max_slot = min_slot + 1;
+            if(!slot_set_[min_slot] || values[min_i] < slot_values_[min_slot]){
+                setSlot(min_slot, points, min_i, values[min_i]);
+            }
+            if(!slot_set_[max_slot] || values[max_i] > slot_values_[max_slot]){
+                setSlot(max_slot, points, max_i, values[max_i]);
+            }
+        }
+    }
+
+    void StreamingDownsampler::setSlot(size_t slot, const PointBatch& points, size_t index, double value){
+        slots_.setPoint(slot, points, index);
+        slot_sequences_[slot] = sequence_ + static_cast<int64_t>(index);
+        slot_values_[slot] = value;
+        slot_set_[slot] = true;
+    }
+
+    void StreamingDownsampler::closeBucket(){
+        if(mode_ != Mode::M4){
+            out_.appendPoint(last_point_, 0);
+            size_t index = out_.size() - 1;
+            int64_t duration = last_point_.times()[0] - first_time_;
+            for(size_t k = 0; k < numeric_columns_.size(); ++k){
+                PointBatch::Column& column = out_.column(numeric_columns_[k]);
+                double average = counts_[k] > 0 ? sums_[k] / static_cast<double>(counts_[k]) : 0;
+                if(mode_ == Mode::TIME_WEIGHTED && duration > 0){
+                    average = weighted_sums_[k] / static_cast<double>(duration);
+                }
+                if(column.type == PointBatch::ColumnType::INT){
+                    average = static_cast<int>(average);
+                }
+                column.values[index] = average;
+                sums_[k] = 0;
+                counts_[k] = 0;
+                weighted_sums_[k] = 0;
+            }
+        } else {
+            // Emit each distinct candidate point once, in the order the points arrived
+            std::vector<std::pair<int64_t, size_t>> selected;
+            for(size_t slot = 0; slot < slot_set_.size(); ++slot){
+                if(slot_set_[slot]){
+                    selected.push_back(std::make_pair(slot_sequences_[slot], slot));
+                    slot_set_[slot] = false;
+                }
+            }
+            std::sort(selected.begin(), selected.end());
+            for(size_t i = 0; i < selected.size(); ++i){
+                if(i == 0 || selected[i].first != selected[i - 1].first){
+                    out_.appendPoint(slots_, selected[i].second);
+                }
+            }
+        }
+        has_bucket_ = false;
+
+        if(out_.size() >= SINK_POINTS_){
+            sink_(out_);
+            out_.clearPoints();
+        }
+    }
+
+}}
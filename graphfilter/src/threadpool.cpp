@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include <graphfilter/threadpool.h>
+
+
+namespace intel { namespace poc {
+
+    ThreadPool::ThreadPool(size_t num_threads):stopping_(false){
+        if(num_threads == 0){
+            num_threads = 1;
+        }
+        workers_.reserve(num_threads);
+        for(size_t i = 0; i < num_threads; ++i){
+            workers_.push_back(std::thread(&ThreadPool::run, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        for(std::vector<std::thread>::iterator it = workers_.begin(); it != workers_.end(); ++it){
+            it->join();
+        }
+    }
+
+    void ThreadPool::run(){
+        while(true){
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                while(!stopping_ && tasks_.empty()){
+                    condition_.wait(lock);
+                }
+                if(tasks_.empty()){
+                    return;
+                }
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+}}
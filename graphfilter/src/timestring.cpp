@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2015, Intel Corporation.
+ *
+ * This program is licensed under the terms and conditions of the
+ * Apache License, version 2.0.  The full text of the Apache License is at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ */
+
+#include <graphfilter/timestring.h>
+
+
+namespace intel { namespace poc {
+
+    namespace {
+
+        inline int digit(char c){
+            return (c >= '0' && c <= '9') ? c - '0' : -1;
+        }
+
+        // Parse two digits, returns -1 if either is not a digit
+        inline int twoDigits(const char* str){
+            int high = digit(str[0]);
+            int low = digit(str[1]);
+            return (high < 0 || low < 0) ? -1 : high * 10 + low;
+        }
+
+        inline bool isLeapYear(int64_t year){
+            return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        }
+
+        inline int daysInMonth(int64_t year, int month){
+            static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+            return (month == 2 && isLeapYear(year)) ? 29 : days[month - 1];
+        }
+
+        // Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+        inline int64_t daysFromCivil(int64_t year, int month, int day){
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            int64_t year_of_era = year - era * 400;
+            int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+            return era * 146097 + day_of_era - 719468;
+        }
+
+        // Inverse of daysFromCivil
+        inline void civilFromDays(int64_t days, int64_t& year, int& month, int& day){
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            int64_t day_of_era = days - era * 146097;
+            int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+            int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+            int64_t mp = (5 * day_of_year + 2) / 153;
+            day = static_cast<int>(day_of_year - (153 * mp + 2) / 5 + 1);
+            month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+            year = year_of_era + era * 400 + (month <= 2);
+        }
+
+        inline void writeDigits(char* buffer, int64_t value, int width){
+            for(int i = width - 1; i >= 0; --i){
+                buffer[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+    }
+
+    const size_t TimeString::LENGTH;
+
+    int64_t TimeString::toEpochSeconds(const char* str, size_t len){
+        // 2015-03-03 00:00Z
+        // 01234567890123456
+        if(str == NULL || len != LENGTH ||
+            str[4] != '-' || str[7] != '-' || str[10] != ' ' || str[13] != ':' || str[16] != 'Z'){
+            return -1;
+        }
+
+        int century = twoDigits(str);
+        int year_of_century = twoDigits(str + 2);
+        int month = twoDigits(str + 5);
+        int day = twoDigits(str + 8);
+        int hour = twoDigits(str + 11);
+        int minute = twoDigits(str + 14);
+        if(century < 0 || year_of_century < 0 || month < 1 || month > 12 || day < 1 ||
+            hour < 0 || hour > 23 || minute < 0 || minute > 59){
+            return -1;
+        }
+
+        int64_t year = century * 100 + year_of_century;
+        if(day > daysInMonth(year, month)){
+            return -1;
+        }
+
+        return daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60;
+    }
+
+    void TimeString::format(int64_t epoch_seconds, char* buffer){
+        int64_t days = epoch_seconds / 86400;
+        int64_t seconds_of_day = epoch_seconds % 86400;
+        if(seconds_of_day < 0){
+            seconds_of_day += 86400;
+            days -= 1;
+        }
+
+        int64_t year;
+        int month;
+        int day;
+        civilFromDays(days, year, month, day);
+
+        writeDigits(buffer, year, 4);
+        buffer[4] = '-';
+        writeDigits(buffer + 5, month, 2);
+        buffer[7] = '-';
+        writeDigits(buffer + 8, day, 2);
+        buffer[10] = ' ';
+        writeDigits(buffer + 11, seconds_of_day / 3600, 2);
+        buffer[13] = ':';
+        writeDigits(buffer + 14, (seconds_of_day / 60) % 60, 2);
+        buffer[16] = 'Z';
+        buffer[17] = '\0';
+    }
+
+    int64_t TimeString::monthIndex(int64_t epoch_seconds){
+        int64_t days = epoch_seconds / 86400;
+        if(epoch_seconds % 86400 < 0){
+            days -= 1;
+        }
+
+        int64_t year;
+        int month;
+        int day;
+        civilFromDays(days, year, month, day);
+        return (year - 1970) * 12 + month - 1;
+    }
+
+    int64_t TimeString::monthStart(int64_t month_index){
+        int64_t year = 1970 + (month_index >= 0 ? month_index : month_index - 11) / 12;
+        int month = static_cast<int>(month_index - (year - 1970) * 12) + 1;
+        return daysFromCivil(year, month, 1) * 86400;
+    }
+
+}}
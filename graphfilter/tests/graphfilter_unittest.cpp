@@ -10,16 +10,33 @@
 #include <stdio.h>
 #include <fstream>
 #include <graphfilter/graphfilter.h>
+#include <graphfilter/graphfilterclib.h>
 #include <graphfilter/datacache.h>
 #include <graphfilter/sqlitedatacache.h>
+#include <graphfilter/nativedatacache.h>
 #include <graphfilter/databaseaccess.h>
 #include <graphfilter/sqlitedatabaseaccess.h>
+#include <graphfilter/datafilter.h>
+#include <graphfilter/pointbatch.h>
+#include <graphfilter/timestring.h>
+#include <graphfilter/aggregationkernels.h>
+#include <graphfilter/streamingdownsampler.h>
+#include <graphfilter/sqlitefunctions.h>
+#include <graphfilter/statementcache.h>
+#include <graphfilter/chunkcodec.h>
+#include <graphfilter/requestqueue.h>
+#include <graphfilter/intervalset.h>
 #include "gtest/gtest.h"
 #include "json.h"
 #include "dummydata.h"  // Data from 2MonthData.csv file
 #include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <thread>
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
 
 namespace {
 
@@ -119,6 +136,138 @@ class DataCacheTest : public ::testing::Test {
     }
 };
 
+class DataFilterTest : public ::testing::Test {
+  protected:
+    Json::Value data_json_;
+    intel::poc::PointBatch data_batch_;
+    std::map<std::string, std::string> data_schema_map_;
+
+    DataFilterTest() {
+      intel::poc::DataFilter::init("date");
+      data_schema_map_["date"] = "TEXT";
+      data_schema_map_["calories"] = "REAL";
+      data_schema_map_["gsr"] = "REAL";
+      data_schema_map_["heart_rate"] = "INT";
+      data_schema_map_["body_temp"] = "REAL";
+      data_schema_map_["steps"] = "INT";
+
+      // Build one day of points from 2MonthData.csv, both as Json and as a PointBatch
+      data_batch_.reset("date");
+      data_batch_.addColumn("body_temp", intel::poc::PointBatch::ColumnType::REAL);
+      data_batch_.addColumn("calories", intel::poc::PointBatch::ColumnType::REAL);
+      data_batch_.addColumn("gsr", intel::poc::PointBatch::ColumnType::REAL);
+      data_batch_.addColumn("heart_rate", intel::poc::PointBatch::ColumnType::INT);
+      data_batch_.addColumn("steps", intel::poc::PointBatch::ColumnType::INT);
+      data_batch_.setDates("2015-03-03 00:00Z", "2015-03-03 23:59Z");
+      data_json_["startDate"] = "2015-03-03 00:00Z";
+      data_json_["endDate"] = "2015-03-03 23:59Z";
+      data_json_["points"] = Json::Value(Json::arrayValue);
+
+      std::istringstream inputStream(std::string(reinterpret_cast<const char*>(POC_2MonthData_csv)));
+      std::string line;
+      while (std::getline(inputStream, line)) {
+        if (line.substr(0, 10) != std::string("2015-03-03"))
+          continue;
+
+        std::stringstream lineStream(line);
+        std::string fields[6];
+        for (int i = 0; i < 6; ++i) {
+          std::getline(lineStream, fields[i], ',');
+        }
+        double calories = atof(fields[1].c_str());
+        double gsr = atof(fields[2].c_str());
+        int heart_rate = atoi(fields[3].c_str());
+        double body_temp = atof(fields[4].c_str());
+        int steps = atoi(fields[5].c_str());
+
+        Json::Value point;
+        point["date"] = fields[0];
+        point["calories"] = calories;
+        point["gsr"] = gsr;
+        point["heart_rate"] = heart_rate;
+        point["body_temp"] = body_temp;
+        point["steps"] = steps;
+        data_json_["points"].append(point);
+
+        data_batch_.times().push_back(intel::poc::TimeString::toEpochSeconds(fields[0]));
+        data_batch_.column(0).values.push_back(body_temp);
+        data_batch_.column(1).values.push_back(calories);
+        data_batch_.column(2).values.push_back(gsr);
+        data_batch_.column(3).values.push_back(heart_rate);
+        data_batch_.column(4).values.push_back(steps);
+      }
+    }
+
+    virtual ~DataFilterTest() {
+      // You can do clean-up work that doesn't throw exceptions here.
+    }
+
+    // The columnar averages sum in a different order than the Json::Value filters, so
+    // REAL values may differ in the last bits
+    void expectSamePoints(const Json::Value& expected, const Json::Value& actual) {
+      EXPECT_EQ(expected["startDate"], actual["startDate"]);
+      EXPECT_EQ(expected["endDate"], actual["endDate"]);
+      ASSERT_EQ(expected["points"].size(), actual["points"].size());
+      for (Json::ArrayIndex i = 0; i < expected["points"].size(); ++i) {
+        const Json::Value& expected_point = expected["points"][i];
+        const Json::Value& actual_point = actual["points"][i];
+        ASSERT_EQ(expected_point.getMemberNames(), actual_point.getMemberNames());
+        std::vector<std::string> names = expected_point.getMemberNames();
+        for (size_t n = 0; n < names.size(); ++n) {
+          if (expected_point[names[n]].isDouble()) {
+            EXPECT_NEAR(expected_point[names[n]].asDouble(), actual_point[names[n]].asDouble(), 1e-9 * std::max(1.0, fabs(expected_point[names[n]].asDouble())));
+          } else {
+            EXPECT_EQ(expected_point[names[n]], actual_point[names[n]]);
+          }
+        }
+      }
+    }
+};
+
+class ChunkCodecTest : public ::testing::Test {
+  protected:
+    ChunkCodecTest() {
+      // You can do set-up work for each test here.
+    }
+
+    virtual ~ChunkCodecTest() {
+      // You can do clean-up work that doesn't throw exceptions here.
+    }
+};
+
+class RequestQueueTest : public ::testing::Test {
+  protected:
+    RequestQueueTest() {
+      // You can do set-up work for each test here.
+    }
+
+    virtual ~RequestQueueTest() {
+      // You can do clean-up work that doesn't throw exceptions here.
+    }
+};
+
+class IntervalSetTest : public ::testing::Test {
+  protected:
+    IntervalSetTest() {
+      // You can do set-up work for each test here.
+    }
+
+    virtual ~IntervalSetTest() {
+      // You can do clean-up work that doesn't throw exceptions here.
+    }
+};
+
+class StatementCacheTest : public ::testing::Test {
+  protected:
+    StatementCacheTest() {
+      // You can do set-up work for each test here.
+    }
+
+    virtual ~StatementCacheTest() {
+      // You can do clean-up work that doesn't throw exceptions here.
+    }
+};
+
 }
 
 TEST_F(GraphFilterTest, Singleton) {
@@ -237,6 +386,86 @@ TEST_F(GraphFilterTest, AddDuplicateData) {
   EXPECT_TRUE(gf.addData(param)) << " input param: " << param;
 }
 
+TEST_F(GraphFilterTest, AddColumnData) {
+  int64_t start = intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z");
+  int64_t times[10];
+  int64_t heart_rate[10];
+  double calories[10];
+  const char* steps[10];
+  for(int i = 0; i < 10; ++i){
+    times[i] = start + i * 60;
+    heart_rate[i] = 60 + i;
+    calories[i] = 0.5 * i;
+    steps[i] = i % 2 ? "3" : NULL;
+  }
+  uint8_t nulls[2] = {0x05, 0x02};  // points 0, 2 and 9
+  intel_poc_Column columns[3] = {
+    {"heart_rate", INTEL_POC_COLUMN_INT64, heart_rate, nulls},
+    {"calories", INTEL_POC_COLUMN_DOUBLE, calories, NULL},
+    {"steps", INTEL_POC_COLUMN_TEXT, steps, NULL}};
+  ASSERT_EQ(1, intel_poc_GraphFilter_addColumns(times, 10, columns, 3));
+
+  std::string result = gf.getData("{\"startDate\":\"2015-03-03 00:00Z\","
+    "\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":1000}");
+  Json::Reader reader;
+  Json::Value json_root;
+  ASSERT_TRUE(reader.parse(result, json_root));
+  ASSERT_EQ(10, json_root["points"].size());
+  EXPECT_EQ("2015-03-03 00:09Z", json_root["points"][9]["date"].asString());
+  EXPECT_EQ(0, json_root["points"][0]["heart_rate"].asInt());
+  EXPECT_EQ(61, json_root["points"][1]["heart_rate"].asInt());
+  EXPECT_EQ(0, json_root["points"][9]["heart_rate"].asInt());
+  EXPECT_DOUBLE_EQ(4.0, json_root["points"][8]["calories"].asDouble());
+  EXPECT_EQ(3, json_root["points"][7]["steps"].asInt());
+  EXPECT_EQ(0, json_root["points"][8]["steps"].asInt());
+
+  // Every column must be a metric of the schema
+  intel_poc_Column date = {"date", INTEL_POC_COLUMN_INT64, times, NULL};
+  EXPECT_EQ(0, intel_poc_GraphFilter_addColumns(times, 10, &date, 1));
+  intel_poc_Column unknown = {"unknown", INTEL_POC_COLUMN_INT64, heart_rate, NULL};
+  EXPECT_EQ(0, intel_poc_GraphFilter_addColumns(times, 10, &unknown, 1));
+  intel_poc_Column bad_type = {"steps", 7, heart_rate, NULL};
+  EXPECT_EQ(0, intel_poc_GraphFilter_addColumns(times, 10, &bad_type, 1));
+  intel_poc_Column repeated[2] = {columns[0], columns[0]};
+  EXPECT_EQ(0, intel_poc_GraphFilter_addColumns(times, 10, repeated, 2));
+  EXPECT_EQ(1, intel_poc_GraphFilter_addColumns(times, 0, NULL, 0));
+}
+
+TEST_F(GraphFilterTest, AsyncAddData) {
+  ASSERT_TRUE(gf.init("{\"asyncIngest\": true, \"ingestDelayMs\": 20}", data_schema, "/data/local/tmp/test.db", true));
+
+  int64_t start = intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z");
+  std::vector<std::thread> threads;
+  for(int t = 0; t < 4; ++t){
+    threads.push_back(std::thread([&, t]() {
+      for(int i = 0; i < 25; ++i){
+        std::string date = intel::poc::TimeString::fromEpochSeconds(start + (t * 25 + i) * 60);
+        gf.addData("{\"startDate\": \"" + date + "\", \"endDate\": \"" + date + "\", \"points\": [{\"date\": \"" + date + "\", \"steps\": " + std::to_string(t) + "}]}");
+      }
+    }));
+  }
+  for(size_t t = 0; t < threads.size(); ++t){
+    threads[t].join();
+  }
+  EXPECT_TRUE(gf.flush());
+  EXPECT_EQ(0, gf.pendingWrites());
+
+  std::string result = gf.getData("{\"startDate\":\"2015-03-03 00:00Z\","
+    "\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":1000}");
+  Json::Reader reader;
+  Json::Value json_root;
+  ASSERT_TRUE(reader.parse(result, json_root));
+  ASSERT_EQ(100, json_root["points"].size());
+  EXPECT_EQ(3, json_root["points"][99]["steps"].asInt());
+
+  // Failures of queued payloads are reported by the next flush
+  EXPECT_TRUE(gf.addData("{\"points\": [}"));
+  EXPECT_FALSE(gf.flush());
+  EXPECT_TRUE(gf.flush());
+  EXPECT_EQ(1, intel_poc_GraphFilter_flush());
+  EXPECT_EQ(0, intel_poc_GraphFilter_pendingWrites());
+}
+
 TEST_F(GraphFilterTest, GetDataAvailable) {
   std::string param = "{\"startDate\":\"2015-03-03 00:00Z\","
      "\"endDate\":\"2015-03-03 23:59Z\","
@@ -279,6 +508,68 @@ TEST_F(GraphFilterTest, GetDataUnavailable) {
 }
 
 
+TEST_F(GraphFilterTest, GetDataAsync) {
+  ASSERT_TRUE(gf.addData("{\"startDate\":\"2015-03-03 00:00Z\","
+    "\"endDate\":\"2015-03-03 23:59Z\","
+    "\"points\" : [{\"date\":\"2015-03-03 00:00Z\",\"steps\":7}]}"));
+  std::string params = "{\"startDate\":\"2015-03-03 00:00Z\","
+    "\"endDate\":\"2015-03-03 23:59Z\","
+    "\"numOfPoints\":1000}";
+
+  // Requests of one group supersede each other, each callback runs exactly once
+  std::mutex mutex;
+  std::condition_variable done;
+  std::map<uint64_t, std::pair<bool, std::string>> results;
+  std::vector<uint64_t> ids;
+  for(int i = 0; i < 5; ++i){
+    ids.push_back(gf.getDataAsync(params, "graph", [&](uint64_t request_id, bool completed, const std::string& result) {
+      std::lock_guard<std::mutex> lock(mutex);
+      EXPECT_EQ(0, results.count(request_id));
+      results[request_id] = std::make_pair(completed, result);
+      done.notify_all();
+    }));
+    EXPECT_NE(0, ids.back());
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(done.wait_for(lock, std::chrono::seconds(10), [&]() { return results.size() == ids.size(); }));
+  }
+  EXPECT_TRUE(results[ids.back()].first);
+  EXPECT_EQ(gf.getData(params), results[ids.back()].second);
+  for(size_t i = 0; i + 1 < ids.size(); ++i){
+    if(!results[ids[i]].first){
+      EXPECT_EQ("", results[ids[i]].second);
+    }
+  }
+  EXPECT_FALSE(gf.cancel(ids.back()));
+  EXPECT_FALSE(gf.cancel(0));
+
+  struct Completion {
+    std::mutex mutex;
+    std::condition_variable done;
+    uint64_t request_id;
+    int completed;
+    std::string result;
+  } completion;
+  completion.request_id = 0;
+  uint64_t request_id = intel_poc_GraphFilter_getDataAsync(params.c_str(), NULL,
+    [](uint64_t request_id, int completed, const char* result, void* user_data) {
+      Completion* completion = static_cast<Completion*>(user_data);
+      std::lock_guard<std::mutex> lock(completion->mutex);
+      completion->request_id = request_id;
+      completion->completed = completed;
+      completion->result = result;
+      completion->done.notify_all();
+    }, &completion);
+  std::unique_lock<std::mutex> lock(completion.mutex);
+  ASSERT_TRUE(completion.done.wait_for(lock, std::chrono::seconds(10), [&]() { return completion.request_id != 0; }));
+  EXPECT_EQ(request_id, completion.request_id);
+  EXPECT_EQ(1, completion.completed);
+  EXPECT_EQ(results[ids.back()].second, completion.result);
+  EXPECT_EQ(0, intel_poc_GraphFilter_cancel(request_id));
+}
+
+
 TEST_F(GraphFilterTest, UseCache) {
   ASSERT_TRUE(gf.init(cache_setup,data_schema,"/data/local/tmp/test.db", true));
   std::string param = "{\"startDate\":\"2015-03-03 00:00Z\","
@@ -300,6 +591,42 @@ TEST_F(GraphFilterTest, UseCache) {
   EXPECT_EQ(1, json_root["points"].size()) << " result size: " << json_root["points"].size();
 }
 
+TEST_F(GraphFilterTest, UseNativeCache) {
+  Json::Reader reader;
+  Json::Value cache_setup_json;
+  ASSERT_TRUE(reader.parse(cache_setup, cache_setup_json));
+  cache_setup_json["cacheEngine"] = "redis";
+  EXPECT_FALSE(gf.init(Json::FastWriter().write(cache_setup_json),data_schema,"/data/local/tmp/test.db", true));
+  cache_setup_json["cacheEngine"] = "native";
+  ASSERT_TRUE(gf.init(Json::FastWriter().write(cache_setup_json),data_schema,"/data/local/tmp/test.db", true));
+  std::string param = "{\"startDate\":\"2015-03-03 00:00Z\","
+     "\"endDate\":\"2015-03-03 23:59Z\","
+     "\"points\" : [{\"date\":\"2015-03-03 00:00Z\","
+     "\"calories\":1.4,"
+     "\"gsr\":5.12886e-05,"
+     "\"heart_rate\":61,"
+     "\"body_temp\":88.7,"
+     "\"steps\":0},"
+     "{\"date\":\"2015-03-03 00:10Z\","
+     "\"calories\":1.5,"
+     "\"heart_rate\":62,"
+     "\"steps\":10}]}";
+  EXPECT_TRUE(gf.addData(param)) << " input param: " << param;
+  std::string query = "{\"startDate\":\"2015-03-03 00:00Z\","
+    "\"endDate\":\"2015-03-03 23:59Z\","
+    "\"numOfPoints\":5000}";
+  std::string result = gf.getData(query);
+
+  // Sleep for some time to give it time to async put, then read from the cache
+  std::this_thread::sleep_for(std::chrono::milliseconds(750));
+  EXPECT_EQ(result, gf.getData(query));
+  EXPECT_LT(0, gf.cacheBytes());
+  EXPECT_EQ(gf.cacheBytes(), intel_poc_GraphFilter_cacheBytes());
+  Json::Value json_root;
+  ASSERT_TRUE(reader.parse(result, json_root));
+  EXPECT_EQ(2, json_root["points"].size()) << " result size: " << json_root["points"].size();
+}
+
 // All tests below are preloaded with data from 2MonthsData.csv
 // Using GraphFilterDummyDataTest typed test
 TEST_F(GraphFilterDummyDataTest, BatchTransaction) {
@@ -628,6 +955,35 @@ TEST_F(DatabaseAccessTest, Init) {
   EXPECT_TRUE(da.init(database_path,data_schema_json_, true));
 }
 
+// Columns are compiled in name order, with the date key as the primary key
+TEST_F(DatabaseAccessTest, InitCompiledSchema) {
+  intel::poc::Schema schema;
+  ASSERT_TRUE(schema.parse(data_schema_json_));
+  EXPECT_EQ("data", schema.table());
+  EXPECT_EQ(6u, schema.numColumns());
+  EXPECT_EQ("body_temp, calories, date, gsr, heart_rate, steps", schema.columnList());
+  EXPECT_EQ("body_temp REAL, calories REAL, date TEXT PRIMARY KEY, gsr REAL, heart_rate INT, steps INT", schema.columnDefinitions());
+  EXPECT_EQ(2u, schema.dateKeyId());
+  EXPECT_EQ(4, schema.find("heart_rate"));
+  EXPECT_EQ(intel::poc::PointBatch::ColumnType::INT, schema.column(4).type);
+  EXPECT_EQ(-1, schema.find("unknown"));
+
+  intel::poc::PointBatch batch;
+  schema.layout(batch);
+  EXPECT_EQ("date", batch.dateKey());
+  EXPECT_EQ(5u, batch.numColumns());
+  EXPECT_EQ(-1, batch.columnIndex("date"));
+
+  EXPECT_TRUE(da.init(database_path, schema, true));
+  EXPECT_TRUE(da.init(database_path, schema, false));
+
+  Json::Value bad_schema = data_schema_json_;
+  bad_schema["date_key_column"] = "time";
+  EXPECT_FALSE(schema.parse(bad_schema));
+  EXPECT_TRUE(schema.empty());
+  EXPECT_FALSE(da.init(database_path, bad_schema, true));
+}
+
 /*
 * Put Tests
 */
@@ -748,6 +1104,684 @@ TEST_F(DatabaseAccessTest, InitDatabasePutAndGetData) {
 }
 
 
+// Init the databaseaccess, put data in, and check that the columnar batch is filled
+TEST_F(DatabaseAccessTest, InitDatabasePutAndGetBatch) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  std::string param = "{\"startDate\":\"2015-03-03 00:00Z\","
+     "\"endDate\":\"2015-03-03 23:59Z\","
+     "\"points\" : [{\"date\":\"2015-03-03 00:00Z\","
+     "\"calories\":1.4,"
+     "\"gsr\":5.12886e-05,"
+     "\"heart_rate\":61,"
+     "\"body_temp\":88.7,"
+     "\"steps\":0},"
+    "{\"date\":\"2015-03-03 00:10Z\","
+     "\"calories\":1.5,"
+     "\"gsr\":5.12886e-05,"
+     "\"heart_rate\":62,"
+     "\"body_temp\":88.8,"
+     "\"steps\":10}]}";
+  Json::Value json_root_param;
+  ASSERT_TRUE(reader_.parse(param, json_root_param));
+  ASSERT_TRUE(da.putData(json_root_param)) << " input param: " << param;
+
+  std::string query = "{\"startDate\":\"2015-03-03 00:00Z\","
+                       "\"endDate\":\"2015-03-03 23:59Z\","
+                       "\"metrics\":[\"heart_rate\",\"body_temp\"]}";
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(query, query_json));
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query_json, result));
+  ASSERT_EQ(2, result.size());
+  ASSERT_EQ(2, result.numColumns());
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:10Z"), result.times()[1]);
+  int heart_rate = result.columnIndex("heart_rate");
+  ASSERT_LE(0, heart_rate);
+  EXPECT_EQ(61, result.column(heart_rate).values[0]);
+  EXPECT_EQ(62, result.column(heart_rate).values[1]);
+  EXPECT_EQ(-1, result.columnIndex("steps"));
+}
+
+// Numbers sent as strings keep their column type, and batches larger than one old INSERT
+// chunk are all stored
+TEST_F(DatabaseAccessTest, InitDatabasePutTypedValues) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  Json::Value data;
+  data["startDate"] = "2015-03-03 00:00Z";
+  data["endDate"] = "2015-03-03 23:59Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  for(int i = 0; i < 1200; ++i){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    point["calories"] = 1.5;
+    point["gsr"] = "4.27263e-05";
+    point["heart_rate"] = i % 100;
+    point["steps"] = "7";
+    data["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(data));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-03 23:59Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(1200, result.size());
+  EXPECT_DOUBLE_EQ(4.27263e-05, result.column(result.columnIndex("gsr")).values[10]);
+  EXPECT_EQ(7, result.column(result.columnIndex("steps")).values[10]);
+  EXPECT_EQ(99, result.column(result.columnIndex("heart_rate")).values[1199]);
+  EXPECT_EQ(0, result.column(result.columnIndex("body_temp")).values[0]);
+}
+
+// The SELECT of a set of columns is reused with different bound dates
+TEST_F(DatabaseAccessTest, InitDatabaseRepeatedRangeQueries) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  Json::Value data;
+  data["startDate"] = "2015-03-03 00:00Z";
+  data["endDate"] = "2015-03-03 23:59Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  for(int i = 0; i < 100; ++i){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    point["heart_rate"] = i;
+    data["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(data));
+
+  const char* ranges[][2] = {{"2015-03-03 00:00Z", "2015-03-03 00:09Z"},
+                             {"2015-03-03 01:00Z", "2015-03-03 01:39Z"},
+                             {"2015-03-03 00:00Z", "2015-03-03 00:09Z"},
+                             {"2015-03-04 00:00Z", "2015-03-04 23:59Z"}};
+  size_t expected_sizes[] = {10, 40, 10, 0};
+  for(int i = 0; i < 4; ++i){
+    Json::Value query;
+    query["startDate"] = ranges[i][0];
+    query["endDate"] = ranges[i][1];
+    query["metrics"].append("heart_rate");
+    intel::poc::PointBatch result;
+    ASSERT_TRUE(da.getData(query, result));
+    ASSERT_EQ(expected_sizes[i], result.size());
+    if(!result.empty()){
+      EXPECT_EQ(intel::poc::TimeString::toEpochSeconds(ranges[i][0]), result.times()[0]);
+    }
+  }
+}
+
+// Queries on several threads run on pooled reader connections, alongside inserts
+TEST_F(DatabaseAccessTest, InitDatabaseConcurrentQueries) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  Json::Value data;
+  data["startDate"] = "2015-03-03 00:00Z";
+  data["endDate"] = "2015-03-03 23:59Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  for(int i = 0; i < 1000; ++i){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    point["heart_rate"] = i;
+    data["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(data));
+
+  Json::Value later = data;
+  for(Json::ArrayIndex i = 0; i < later["points"].size(); ++i){
+    later["points"][i]["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-05 00:00Z") + i * 60);
+  }
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-03 23:59Z";
+  std::vector<int> failures(8, 0);
+  std::vector<std::thread> readers;
+  for(size_t t = 0; t < failures.size(); ++t){
+    readers.push_back(std::thread([this, &query, &failures, t]() {
+      for(int i = 0; i < 10; ++i){
+        intel::poc::PointBatch result;
+        if(!da.getData(query, result) || result.size() != 1000){
+          ++failures[t];
+        }
+      }
+    }));
+  }
+  EXPECT_TRUE(da.putData(later));
+  for(size_t t = 0; t < readers.size(); ++t){
+    readers[t].join();
+    EXPECT_EQ(0, failures[t]);
+  }
+}
+
+TEST_F(DatabaseAccessTest, InitDatabasePutAndStreamData) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  std::string param = "{\"startDate\":\"2015-03-03 00:00Z\","
+     "\"endDate\":\"2015-03-03 00:59Z\","
+     "\"points\" : ["
+     "{\"date\":\"2015-03-03 00:00Z\",\"calories\":1.0,\"gsr\":0.1,\"heart_rate\":60,\"body_temp\":88.0,\"steps\":0},"
+     "{\"date\":\"2015-03-03 00:10Z\",\"calories\":2.0,\"gsr\":0.1,\"heart_rate\":62,\"body_temp\":88.0,\"steps\":10},"
+     "{\"date\":\"2015-03-03 00:20Z\",\"calories\":3.0,\"gsr\":0.1,\"heart_rate\":64,\"body_temp\":88.0,\"steps\":20},"
+     "{\"date\":\"2015-03-03 00:30Z\",\"calories\":4.0,\"gsr\":0.1,\"heart_rate\":70,\"body_temp\":88.0,\"steps\":30},"
+     "{\"date\":\"2015-03-03 00:40Z\",\"calories\":5.0,\"gsr\":0.1,\"heart_rate\":80,\"body_temp\":88.0,\"steps\":40}]}";
+  Json::Value json_root_param;
+  ASSERT_TRUE(reader_.parse(param, json_root_param));
+  ASSERT_TRUE(da.putData(json_root_param)) << " input param: " << param;
+
+  std::string query = "{\"startDate\":\"2015-03-03 00:00Z\","
+                       "\"endDate\":\"2015-03-03 00:59Z\","
+                       "\"metrics\":[\"heart_rate\",\"calories\"]}";
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(query, query_json));
+  intel::poc::PointBatch result;
+  int sink_calls = 0;
+  intel::poc::StreamingDownsampler downsampler(intel::poc::StreamingDownsampler::Mode::AVERAGE, 2,
+    [&result, &sink_calls](const intel::poc::PointBatch& points) {
+      result.copyLayout(points);
+      result.append(points);
+      ++sink_calls;
+    });
+  ASSERT_TRUE(da.getData(query_json, downsampler));
+  EXPECT_EQ(1, sink_calls);
+  ASSERT_EQ(2, result.size());
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:20Z"), result.times()[0]);
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:40Z"), result.times()[1]);
+  int heart_rate = result.columnIndex("heart_rate");
+  int calories = result.columnIndex("calories");
+  ASSERT_LE(0, heart_rate);
+  ASSERT_LE(0, calories);
+  EXPECT_EQ(62, result.column(heart_rate).values[0]);
+  EXPECT_EQ(75, result.column(heart_rate).values[1]);
+  EXPECT_DOUBLE_EQ(2.0, result.column(calories).values[0]);
+  EXPECT_DOUBLE_EQ(4.5, result.column(calories).values[1]);
+}
+
+// Averaging in the query gives the same points as streaming the rows through TIME_WEIGHTED,
+// missing values counting as 0 in both
+TEST_F(DatabaseAccessTest, InitDatabasePutAndAggregateData) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  Json::Value data;
+  data["startDate"] = "2015-03-03 00:00Z";
+  data["endDate"] = "2015-03-04 00:00Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  for(int i = 0; i < 1440; i += 1 + i % 7){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    point["calories"] = 0.25 * (i % 13);
+    if(i % 5 != 0){
+      point["gsr"] = 0.001 * i;
+    }
+    point["heart_rate"] = 60 + i % 41;
+    point["body_temp"] = 85 + 0.1 * (i % 30);
+    point["steps"] = i % 17;
+    data["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(data));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-03 23:59Z";
+  query["numOfPoints"] = 37;
+  intel::poc::PointBatch aggregated;
+  ASSERT_TRUE(da.getAggregatedData(query, aggregated));
+
+  intel::poc::PointBatch streamed;
+  intel::poc::StreamingDownsampler downsampler(intel::poc::StreamingDownsampler::Mode::TIME_WEIGHTED, 37,
+    [&streamed](const intel::poc::PointBatch& points) {
+      if(streamed.dateKey().empty()){
+        streamed.copyLayout(points);
+      }
+      streamed.append(points);
+    });
+  ASSERT_TRUE(da.getData(query, downsampler));
+
+  ASSERT_EQ(37, aggregated.size());
+  ASSERT_EQ(streamed.size(), aggregated.size());
+  ASSERT_EQ(streamed.numColumns(), aggregated.numColumns());
+  for(size_t i = 0; i < aggregated.size(); ++i){
+    EXPECT_EQ(streamed.times()[i], aggregated.times()[i]);
+    for(size_t c = 0; c < aggregated.numColumns(); ++c){
+      EXPECT_NEAR(streamed.column(c).values[i], aggregated.column(c).values[i], 1e-9) << aggregated.column(c).name;
+    }
+  }
+
+  query["numOfPoints"] = 0;
+  EXPECT_FALSE(da.getAggregatedData(query, aggregated));
+}
+
+
+// Run the tsdv_* SQL functions on a connection of their own
+TEST_F(DatabaseAccessTest, SQLiteFunctions) {
+  ASSERT_TRUE(intel::poc::DataFilter::init("date"));
+  sqlite3* database = NULL;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &database));
+  ASSERT_TRUE(intel::poc::SQLiteFunctions::registerAll(database));
+  ASSERT_EQ(SQLITE_OK, sqlite3_exec(database, "CREATE TABLE t (date TEXT, value REAL);", NULL, NULL, NULL));
+  int64_t start = intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z");
+  for(int i = 0; i < 200; ++i){
+    // Inserted out of order, the aggregates sort by date
+    int minute = (i * 7) % 200;
+    std::string sql = "INSERT INTO t VALUES ('" + intel::poc::TimeString::fromEpochSeconds(start + minute * 60) +
+                      "', " + std::to_string(minute % 23) + ");";
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(database, sql.c_str(), NULL, NULL, NULL));
+  }
+
+  auto query = [database](const std::string& sql) {
+    sqlite3_stmt* stmt = NULL;
+    std::string result = "NULL";
+    EXPECT_EQ(SQLITE_OK, sqlite3_prepare_v2(database, sql.c_str(), -1, &stmt, NULL)) << sql;
+    if(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL){
+      result = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return result;
+  };
+
+  EXPECT_EQ("2", query("SELECT tsdv_bucket('2015-03-03 01:00Z', '2015-03-03 00:00Z', 1800);"));
+  EXPECT_EQ("-1", query("SELECT tsdv_bucket(" + std::to_string(start - 1) + ", '2015-03-03 00:00Z', 1800);"));
+  EXPECT_EQ("NULL", query("SELECT tsdv_bucket('2015-03-03 01:00Z', '2015-03-03 00:00Z', 0);"));
+  EXPECT_EQ("NULL", query("SELECT tsdv_bucket('not a date', '2015-03-03 00:00Z', 60);"));
+  EXPECT_EQ("-2", query("SELECT tsdv_bucket('1969-12-31 22:30Z', '1970-01-01 00:00Z', 3600);"));
+  EXPECT_EQ("0", query("SELECT tsdv_bucket(-1, -1, 60);"));
+  EXPECT_EQ("4", query("SELECT count(DISTINCT tsdv_bucket(date, '2015-03-03 00:00Z', 3000)) FROM t;"));
+
+  // 1 for 10s, 3 for 20s
+  EXPECT_NEAR(70.0 / 30.0, std::stod(query("SELECT tsdv_twavg(d, v) FROM (SELECT 30 AS d, 5 AS v UNION ALL "
+                                            "SELECT 0, 1 UNION ALL SELECT 10, 3);")), 1e-9);
+  EXPECT_NEAR(3.0, std::stod(query("SELECT tsdv_twavg(d, v) FROM (SELECT 0 AS d, 2 AS v UNION ALL SELECT 0, 4);")), 1e-9);
+  EXPECT_EQ("NULL", query("SELECT tsdv_twavg(date, value) FROM t WHERE 0;"));
+
+  Json::Reader reader;
+  Json::Value lttb;
+  ASSERT_TRUE(reader.parse(query("SELECT tsdv_lttb(date, value, 20) FROM t;"), lttb));
+  ASSERT_TRUE(lttb.isArray());
+  EXPECT_EQ(20u, lttb.size());
+  EXPECT_EQ("2015-03-03 00:00Z", lttb[0]["date"].asString());
+  EXPECT_EQ(intel::poc::TimeString::fromEpochSeconds(start + 199 * 60), lttb[lttb.size() - 1]["date"].asString());
+
+  Json::Value m4;
+  ASSERT_TRUE(reader.parse(query("SELECT tsdv_m4(date, value, 10) FROM t;"), m4));
+  ASSERT_TRUE(m4.isArray());
+  EXPECT_GT(m4.size(), 0u);
+  EXPECT_LE(m4.size(), 40u);
+  for(Json::ArrayIndex i = 1; i < m4.size(); ++i){
+    EXPECT_LT(m4[i - 1]["date"].asString(), m4[i]["date"].asString());
+  }
+
+  sqlite3_close(database);
+}
+
+
+// Dates stored as epoch seconds still go in and come out as text
+TEST_F(DatabaseAccessTest, InitIntegerDateKey) {
+  Json::Value schema = data_schema_json_;
+  schema["date_key_storage"] = "INTEGER";
+  ASSERT_TRUE(da.init(database_path, schema, true));
+  EXPECT_TRUE(da.init(database_path, schema, false));
+  EXPECT_FALSE(da.init(database_path, data_schema_json_, false));
+  ASSERT_TRUE(da.init(database_path, schema, false));
+
+  Json::Value data;
+  data["startDate"] = "2015-03-03 00:00Z";
+  data["endDate"] = "2015-03-03 23:59Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  for(int i = 0; i < 600; ++i){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    point["heart_rate"] = i % 100;
+    point["gsr"] = 0.5 * i;
+    data["points"].append(point);
+  }
+  Json::Value invalid;
+  invalid["date"] = "yesterday";
+  data["points"].append(invalid);
+  ASSERT_TRUE(da.putData(data));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 01:00Z";
+  query["endDate"] = "2015-03-03 01:59Z";
+  Json::Value result = da.getData(query);
+  ASSERT_EQ(60, result["points"].size());
+  EXPECT_EQ("2015-03-03 01:00Z", result["points"][0]["date"].asString());
+  EXPECT_EQ("2015-03-03 01:59Z", result["points"][59]["date"].asString());
+  EXPECT_EQ(60, result["points"][0]["heart_rate"].asInt());
+  EXPECT_DOUBLE_EQ(30.0, result["points"][0]["gsr"].asDouble());
+
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-03 09:59Z";
+  query["numOfPoints"] = 10;
+  intel::poc::PointBatch aggregated;
+  ASSERT_TRUE(da.getAggregatedData(query, aggregated));
+  ASSERT_EQ(10, aggregated.size());
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:59Z"), aggregated.times()[0]);
+  // Weighted by time, the value of the last point of the bucket does not count
+  EXPECT_DOUBLE_EQ(0.5 * 29, aggregated.column(aggregated.columnIndex("gsr")).values[0]);
+
+  query["startDate"] = "today";
+  EXPECT_FALSE(da.getData(query, aggregated));
+
+  schema["date_key_storage"] = "BLOB";
+  EXPECT_FALSE(da.init(database_path, schema, true));
+}
+
+
+// The JSON text is parsed while it is inserted, over several batches
+TEST_F(DatabaseAccessTest, PutJsonData) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  std::string payload = "{\"source\": {\"device\": [1, 2, {\"a\": null}]}, \"startDate\": \"2015-03-03 00:00Z\", \"points\": [";
+  for(int i = 0; i < 2000; ++i){
+    if(i > 0){
+      payload += ",\n";
+    }
+    payload += "{\"date\": \"" + intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60) + "\"";
+    payload += ", \"heart_rate\": " + std::to_string(i % 100);
+    payload += ", \"calories\": " + std::to_string(i) + ".5";
+    payload += ", \"gsr\": \"4.27263e-05\"";
+    payload += ", \"steps\": true, \"unknown\": [\"x\"], \"body_temp\": null}";
+  }
+  payload += ", {\"heart_rate\": 5}, 7], \"endDate\": \"2015-03-04 09:19Z\"}";
+  ASSERT_TRUE(da.putJsonData(payload));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-05 00:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(2000, result.size());
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-04 09:19Z"), result.times()[1999]);
+  EXPECT_EQ(99, result.column(result.columnIndex("heart_rate")).values[1999]);
+  EXPECT_DOUBLE_EQ(1234.5, result.column(result.columnIndex("calories")).values[1234]);
+  EXPECT_DOUBLE_EQ(4.27263e-05, result.column(result.columnIndex("gsr")).values[10]);
+  EXPECT_EQ(1, result.column(result.columnIndex("steps")).values[10]);
+  EXPECT_EQ(0, result.column(result.columnIndex("body_temp")).values[0]);
+
+  // Same values as through a Json::Value
+  std::string single = "{\"startDate\": \"2015-03-06 00:00Z\", \"endDate\": \"2015-03-06 00:00Z\", "
+                       "\"points\": [{\"date\": \"2015-03-06 00:00Z\", \"heart_rate\": 7.0, \"steps\": \"7\", \"calories\": 1e2}]}";
+  ASSERT_TRUE(da.putJsonData(single));
+  query["startDate"] = "2015-03-06 00:00Z";
+  query["endDate"] = "2015-03-06 00:00Z";
+  Json::Value streamed = da.getData(query);
+  Json::Value parsed;
+  Json::Reader reader;
+  ASSERT_TRUE(reader.parse(single, parsed));
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  ASSERT_TRUE(da.putData(parsed));
+  EXPECT_EQ(da.getData(query), streamed);
+}
+
+// A payload that fails part way through adds no points
+TEST_F(DatabaseAccessTest, PutMalformedJsonData) {
+  ASSERT_TRUE(da.init(database_path,data_schema_json_, true));
+  std::string payload = "{\"startDate\": \"2015-03-03 00:00Z\", \"endDate\": \"2015-03-03 23:59Z\", \"points\": [";
+  for(int i = 0; i < 1440; ++i){
+    payload += (i > 0 ? ", " : "") + std::string("{\"date\": \"") +
+               intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60) + "\", \"steps\": 1}";
+  }
+  EXPECT_FALSE(da.putJsonData(payload));
+  EXPECT_FALSE(da.putJsonData(payload + "]"));
+  EXPECT_FALSE(da.putJsonData(payload + ", {\"date\": \"2015-03-04 00:00Z\", \"steps\": 1x}]}"));
+  EXPECT_FALSE(da.putJsonData("{\"startDate\": \"2015-03-03 00:00Z\", \"points\": []}"));
+  EXPECT_FALSE(da.putJsonData("[]"));
+  EXPECT_TRUE(da.putJsonData("{\"startDate\": \"\", \"endDate\": \"\", \"points\": []}"));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-04 00:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  EXPECT_EQ(0, result.size());
+
+  EXPECT_TRUE(da.putJsonData(payload + "]}"));
+  ASSERT_TRUE(da.getData(query, result));
+  EXPECT_EQ(1440, result.size());
+}
+
+
+// Columns are bound from the arrays into the INTEGER date key table too
+TEST_F(DatabaseAccessTest, PutJsonDataBatch) {
+  Json::Value schema = data_schema_json_;
+  schema["partition_span"] = "MONTH";
+  ASSERT_TRUE(da.init(database_path, schema, true));
+
+  // The second payload creates the April partition before failing, so it is rolled back
+  std::vector<std::string> payloads;
+  payloads.push_back("{\"startDate\": \"\", \"endDate\": \"\", \"points\": [{\"date\": \"2015-03-03 00:00Z\", \"steps\": 1}]}");
+  payloads.push_back("{\"startDate\": \"\", \"endDate\": \"\", \"points\": [{\"date\": \"2015-04-03 00:00Z\", \"steps\": 2}, {\"steps\": 1x}]}");
+  payloads.push_back("{\"startDate\": \"\", \"endDate\": \"\", \"points\": [{\"date\": \"2015-03-03 00:01Z\", \"steps\": 3}]}");
+  EXPECT_EQ(2, da.putJsonData(payloads));
+  EXPECT_EQ(0, da.putJsonData(std::vector<std::string>()));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-01 00:00Z";
+  query["endDate"] = "2015-04-30 00:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(2, result.size());
+  EXPECT_EQ(3, result.column(result.columnIndex("steps")).values[1]);
+
+  payloads.erase(payloads.begin(), payloads.begin() + 2);
+  payloads.push_back("{\"startDate\": \"\", \"endDate\": \"\", \"points\": [{\"date\": \"2015-04-03 00:00Z\", \"steps\": 4}]}");
+  EXPECT_EQ(2, da.putJsonData(payloads));
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(3, result.size());
+  EXPECT_EQ(4, result.column(result.columnIndex("steps")).values[2]);
+}
+
+TEST_F(DatabaseAccessTest, PutColumnsIntegerDateKey) {
+  Json::Value schema = data_schema_json_;
+  schema["date_key_storage"] = "INTEGER";
+  ASSERT_TRUE(da.init(database_path, schema, true));
+
+  std::vector<int64_t> times;
+  std::vector<double> gsr;
+  for(int i = 0; i < 1000; ++i){
+    times.push_back(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    gsr.push_back(0.001 * i);
+  }
+  times[500] = -1;
+  intel::poc::ColumnBatch::Column column = {"gsr", intel::poc::ColumnBatch::Type::DOUBLE, &gsr[0], NULL};
+  intel::poc::ColumnBatch batch = {&times[0], times.size(), &column, 1};
+  ASSERT_TRUE(da.putColumns(batch));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-04 00:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(999, result.size());
+  EXPECT_EQ(times[999], result.times()[998]);
+  EXPECT_DOUBLE_EQ(0.999, result.column(result.columnIndex("gsr")).values[998]);
+}
+
+
+// Points are kept in one table per month, and old months are dropped whole
+TEST_F(DatabaseAccessTest, InitPartitioned) {
+  Json::Value schema = data_schema_json_;
+  schema["partition_span"] = "MONTH";
+  ASSERT_TRUE(da.init(database_path, schema, true));
+
+  Json::Value data;
+  data["startDate"] = "2015-01-31 00:00Z";
+  data["endDate"] = "2015-03-02 00:00Z";
+  data["points"] = Json::Value(Json::arrayValue);
+  int64_t start = intel::poc::TimeString::toEpochSeconds("2015-01-31 00:00Z");
+  for(int i = 0; i < 31 * 24; ++i){
+    Json::Value point;
+    point["date"] = intel::poc::TimeString::fromEpochSeconds(start + i * 3600);
+    point["steps"] = i;
+    data["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(data));
+  EXPECT_TRUE(da.init(database_path, schema, false));
+  EXPECT_FALSE(da.init(database_path, data_schema_json_, false));
+  schema["partition_span"] = 86400;
+  EXPECT_FALSE(da.init(database_path, schema, false));
+  schema["partition_span"] = "MONTH";
+  ASSERT_TRUE(da.init(database_path, schema, false));
+
+  Json::Value query;
+  query["startDate"] = "2015-01-31 12:00Z";
+  query["endDate"] = "2015-03-01 11:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(29 * 24, result.size());
+  for(size_t i = 1; i < result.size(); ++i){
+    ASSERT_EQ(result.times()[i - 1] + 3600, result.times()[i]);
+  }
+  EXPECT_EQ(12, result.column(result.columnIndex("steps")).values[0]);
+
+  query["numOfPoints"] = 29;
+  ASSERT_TRUE(da.getAggregatedData(query, result));
+  ASSERT_EQ(29, result.size());
+  EXPECT_EQ(23, result.column(result.columnIndex("steps")).values[0]);
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-02-01 11:00Z"), result.times()[0]);
+
+  // Only February is queried
+  query["startDate"] = "2015-02-10 00:00Z";
+  query["endDate"] = "2015-02-10 23:59Z";
+  Json::Value day = da.getData(query);
+  EXPECT_EQ(24, day["points"].size());
+  query["startDate"] = "2014-01-01 00:00Z";
+  query["endDate"] = "2014-12-31 23:59Z";
+  EXPECT_EQ(0, da.getData(query)["points"].size());
+
+  ASSERT_TRUE(da.removeData("2015-02-15 00:00Z"));
+  EXPECT_FALSE(da.removeData("someday"));
+  query["startDate"] = "2015-01-01 00:00Z";
+  query["endDate"] = "2015-03-31 23:59Z";
+  query["numOfPoints"] = 0;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ((14 + 2) * 24, result.size());
+  EXPECT_EQ("2015-02-15 00:00Z", intel::poc::TimeString::fromEpochSeconds(result.times()[0]));
+
+  // January can be added again
+  data["points"].resize(1);
+  ASSERT_TRUE(da.putData(data));
+  ASSERT_TRUE(da.getData(query, result));
+  EXPECT_EQ((14 + 2) * 24 + 1, result.size());
+}
+
+// Fixed spans of an INTEGER date key, through every insert path
+TEST_F(DatabaseAccessTest, InitPartitionedSpan) {
+  Json::Value schema = data_schema_json_;
+  schema["partition_span"] = 6 * 3600;
+  schema["date_key_storage"] = "INTEGER";
+  ASSERT_TRUE(da.init(database_path, schema, true));
+
+  std::vector<int64_t> times;
+  std::vector<int64_t> steps;
+  for(int i = 0; i < 2000; ++i){
+    times.push_back(intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z") + i * 60);
+    steps.push_back(i);
+  }
+  intel::poc::ColumnBatch::Column column = {"steps", intel::poc::ColumnBatch::Type::INT64, &steps[0], NULL};
+  intel::poc::ColumnBatch batch = {&times[0], times.size(), &column, 1};
+  ASSERT_TRUE(da.putColumns(batch));
+  ASSERT_TRUE(da.putJsonData("{\"startDate\": \"\", \"endDate\": \"\", \"points\": ["
+                             "{\"date\": \"2015-03-05 00:00Z\", \"steps\": 1}, {\"date\": \"2015-03-04 23:59Z\", \"steps\": 2}]}"));
+
+  Json::Value query;
+  query["startDate"] = "2015-03-03 00:00Z";
+  query["endDate"] = "2015-03-05 00:00Z";
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(2002, result.size());
+  EXPECT_EQ(1999, result.column(result.columnIndex("steps")).values[1999]);
+  EXPECT_EQ(2, result.column(result.columnIndex("steps")).values[2000]);
+  EXPECT_EQ(1, result.column(result.columnIndex("steps")).values[2001]);
+
+  ASSERT_TRUE(da.removeData("2015-03-04 12:00Z"));
+  ASSERT_TRUE(da.getData(query, result));
+  EXPECT_EQ(2, result.size());
+}
+
+TEST_F(DatabaseAccessTest, InitChunked) {
+  Json::Value schema = data_schema_json_;
+  schema["chunk_points"] = 100;
+  ASSERT_TRUE(da.init(database_path, schema, true));
+  EXPECT_FALSE(da.init(database_path, data_schema_json_, false));
+  schema["partition_span"] = "MONTH";
+  EXPECT_FALSE(da.init(database_path, schema, true));
+  schema.removeMember("partition_span");
+
+  // Every seventh minute is skipped
+  int64_t start = intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z");
+  std::vector<int64_t> times;
+  std::vector<int64_t> steps;
+  std::vector<double> gsr;
+  for(int i = 0; i < 1000; ++i){
+    times.push_back(start + (i + i / 7) * 60);
+    steps.push_back(i);
+    gsr.push_back(0.25 * (i % 13) - 1.1);
+  }
+  intel::poc::ColumnBatch::Column columns[] = {
+    {"steps", intel::poc::ColumnBatch::Type::INT64, &steps[0], NULL},
+    {"gsr", intel::poc::ColumnBatch::Type::DOUBLE, &gsr[0], NULL}};
+  intel::poc::ColumnBatch batch = {&times[0], times.size(), columns, 2};
+  // The points of a duplicate of a sealed point are ignored, a late point is merged into its chunk
+  std::string late = "{\"startDate\": \"\", \"endDate\": \"\", \"points\": ["
+      "{\"date\": \"" + intel::poc::TimeString::fromEpochSeconds(times[10]) + "\", \"steps\": -1},"
+      "{\"date\": \"" + intel::poc::TimeString::fromEpochSeconds(start + 7 * 60) + "\", \"steps\": -2, \"gsr\": 2.5}]}";
+
+  Json::Value query;
+  query["startDate"] = intel::poc::TimeString::fromEpochSeconds(start);
+  query["endDate"] = intel::poc::TimeString::fromEpochSeconds(times.back());
+  std::vector<intel::poc::PointBatch> results;
+  for(int chunked = 1; chunked >= 0; --chunked){
+    ASSERT_TRUE(da.init(database_path, chunked ? schema : data_schema_json_, true));
+    ASSERT_TRUE(da.putColumns(batch));
+    ASSERT_TRUE(da.putJsonData(late));
+    if(chunked){
+      ASSERT_TRUE(da.init(database_path, schema, false));
+    }
+
+    intel::poc::PointBatch result;
+    ASSERT_TRUE(da.getData(query, result));
+    results.push_back(result);
+    query["numOfPoints"] = 5;
+    ASSERT_TRUE(da.getAggregatedData(query, result));
+    results.push_back(result);
+    query["numOfPoints"] = 7;
+    ASSERT_TRUE(da.getAggregatedData(query, result));
+    results.push_back(result);
+    query.removeMember("numOfPoints");
+  }
+
+  // Chunks read back, and average, like rows
+  ASSERT_EQ(1001, results[0].size());
+  EXPECT_EQ(-2, results[0].column(results[0].columnIndex("steps")).values[7]);
+  EXPECT_EQ(10, results[0].column(results[0].columnIndex("steps")).values[11]);
+  for(size_t r = 0; r < 3; ++r){
+    const intel::poc::PointBatch& chunked = results[r];
+    const intel::poc::PointBatch& rows = results[r + 3];
+    ASSERT_EQ(rows.size(), chunked.size());
+    EXPECT_EQ(rows.times(), chunked.times());
+    for(size_t c = 0; c < rows.numColumns(); ++c){
+      const intel::poc::PointBatch::Column& column = chunked.column(chunked.columnIndex(rows.column(c).name));
+      for(size_t i = 0; i < rows.size(); ++i){
+        EXPECT_NEAR(rows.column(c).values[i], column.values[i], 1e-9);
+      }
+    }
+  }
+
+  // A time frame inside the chunks
+  schema["chunk_points"] = 100;
+  ASSERT_TRUE(da.init(database_path, schema, true));
+  ASSERT_TRUE(da.putColumns(batch));
+  query["startDate"] = intel::poc::TimeString::fromEpochSeconds(times[150]);
+  query["endDate"] = intel::poc::TimeString::fromEpochSeconds(times[420]);
+  query["metrics"].append("gsr");
+  intel::poc::PointBatch result;
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(271, result.size());
+  ASSERT_EQ(1, result.numColumns());
+  EXPECT_EQ(times[150], result.times()[0]);
+  EXPECT_DOUBLE_EQ(gsr[420], result.column(0).values[270]);
+
+  ASSERT_TRUE(da.removeData(intel::poc::TimeString::fromEpochSeconds(times[250])));
+  query["startDate"] = intel::poc::TimeString::fromEpochSeconds(start);
+  query["endDate"] = intel::poc::TimeString::fromEpochSeconds(times.back());
+  ASSERT_TRUE(da.getData(query, result));
+  ASSERT_EQ(750, result.size());
+  EXPECT_EQ(times[250], result.times()[0]);
+}
+
 /********************************************************************
 * DataCache tests
 ********************************************************************/
@@ -1100,6 +2134,350 @@ TEST_F(DataCacheTest, AddDuplicateData) {
   std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
 }
 
+// Overlapping fills requested while scrolling are merged, and stale ones dropped
+TEST_F(DataCacheTest, AddDataCoalescesOverlappingFills) {
+  ASSERT_TRUE(dc.init(cache_setup_json_,data_schema_json_, true));
+  Json::Value param_json;
+  param_json["startDate"] = "2015-03-03 00:00Z";
+  param_json["endDate"] = "2015-03-03 23:59Z";
+  for(int hour = 0; hour < 24; ++hour){
+    char date[32];
+    snprintf(date, sizeof(date), "2015-03-03 %02d:00Z", hour);
+    Json::Value point;
+    point["date"] = date;
+    point["steps"] = hour;
+    param_json["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(param_json));
+
+  for(int hour = 0; hour < 22; ++hour){
+    char start_date[32];
+    char end_date[32];
+    snprintf(start_date, sizeof(start_date), "2015-03-03 %02d:00Z", hour);
+    snprintf(end_date, sizeof(end_date), "2015-03-03 %02d:00Z", hour + 2);
+    EXPECT_NO_THROW(dc.cacheData(start_date, end_date));
+  }
+
+  // Sleep for some time to give it time to async put
+  std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+
+  // Views scrolled past may have been dropped, the last one is always cached
+  std::string query = "{\"startDate\":\"2015-03-03 21:00Z\","
+    "\"endDate\":\"2015-03-03 23:00Z\","
+    "\"numOfPoints\":5000}";
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(query, query_json));
+  Json::Value result = dc.getData(query_json);
+  ASSERT_EQ(3, result["points"].size());
+  for(int hour = 0; hour < 3; ++hour){
+    EXPECT_EQ(21 + hour, result["points"][hour]["steps"].asInt());
+  }
+}
+
+// The ranges fetched ahead and behind are filled after the requested one
+TEST_F(DataCacheTest, AddDataFetchesAheadAndBehind) {
+  Json::Value cache_setup_json = cache_setup_json_;
+  cache_setup_json["fetchAhead"] = 1;
+  cache_setup_json["fetchBehind"] = 2;
+  ASSERT_TRUE(dc.init(cache_setup_json,data_schema_json_, true));
+  Json::Value param_json;
+  param_json["startDate"] = "2015-03-03 00:00Z";
+  param_json["endDate"] = "2015-03-03 23:59Z";
+  for(int hour = 0; hour < 24; ++hour){
+    char date[32];
+    snprintf(date, sizeof(date), "2015-03-03 %02d:00Z", hour);
+    Json::Value point;
+    point["date"] = date;
+    point["steps"] = hour;
+    param_json["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(param_json));
+
+  EXPECT_NO_THROW(dc.cacheData("2015-03-03 12:00Z", "2015-03-03 14:00Z"));
+
+  // Sleep for some time to give it time to async put
+  std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+
+  std::string query = "{\"startDate\":\"2015-03-03 08:00Z\","
+    "\"endDate\":\"2015-03-03 16:00Z\","
+    "\"numOfPoints\":5000}";
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(query, query_json));
+  Json::Value result = dc.getData(query_json);
+  ASSERT_EQ(9, result["points"].size());
+  EXPECT_EQ(8, result["points"][0]["steps"].asInt());
+  EXPECT_EQ(16, result["points"][8]["steps"].asInt());
+}
+
+namespace {
+
+// A SQLiteDataCache whose fills wait at a gate before each slice is inserted, so a test can
+// hold them while it queues more, and see which fill runs next
+class GatedDataCache : public intel::poc::SQLiteDataCache {
+  public:
+    GatedDataCache() : waiting_(0), permits_(0) {}
+
+    ~GatedDataCache() {
+      finish();
+    }
+
+    // Let count held or future slices be inserted
+    void release(size_t count) {
+      std::lock_guard<std::mutex> lock(gate_mutex_);
+      permits_ += count;
+      gate_changed_.notify_all();
+    }
+
+    // Wait until num_inserted slices were inserted and num_waiting fills are held
+    bool waitFor(size_t num_inserted, size_t num_waiting) {
+      std::unique_lock<std::mutex> lock(gate_mutex_);
+      return gate_changed_.wait_for(lock, std::chrono::seconds(10), [this, num_inserted, num_waiting]() {
+        return inserted_.size() == num_inserted && waiting_ == num_waiting;
+      });
+    }
+
+    // Open the gate, then cancel and wait for every fill
+    void finish() {
+      release(1000000);
+      std::unique_lock<std::mutex> fills_lock(fills_mutex_);
+      waitForFills(fills_lock);
+    }
+
+    // Start of every slice inserted into the raw table, in order
+    std::vector<int64_t> inserted() {
+      std::lock_guard<std::mutex> lock(gate_mutex_);
+      return inserted_;
+    }
+
+    // Start dates of the fills in each state
+    std::vector<std::string> pendingFills() { return starts(pending_fills_, false); }
+    std::vector<std::string> pendingPrefetches() { return starts(pending_prefetches_, false); }
+    std::vector<std::string> runningFills() { return starts(running_fills_, false); }
+    std::vector<std::string> cancelledFills() { return starts(running_fills_, true); }
+
+  protected:
+    bool putDataTable(const std::string& table_name, const intel::poc::PointBatch& points) {
+      if(table_name.size() > 4 && table_name.compare(table_name.size() - 4, 4, "_raw") == 0){
+        std::unique_lock<std::mutex> lock(gate_mutex_);
+        ++waiting_;
+        gate_changed_.notify_all();
+        gate_changed_.wait(lock, [this]() { return permits_ > 0; });
+        --permits_;
+        --waiting_;
+        inserted_.push_back(points.times().front());
+        gate_changed_.notify_all();
+      }
+      return SQLiteDataCache::putDataTable(table_name, points);
+    }
+
+  private:
+    std::vector<std::string> starts(const std::map<std::string,Fill>& fills, bool cancelled_only) {
+      std::lock_guard<std::mutex> lock(fills_mutex_);
+      std::vector<std::string> result;
+      for(std::map<std::string,Fill>::const_iterator it = fills.begin(); it != fills.end(); ++it){
+        if(!cancelled_only || it->second.cancelled){
+          result.push_back(it->first);
+        }
+      }
+      return result;
+    }
+
+    std::mutex gate_mutex_;
+    std::condition_variable gate_changed_;
+    size_t waiting_;
+    size_t permits_;
+    std::vector<int64_t> inserted_;
+};
+
+}
+
+// A newer view drops the stale pending fills, stops the running ones at their next slice,
+// and is filled before its own prefetches
+TEST_F(DataCacheTest, StaleFillsStopBetweenSlices) {
+  intel::poc::DataFilter::init("date");
+  Json::Value param_json;
+  param_json["startDate"] = "2015-03-01 00:00Z";
+  param_json["endDate"] = "2015-03-24 23:00Z";
+  for(int day = 1; day <= 24; ++day){
+    for(int hour = 0; hour < 24; ++hour){
+      char date[32];
+      snprintf(date, sizeof(date), "2015-03-%02d %02d:00Z", day, hour);
+      Json::Value point;
+      point["date"] = date;
+      point["steps"] = hour;
+      param_json["points"].append(point);
+    }
+  }
+  ASSERT_TRUE(da.putData(param_json));
+
+  Json::Value cache_setup_json = cache_setup_json_;
+  cache_setup_json["fetchAhead"] = 1;
+  cache_setup_json["fetchBehind"] = 1;
+  GatedDataCache cache;
+  ASSERT_TRUE(cache.init(cache_setup_json, data_schema_json_, true));
+
+  // Every day is a slice: both workers hold the first slice of a three day fill
+  EXPECT_NO_THROW(cache.cacheData("2015-03-05 00:00Z", "2015-03-08 00:00Z"));
+  ASSERT_TRUE(cache.waitFor(0, 2));
+  std::vector<std::string> running = cache.runningFills();
+  ASSERT_EQ(2, running.size());
+  EXPECT_EQ("2015-03-02 00:00Z", running[0]);
+  EXPECT_EQ("2015-03-05 00:00Z", running[1]);
+  EXPECT_EQ(std::vector<std::string>(1, "2015-03-08 00:00Z"), cache.pendingPrefetches());
+
+  // The view jumps ahead: the old prefetch is dropped and the old fills cancelled
+  EXPECT_NO_THROW(cache.cacheData("2015-03-20 00:00Z", "2015-03-21 00:00Z"));
+  EXPECT_EQ(std::vector<std::string>(1, "2015-03-20 00:00Z"), cache.pendingFills());
+  std::vector<std::string> prefetches = cache.pendingPrefetches();
+  ASSERT_EQ(2, prefetches.size());
+  EXPECT_EQ("2015-03-19 00:00Z", prefetches[0]);
+  EXPECT_EQ("2015-03-21 00:00Z", prefetches[1]);
+  EXPECT_EQ(running, cache.cancelledFills());
+
+  // The first worker freed starts the visible range, while the prefetches wait
+  cache.release(1);
+  ASSERT_TRUE(cache.waitFor(1, 2));
+  EXPECT_TRUE(cache.pendingFills().empty());
+  EXPECT_EQ(prefetches, cache.pendingPrefetches());
+  running = cache.runningFills();
+  EXPECT_NE(running.end(), std::find(running.begin(), running.end(), "2015-03-20 00:00Z"));
+
+  // Only the second worker freed starts a prefetch
+  cache.release(1);
+  ASSERT_TRUE(cache.waitFor(2, 2));
+  EXPECT_EQ(std::vector<std::string>(1, "2015-03-21 00:00Z"), cache.pendingPrefetches());
+
+  // The cancelled fills inserted only the slice they held
+  cache.finish();
+  std::vector<int64_t> inserted = cache.inserted();
+  std::sort(inserted.begin(), inserted.end());
+  ASSERT_LE(2, inserted.size());
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-02 00:00Z"), inserted[0]);
+  EXPECT_EQ(intel::poc::TimeString::toEpochSeconds("2015-03-05 00:00Z"), inserted[1]);
+  for(size_t i = 2; i < inserted.size(); ++i){
+    EXPECT_LE(intel::poc::TimeString::toEpochSeconds("2015-03-19 00:00Z"), inserted[i]);
+  }
+}
+
+// The native cache returns exactly what the SQLite cache does
+TEST_F(DataCacheTest, NativeCacheMatchesSQLiteCache) {
+  intel::poc::DataCache& native = intel::poc::NativeDataCache::instance();
+  ASSERT_TRUE(dc.init(cache_setup_json_,data_schema_json_, true));
+  ASSERT_TRUE(native.init(cache_setup_json_,data_schema_json_, true));
+  Json::Value param_json;
+  param_json["startDate"] = "2015-03-03 00:00Z";
+  param_json["endDate"] = "2015-03-03 23:59Z";
+  for(int minute = 0; minute < 24 * 60; minute += 7){
+    char date[32];
+    snprintf(date, sizeof(date), "2015-03-03 %02d:%02dZ", minute / 60, minute % 60);
+    Json::Value point;
+    point["date"] = date;
+    point["steps"] = minute % 13;
+    point["calories"] = 0.25 * (minute % 9);
+    if(minute % 3 != 0){
+      point["heart_rate"] = 60 + minute % 20;
+    }
+    param_json["points"].append(point);
+  }
+  ASSERT_TRUE(da.putData(param_json));
+
+  // Fill the halves separately, so chunks are merged
+  EXPECT_NO_THROW(dc.cacheData("2015-03-03 12:00Z", "2015-03-03 23:59Z"));
+  EXPECT_NO_THROW(native.cacheData("2015-03-03 12:00Z", "2015-03-03 23:59Z"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+  EXPECT_NO_THROW(dc.cacheData("2015-03-03 00:00Z", "2015-03-03 12:00Z"));
+  EXPECT_NO_THROW(native.cacheData("2015-03-03 00:00Z", "2015-03-03 12:00Z"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+
+  const char* queries[] = {
+    "{\"startDate\":\"2015-03-03 00:00Z\",\"endDate\":\"2015-03-04 00:00Z\",\"numOfPoints\":100}",
+    "{\"startDate\":\"2015-03-03 00:00Z\",\"endDate\":\"2015-03-04 00:00Z\",\"numOfPoints\":1000}",
+    "{\"startDate\":\"2015-03-03 00:00Z\",\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":5000}",
+    "{\"startDate\":\"2015-03-03 06:03Z\",\"endDate\":\"2015-03-03 17:31Z\",\"numOfPoints\":5000,"
+      "\"metrics\":[\"steps\",\"date\",\"heart_rate\",\"steps\"]}",
+    "{\"startDate\":\"2015-03-03 06:03Z\",\"endDate\":\"2015-03-03 06:04Z\",\"numOfPoints\":5000}",
+    "{\"startDate\":\"2015-03-03 00:00Z\",\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":5000,\"metrics\":[\"pulse\"]}",
+    "{\"startDate\":\"2015-03-02 00:00Z\",\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":5000}"
+  };
+  for(size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i){
+    Json::Value query_json;
+    ASSERT_TRUE(reader_.parse(queries[i], query_json));
+    intel::poc::PointBatch expected;
+    intel::poc::PointBatch actual;
+    EXPECT_EQ(dc.getData(query_json, expected), native.getData(query_json, actual)) << queries[i];
+    EXPECT_EQ(expected.toJson(), actual.toJson()) << queries[i];
+  }
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(queries[2], query_json));
+  EXPECT_EQ(206, native.getData(query_json)["points"].size());
+}
+
+// Over "maxCacheBytes", the range least recently used is evicted from every table
+TEST_F(DataCacheTest, MaxCacheBytesEvictsColdRanges) {
+  Json::Value param_json;
+  param_json["startDate"] = "2015-03-03 00:00Z";
+  param_json["endDate"] = "2015-03-05 23:59Z";
+  for(int day = 3; day <= 5; ++day){
+    for(int hour = 0; hour < 24; ++hour){
+      char date[32];
+      snprintf(date, sizeof(date), "2015-03-%02d %02d:00Z", day, hour);
+      Json::Value point;
+      point["date"] = date;
+      point["steps"] = hour;
+      point["calories"] = 0.5 * hour;
+      param_json["points"].append(point);
+    }
+  }
+  ASSERT_TRUE(da.putData(param_json));
+
+  intel::poc::DataCache* caches[] = { &dc, &intel::poc::NativeDataCache::instance() };
+  for(size_t c = 0; c < 2; ++c){
+    intel::poc::DataCache& cache = *caches[c];
+
+    // Measure one day, then allow two and a half
+    ASSERT_TRUE(cache.init(cache_setup_json_,data_schema_json_, true));
+    EXPECT_EQ(0, cache.cacheBytes());
+    EXPECT_NO_THROW(cache.cacheData("2015-03-03 00:00Z","2015-03-03 23:59Z"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+    size_t day_bytes = cache.cacheBytes();
+    ASSERT_LT(0, day_bytes);
+
+    Json::Value cache_setup_json = cache_setup_json_;
+    cache_setup_json["maxCacheBytes"] = static_cast<Json::UInt64>(day_bytes * 5 / 2);
+    ASSERT_TRUE(cache.init(cache_setup_json,data_schema_json_, true));
+    EXPECT_NO_THROW(cache.cacheData("2015-03-03 00:00Z","2015-03-03 23:59Z"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+    EXPECT_NO_THROW(cache.cacheData("2015-03-04 00:00Z","2015-03-04 23:59Z"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+    EXPECT_EQ(2 * day_bytes, cache.cacheBytes());
+
+    // Reading the first day makes the second the coldest
+    Json::Value query_json;
+    ASSERT_TRUE(reader_.parse("{\"startDate\":\"2015-03-03 00:00Z\",\"endDate\":\"2015-03-03 23:59Z\",\"numOfPoints\":5000}", query_json));
+    intel::poc::PointBatch data;
+    EXPECT_TRUE(cache.getData(query_json, data));
+    EXPECT_EQ(24, data.size());
+
+    EXPECT_NO_THROW(cache.cacheData("2015-03-05 00:00Z","2015-03-05 23:59Z"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+    EXPECT_EQ(2 * day_bytes, cache.cacheBytes());
+
+    EXPECT_TRUE(cache.getData(query_json, data));
+    EXPECT_EQ(24, data.size());
+    ASSERT_TRUE(reader_.parse("{\"startDate\":\"2015-03-05 00:00Z\",\"endDate\":\"2015-03-05 23:59Z\",\"numOfPoints\":100}", query_json));
+    EXPECT_TRUE(cache.getData(query_json, data));
+    ASSERT_TRUE(reader_.parse("{\"startDate\":\"2015-03-04 00:00Z\",\"endDate\":\"2015-03-04 23:59Z\",\"numOfPoints\":5000}", query_json));
+    EXPECT_FALSE(cache.getData(query_json, data));
+
+    // The evicted day is filled again
+    EXPECT_NO_THROW(cache.cacheData("2015-03-04 00:00Z","2015-03-04 23:59Z"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+    EXPECT_TRUE(cache.getData(query_json, data));
+    EXPECT_EQ(24, data.size());
+    EXPECT_EQ(2 * day_bytes, cache.cacheBytes());
+  }
+}
+
 /*
 * Get Tests
 */
@@ -1180,6 +2558,45 @@ TEST_F(DataCacheTest, InitDatabasePutAndGetData) {
 }
 
 
+// Dates up to and before the epoch are valid, and are cached like any other
+TEST_F(DataCacheTest, InitDatabasePutAndGetPre1970Data) {
+  ASSERT_TRUE(dc.init(cache_setup_json_,data_schema_json_, true));
+  std::string param = "{\"startDate\":\"1969-12-31 23:00Z\","
+     "\"endDate\":\"1970-01-01 00:00Z\","
+     "\"points\" : [{\"date\":\"1969-12-31 23:00Z\","
+     "\"calories\":1.4,"
+     "\"gsr\":5.12886e-05,"
+     "\"heart_rate\":61,"
+     "\"body_temp\":88.7,"
+     "\"steps\":0},"
+    "{\"date\":\"1970-01-01 00:00Z\","
+     "\"calories\":1.5,"
+     "\"gsr\":5.12886e-05,"
+     "\"heart_rate\":62,"
+     "\"body_temp\":88.8,"
+     "\"steps\":10}]}";
+
+  Json::Value json_root_param;
+  ASSERT_TRUE(reader_.parse(param, json_root_param));
+  ASSERT_TRUE(da.putData(json_root_param)) << " input param: " << param;
+
+  EXPECT_NO_THROW(dc.cacheData("1969-12-31 23:00Z","1970-01-01 00:00Z"));
+
+  // Sleep for some time to give it time to async put
+  std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
+
+  std::string query = "{\"startDate\":\"1969-12-31 23:00Z\","
+                       "\"endDate\":\"1970-01-01 00:00Z\","
+                       "\"numOfPoints\":1000}";
+  Json::Value query_json;
+  ASSERT_TRUE(reader_.parse(query, query_json));
+  Json::Value result = dc.getData(query_json);
+  ASSERT_TRUE(result.isMember("points"));
+  ASSERT_EQ(2, result["points"].size()) << " result size: " << result["points"].size();
+  ASSERT_EQ(0,json_root_param.compare(result));
+}
+
+
 // Init the cache, put data in, request only one metric, and check results are valid
 TEST_F(DataCacheTest, InitDatabasePutAndGetOnlyGSRtData) {
   ASSERT_TRUE(dc.init(cache_setup_json_,data_schema_json_, true));
@@ -1289,6 +2706,658 @@ TEST_F(DataCacheTest, InitDatabasePutPrefetchAndGetBeforeAfter) {
   //printf("json_root_param:\n%s\nresult:\n%s\n",json_root_param.toStyledString().c_str(),result.toStyledString().c_str());
 }
 
+/********************************************************************
+* DataFilter tests
+********************************************************************/
+
+TEST_F(DataFilterTest, TimeStringRoundTrip) {
+  EXPECT_EQ(0, intel::poc::TimeString::toEpochSeconds("1970-01-01 00:00Z"));
+  EXPECT_EQ(1425340800, intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z"));
+  EXPECT_EQ(1456790340, intel::poc::TimeString::toEpochSeconds("2016-02-29 23:59Z"));
+  EXPECT_EQ("2015-03-03 23:59Z", intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-03-03 23:59Z")));
+  EXPECT_EQ("2016-02-29 23:59Z", intel::poc::TimeString::fromEpochSeconds(1456790340));
+  EXPECT_EQ("1969-12-31 23:59Z", intel::poc::TimeString::fromEpochSeconds(-60));
+  EXPECT_EQ("2015-03-01 00:00Z", intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::toEpochSeconds("2015-02-28 23:59Z") + 60));
+}
+
+TEST_F(DataFilterTest, TimeStringMonths) {
+  EXPECT_EQ(0, intel::poc::TimeString::monthIndex(0));
+  EXPECT_EQ(-1, intel::poc::TimeString::monthIndex(-60));
+  EXPECT_EQ(542, intel::poc::TimeString::monthIndex(intel::poc::TimeString::toEpochSeconds("2015-04-01 00:00Z") - 60));
+  EXPECT_EQ(544, intel::poc::TimeString::monthIndex(intel::poc::TimeString::toEpochSeconds("2015-05-31 23:59Z")));
+  EXPECT_EQ("2015-04-01 00:00Z", intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::monthStart(543)));
+  EXPECT_EQ("2016-02-01 00:00Z", intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::monthStart(553)));
+  EXPECT_EQ("1969-12-01 00:00Z", intel::poc::TimeString::fromEpochSeconds(intel::poc::TimeString::monthStart(-1)));
+}
+
+TEST_F(DataFilterTest, TimeStringInvalid) {
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("not a date"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds(""));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-02-29 00:00Z"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-13-01 00:00Z"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-03-03 24:00Z"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-03-03 00:60Z"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00"));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-03-03 00:00Z "));
+  EXPECT_EQ(-1, intel::poc::TimeString::toEpochSeconds("2015-03-0a 00:00Z"));
+}
+
+TEST_F(DataFilterTest, PointBatchToJson) {
+  ASSERT_LT(0, data_batch_.size());
+  EXPECT_EQ(0, data_json_.compare(data_batch_.toJson()));
+}
+
+// The columnar filters must produce exactly the points of the Json::Value filters
+TEST_F(DataFilterTest, BatchMatchesJsonPoints) {
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data_json_, data_schema_map_, 100, intel::poc::DataFilter::FilterType::POINTS);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 100, intel::poc::DataFilter::FilterType::POINTS);
+  EXPECT_GE(100, result.size());
+  expectSamePoints(expected, result.toJson());
+}
+
+TEST_F(DataFilterTest, BatchMatchesJsonTimeWeightedPoints) {
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data_json_, data_schema_map_, 100, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_POINTS);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 100, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_POINTS);
+  EXPECT_GE(100, result.size());
+  expectSamePoints(expected, result.toJson());
+}
+
+TEST_F(DataFilterTest, BatchMatchesJsonTimeWeightedTime) {
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data_json_, data_schema_map_, 500, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_TIME);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 500, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_TIME);
+  EXPECT_GE(500, result.size());
+  expectSamePoints(expected, result.toJson());
+}
+
+// LTTB keeps real points, including the first and last, in time order
+TEST_F(DataFilterTest, LTTBKeepsRealPoints) {
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 100, intel::poc::DataFilter::FilterType::LTTB);
+  ASSERT_EQ(100, result.size());
+  EXPECT_EQ(data_batch_.times().front(), result.times().front());
+  EXPECT_EQ(data_batch_.times().back(), result.times().back());
+
+  size_t data_i = 0;
+  for (size_t i = 0; i < result.size(); ++i) {
+    while (data_i < data_batch_.size() && data_batch_.times()[data_i] < result.times()[i])
+      ++data_i;
+    ASSERT_LT(data_i, data_batch_.size());
+    ASSERT_EQ(data_batch_.times()[data_i], result.times()[i]);
+    for (size_t c = 0; c < result.numColumns(); ++c) {
+      EXPECT_EQ(data_batch_.column(c).values[data_i], result.column(c).values[i]);
+    }
+    ++data_i;
+  }
+}
+
+TEST_F(DataFilterTest, LTTBKeepsSpike) {
+  intel::poc::PointBatch data;
+  data.reset("date");
+  data.addColumn("heart_rate", intel::poc::PointBatch::ColumnType::INT);
+  for (int i = 0; i < 1000; ++i) {
+    data.times().push_back(1425340800 + i * 60);
+    data.column(0).values.push_back(i == 567 ? 180 : 60);
+  }
+
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data, result, 20, intel::poc::DataFilter::FilterType::LTTB);
+  ASSERT_EQ(20, result.size());
+  EXPECT_NE(result.times().end(), std::find(result.times().begin(), result.times().end(), 1425340800 + 567 * 60));
+  EXPECT_EQ(180, *std::max_element(result.column(0).values.begin(), result.column(0).values.end()));
+
+  intel::poc::DataFilter::applyFilter(data, result, 20, intel::poc::DataFilter::FilterType::POINTS);
+  EXPECT_GT(180, *std::max_element(result.column(0).values.begin(), result.column(0).values.end()));
+}
+
+TEST_F(DataFilterTest, BatchMatchesJsonLTTB) {
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data_json_, data_schema_map_, 100, intel::poc::DataFilter::FilterType::LTTB);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 100, intel::poc::DataFilter::FilterType::LTTB);
+  EXPECT_EQ(0, expected.compare(result.toJson()));
+  EXPECT_EQ(intel::poc::DataFilter::FilterType::LTTB, intel::poc::DataFilter::getType("LTTB"));
+}
+
+// M4 keeps the first, last, minimum and maximum point of every pixel column
+TEST_F(DataFilterTest, M4KeepsBucketExtremes) {
+  intel::poc::PointBatch data;
+  data.reset("date");
+  data.addColumn("heart_rate", intel::poc::PointBatch::ColumnType::INT);
+  data.times() = data_batch_.times();
+  data.column(0).values = data_batch_.column(3).values;
+
+  const int width = 50;
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data, result, width, intel::poc::DataFilter::FilterType::M4);
+  ASSERT_LT(0, result.size());
+  EXPECT_GE(4 * width, result.size());
+
+  int64_t start_time = data.times().front();
+  int64_t span = data.times().back() - start_time + 1;
+  std::vector<double> min(width, 1e9), max(width, -1e9), result_min(width, 1e9), result_max(width, -1e9);
+  std::vector<int64_t> first(width, -1), result_first(width, -1), last(width, -1), result_last(width, -1);
+  for (size_t i = 0; i < data.size(); ++i) {
+    int b = static_cast<int>((data.times()[i] - start_time) * width / span);
+    min[b] = std::min(min[b], data.column(0).values[i]);
+    max[b] = std::max(max[b], data.column(0).values[i]);
+    first[b] = first[b] < 0 ? data.times()[i] : first[b];
+    last[b] = data.times()[i];
+  }
+  for (size_t i = 0; i < result.size(); ++i) {
+    int b = static_cast<int>((result.times()[i] - start_time) * width / span);
+    result_min[b] = std::min(result_min[b], result.column(0).values[i]);
+    result_max[b] = std::max(result_max[b], result.column(0).values[i]);
+    result_first[b] = result_first[b] < 0 ? result.times()[i] : result_first[b];
+    result_last[b] = result.times()[i];
+  }
+  EXPECT_EQ(min, result_min);
+  EXPECT_EQ(max, result_max);
+  EXPECT_EQ(first, result_first);
+  EXPECT_EQ(last, result_last);
+}
+
+TEST_F(DataFilterTest, BatchMatchesJsonM4) {
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data_json_, data_schema_map_, 100, intel::poc::DataFilter::FilterType::M4);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data_batch_, result, 100, intel::poc::DataFilter::FilterType::M4);
+  EXPECT_GE(12 * 100, result.size());
+  EXPECT_GT(data_batch_.size(), result.size());
+  EXPECT_EQ(0, expected.compare(result.toJson()));
+}
+
+// Large inputs take the parallel path, which must still match the serial Json::Value filter
+TEST_F(DataFilterTest, BatchMatchesJsonTimeWeightedTimeParallel) {
+  intel::poc::PointBatch data;
+  data.reset("date");
+  data.addColumn("body_temp", intel::poc::PointBatch::ColumnType::REAL);
+  data.addColumn("heart_rate", intel::poc::PointBatch::ColumnType::INT);
+  data.setDates("2015-03-01 00:00Z", "2015-04-01 00:00Z");
+  int64_t time = intel::poc::TimeString::toEpochSeconds("2015-03-01 00:00Z");
+  for (int i = 0; i < 40000; ++i) {
+    // Irregular sampling with a few long gaps
+    time += (i % 1000 == 999) ? 3600 * 5 : 60 * (1 + i % 3);
+    data.times().push_back(time);
+    data.column(0).values.push_back(85.0 + sin(i / 100.0));
+    data.column(1).values.push_back(60 + (i * 7) % 40);
+  }
+  std::map<std::string, std::string> schema;
+  schema["date"] = "TEXT";
+  schema["body_temp"] = "REAL";
+  schema["heart_rate"] = "INT";
+
+  Json::Value expected = intel::poc::DataFilter::applyFilter(data.toJson(), schema, 1000, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_TIME);
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data, result, 1000, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_TIME);
+  EXPECT_LT(0, result.size());
+  expectSamePoints(expected, result.toJson());
+}
+
+// Points sharing one timestamp used to recurse forever
+TEST_F(DataFilterTest, TimeWeightedTimeIdenticalTimestamps) {
+  intel::poc::PointBatch data;
+  data.reset("date");
+  data.addColumn("steps", intel::poc::PointBatch::ColumnType::INT);
+  for (int i = 0; i < 1000; ++i) {
+    data.times().push_back(1425340800);
+    data.column(0).values.push_back(i);
+  }
+  intel::poc::PointBatch result;
+  intel::poc::DataFilter::applyFilter(data, result, 100, intel::poc::DataFilter::FilterType::TIME_WEIGHTED_TIME);
+  EXPECT_EQ(100, result.size());
+  EXPECT_EQ(4, result.column(0).values[0]);
+}
+
+namespace {
+
+// Push a batch through a StreamingDownsampler in fixed-size chunks
+void streamBatch(const intel::poc::PointBatch& data, intel::poc::StreamingDownsampler::Mode mode,
+                 int num_of_points, size_t chunk_size, intel::poc::PointBatch& result, int& sink_calls) {
+  result.copyLayout(data);
+  sink_calls = 0;
+  intel::poc::StreamingDownsampler downsampler(mode, num_of_points,
+    [&result, &sink_calls](const intel::poc::PointBatch& points) {
+      result.append(points);
+      ++sink_calls;
+    });
+  ASSERT_TRUE(downsampler.begin(data, data.times().front(), data.times().back()));
+  intel::poc::PointBatch chunk;
+  chunk.copyLayout(data);
+  for (size_t i = 0; i < data.size(); ++i) {
+    chunk.appendPoint(data, i);
+    if (chunk.size() == chunk_size) {
+      downsampler.push(chunk);
+      chunk.clearPoints();
+    }
+  }
+  downsampler.push(chunk);
+  downsampler.finish();
+}
+
+}
+
+// Streaming M4 keeps exactly the points of DataFilter's M4, however the input is chunked
+TEST_F(DataFilterTest, StreamingM4MatchesFilter) {
+  intel::poc::PointBatch expected;
+  intel::poc::DataFilter::applyFilter(data_batch_, expected, 100, intel::poc::DataFilter::FilterType::M4);
+
+  size_t chunk_sizes[] = { 1, 7, 100, 5000 };
+  for (size_t n = 0; n < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++n) {
+    intel::poc::PointBatch result;
+    int sink_calls = 0;
+    streamBatch(data_batch_, intel::poc::StreamingDownsampler::Mode::M4, 100, chunk_sizes[n], result, sink_calls);
+    EXPECT_LT(1, sink_calls);
+    EXPECT_EQ(0, expected.toJson().compare(result.toJson())) << "chunk size " << chunk_sizes[n];
+  }
+}
+
+TEST_F(DataFilterTest, StreamingAverage) {
+  const int num_of_points = 24;
+  intel::poc::PointBatch result;
+  int sink_calls = 0;
+  streamBatch(data_batch_, intel::poc::StreamingDownsampler::Mode::AVERAGE, num_of_points, 100, result, sink_calls);
+  EXPECT_EQ(1, sink_calls);
+  ASSERT_EQ(num_of_points, result.size());
+
+  // One point per hour of the day: the average heart rate, at the time of the last point
+  int64_t start_time = data_batch_.times().front();
+  int64_t span = data_batch_.times().back() - start_time + 1;
+  for (int b = 0; b < num_of_points; ++b) {
+    double sum = 0;
+    int count = 0;
+    int64_t last_time = 0;
+    for (size_t i = 0; i < data_batch_.size(); ++i) {
+      if ((data_batch_.times()[i] - start_time) * num_of_points / span == b) {
+        sum += data_batch_.column(3).values[i];
+        ++count;
+        last_time = data_batch_.times()[i];
+      }
+    }
+    ASSERT_LT(0, count);
+    EXPECT_EQ(last_time, result.times()[b]);
+    EXPECT_EQ(static_cast<int>(sum / count), result.column(3).values[b]);
+  }
+
+  intel::poc::StreamingDownsampler invalid(intel::poc::StreamingDownsampler::Mode::AVERAGE, 0,
+    [](const intel::poc::PointBatch&) {});
+  EXPECT_FALSE(invalid.begin(data_batch_, 0, 100));
+  EXPECT_THROW(intel::poc::StreamingDownsampler::getMode("MEDIAN"), std::runtime_error);
+}
+
+// Streaming TIME_WEIGHTED weights each value by the time until the next point of its
+// bucket, however the input is chunked
+TEST_F(DataFilterTest, StreamingTimeWeighted) {
+  const int num_of_points = 24;
+  int64_t start_time = data_batch_.times().front();
+  int64_t span = data_batch_.times().back() - start_time + 1;
+  std::vector<double> expected(num_of_points, 0);
+  for (int b = 0; b < num_of_points; ++b) {
+    double weighted = 0;
+    int64_t first_time = -1;
+    int64_t last_time = -1;
+    for (size_t i = 0; i < data_batch_.size(); ++i) {
+      if ((data_batch_.times()[i] - start_time) * num_of_points / span == b) {
+        if (last_time != -1) {
+          weighted += data_batch_.column(2).values[i - 1] * (data_batch_.times()[i] - last_time);
+        } else {
+          first_time = data_batch_.times()[i];
+        }
+        last_time = data_batch_.times()[i];
+      }
+    }
+    ASSERT_LT(first_time, last_time);
+    expected[b] = weighted / (last_time - first_time);
+  }
+
+  size_t chunk_sizes[] = { 1, 7, 5000 };
+  for (size_t n = 0; n < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++n) {
+    intel::poc::PointBatch result;
+    int sink_calls = 0;
+    streamBatch(data_batch_, intel::poc::StreamingDownsampler::Mode::TIME_WEIGHTED, num_of_points, chunk_sizes[n], result, sink_calls);
+    ASSERT_EQ(num_of_points, result.size());
+    for (int b = 0; b < num_of_points; ++b) {
+      EXPECT_NEAR(expected[b], result.column(2).values[b], 1e-9) << "chunk size " << chunk_sizes[n];
+    }
+  }
+  EXPECT_EQ(intel::poc::StreamingDownsampler::Mode::TIME_WEIGHTED, intel::poc::StreamingDownsampler::getMode("TIME_WEIGHTED"));
+}
+
+// Every kernel implementation must give bit-identical results
+TEST_F(DataFilterTest, AggregationKernelsMatchScalar) {
+  std::vector<double> values(1000);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = (i % 13 == 5) ? NAN : sin(static_cast<double>(i)) * 1000.0 + 1e6 / (i + 1);
+  }
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i < values.size(); i += 1 + i % 29) {
+    bounds.push_back(i);
+  }
+  bounds.push_back(values.size());
+
+  intel::poc::AggregationKernels::Isa detected = intel::poc::AggregationKernels::isa();
+  intel::poc::AggregationKernels::Isa isas[] = { intel::poc::AggregationKernels::Isa::SCALAR,
+                                                 intel::poc::AggregationKernels::Isa::SSE42,
+                                                 intel::poc::AggregationKernels::Isa::AVX2 };
+  std::vector<double> expected;
+  for (size_t n = 0; n < sizeof(isas) / sizeof(isas[0]); ++n) {
+    if (!intel::poc::AggregationKernels::setIsa(isas[n]))
+      continue;
+    std::vector<double> results;
+    for (size_t count = 0; count <= 37; ++count) {
+      results.push_back(intel::poc::AggregationKernels::sum(&values[3], count));
+      results.push_back(intel::poc::AggregationKernels::count(&values[3], count));
+      results.push_back(intel::poc::AggregationKernels::min(&values[3], count));
+      results.push_back(intel::poc::AggregationKernels::max(&values[3], count));
+      results.push_back(intel::poc::AggregationKernels::argMin(&values[3], count));
+      results.push_back(intel::poc::AggregationKernels::argMax(&values[3], count));
+    }
+    std::vector<double> reduced(bounds.size() - 1);
+    std::vector<size_t> counts(reduced.size());
+    intel::poc::AggregationKernels::sumBuckets(&values[0], &bounds[0], reduced.size(), &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::minBuckets(&values[0], &bounds[0], reduced.size(), &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::maxBuckets(&values[0], &bounds[0], reduced.size(), &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::countBuckets(&values[0], &bounds[0], counts.size(), &counts[0]);
+    results.insert(results.end(), counts.begin(), counts.end());
+    reduced.resize((values.size() + 15) / 16);
+    counts.resize(reduced.size());
+    intel::poc::AggregationKernels::sumBuckets(&values[0], values.size(), 16, &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::minBuckets(&values[0], values.size(), 16, &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::maxBuckets(&values[0], values.size(), 16, &reduced[0]);
+    results.insert(results.end(), reduced.begin(), reduced.end());
+    intel::poc::AggregationKernels::countBuckets(&values[0], values.size(), 16, &counts[0]);
+    results.insert(results.end(), counts.begin(), counts.end());
+
+    if (expected.empty()) {
+      expected = results;
+    } else {
+      ASSERT_EQ(expected.size(), results.size());
+      EXPECT_EQ(0, memcmp(&expected[0], &results[0], expected.size() * sizeof(double))) << "Isa " << static_cast<int>(isas[n]);
+    }
+  }
+  EXPECT_TRUE(intel::poc::AggregationKernels::setIsa(detected));
+
+  // NaN values are skipped
+  EXPECT_EQ(14, intel::poc::AggregationKernels::count(&values[0], 15));
+  double with_nan[] = { NAN, 2.0, -1.0, NAN, 4.0 };
+  EXPECT_EQ(5.0, intel::poc::AggregationKernels::sum(with_nan, 5));
+  EXPECT_EQ(-1.0, intel::poc::AggregationKernels::min(with_nan, 5));
+  EXPECT_EQ(4.0, intel::poc::AggregationKernels::max(with_nan, 5));
+  EXPECT_EQ(2, intel::poc::AggregationKernels::argMin(with_nan, 5));
+  EXPECT_EQ(4, intel::poc::AggregationKernels::argMax(with_nan, 5));
+
+  // Buckets reduce like the whole-range kernels
+  size_t with_nan_bounds[] = { 0, 2, 5 };
+  double bucket_mins[2];
+  double bucket_maxs[2];
+  size_t bucket_counts[2];
+  intel::poc::AggregationKernels::minBuckets(with_nan, with_nan_bounds, 2, bucket_mins);
+  intel::poc::AggregationKernels::maxBuckets(with_nan, with_nan_bounds, 2, bucket_maxs);
+  intel::poc::AggregationKernels::countBuckets(with_nan, with_nan_bounds, 2, bucket_counts);
+  EXPECT_EQ(2.0, bucket_mins[0]);
+  EXPECT_EQ(-1.0, bucket_mins[1]);
+  EXPECT_EQ(2.0, bucket_maxs[0]);
+  EXPECT_EQ(4.0, bucket_maxs[1]);
+  EXPECT_EQ(1, bucket_counts[0]);
+  EXPECT_EQ(2, bucket_counts[1]);
+  intel::poc::AggregationKernels::countBuckets(with_nan, 5, 3, bucket_counts);
+  EXPECT_EQ(2, bucket_counts[0]);
+  EXPECT_EQ(1, bucket_counts[1]);
+}
+
+TEST_F(ChunkCodecTest, RoundTrip) {
+  intel::poc::PointBatch points;
+  points.reset("date");
+  points.addColumn("steps", intel::poc::PointBatch::ColumnType::INT);
+  points.addColumn("gsr", intel::poc::PointBatch::ColumnType::REAL);
+  points.addColumn("note", intel::poc::PointBatch::ColumnType::TEXT);
+  int64_t times[] = {1425340800, 1425340860, 1425340920, 1425340980, 1425344580, 1425344640, 0, 4102444800LL, 4102444800LL};
+  double steps[] = {0, 12, -7, 2147483647, -2147483647, 5, 5, 0, 1};
+  double gsr[] = {4.27263e-05, 4.27263e-05, 0.5, -0.5, 1e300, 0, 3.14159, 3.14159, -0.0};
+  for(size_t i = 0; i < sizeof(times) / sizeof(times[0]); ++i){
+    points.times().push_back(times[i]);
+    points.column(0).values.push_back(steps[i]);
+    points.column(1).values.push_back(gsr[i]);
+    points.column(2).text.push_back(i % 2 ? "" : std::string(i * 40, 'x'));
+  }
+
+  std::string blob;
+  intel::poc::ChunkCodec::encode(points, blob);
+  intel::poc::PointBatch decoded;
+  decoded.copyLayout(points);
+  ASSERT_TRUE(intel::poc::ChunkCodec::decode(blob.data(), blob.size(), decoded));
+  EXPECT_EQ(points.times(), decoded.times());
+  EXPECT_EQ(points.column(0).values, decoded.column(0).values);
+  EXPECT_EQ(points.column(2).text, decoded.column(2).text);
+  for(size_t i = 0; i < points.size(); ++i){
+    EXPECT_EQ(0, memcmp(&points.column(1).values[i], &decoded.column(1).values[i], sizeof(double)));
+  }
+
+  // Regularly sampled points take a bit per time and per repeated value
+  intel::poc::PointBatch regular;
+  regular.reset("date");
+  regular.addColumn("gsr", intel::poc::PointBatch::ColumnType::REAL);
+  for(int i = 0; i < 1024; ++i){
+    regular.times().push_back(times[0] + i * 60);
+    regular.column(0).values.push_back(gsr[0]);
+  }
+  intel::poc::ChunkCodec::encode(regular, blob);
+  EXPECT_GT(300u, blob.size());
+
+  intel::poc::ChunkCodec::encode(points, blob);
+  decoded.clearPoints();
+  EXPECT_FALSE(intel::poc::ChunkCodec::decode(blob.data(), blob.size() / 2, decoded));
+  intel::poc::PointBatch other;
+  other.reset("date");
+  other.addColumn("steps", intel::poc::PointBatch::ColumnType::REAL);
+  other.addColumn("gsr", intel::poc::PointBatch::ColumnType::REAL);
+  other.addColumn("note", intel::poc::PointBatch::ColumnType::TEXT);
+  EXPECT_FALSE(intel::poc::ChunkCodec::decode(blob.data(), blob.size(), other));
+
+  intel::poc::ChunkCodec::Summary summary;
+  intel::poc::ChunkCodec::summarize(points, blob);
+  ASSERT_TRUE(intel::poc::ChunkCodec::decodeSummary(blob.data(), blob.size(), 3, summary));
+  EXPECT_FALSE(intel::poc::ChunkCodec::decodeSummary(blob.data(), blob.size(), 2, summary));
+  ASSERT_TRUE(intel::poc::ChunkCodec::decodeSummary(blob.data(), blob.size(), 3, summary));
+  EXPECT_EQ(-2147483647, summary.min[0]);
+  EXPECT_EQ(2147483647, summary.max[0]);
+  EXPECT_EQ(16, summary.sum[0]);
+  EXPECT_EQ(1e300, summary.max[1]);
+  EXPECT_EQ(0, summary.sum[2]);
+}
+
+TEST_F(RequestQueueTest, SubmitAndCancel) {
+  std::map<uint64_t, bool> results;
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool started = false;
+  bool release = false;
+  intel::poc::RequestQueue::Callback callback = [&](uint64_t request_id, bool completed, const std::string& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(0, results.count(request_id));
+    EXPECT_EQ(completed ? "done" : "", result);
+    results[request_id] = completed;
+    changed.notify_all();
+  };
+  intel::poc::RequestQueue::Task task = []() { return std::string("done"); };
+
+  uint64_t running, superseded, stale, latest, newest, failed;
+  {
+    intel::poc::RequestQueue queue(1, 2);
+    running = queue.submit("a", [&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      started = true;
+      changed.notify_all();
+      changed.wait(lock, [&]() { return release; });
+      return std::string("done");
+    }, callback);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return started; });
+    }
+
+    // A queued request of the group is cancelled at once, a running one when it returns
+    superseded = queue.submit("a", task, callback);
+    stale = queue.submit("b", task, callback);
+    latest = queue.submit("b", task, callback);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ASSERT_EQ(1, results.size());
+      EXPECT_FALSE(results[stale]);
+    }
+
+    // The oldest queued request is dropped when the queue is full
+    newest = queue.submit("", task, callback);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ASSERT_EQ(2, results.size());
+      EXPECT_FALSE(results[superseded]);
+    }
+
+    EXPECT_TRUE(queue.cancel(latest));
+    EXPECT_FALSE(queue.cancel(latest));
+    EXPECT_TRUE(queue.cancel(running));
+    failed = queue.submit("", []() -> std::string { throw std::runtime_error("failed"); }, callback);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      release = true;
+      changed.notify_all();
+      ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(10), [&]() { return results.size() == 6; }));
+    }
+  }
+  EXPECT_FALSE(results[running]);
+  EXPECT_FALSE(results[latest]);
+  EXPECT_TRUE(results[newest]);
+  EXPECT_FALSE(results[failed]);
+}
+
+TEST_F(IntervalSetTest, InsertEraseAndDifference) {
+  intel::poc::IntervalSet set;
+  std::vector<intel::poc::IntervalSet::Interval> missing;
+  EXPECT_FALSE(set.contains(0, 0));
+  set.difference(10, 20, missing);
+  ASSERT_EQ(1, missing.size());
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(10, 20), missing[0]);
+
+  set.insert(10, 20);
+  set.insert(40, 50);
+  set.insert(70, 80);
+  EXPECT_EQ(3, set.size());
+  EXPECT_TRUE(set.contains(10, 20));
+  EXPECT_TRUE(set.contains(12, 18));
+  EXPECT_FALSE(set.contains(5, 15));
+  EXPECT_FALSE(set.contains(15, 45));
+
+  // Missing parts end where the ranges around them start
+  set.difference(0, 100, missing);
+  ASSERT_EQ(4, missing.size());
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(0, 10), missing[0]);
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(20, 40), missing[1]);
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(50, 70), missing[2]);
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(80, 100), missing[3]);
+  set.difference(15, 45, missing);
+  ASSERT_EQ(1, missing.size());
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(20, 40), missing[0]);
+  set.difference(42, 48, missing);
+  EXPECT_TRUE(missing.empty());
+  set.difference(60, 60, missing);
+  ASSERT_EQ(1, missing.size());
+  EXPECT_EQ(intel::poc::IntervalSet::Interval(60, 60), missing[0]);
+
+  // Touching and overlapping ranges merge
+  set.insert(20, 30);
+  EXPECT_EQ(3, set.size());
+  EXPECT_TRUE(set.contains(10, 30));
+  set.insert(25, 75);
+  EXPECT_EQ(1, set.size());
+  EXPECT_TRUE(set.contains(10, 80));
+  set.insert(0, 100);
+  EXPECT_EQ(1, set.size());
+  EXPECT_TRUE(set.contains(0, 100));
+
+  // Erasing cuts the ranges around the erased one
+  set.erase(40, 60);
+  EXPECT_EQ(2, set.size());
+  EXPECT_TRUE(set.contains(0, 39));
+  EXPECT_TRUE(set.contains(61, 100));
+  EXPECT_FALSE(set.contains(39, 40));
+  set.erase(-10, 10);
+  set.erase(90, 110);
+  EXPECT_TRUE(set.contains(11, 39));
+  EXPECT_FALSE(set.contains(10, 11));
+  EXPECT_TRUE(set.contains(61, 89));
+  EXPECT_FALSE(set.contains(89, 90));
+  set.erase(0, 200);
+  EXPECT_TRUE(set.empty());
+  set.insert(0, 100);
+  set.clear();
+  EXPECT_TRUE(set.empty());
+}
+
+TEST_F(StatementCacheTest, EvictsLeastRecentlyUsed) {
+  sqlite3* database = NULL;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &database));
+  size_t max_statements = intel::poc::StatementCache::MAX_STATEMENTS_;
+  {
+    intel::poc::StatementCache statements;
+    statements.setDatabase(database);
+
+    // Hand back more distinct statements than are kept; only the most recent stay prepared
+    sqlite3_stmt* first = statements.acquire("SELECT 0;");
+    ASSERT_TRUE(first != NULL);
+    statements.release("SELECT 0;", first);
+    for(size_t i = 1; i <= max_statements; ++i){
+      std::stringstream sql;
+      sql << "SELECT " << i << ";";
+      statements.release(sql.str(), statements.acquire(sql.str()));
+    }
+    size_t prepared = 0;
+    for(sqlite3_stmt* stmt = sqlite3_next_stmt(database, NULL); stmt != NULL; stmt = sqlite3_next_stmt(database, stmt)){
+      ++prepared;
+    }
+    EXPECT_EQ(max_statements, prepared);
+
+    // The statements still kept are reused
+    sqlite3_stmt* stmt = statements.acquire("SELECT 1;");
+    ASSERT_TRUE(stmt != NULL);
+    ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+    EXPECT_EQ(1, sqlite3_column_int(stmt, 0));
+    statements.release("SELECT 1;", stmt);
+    statements.setDatabase(NULL);
+  }
+  EXPECT_EQ(NULL, sqlite3_next_stmt(database, NULL));
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(database));
+}
+
+TEST_F(StatementCacheTest, PurgeTable) {
+  sqlite3* database = NULL;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &database));
+  ASSERT_EQ(SQLITE_OK, sqlite3_exec(database, "CREATE TABLE data_1 (x INT); CREATE TABLE data_10 (x INT);", NULL, NULL, NULL));
+  {
+    intel::poc::StatementCache statements;
+    statements.setDatabase(database);
+    const char* sqls[] = {"SELECT x FROM data_1;", "SELECT x FROM data_1 WHERE x > 0;", "SELECT x FROM data_10;"};
+    for(size_t i = 0; i < 3; ++i){
+      statements.release(sqls[i], statements.acquire(sqls[i]));
+    }
+
+    // Only the statements of data_1 are finalized
+    statements.purge("data_1");
+    sqlite3_stmt* stmt = sqlite3_next_stmt(database, NULL);
+    ASSERT_TRUE(stmt != NULL);
+    EXPECT_EQ(std::string(sqls[2]), sqlite3_sql(stmt));
+    EXPECT_EQ(NULL, sqlite3_next_stmt(database, stmt));
+    EXPECT_EQ(SQLITE_OK, sqlite3_exec(database, "DROP TABLE data_1;", NULL, NULL, NULL));
+    statements.setDatabase(NULL);
+  }
+  EXPECT_EQ(SQLITE_OK, sqlite3_close(database));
+}
+
 int main(int argc, char * argv[])
 {
   ::testing::InitGoogleTest(&argc, argv);